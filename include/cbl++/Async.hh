@@ -0,0 +1,133 @@
+//
+// Async.hh
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "cbl++/Base.hh"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#   include <coroutine>
+#   define CBL_CPP_COROUTINES 1
+#endif
+
+// PLEASE NOTE: This C++ wrapper API is provided as a convenience only.
+// It is not considered part of the official Couchbase Lite API.
+
+CBL_ASSUME_NONNULL_BEGIN
+
+namespace cbl::async {
+
+    /** The eventual result of an asynchronous operation such as `Database::saveDocumentAsync`:
+        a value, or the CBLError the operation failed with, which is thrown when it's retrieved.
+        In C++20 a coroutine can `co_await` it; it resumes on the thread that delivers the
+        completion (see `CBLDatabase_BufferNotifications`.) Otherwise, `get` waits for it. */
+    template <class T>
+    class Future {
+    public:
+        /// True once the result is available.
+        bool ready() const {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            return _state->done;
+        }
+
+        /// Blocks until the result is available, then returns it or throws its error.
+        T get() {
+            std::unique_lock<std::mutex> lock(_state->mutex);
+            _state->cond.wait(lock, [&]{return _state->done;});
+            return _state->result();
+        }
+
+#ifdef CBL_CPP_COROUTINES
+        bool await_ready() const                        {return ready();}
+
+        bool await_suspend(std::coroutine_handle<> waiter) {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            if (_state->done)
+                return false;       // finished in the meantime; don't suspend after all
+            _state->waiter = waiter;
+            return true;
+        }
+
+        T await_resume() {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            return _state->result();
+        }
+#endif
+
+        // Internal use only: creates a Future and the context to pass to the C function.
+        static std::pair<Future, void*> make() {
+            auto state = std::make_shared<State>();
+            return {Future(state), new std::shared_ptr<State>(state)};
+        }
+
+        // Internal use only: called from the C completion callback; consumes the context.
+        static void complete(void *context, T value, const CBLError* _cbl_nullable error) {
+            std::unique_ptr<std::shared_ptr<State>> state((std::shared_ptr<State>*)context);
+            (*state)->complete(std::move(value), error);
+        }
+
+    private:
+        struct State {
+            std::mutex              mutex;
+            std::condition_variable cond;
+            bool                    done {false};
+            T                       value {};
+            CBLError                error {};
+#ifdef CBL_CPP_COROUTINES
+            std::coroutine_handle<> waiter;
+#endif
+
+            T result() {
+                if (error.code)
+                    throw error;
+                return value;
+            }
+
+            void complete(T v, const CBLError* _cbl_nullable err) {
+#ifdef CBL_CPP_COROUTINES
+                std::coroutine_handle<> w;
+#endif
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    value = std::move(v);
+                    if (err)
+                        error = *err;
+                    done = true;
+#ifdef CBL_CPP_COROUTINES
+                    w = std::exchange(waiter, {});
+#endif
+                }
+                cond.notify_all();
+#ifdef CBL_CPP_COROUTINES
+                if (w)
+                    w.resume();
+#endif
+            }
+        };
+
+        explicit Future(std::shared_ptr<State> state)   :_state(std::move(state)) { }
+
+        std::shared_ptr<State> _state;
+    };
+
+}
+
+CBL_ASSUME_NONNULL_END
@@ -79,6 +79,14 @@ namespace cbl {
             return content;
         }
 
+        /// Reads up to `length` bytes of content starting at `offset`. (See \ref CBLBlob_ReadRange.)
+        alloc_slice loadRange(uint64_t offset, uint64_t length) {
+            CBLError error;
+            fleece::alloc_slice content = CBLBlob_ReadRange(ref(), offset, length, &error);
+            check(content.buf, error);
+            return content;
+        }
+
         inline BlobReadStream* openContentStream();
 
     protected:
@@ -109,6 +117,22 @@ namespace cbl {
             return size_t(bytesRead);
         }
 
+        /// Moves to a position in the blob, so the next read starts there.
+        void seek(uint64_t offset) {
+            CBLError error;
+            if (!CBLBlobReader_Seek(_stream, offset, &error))
+                throw error;
+        }
+
+        /// The total length of the blob.
+        uint64_t length() const {
+            CBLError error;
+            int64_t len = CBLBlobReader_Length(_stream, &error);
+            if (len < 0)
+                throw error;
+            return uint64_t(len);
+        }
+
     private:
         CBLBlobReadStream* _cbl_nullable _stream {nullptr};
     };
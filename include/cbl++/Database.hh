@@ -18,6 +18,7 @@
 
 #pragma once
 #include "cbl++/Base.hh"
+#include "cbl++/Async.hh"
 #include "cbl/CBLDatabase.h"
 #include "cbl/CBLDocument.h"
 #include "cbl/CBLQuery.h"
@@ -109,10 +110,18 @@ namespace cbl {
             check(CBLDatabase_PerformMaintenance(ref(), type, &error), error);
         }
 
+        /** Changes the page cache size of the database's connections; see \ref CBLStorageTuning. */
+        void setPageCacheSize(unsigned sizeKB) {
+            CBLError error;
+            check(CBLDatabase_SetPageCacheSize(ref(), sizeKB, &error), error);
+        }
+
         // Accessors:
 
         std::string name() const                        {return asString(CBLDatabase_Name(ref()));}
         std::string path() const                        {return asString(CBLDatabase_Path(ref()));}
+        slice nameSlice() const                         {return CBLDatabase_Name(ref());}
+        alloc_slice pathSlice() const                   {return alloc_slice(CBLDatabase_Path(ref()));}
         uint64_t count() const                          {return CBLDatabase_Count(ref());}
         CBLDatabaseConfiguration config() const         {return CBLDatabase_Config(ref());}
 
@@ -129,6 +138,21 @@ namespace cbl {
         _cbl_warn_unused
         inline bool saveDocument(MutableDocument &doc, SaveConflictHandler conflictHandler);
 
+        /** Saves a batch of documents in a single transaction. Returns false if any of them
+            couldn't be saved because of a conflict; other errors are thrown. */
+        _cbl_warn_unused
+        inline bool saveDocuments(std::vector<MutableDocument> &docs, CBLConcurrencyControl c);
+
+        /** Saves a document on a background thread. The result is false if the document
+            couldn't be saved because of a conflict; other errors are thrown when it's retrieved.
+            Don't modify the document until the result is ready. */
+        inline async::Future<bool> saveDocumentAsync(MutableDocument &doc,
+                                                     CBLConcurrencyControl c =kCBLConcurrencyControlLastWriteWins);
+
+        /** Reads a document on a background thread. The result is an empty Document if it
+            doesn't exist. */
+        inline async::Future<Document> getDocumentAsync(slice id) const;
+
         inline void deleteDocument(Document &doc);
 
         _cbl_warn_unused
@@ -168,6 +192,11 @@ namespace cbl {
             check(CBLDatabase_CreateFullTextIndex(ref(), name, config, &error), error);
         }
 
+        void createIndexes(const std::vector<CBLIndexSpec> &specs) {
+            CBLError error;
+            check(CBLDatabase_CreateIndexes(ref(), specs.data(), specs.size(), &error), error);
+        }
+
         void deleteIndex(slice name) {
             CBLError error;
             check(CBLDatabase_DeleteIndex(ref(), name, &error), error);
@@ -38,6 +38,12 @@ namespace cbl {
 
         std::string revisionID() const             {return asString(CBLDocument_RevisionID(ref()));}
 
+        /// The document ID, without copying it. It stays valid as long as the document does.
+        slice idSlice() const                      {return CBLDocument_ID(ref());}
+
+        /// The revision ID, without copying it. It stays valid until the document is saved.
+        slice revisionIDSlice() const              {return CBLDocument_RevisionID(ref());}
+
         uint64_t sequence() const                  {return CBLDocument_Sequence(ref());}
 
         // Properties:
@@ -173,6 +179,43 @@ namespace cbl {
             error);
     }
 
+    inline bool Database::saveDocuments(std::vector<MutableDocument> &docs,
+                                        CBLConcurrencyControl c)
+    {
+        std::vector<CBLDocument*> refs;
+        refs.reserve(docs.size());
+        for (auto &doc : docs)
+            refs.push_back(doc.ref());
+        CBLError error;
+        return Document::checkSave(
+            CBLDatabase_SaveDocuments(ref(), refs.data(), refs.size(), c, nullptr, &error),
+            error);
+    }
+
+    inline async::Future<bool> Database::saveDocumentAsync(MutableDocument &doc,
+                                                           CBLConcurrencyControl c)
+    {
+        auto [future, context] = async::Future<bool>::make();
+        CBLDatabase_SaveDocumentAsync(ref(), doc.ref(), c,
+                                      [](void *context, CBLDocument*, bool saved,
+                                         const CBLError *error) {
+            if (!saved && error->code == kCBLErrorConflict && error->domain == kCBLDomain)
+                error = nullptr;
+            async::Future<bool>::complete(context, saved, error);
+        }, context);
+        return future;
+    }
+
+    inline async::Future<Document> Database::getDocumentAsync(slice id) const {
+        auto [future, context] = async::Future<Document>::make();
+        CBLDatabase_GetDocumentAsync(ref(), id,
+                                     [](void *context, const CBLDocument *doc,
+                                        const CBLError *error) {
+            async::Future<Document>::complete(context, Document(doc), error);
+        }, context);
+        return future;
+    }
+
     inline void Database::deleteDocument(Document &doc) {
         (void) deleteDocument(doc, kCBLConcurrencyControlLastWriteWins);
     }
@@ -45,10 +45,20 @@ namespace cbl {
 
         inline std::vector<std::string> columnNames() const;
 
+        /// The number of columns in each result.
+        unsigned columnCount() const                {return CBLQuery_ColumnCount(ref());}
+
+        /// The name of a column, without copying it. It stays valid as long as the query does.
+        slice columnName(unsigned i) const          {return CBLQuery_ColumnName(ref(), i);}
+
         void setParameters(fleece::Dict parameters) {CBLQuery_SetParameters(ref(), parameters);}
         fleece::Dict parameters() const             {return CBLQuery_Parameters(ref());}
 
         inline ResultSet execute();
+        inline ResultSet execute(fleece::Dict parameters);
+
+        /** Runs the query on a background thread, with its current parameters. */
+        inline async::Future<ResultSet> executeAsync();
 
         std::string explain()   {return fleece::alloc_slice(CBLQuery_Explain(ref())).asString();}
 
@@ -59,6 +69,10 @@ namespace cbl {
 
         [[nodiscard]] inline ChangeListener addChangeListener(ListenerToken<Change>::Callback);
 
+        /** Adds a change listener that limits how often the query re-runs. */
+        [[nodiscard]] inline ChangeListener addChangeListener(const CBLQueryListenerOptions&,
+                                                              ListenerToken<Change>::Callback);
+
     private:
         static void _callListener(void *context, CBLQuery*, CBLListenerToken* token);
         CBL_REFCOUNTED_BOILERPLATE(Query, RefCounted, CBLQuery)
@@ -105,7 +119,9 @@ namespace cbl {
     };
 
 
-    // implementation of ResultSet::iterator
+    // implementation of ResultSet::iterator. Like a container's iterator, it doesn't retain
+    // the ResultSet, so it mustn't outlive it. (A range-based `for` over a temporary ResultSet is
+    // fine, since the temporary lasts until the loop ends.)
     class ResultSetIterator {
     public:
         const Result& operator*()  const {return _result;}
@@ -115,19 +131,19 @@ namespace cbl {
         bool operator!= (const ResultSetIterator &i) const {return _rs != i._rs;}
 
         ResultSetIterator& operator++() {
-            if (!CBLResultSet_Next(_rs.ref()))
-                _rs = ResultSet{};
+            if (!CBLResultSet_Next(_rs))
+                _rs = nullptr;
             return *this;
         }
     protected:
-        ResultSetIterator()                                 :_rs(), _result(nullptr) { }
-        explicit ResultSetIterator(ResultSet rs)
-        :_rs(rs), _result(_rs.ref())
+        ResultSetIterator()                                 :_rs(nullptr), _result(nullptr) { }
+        explicit ResultSetIterator(CBLResultSet* rs)
+        :_rs(rs), _result(rs)
         {
             ++*this;         // CBLResultSet_Next() has to be called first
         }
 
-        ResultSet _rs;
+        CBLResultSet* _cbl_nullable _rs;
         Result _result;
         friend class ResultSet;
     };
@@ -154,6 +170,23 @@ namespace cbl {
         return ResultSet::adopt(rs);
     }
 
+    inline ResultSet Query::execute(fleece::Dict parameters) {
+        CBLError error;
+        auto rs = CBLQuery_ExecuteWithParameters(ref(), parameters, &error);
+        check(rs, error);
+        return ResultSet::adopt(rs);
+    }
+
+
+    inline async::Future<ResultSet> Query::executeAsync() {
+        auto [future, context] = async::Future<ResultSet>::make();
+        CBLQuery_ExecuteAsync(ref(), [](void *context, CBLQuery*, CBLResultSet *rs,
+                                        const CBLError *error) {
+            async::Future<ResultSet>::complete(context, ResultSet(rs), error);
+        }, context);
+        return future;
+    }
+
 
     class Query::ChangeListener : public ListenerToken<Change> {
     public:
@@ -166,6 +199,11 @@ namespace cbl {
             return getResults(_query, token());
         }
 
+        /** Pauses or resumes the listener; while paused, the query isn't re-run. */
+        void setPaused(bool paused) {
+            CBLQuery_SetListenerPaused(_query.ref(), token(), paused);
+        }
+
     private:
         static ResultSet getResults(Query query, CBLListenerToken* token) {
             CBLError error;
@@ -207,13 +245,23 @@ namespace cbl {
     }
 
 
+    inline Query::ChangeListener Query::addChangeListener(const CBLQueryListenerOptions &options,
+                                                          ChangeListener::Callback f)
+    {
+        auto l = ChangeListener(*this, f);
+        l.setToken( CBLQuery_AddChangeListenerWithOptions(ref(), &options, &_callListener,
+                                                          l.context()) );
+        return l;
+    }
+
+
     inline void Query::_callListener(void *context, CBLQuery *q, CBLListenerToken* token) {
         ChangeListener::call(context, Change{Query(q), token});
     }
 
 
     inline ResultSet::iterator ResultSet::begin()  {
-        return iterator(*this);
+        return iterator(ref());
     }
 
     inline ResultSet::iterator ResultSet::end() {
@@ -84,6 +84,13 @@ namespace cbl {
         
         unsigned heartbeat                  = 0;
 
+        unsigned maxConflictResolvers       = 0;
+        unsigned conflictResolverBatchSize  = 0;
+
+        unsigned documentEventsFlushInterval = 0;
+
+        int compressionLevel                = 0;
+
         Authenticator authenticator;
         CBLProxySettings* proxy             = nullptr;
         fleece::MutableDict headers         = fleece::MutableDict::newDict();
@@ -96,6 +103,9 @@ namespace cbl {
 
         ReplicationFilter pushFilter;
         ReplicationFilter pullFilter;
+
+        std::string pushFilterExpression;
+        std::string pullFilterExpression;
         
         operator CBLReplicatorConfiguration() const {
             CBLReplicatorConfiguration conf = {};
@@ -107,6 +117,10 @@ namespace cbl {
             conf.maxAttempts = maxAttempts;
             conf.maxAttemptWaitTime = maxAttemptWaitTime;
             conf.heartbeat = heartbeat;
+            conf.maxConflictResolvers = maxConflictResolvers;
+            conf.conflictResolverBatchSize = conflictResolverBatchSize;
+            conf.documentEventsFlushInterval = documentEventsFlushInterval;
+            conf.compressionLevel = compressionLevel;
             conf.authenticator = authenticator.ref();
             conf.proxy = proxy;
             if (!headers.empty())
@@ -119,6 +133,10 @@ namespace cbl {
                 conf.channels = channels;
             if (!documentIDs.empty())
                 conf.documentIDs = documentIDs;
+            if (!pushFilterExpression.empty())
+                conf.pushFilterExpression = slice(pushFilterExpression);
+            if (!pullFilterExpression.empty())
+                conf.pullFilterExpression = slice(pullFilterExpression);
             return conf;
         }
     };
@@ -161,6 +179,22 @@ namespace cbl {
             return result;
         }
 
+        uint64_t pendingDocumentCount() const {
+            CBLError error;
+            uint64_t count = CBLReplicator_PendingDocumentCount(ref(), &error);
+            check(count > 0 || error.code == 0, error);
+            return count;
+        }
+
+        fleece::MutableArray pendingDocumentIDs(uint64_t offset, unsigned limit) const {
+            CBLError error;
+            FLArray result = CBLReplicator_PendingDocumentIDsPage(ref(), offset, limit, &error);
+            check(result != nullptr, error);
+            fleece::MutableArray ids(FLArray_AsMutable(result));
+            FLArray_Release(result);  // remove the extra ref the C function returned with
+            return ids;
+        }
+
         bool isDocumentPending(fleece::slice docID) const {
             CBLError error;
             bool pending = CBLReplicator_IsDocumentPending(ref(), docID, &error);
@@ -207,6 +241,25 @@ namespace cbl {
 
         CBL_REFCOUNTED_BOILERPLATE(Replicator, RefCounted, CBLReplicator)
     };
+
+
+    /** Schedules a set of replicators by priority, keeping at most `maxActive` of them busy. */
+    class ReplicatorGroup : private RefCounted {
+    public:
+        explicit ReplicatorGroup(unsigned maxActive) {
+            _ref = (CBLRefCounted*) CBLReplicatorGroup_Create(maxActive);
+        }
+
+        void add(Replicator repl, int priority =0) {CBLReplicatorGroup_Add(ref(), repl.ref(), priority);}
+        void remove(Replicator repl)        {CBLReplicatorGroup_Remove(ref(), repl.ref());}
+
+        void start(bool resetCheckpoint =false) {CBLReplicatorGroup_Start(ref(), resetCheckpoint);}
+        void stop()                         {CBLReplicatorGroup_Stop(ref());}
+
+        unsigned activeCount() const        {return CBLReplicatorGroup_ActiveCount(ref());}
+
+        CBL_REFCOUNTED_BOILERPLATE(ReplicatorGroup, RefCounted, CBLReplicatorGroup)
+    };
 }
 
 CBL_ASSUME_NONNULL_END
@@ -166,6 +166,28 @@ unsigned CBL_InstanceCount(void) CBLAPI;
     @note  May only be functional in debug builds of Couchbase Lite. */
 void CBL_DumpInstances(void) CBLAPI;
 
+/** Custom memory allocation functions, to be used by \ref CBL_SetAllocator. */
+typedef struct {
+    /** Allocates `size` bytes, aligned as `malloc` would, or returns NULL on failure. */
+    void* _cbl_nullable (*allocate)(void* _cbl_nullable context, size_t size);
+    /** Frees a block returned by `allocate`; `size` is the size it was allocated with. */
+    void (*deallocate)(void* _cbl_nullable context, void* ptr, size_t size);
+    /** An arbitrary value passed to the functions. */
+    void* _cbl_nullable context;
+} CBLAllocator;
+
+/** Makes Couchbase Lite allocate its ref-counted objects (documents, result sets, listener
+    tokens, etc.) with the given functions instead of the global `operator new`, so they can come
+    from a custom heap or arena such as mimalloc's or jemalloc's. Pass NULL to go back to the
+    default.
+    @note  This has to be called before any Couchbase Lite object is created, since objects
+           have to be freed by the allocator they came from.
+    @note  The data that LiteCore and Fleece allocate internally, such as document bodies and
+           Fleece values, still comes from the global heap.
+    @param allocator  The allocation functions (which are copied), or NULL.
+    @return  True on success, false if objects have already been allocated. */
+bool CBL_SetAllocator(const CBLAllocator* _cbl_nullable allocator) CBLAPI;
+
 // Declares retain/release functions for TYPE. For internal use only.
 #define CBL_REFCOUNTED(TYPE, NAME) \
     static inline const TYPE CBL##NAME##_Retain(const TYPE _cbl_nullable t) \
@@ -204,6 +226,9 @@ typedef struct CBLQuery      CBLQuery;
 
 /** An iterator over the rows resulting from running a query. */
 typedef struct CBLResultSet  CBLResultSet;
+
+/** An iterator over the rows resulting from running a query on many databases. */
+typedef struct CBLFanOutResults CBLFanOutResults;
 /** @} */
 
 /** \defgroup replication  Replication
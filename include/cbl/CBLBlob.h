@@ -106,6 +106,23 @@ CBL_CAPI_BEGIN
     FLSliceResult CBLBlob_Content(const CBLBlob* blob,
                                   CBLError* _cbl_nullable outError) CBLAPI;
 
+    /** Reads part of a blob's contents into memory and returns it, without reading (or, if the
+        database is encrypted, decrypting) everything before it. This is useful for serving
+        HTTP range requests.
+        @note  You are responsible for releasing the result by calling \ref FLSliceResult_Release.
+        @param blob  The blob.
+        @param offset  The position of the first byte to read. If it's past the end of the blob,
+                       that's an error; if it's equal to the blob's length, the result is empty.
+        @param length  The maximum number of bytes to read. Fewer are returned if the blob ends
+                       first.
+        @param outError  On failure, an error will be stored here if non-NULL.
+        @return  The data, or NULL on error. */
+    _cbl_warn_unused
+    FLSliceResult CBLBlob_ReadRange(const CBLBlob* blob,
+                                    uint64_t offset,
+                                    uint64_t length,
+                                    CBLError* _cbl_nullable outError) CBLAPI;
+
     /** A stream for reading a blob's content. */
     typedef struct CBLBlobReadStream CBLBlobReadStream;
 
@@ -125,9 +142,54 @@ CBL_CAPI_BEGIN
                            size_t maxLength,
                            CBLError* _cbl_nullable outError) CBLAPI;
 
+    /** Moves a stream to a position in the blob, so the next read starts there. Seeking doesn't
+        read the data skipped over, though in an encrypted database the block containing the
+        new position has to be decrypted.
+        @param stream  The stream.
+        @param offset  The new position, which can't be past the end of the blob.
+        @param outError  On failure, an error will be stored here if non-NULL.
+        @return  True on success, false on error. */
+    bool CBLBlobReader_Seek(CBLBlobReadStream* stream,
+                            uint64_t offset,
+                            CBLError* _cbl_nullable outError) CBLAPI;
+
+    /** Returns the total length of the stream's blob, or -1 on error. */
+    int64_t CBLBlobReader_Length(CBLBlobReadStream* stream,
+                                 CBLError* _cbl_nullable outError) CBLAPI;
+
     /** Closes a CBLBlobReadStream. */
     void CBLBlobReader_Close(CBLBlobReadStream* _cbl_nullable) CBLAPI;
 
+    /** A read-only view of a blob's entire content, without copying it where possible. */
+    typedef struct CBLBlobContentMap CBLBlobContentMap;
+
+    /** Maps a saved blob's content into memory, read-only. If the blob is stored in a plain
+        file, as it is when the database isn't encrypted, the file is memory-mapped and no data
+        is copied. Otherwise (or on platforms without `mmap`) the content is read into memory,
+        as by \ref CBLBlob_Content.
+        @note  You must call \ref CBLBlobContentMap_Close when you're done with the content.
+        @param blob  The blob.
+        @param outError  On failure, an error will be stored here if non-NULL.
+        @return  The mapped content, or NULL on error. */
+    _cbl_warn_unused
+    CBLBlobContentMap* _cbl_nullable CBLBlob_MapContent(const CBLBlob* blob,
+                                                        CBLError* _cbl_nullable outError) CBLAPI;
+
+    /** Returns the content of a mapped blob. It remains valid until the map is closed. */
+    FLSlice CBLBlobContentMap_Content(const CBLBlobContentMap*) CBLAPI;
+
+    /** Returns true if the content is memory-mapped from the blob's file, false if it was read
+        into memory. */
+    bool CBLBlobContentMap_IsMapped(const CBLBlobContentMap*) CBLAPI;
+
+    /** Returns a read-only file descriptor open on the blob's file, suitable for `sendfile`,
+        or -1 if the content isn't available as a plain file. The descriptor is owned by the map
+        and is closed with it; don't close it yourself. */
+    int CBLBlobContentMap_FileDescriptor(const CBLBlobContentMap*) CBLAPI;
+
+    /** Closes a CBLBlobContentMap, unmapping its content. */
+    void CBLBlobContentMap_Close(CBLBlobContentMap* _cbl_nullable) CBLAPI;
+
     /** Compares whether the two given blobs are equal based on their content. */
     bool CBLBlob_Equals(CBLBlob* blob, CBLBlob* anotherBlob) CBLAPI;
 
@@ -264,6 +326,112 @@ CBL_CAPI_BEGIN
     bool CBLDatabase_SaveBlob(CBLDatabase* db, CBLBlob* blob,
                               CBLError* _cbl_nullable outError) CBLAPI;
 
+    /** Saves several new \ref CBLBlob objects into the database, like \ref CBLDatabase_SaveBlob.
+        The blobs are written concurrently, without locking the database, so other threads can
+        keep using it meanwhile.
+        @note  Saving a document also installs its new blobs this way, before it locks the
+               database, so you only need this to save blobs ahead of time.
+        @param db   The database.
+        @param blobs The blobs to save.
+        @param count The number of blobs.
+        @param outError On failure, error info will be written here.
+        @return  True on success; false if any blob couldn't be saved. */
+    bool CBLDatabase_SaveBlobs(CBLDatabase* db, CBLBlob* const blobs[_cbl_nonnull], size_t count,
+                               CBLError* _cbl_nullable outError) CBLAPI;
+
+    /** Statistics of a database's blob content cache.
+        (See \ref CBLDatabaseConfiguration.blobCacheCapacity.) */
+    typedef struct {
+        uint64_t hits;          ///< Number of blob reads served from the cache
+        uint64_t misses;        ///< Number of blob reads that had to read the blob store
+        unsigned count;         ///< Number of blobs currently cached
+        size_t   size;          ///< Total size of the cached content, in bytes
+        size_t   capacity;      ///< Maximum total size of the cached content, in bytes
+    } CBLBlobCacheStats;
+
+    /** Returns statistics of the database's blob content cache. */
+    CBLBlobCacheStats CBLDatabase_BlobCacheStats(const CBLDatabase* db) CBLAPI;
+
+
+#ifdef __APPLE__
+#pragma mark - BLOB STORE:
+#endif
+
+    /** The size of a blob in the blob store, as reported by \ref CBLDatabase_GetBlobStoreStats. */
+    typedef struct {
+        char     digest[48];        ///< The blob's digest string, NUL-terminated
+        uint64_t size;              ///< The blob's size in bytes, as stored
+    } CBLBlobSize;
+
+    /** Statistics of a database's blob store, from \ref CBLDatabase_GetBlobStoreStats. */
+    typedef struct {
+        uint64_t blobCount;         ///< Number of blobs in the store
+        uint64_t totalBytes;        ///< Total size of the blobs in the store
+        uint64_t reachableCount;    ///< Number of blobs used by current revisions
+        uint64_t reachableBytes;    ///< Total size of the blobs used by current revisions
+        uint64_t referenceCount;    ///< Number of blob references in current revisions; more
+                                    ///< than `reachableCount` if some blobs are shared
+        uint64_t referencedBytes;   ///< Total size of those references, counting a blob again
+                                    ///< each time it's used. The difference from
+                                    ///< `reachableBytes` is what deduplication saves.
+        size_t   largestCount;      ///< Number of entries stored in the `outLargest` array
+    } CBLBlobStoreStats;
+
+    /** Scans a database's blob store and its documents' current revisions, and reports how much
+        space the blobs take and how much of it is in use. Blobs that aren't reachable are
+        either used only by older revisions, or garbage; see \ref CBLDatabase_NewBlobGC.
+        @note  This reads every document, so it can take a while on a large database. The
+               database is only locked for a batch of documents at a time.
+        @param db  The database.
+        @param outStats  The statistics are stored here.
+        @param outLargest  If non-NULL, the largest blobs are stored here, largest first.
+        @param maxLargest  The capacity of the `outLargest` array.
+        @param outError  On failure, an error will be stored here if non-NULL.
+        @return  True on success, false on error. */
+    bool CBLDatabase_GetBlobStoreStats(const CBLDatabase* db,
+                                       CBLBlobStoreStats* outStats,
+                                       CBLBlobSize* _cbl_nullable outLargest,
+                                       size_t maxLargest,
+                                       CBLError* _cbl_nullable outError) CBLAPI;
+
+    /** An incremental garbage collector of a database's blob store, which deletes the blobs that
+        no revision of any document uses. Unlike \ref kCBLMaintenanceTypeCompact, it does its
+        work in small steps, only locking the database during each one, so it can run in the
+        background or a bit at a time when the app is idle. */
+    typedef struct CBLBlobGC CBLBlobGC;
+    CBL_REFCOUNTED(CBLBlobGC*, BlobGC);
+
+    /** The progress of a \ref CBLBlobGC. */
+    typedef struct {
+        uint64_t blobsFound;        ///< Number of blobs in the store when collection started
+        uint64_t docsScanned;       ///< Number of documents scanned for blob references
+        uint64_t blobsDeleted;      ///< Number of unused blobs deleted
+        uint64_t bytesFreed;        ///< Total size of the deleted blobs
+        bool     done;              ///< True once collection is complete
+    } CBLBlobGCProgress;
+
+    /** Starts collecting a database's unused blobs. Only blobs that exist now will be deleted;
+        call \ref CBLBlobGC_Step until it returns false to do the work.
+        @note  You must release the collector when you're finished with it. */
+    _cbl_warn_unused
+    CBLBlobGC* _cbl_nullable CBLDatabase_NewBlobGC(CBLDatabase* db,
+                                                   CBLError* _cbl_nullable outError) CBLAPI;
+
+    /** Does the next step of blob collection: scanning up to `batchSize` documents for the blobs
+        they use, or, once they've all been scanned, considering up to `batchSize` blobs for
+        deletion. Documents changed since the scan are rescanned first, so a blob that has come
+        back into use isn't deleted.
+        @param gc  The collector.
+        @param batchSize  The maximum number of documents or blobs to process, or 0 for 100.
+        @param outError  On failure, an error will be stored here if non-NULL.
+        @return  True if there's more to do, false if collection is done or failed. */
+    bool CBLBlobGC_Step(CBLBlobGC* gc,
+                        unsigned batchSize,
+                        CBLError* _cbl_nullable outError) CBLAPI;
+
+    /** Returns the progress of blob collection. */
+    CBLBlobGCProgress CBLBlobGC_Progress(const CBLBlobGC* gc) CBLAPI;
+
 /** @} */
 
 CBL_CAPI_END
@@ -53,12 +53,60 @@ typedef struct {
 } CBLEncryptionKey;
 #endif
 
+/** How thoroughly SQLite makes sure transactions reach the disk (`PRAGMA synchronous`.) */
+typedef CBL_ENUM(uint8_t, CBLSyncMode) {
+    kCBLSyncDefault,        ///< LiteCore's default, which is `NORMAL`
+    kCBLSyncOff,            ///< Never wait for the disk. Fastest, but an OS crash or power
+                            ///< failure can corrupt the database.
+    kCBLSyncNormal,         ///< Wait for the disk at checkpoints: a power failure may undo the
+                            ///< latest transactions, but won't corrupt the database.
+    kCBLSyncFull,           ///< Wait for the disk at every commit, so no committed transaction
+                            ///< is lost. Slowest on flash storage like eMMC.
+};
+
+/** Tuning of the storage engine, applied to each connection when it's opened. Each field left
+    zero keeps LiteCore's default. */
+typedef struct {
+    /** The maximum memory the page cache of each connection may use, in KB
+        (`PRAGMA cache_size`.) It can be changed later with \ref CBLDatabase_SetPageCacheSize. */
+    unsigned pageCacheSize;
+    /** The maximum number of bytes of the database file that each connection memory-maps
+        (`PRAGMA mmap_size`.) */
+    uint64_t mmapSize;
+    /** The size, in pages, that the write-ahead log reaches before it's checkpointed into the
+        database file (`PRAGMA wal_autocheckpoint`.) SQLite's default is 1000. */
+    unsigned walAutoCheckpoint;
+    /** How thoroughly transactions are written to disk. */
+    CBLSyncMode syncMode;
+} CBLStorageTuning;
+
 /** Database configuration options. */
 typedef struct {
     FLString directory;                 ///< The parent directory of the database
 #ifdef COUCHBASE_ENTERPRISE
     CBLEncryptionKey encryptionKey;     ///< The database's encryption key (if any)
 #endif
+    /** The number of additional read-only connections to open on the database file (default 0.)
+        Document lookups, \ref CBLDatabase_Count and query execution are served by a free reader
+        connection, so they don't have to wait while a writer or replicator is using the database.
+        Reads made while a transaction is open on the database always use the main connection. */
+    unsigned readerCount;
+    /** The maximum number of compiled queries to cache (default 0, i.e. no caching.)
+        If nonzero, \ref CBLDatabase_CreateQuery keeps the most recently used compiled queries,
+        keyed by language and query string, and returns a new lightweight \ref CBLQuery sharing
+        the compiled form when it's called again with the same query. */
+    unsigned queryCacheCapacity;
+    /** The maximum total size, in bytes, of blob content to cache in memory (default 0, i.e. no
+        caching.) If nonzero, \ref CBLBlob_Content keeps the most recently read blobs' content,
+        keyed by digest, so reading a hot blob again skips opening, reading (and decrypting) its
+        file. Blobs larger than a quarter of the capacity aren't cached. */
+    size_t blobCacheCapacity;
+    /** If true, the reader connections (see `readerCount`) aren't opened by \ref CBLDatabase_Open,
+        but each when it's first needed, making the open faster. This suits a database that may
+        be opened just to read a setting and closed again. */
+    bool lazyReaders;
+    /** Storage engine tuning; a zeroed struct keeps LiteCore's defaults. */
+    CBLStorageTuning storage;
 } CBLDatabaseConfiguration;
 
 /** Returns the default database configuration. */
@@ -68,10 +116,19 @@ CBLDatabaseConfiguration CBLDatabaseConfiguration_Default(void) CBLAPI;
 /** Derives an encryption key from a password. If your UI uses passwords, call this function to
     create the key used to encrypt the database. It is designed for security, and deliberately
     runs slowly to make brute-force attacks impractical.
+    The derivation is deterministic, so rather than calling this every time the database is
+    reopened, keep the key for as long as the app is unlocked, and pass the same key to
+    \ref CBLDatabase_Open and \ref CBLDatabase_ChangeEncryptionKey; then erase it with
+    \ref CBLEncryptionKey_Clear.
     @param key  The derived AES key will be stored here.
     @param password  The input password, which can be any data.
     @return  True on success, false if there was a problem deriving the key. */
 bool CBLEncryptionKey_FromPassword(CBLEncryptionKey *key, FLString password) CBLAPI;
+
+/** Securely erases an encryption key, overwriting its bytes with zeroes in a way the compiler
+    can't optimize away, and setting its algorithm to \ref kCBLEncryptionNone. Call this when
+    you no longer need a key you've kept in memory. */
+void CBLEncryptionKey_Clear(CBLEncryptionKey *key) CBLAPI;
 #endif
 
 /** @} */
@@ -93,6 +150,9 @@ bool CBL_DatabaseExists(FLString name, FLString inDirectory) CBLAPI;
 
 /** Copies a database file to a new location, and assigns it a new internal UUID to distinguish
     it from the original database when replicating.
+    If the filesystem supports it (APFS, btrfs, XFS), the files are cloned copy-on-write, which
+    is nearly instant and takes no extra space until one of the databases changes. Otherwise
+    their contents are copied.
     @param fromPath  The full filesystem path to the original database (including extension).
     @param toName  The new database name (without the ".cblite2" extension.)
     @param config  The database configuration (directory and encryption option.)
@@ -102,6 +162,30 @@ bool CBL_CopyDatabase(FLString fromPath,
                       const CBLDatabaseConfiguration* _cbl_nullable config,
                       CBLError* _cbl_nullable outError) CBLAPI;
 
+/** Callback reporting the progress of \ref CBL_CopyDatabaseWithProgress.
+    @param context  The `context` parameter passed to the copy function.
+    @param bytesCopied  The number of bytes copied so far.
+    @param bytesTotal  The total number of bytes to copy. */
+typedef void (*CBLCopyProgressCallback)(void* _cbl_nullable context,
+                                        uint64_t bytesCopied,
+                                        uint64_t bytesTotal);
+
+/** Copies a database file like \ref CBL_CopyDatabase, reporting progress if the files can't be
+    cloned and have to be copied byte by byte. (A clone is too quick to need it, so the callback
+    isn't called at all in that case.)
+    @param fromPath  The full filesystem path to the original database (including extension).
+    @param toName  The new database name (without the ".cblite2" extension.)
+    @param config  The database configuration (directory and encryption option.)
+    @param progress  Called periodically during a byte-by-byte copy, on the calling thread.
+    @param context  An arbitrary value that will be passed to the callback.
+    @param outError  On return, will be set to the error that occurred, if applicable.*/
+bool CBL_CopyDatabaseWithProgress(FLString fromPath,
+                                  FLString toName,
+                                  const CBLDatabaseConfiguration* _cbl_nullable config,
+                                  CBLCopyProgressCallback _cbl_nullable progress,
+                                  void* _cbl_nullable context,
+                                  CBLError* _cbl_nullable outError) CBLAPI;
+
 /** Deletes a database file. If the database file is open, an error is returned.
     @param name  The database name (without the ".cblite2" extension.)
     @param inDirectory  The directory containing the database. If NULL, `name` must be an
@@ -143,6 +227,33 @@ bool CBLDatabase_Close(CBLDatabase*,
 
 CBL_REFCOUNTED(CBLDatabase*, Database);
 
+/** Opens a database through a process-wide cache of open handles, for apps that open the same
+    databases over and over, e.g. per request. If the cache has an open handle on a database with
+    the same directory and name, it's returned, shared with whoever else opened it; otherwise one
+    is opened with the given configuration and cached.
+    A cached handle is closed once it's been idle -- its only reference being the cache's -- for
+    the timeout set by \ref CBL_SetDatabaseCacheLimits, or if the cache is over its limit.
+    Closing a handle stops its replicators and live queries, as \ref CBLDatabase_Close does.
+    If the cache is disabled (the default), this is the same as \ref CBLDatabase_Open.
+    \warning  Don't call \ref CBLDatabase_Close on a shared handle, just release it.
+    @param name  The database name (without the ".cblite2" extension.)
+    @param config  The database configuration, or NULL for the default configuration. If a cached
+                   handle is returned, it must match the configuration that handle was opened
+                   with, else this fails with \ref kCBLErrorInvalidParameter.
+    @param outError  On failure, the error will be written here.
+    @return  The database object, or NULL on failure. You must release it when done. */
+_cbl_warn_unused
+CBLDatabase* _cbl_nullable CBLDatabase_OpenShared(FLString name,
+                                                  const CBLDatabaseConfiguration* _cbl_nullable config,
+                                                  CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Sets the limits of the cache used by \ref CBLDatabase_OpenShared; handles over the limits are
+    closed right away if they're idle.
+    @param maxOpen  The maximum number of idle handles to keep open, or 0 to disable the cache.
+                    (Handles in use don't count against the limit.)
+    @param idleTimeout  The time, in seconds, after which an idle handle is closed. */
+void CBL_SetDatabaseCacheLimits(unsigned maxOpen, double idleTimeout) CBLAPI;
+
 /** Closes and deletes a database. If there are any other connections to the database,
     an error is returned. */
 bool CBLDatabase_Delete(CBLDatabase*,
@@ -171,6 +282,30 @@ bool CBLDatabase_EndTransaction(CBLDatabase*,
 bool CBLDatabase_ChangeEncryptionKey(CBLDatabase*,
                                      const CBLEncryptionKey* _cbl_nullable newKey,
                                      CBLError* outError) CBLAPI;
+
+/** A callback that's told the outcome of \ref CBLDatabase_ChangeEncryptionKeyAsync.
+    @param context  The `context` given to \ref CBLDatabase_ChangeEncryptionKeyAsync.
+    @param db  The database.
+    @param error  The reason the key couldn't be changed, or NULL if it was. */
+typedef void (*CBLChangeEncryptionKeyCompletion)(void* _cbl_nullable context,
+                                                 CBLDatabase* db,
+                                                 const CBLError* _cbl_nullable error);
+
+/** Changes a database's encryption key like \ref CBLDatabase_ChangeEncryptionKey, but on a
+    background thread, so the calling thread isn't blocked while the database is rewritten.
+    Other calls that use the database will still wait until it's done. The change is queued
+    with the database's asynchronous saves, after any that have already been requested.
+    The callback is called like a database change listener: on the background thread, or, if
+    \ref CBLDatabase_BufferNotifications has been called, by \ref CBLDatabase_SendNotifications.
+    @note  The key is copied, so it can be cleared as soon as this returns.
+    @param db  The database.
+    @param newKey  The new key, or NULL to decrypt the database.
+    @param completion  The callback to be called when done (may be NULL.)
+    @param context  An arbitrary value to be passed to the callback. */
+void CBLDatabase_ChangeEncryptionKeyAsync(CBLDatabase* db,
+                                          const CBLEncryptionKey* _cbl_nullable newKey,
+                                          CBLChangeEncryptionKeyCompletion _cbl_nullable completion,
+                                          void* _cbl_nullable context) CBLAPI;
 #endif
 
 /** Maintenance Type used when performing database maintenance. */
@@ -199,6 +334,47 @@ bool CBLDatabase_PerformMaintenance(CBLDatabase* db,
                                     CBLMaintenanceType type,
                                     CBLError* _cbl_nullable outError) CBLAPI;
 
+/** A callback reporting the progress of \ref CBLDatabase_ScheduleMaintenance. It's called on the
+    background thread after each step, and a last time when it stops.
+    @param context  The value given to \ref CBLDatabase_ScheduleMaintenance.
+    @param stepsDone  The number of steps successfully completed so far.
+    @param stepCount  The total number of steps requested.
+    @param finished  True on the last call: when all steps are done, or after a step failed, the
+                     time budget ran out, or the callback returned false.
+    @param error  The error, if the last step failed; else NULL.
+    @return  True to go on to the next step, false to cancel the rest. (Ignored on the last call.) */
+typedef bool (*CBLMaintenanceProgressCallback)(void* _cbl_nullable context,
+                                               unsigned stepsDone,
+                                               unsigned stepCount,
+                                               bool finished,
+                                               const CBLError* _cbl_nullable error);
+
+/** Performs a series of maintenance operations in the background, on a separate connection to the
+    database file, so this database's lock isn't held meanwhile; reads and queries go on as usual.
+    Use it to schedule maintenance in an app's idle time: between steps the callback can cancel the
+    remaining ones, and no step is begun after the time budget has run out.
+    \note  Each step is a single LiteCore operation that runs to completion; in particular,
+           compaction rewrites the whole database file, and writes wait for it to commit. So break
+           up the work by giving several steps, e.g. `optimize` on most idle slices and `compact`
+           on a long one.
+    \note  Closing or deleting the database stops the maintenance after the current step, and
+           waits for that step to finish.
+    @param db  The database.
+    @param steps  The maintenance operations to perform, in order.
+    @param count  The number of steps.
+    @param timeBudget  The time in seconds after which no new step is begun, or 0 for no limit.
+    @param callback  An optional callback reporting progress, and allowing cancellation.
+    @param context  An arbitrary value passed to the callback.
+    @param outError  On failure to start, the error is written here.
+    @return  True if the maintenance started, false on error. */
+bool CBLDatabase_ScheduleMaintenance(CBLDatabase* db,
+                                     const CBLMaintenanceType steps[_cbl_nonnull],
+                                     size_t count,
+                                     double timeBudget,
+                                     CBLMaintenanceProgressCallback _cbl_nullable callback,
+                                     void* _cbl_nullable context,
+                                     CBLError* _cbl_nullable outError) CBLAPI;
+
 /** @} */
 
 
@@ -224,6 +400,263 @@ uint64_t CBLDatabase_Count(const CBLDatabase*) CBLAPI;
     @note  The encryption key is not filled in, for security reasons. */
 const CBLDatabaseConfiguration CBLDatabase_Config(const CBLDatabase*) CBLAPI;
 
+/** The APIs that a database's lock waits are attributed to, in \ref CBLLockStats. */
+typedef CBL_ENUM(uint8_t, CBLLockCaller) {
+    kCBLLockCallerOther,        ///< Anything not listed below, e.g. transactions and indexes
+    kCBLLockCallerSave,         ///< Saving, deleting or purging documents
+    kCBLLockCallerGet,          ///< Reading documents
+    kCBLLockCallerQuery,        ///< Creating and running queries
+    kCBLLockCallerReplicator,   ///< Replicators, including conflict resolution
+    kCBLLockCallerListener,     ///< Adding listeners and dispatching change notifications
+};
+
+/** Contention statistics of a database's lock, which serializes most operations on the
+    database's main connection. Times are in nanoseconds. */
+typedef struct {
+    uint64_t acquisitions;              ///< Number of times the lock was acquired
+    uint64_t totalWaitTime;             ///< Total time threads waited to acquire the lock
+    uint64_t maxWaitTime;               ///< Longest single wait
+    uint64_t acquisitionsByCaller[6];   ///< Acquisitions, indexed by \ref CBLLockCaller
+    uint64_t waitTimeByCaller[6];       ///< Wait time, indexed by \ref CBLLockCaller
+    uint64_t holdTimeHistogram[8];      ///< Hold times: bucket 0 counts those under 1µs, bucket `i`
+                                        ///< those under 10^i µs, and bucket 7 those of 1s or more.
+} CBLLockStats;
+
+/** Enables or disables collecting \ref CBLLockStats for the database, and resets them.
+    Collecting costs a few clock reads per lock acquisition, so it can be left enabled in
+    production; it's disabled by default. */
+void CBLDatabase_SetLockStatsEnabled(CBLDatabase*, bool enabled) CBLAPI;
+
+/** Returns the lock statistics collected since they were enabled. */
+CBLLockStats CBLDatabase_GetLockStats(const CBLDatabase*) CBLAPI;
+
+/** Changes the maximum memory the page cache of each of the database's connections may use,
+    overriding \ref CBLStorageTuning.pageCacheSize. Lowering it frees the excess memory.
+    @param db  The database.
+    @param sizeKB  The cache size in KB; must be nonzero.
+    @param outError  On failure, the error will be written here.
+    @return  True on success, false on failure. */
+bool CBLDatabase_SetPageCacheSize(CBLDatabase* db,
+                                  unsigned sizeKB,
+                                  CBLError* _cbl_nullable outError) CBLAPI;
+
+/** How urgently memory should be released; see \ref CBL_HandleMemoryPressure. */
+typedef CBL_ENUM(uint8_t, CBLMemoryPressure) {
+    kCBLMemoryPressureModerate,     ///< Empty the blob caches and shrink the SQLite page caches
+    kCBLMemoryPressureCritical,     ///< Also empty the query caches, and close the idle handles
+                                    ///< cached by \ref CBLDatabase_OpenShared
+};
+
+/** Memory held by a database's caches; see \ref CBLDatabase_GetMemoryStats. */
+typedef struct {
+    size_t blobCacheBytes;          ///< Blob content held by the blob cache
+    unsigned cachedQueries;         ///< Compiled queries held by the query cache
+    unsigned openConnections;       ///< SQLite connections open: the main one and open readers
+    uint64_t pageCacheLimit;        ///< The most memory those connections' page caches may hold,
+                                    ///< in bytes, or 0 if it's LiteCore's default
+} CBLMemoryStats;
+
+/** Releases memory held by a database's caches; they refill as they're used again.
+    This doesn't affect memory held by objects the app has references to, such as documents
+    and result sets. */
+void CBLDatabase_ReleaseMemory(CBLDatabase* db, CBLMemoryPressure level) CBLAPI;
+
+/** Releases memory held by the caches of every open database, as by \ref CBLDatabase_ReleaseMemory.
+    Call this when the OS warns that memory is low, e.g. from `onTrimMemory` on Android or on
+    `UIApplicationDidReceiveMemoryWarningNotification` on iOS. */
+void CBL_HandleMemoryPressure(CBLMemoryPressure level) CBLAPI;
+
+/** Returns the memory held by a database's caches. */
+CBLMemoryStats CBLDatabase_GetMemoryStats(const CBLDatabase* db) CBLAPI;
+
+/** Timing of the work done by \ref CBLDatabase_Open, in nanoseconds. */
+typedef struct {
+    uint64_t setupTime;     ///< Initializing logging and the LiteCore configuration
+    uint64_t openTime;      ///< Opening the database file, including LiteCore's schema checks
+    uint64_t readersTime;   ///< Opening the reader connections (0 if they're lazy)
+    uint64_t totalTime;     ///< The whole open
+} CBLDatabaseOpenStats;
+
+/** Returns the timing of the open of this database. (It's also logged, at the verbose level.) */
+CBLDatabaseOpenStats CBLDatabase_GetOpenStats(const CBLDatabase*) CBLAPI;
+
+/** @} */
+
+
+#ifdef __APPLE__
+#pragma mark - IMPORT & EXPORT
+#endif
+/** \name  Database import and export
+    @{
+    Bulk loading and dumping documents in the JSON-lines (NDJSON) format, one JSON object
+    per line.
+ */
+
+/** A callback that supplies the data to be imported by \ref CBLDatabase_ImportJSONLinesFromReader.
+    @param context  The `readerContext` value given to the import function.
+    @param buffer  Where to copy the data.
+    @param bufferSize  The maximum number of bytes to copy.
+    @return  The number of bytes copied, 0 at the end of the data, or -1 on error. */
+typedef int64_t (*CBLImportReader)(void* _cbl_nullable context,
+                                   void* buffer,
+                                   size_t bufferSize);
+
+/** A callback that reports the progress of an import, called after each batch is committed.
+    @param context  The `context` value from the \ref CBLImportOptions.
+    @param docsImported  The number of documents saved so far.
+    @param bytesRead  The number of bytes of input consumed so far.
+    @return  True to continue, false to stop importing. */
+typedef bool (*CBLImportProgressCallback)(void* _cbl_nullable context,
+                                          uint64_t docsImported,
+                                          uint64_t bytesRead);
+
+/** Options for importing JSON-lines data. A zeroed struct gives the default behavior. */
+typedef struct {
+    /** The name of a top-level property whose string value is used as the document ID.
+        If NULL, or if a document has no such property, a random ID is generated. */
+    FLString idProperty;
+    /** The number of documents saved per transaction. Defaults to 1000. */
+    unsigned batchSize;
+    /** The number of threads converting JSON to Fleece while the previous batch is saved.
+        Defaults to one less than the number of CPU cores. */
+    unsigned workerCount;
+    /** Optional callback reporting the progress of the import. */
+    CBLImportProgressCallback _cbl_nullable progress;
+    /** An arbitrary value that will be passed to the \p progress callback. */
+    void* _cbl_nullable context;
+} CBLImportOptions;
+
+/** Imports documents from a JSON-lines file, where each (non-empty) line is a JSON object that
+    becomes the body of a document. Documents whose IDs already exist are overwritten.
+    Parsing is done on background threads, and documents are saved in batches, each in its own
+    transaction; if the import fails, the batches already saved remain in the database.
+    @param db  The database to import into.
+    @param path  The filesystem path of the file to read.
+    @param options  Import options, or NULL for the defaults.
+    @param outDocCount  If non-NULL, the number of documents saved will be stored here.
+    @param outError  On failure, the error will be written here.
+    @return  True on success, false on failure. */
+bool CBLDatabase_ImportJSONLines(CBLDatabase* db,
+                                 FLString path,
+                                 const CBLImportOptions* _cbl_nullable options,
+                                 uint64_t* _cbl_nullable outDocCount,
+                                 CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Imports documents from JSON-lines data supplied by a callback.
+    This is otherwise identical to \ref CBLDatabase_ImportJSONLines.
+    @param db  The database to import into.
+    @param reader  The callback that reads the data.
+    @param readerContext  An arbitrary value that will be passed to the \p reader.
+    @param options  Import options, or NULL for the defaults.
+    @param outDocCount  If non-NULL, the number of documents saved will be stored here.
+    @param outError  On failure, the error will be written here.
+    @return  True on success, false on failure. */
+bool CBLDatabase_ImportJSONLinesFromReader(CBLDatabase* db,
+                                           CBLImportReader reader,
+                                           void* _cbl_nullable readerContext,
+                                           const CBLImportOptions* _cbl_nullable options,
+                                           uint64_t* _cbl_nullable outDocCount,
+                                           CBLError* _cbl_nullable outError) CBLAPI;
+
+/** A callback that receives the data written by \ref CBLDatabase_ExportJSONLines.
+    The data is delivered in large chunks, each consisting of complete lines.
+    @param context  The `context` value given to the export function.
+    @param data  The data to write.
+    @param size  The length of the data in bytes.
+    @return  True on success, false to abort the export. */
+typedef bool (*CBLExportWriter)(void* _cbl_nullable context,
+                                const void* data,
+                                size_t size);
+
+/** Exports documents in JSON-lines format: every document, or every row of a query's results,
+    is written as a JSON object on a line of its own. Document bodies are converted straight to
+    JSON without creating \ref CBLDocument objects, and the output is buffered and passed to the
+    \p writer in large chunks, so memory use stays low regardless of the database size.
+    @note  The database is only locked while each chunk is being generated, not while the
+           \p writer is called, so changes made during an export may or may not be included.
+    @param db  The database to export from.
+    @param query  A query whose results will be exported (one row per line, as an object mapping
+                  column names to values), or NULL to export all documents.
+    @param idProperty  When exporting documents, the name of a property to add to each object,
+                  containing the document ID, replacing any property of that name in the body.
+                  May be NULL, in which case IDs are not exported.
+                  (Importing with the same \ref CBLImportOptions.idProperty restores the IDs.)
+    @param writer  The callback that writes the output.
+    @param context  An arbitrary value that will be passed to the \p writer.
+    @param outCount  If non-NULL, the number of documents or rows exported will be stored here.
+    @param outError  On failure, the error will be written here. If the writer returns false,
+                     the error is \ref kCBLErrorIOError.
+    @return  True on success, false on failure. */
+bool CBLDatabase_ExportJSONLines(CBLDatabase* db,
+                                 CBLQuery* _cbl_nullable query,
+                                 FLString idProperty,
+                                 CBLExportWriter writer,
+                                 void* _cbl_nullable context,
+                                 uint64_t* _cbl_nullable outCount,
+                                 CBLError* _cbl_nullable outError) CBLAPI;
+
+/** @} */
+
+
+#ifdef __APPLE__
+#pragma mark - CHANGES FEED
+#endif
+/** \name  Changes feed
+    @{
+    The changes feed lists the documents changed since a given sequence number, in sequence
+    order. Unlike a change listener, it works across restarts: save the sequence of the last
+    change you processed, and pass it the next time to pick up where you left off.
+ */
+
+/** Flags describing a document reported by \ref CBLDatabase_EnumerateChanges. */
+typedef CBL_OPTIONS(unsigned, CBLChangeFlags) {
+    kCBLChangeDeleted           = 1 << 0,   ///< The document has been deleted.
+    kCBLChangeConflicted        = 1 << 1,   ///< The document is in conflict.
+    kCBLChangeHasAttachments    = 1 << 2,   ///< The document has blobs.
+};
+
+/** A document changed since the starting sequence of \ref CBLDatabase_EnumerateChanges. */
+typedef struct {
+    FLString docID;                     ///< The document's ID
+    FLString revisionID;                ///< The ID of its current revision
+    uint64_t sequence;                  ///< The sequence number of its current revision
+    CBLChangeFlags flags;               ///< Whether it's deleted, etc.
+    FLDict _cbl_nullable properties;    ///< Its properties, if bodies were requested
+} CBLChangedDocument;
+
+/** A callback that's given a batch of changed documents by \ref CBLDatabase_EnumerateChanges.
+    The values in \p changes are only valid until the callback returns.
+    @param context  The `context` value given to \ref CBLDatabase_EnumerateChanges.
+    @param changes  The changed documents, in increasing order of sequence.
+    @param count  The number of documents in \p changes.
+    @return  True to continue, false to stop after this batch. */
+typedef bool (*CBLChangesCallback)(void* _cbl_nullable context,
+                                   const CBLChangedDocument changes[_cbl_nonnull],
+                                   unsigned count);
+
+/** Reports every document whose current revision was saved after a given sequence, reading
+    LiteCore's sequence index a batch at a time. Deleted documents are included.
+    @note  The database is only locked while each batch is read, not while the \p callback is
+           called; a document changed during the enumeration is reported again afterwards, with
+           its new sequence.
+    @param db  The database.
+    @param sinceSequence  Only documents with a greater sequence are reported; 0 for all of them.
+    @param batchSize  The maximum number of documents per call to \p callback; 0 for a default
+                      of 1000.
+    @param includeBodies  True to include the documents' properties in the change records.
+    @param callback  The callback that receives the changes.
+    @param context  An arbitrary value that will be passed to the \p callback.
+    @param outError  On failure, the error will be written here.
+    @return  The sequence of the last change reported (or \p sinceSequence if there were none),
+             to pass as \p sinceSequence next time; or -1 on failure. */
+int64_t CBLDatabase_EnumerateChanges(const CBLDatabase* db,
+                                     uint64_t sinceSequence,
+                                     unsigned batchSize,
+                                     bool includeBodies,
+                                     CBLChangesCallback callback,
+                                     void* _cbl_nullable context,
+                                     CBLError* _cbl_nullable outError) CBLAPI;
+
 /** @} */
 
 
@@ -263,6 +696,33 @@ CBLListenerToken* CBLDatabase_AddChangeListener(const CBLDatabase* db,
                                                 CBLDatabaseChangeListener listener,
                                                 void* _cbl_nullable context) CBLAPI;
 
+/** Options for a coalescing database change listener. */
+typedef struct {
+    /** How long to collect changes before delivering them, in milliseconds.
+        (0 means the default of 50ms.) */
+    unsigned intervalMs;
+    /** The maximum number of document IDs in a single call to the listener; once this many
+        distinct documents have changed they're delivered right away. (0 means no limit.) */
+    unsigned maxBatchSize;
+} CBLChangeCoalescingOptions;
+
+/** Registers a database change listener callback that's called at most once per interval.
+    Changes made during the interval are collected and de-duplicated by document ID, so the
+    listener is called with each changed document only once, no matter how many times it was
+    written. This is useful for listeners, like UI updates, that would otherwise be called
+    thousands of times a second during a replication burst.
+    @param db  The database to observe.
+    @param options  The coalescing interval and batch size, or NULL for the defaults.
+    @param listener  The callback to be invoked.
+    @param context  An opaque value that will be passed to the callback.
+    @return  A token to be passed to \ref CBLListener_Remove when it's time to remove the
+            listener.*/
+_cbl_warn_unused
+CBLListenerToken* CBLDatabase_AddCoalescedChangeListener(const CBLDatabase* db,
+                                                         const CBLChangeCoalescingOptions* _cbl_nullable options,
+                                                         CBLDatabaseChangeListener listener,
+                                                         void* _cbl_nullable context) CBLAPI;
+
 /** @} */
 /** @} */    // end of outer \defgroup
 
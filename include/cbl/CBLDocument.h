@@ -73,6 +73,63 @@ const CBLDocument* _cbl_nullable CBLDatabase_GetDocument(const CBLDatabase* data
                                                          FLString docID,
                                                          CBLError* _cbl_nullable outError) CBLAPI;
 
+/** Reads a number of documents from the database at once, creating a new (immutable)
+    \ref CBLDocument object for each one that exists. This is faster than calling
+    \ref CBLDatabase_GetDocument once per document, since the database is only locked once.
+    @note  You must release each of the returned documents when you're done with them.
+    @param database  The database.
+    @param docIDs  An array of document IDs.
+    @param count  The number of document IDs in \p docIDs.
+    @param outDocs  An array of \p count document pointers; on return each will be set to the
+                    corresponding document, or NULL if that document doesn't exist.
+    @param outError  On failure, the error will be written here.
+    @return  True on success (even if some documents don't exist), false if an error occurred. */
+bool CBLDatabase_GetDocuments(const CBLDatabase* database,
+                              const FLString docIDs[_cbl_nonnull],
+                              size_t count,
+                              const CBLDocument* _cbl_nullable outDocs[_cbl_nonnull],
+                              CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Reads the properties of a number of documents at once, without creating any
+    \ref CBLDocument objects. The result is a dictionary that maps each existing document's ID
+    to its properties; document IDs that don't exist are left out, and repeated ones appear once.
+    @note  You must release the returned dictionary with `FLDict_Release` when you're done.
+    @param database  The database.
+    @param docIDs  An array of document IDs.
+    @param count  The number of document IDs in \p docIDs.
+    @param outError  On failure, the error will be written here.
+    @return  A new dictionary of document properties, or NULL if an error occurred. */
+_cbl_warn_unused
+FLDict _cbl_nullable CBLDatabase_GetDocumentsProperties(const CBLDatabase* database,
+                                                        const FLString docIDs[_cbl_nonnull],
+                                                        size_t count,
+                                                        CBLError* _cbl_nullable outError) CBLAPI;
+
+/** A callback that's given the result of \ref CBLDatabase_GetDocumentAsync.
+    @param context  The `context` given to \ref CBLDatabase_GetDocumentAsync.
+    @param doc  The document, or NULL if it doesn't exist or couldn't be read. It's released
+                after the callback returns, so retain it if you want to keep it.
+    @param error  The reason the document couldn't be read, or NULL if it was read or doesn't
+                exist. */
+typedef void (*CBLGetDocumentCompletion)(void* _cbl_nullable context,
+                                         const CBLDocument* _cbl_nullable doc,
+                                         const CBLError* _cbl_nullable error);
+
+/** Reads a document on a background thread, like \ref CBLDatabase_GetDocument, and passes it
+    to a callback. Asynchronous reads may run concurrently with each other, and with
+    asynchronous saves.
+    The callback is called like a database change listener: on the background thread, or, if
+    \ref CBLDatabase_BufferNotifications has been called, by \ref CBLDatabase_SendNotifications.
+    @note  The database is retained until the callback has been called.
+    @param database  The database.
+    @param docID  The ID of the document.
+    @param completion  The callback to pass the document to.
+    @param context  An arbitrary value to be passed to the callback. */
+void CBLDatabase_GetDocumentAsync(const CBLDatabase* database,
+                                  FLString docID,
+                                  CBLGetDocumentCompletion completion,
+                                  void* _cbl_nullable context) CBLAPI;
+
 CBL_REFCOUNTED(CBLDocument*, Document);
 
 /** Saves a (mutable) document to the database.
@@ -117,6 +174,56 @@ bool CBLDatabase_SaveDocumentWithConflictHandler(CBLDatabase* db,
                                                  void* _cbl_nullable context,
                                                  CBLError* _cbl_nullable outError) CBLAPI;
 
+/** Saves a batch of (mutable) documents to the database in a single transaction.
+    This is much faster than saving the documents one at a time, since the database is locked
+    and the transaction committed only once for the whole batch.
+    A document that can't be saved, for instance because of a conflict, doesn't prevent the other
+    documents from being saved; its status is written to the corresponding item of \p outResults.
+    @param db  The database to save to.
+    @param docs  An array of mutable documents to save.
+    @param count  The number of documents in \p docs.
+    @param concurrency  Conflict-handling strategy (fail or overwrite).
+    @param outResults  If non-NULL, an array of \p count errors: each one is set to the status
+                    of the corresponding document, with a zero code if it was saved.
+    @param outError  On failure, the error will be written here: either the error that prevented
+                    the batch from being saved, or the status of the first unsaved document.
+    @return  True if all the documents were saved, false if any of them weren't. */
+bool CBLDatabase_SaveDocuments(CBLDatabase* db,
+                               CBLDocument* const docs[_cbl_nonnull],
+                               size_t count,
+                               CBLConcurrencyControl concurrency,
+                               CBLError* _cbl_nullable outResults,
+                               CBLError* _cbl_nullable outError) CBLAPI;
+
+/** A callback that's told the outcome of \ref CBLDatabase_SaveDocumentAsync.
+    @param context  The `context` given to \ref CBLDatabase_SaveDocumentAsync.
+    @param doc  The document that was to be saved.
+    @param saved  True if the document was saved, false if not.
+    @param error  The reason the document wasn't saved, or NULL if it was. */
+typedef void (*CBLSaveDocumentCompletion)(void* _cbl_nullable context,
+                                          CBLDocument* doc,
+                                          bool saved,
+                                          const CBLError* _cbl_nullable error);
+
+/** Saves a (mutable) document on a background thread, like
+    \ref CBLDatabase_SaveDocumentWithConcurrencyControl, then calls a callback.
+    Asynchronous saves to a database are performed one at a time, in the order they were
+    requested, so saving the same document twice in a row behaves as expected.
+    The callback is called like a database change listener: on the background thread, or, if
+    \ref CBLDatabase_BufferNotifications has been called, by \ref CBLDatabase_SendNotifications.
+    @warning  Don't modify the document until the callback has been called.
+    @note  The database and document are retained until the callback has been called.
+    @param db  The database to save to.
+    @param doc  The mutable document to save.
+    @param concurrency  Conflict-handling strategy (fail or overwrite).
+    @param completion  The callback to be called when done (may be NULL.)
+    @param context  An arbitrary value to be passed to the callback. */
+void CBLDatabase_SaveDocumentAsync(CBLDatabase* db,
+                                   CBLDocument* doc,
+                                   CBLConcurrencyControl concurrency,
+                                   CBLSaveDocumentCompletion _cbl_nullable completion,
+                                   void* _cbl_nullable context) CBLAPI;
+
 /** Deletes a document from the database. Deletions are replicated.
     @warning  You are still responsible for releasing the CBLDocument.
     @param db  The database containing the document.
@@ -165,6 +272,85 @@ bool CBLDatabase_PurgeDocumentByID(CBLDatabase* database,
                                    FLString docID,
                                    CBLError* _cbl_nullable outError) CBLAPI;
 
+/** Purges a number of documents, given their IDs. This holds the database's lock throughout, and
+    commits a transaction per few thousand documents, so it's much faster than purging them one
+    at a time. IDs of documents that don't exist are skipped.
+    @param database  The database.
+    @param docIDs  The IDs of the documents to purge.
+    @param count  The number of document IDs.
+    @param outError  On failure, the error will be written here.
+    @return  The number of documents purged, or -1 on failure. (On failure, the documents purged
+             by the transactions already committed stay purged.) */
+int64_t CBLDatabase_PurgeDocuments(CBLDatabase* database,
+                                   const FLString docIDs[_cbl_nonnull],
+                                   size_t count,
+                                   CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Purges all the documents matching a query condition, like \ref CBLDatabase_PurgeDocuments.
+    @param database  The database.
+    @param where  A N1QL expression, as in a query's `WHERE` clause, e.g. `type = 'telemetry'`.
+    @param outError  On failure, the error will be written here.
+    @return  The number of documents purged, or -1 on failure. */
+int64_t CBLDatabase_PurgeDocumentsWhere(CBLDatabase* database,
+                                        FLString where,
+                                        CBLError* _cbl_nullable outError) CBLAPI;
+
+/** @} */
+
+
+
+/** \name  Document enumeration
+    @{
+    A `CBLDocEnumerator` iterates over the documents in a database in order of their IDs.
+    It reads the documents a batch at a time, locking the database once per batch, so it's much
+    faster than querying for document IDs and then getting each document.
+ */
+
+typedef struct CBLDocEnumerator CBLDocEnumerator;
+CBL_REFCOUNTED(CBLDocEnumerator*, DocEnumerator);
+
+/** Flags for \ref CBLDocEnumeratorOptions. */
+typedef CBL_OPTIONS(unsigned, CBLDocEnumeratorFlags) {
+    kCBLEnumerateDescending     = 1 << 0,   ///< Iterate in descending order of document ID
+    kCBLEnumerateIncludeDeleted = 1 << 1,   ///< Include deleted documents
+    kCBLEnumerateMetadataOnly   = 1 << 2,   ///< Don't read bodies; the properties will be empty
+};
+
+/** Options for \ref CBLDatabase_EnumerateDocuments. A zeroed struct gives the default behavior:
+    every non-deleted document with its current properties, in ascending order of ID. */
+typedef struct {
+    CBLDocEnumeratorFlags flags;    ///< Options, as described above
+    FLString startDocID;            ///< The first document ID to include, if not NULL
+    FLString endDocID;              ///< The last document ID to include, if not NULL
+    unsigned batchSize;             ///< Documents read per lock of the database; 0 for 100
+} CBLDocEnumeratorOptions;
+
+/** Creates an enumerator over the documents in a database.
+    The range from \ref CBLDocEnumeratorOptions.startDocID to \ref CBLDocEnumeratorOptions.endDocID
+    is inclusive, and in the order of the enumeration: with \ref kCBLEnumerateDescending the
+    start ID is the greater one.
+    @note  The database is only locked while a batch is being read, so changes made during the
+           enumeration may or may not be seen.
+    @note  You must release the enumerator when you're done with it.
+    @param database  The database.
+    @param options  Enumeration options, or NULL for the defaults.
+    @param outError  On failure, the error will be written here.
+    @return  A new enumerator, or NULL on failure. */
+_cbl_warn_unused
+CBLDocEnumerator* _cbl_nullable CBLDatabase_EnumerateDocuments(const CBLDatabase* database,
+                                                               const CBLDocEnumeratorOptions* _cbl_nullable options,
+                                                               CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Returns the next document from an enumerator, or NULL at the end.
+    @note  The enumerator owns the document, which is only guaranteed to stay valid until the
+           next call to this function; retain it if you want to keep it longer.
+    @param e  The enumerator.
+    @param outError  On failure, the error will be written here. (At the end of the enumeration,
+                     the error code will be zero.)
+    @return  The next document, or NULL at the end or if an error occurred. */
+const CBLDocument* _cbl_nullable CBLDocEnumerator_Next(CBLDocEnumerator* e,
+                                                       CBLError* _cbl_nullable outError) CBLAPI;
+
 /** @} */
 
 
@@ -302,6 +488,47 @@ bool CBLDatabase_SetDocumentExpiration(CBLDatabase* db,
                                        CBLTimestamp expiration,
                                        CBLError* _cbl_nullable outError) CBLAPI;
 
+/** Sets or clears the expiration time of a number of documents, holding the database's lock
+    throughout and committing a transaction per few thousand documents. IDs of documents that
+    don't exist are skipped.
+    @param db  The database.
+    @param docIDs  The IDs of the documents.
+    @param count  The number of document IDs.
+    @param expiration  The expiration time as a CBLTimestamp (milliseconds since Unix epoch),
+                        or 0 if the documents should never expire.
+    @param outError  On failure, an error is written here.
+    @return  The number of documents updated, or -1 on failure. */
+int64_t CBLDatabase_SetDocumentsExpiration(CBLDatabase* db,
+                                           const FLString docIDs[_cbl_nonnull],
+                                           size_t count,
+                                           CBLTimestamp expiration,
+                                           CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Returns the earliest expiration time of any document in the database, or 0 if no documents
+    have an expiration time. An app that purges expired documents itself, with
+    \ref CBLDatabase_PurgeExpiredDocuments, can use this to decide when to do so next.
+    @param db  The database.
+    @param outError  On failure, an error is written here.
+    @return  The expiration time, 0 if none, or -1 if the call failed. */
+CBLTimestamp CBLDatabase_NextDocumentExpiration(CBLDatabase* db,
+                                                CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Purges documents whose expiration time has passed, in batches: each batch is purged in its own
+    transaction, and the database is unlocked between batches so other threads can get in.
+    (Expired documents are also purged automatically, in the background; this lets an app do it
+    at a time of its choosing, in smaller pieces.)
+    @param db  The database.
+    @param batchSize  The maximum number of documents to purge per transaction, or 0 for a
+                      default of 100.
+    @param timeBudget  The time in seconds after which no new batch is begun, or 0 for no limit.
+                       Documents left over are purged by a later call.
+    @param outError  On failure, an error is written here.
+    @return  The number of documents purged, or -1 if the call failed. */
+int64_t CBLDatabase_PurgeExpiredDocuments(CBLDatabase* db,
+                                          unsigned batchSize,
+                                          double timeBudget,
+                                          CBLError* _cbl_nullable outError) CBLAPI;
+
 /** @} */
 
 
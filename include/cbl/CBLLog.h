@@ -104,6 +104,41 @@ CBLLogCallback CBLLog_Callback(void) CBLAPI;
 /** Sets the callback for receiving log messages. If set to NULL, no messages are logged to the console. */
 void CBLLog_SetCallback(CBLLogCallback _cbl_nullable callback) CBLAPI;
 
+/** The log destinations whose level can be set per domain. */
+typedef CBL_ENUM(uint8_t, CBLLogSink) {
+    kCBLLogSinkConsole,     ///< Console logging (\ref CBLLog_SetConsoleLevel)
+    kCBLLogSinkCallback,    ///< The log callback (\ref CBLLog_SetCallbackLevel)
+};
+
+/** Gets the log level of a sink for one domain. */
+CBLLogLevel CBLLog_DomainLevel(CBLLogSink sink, CBLLogDomain domain) CBLAPI;
+
+/** Sets the log level of a sink for one domain, e.g. to log verbose replicator messages to the
+    callback without also logging verbose database and query messages. Messages that no sink
+    (including the log files) wants are discarded before they're formatted.
+    \note  \ref CBLLog_SetConsoleLevel and \ref CBLLog_SetCallbackLevel set the level of every
+           domain of their sink. */
+void CBLLog_SetDomainLevel(CBLLogSink sink,
+                           CBLLogDomain domain,
+                           CBLLogLevel level) CBLAPI;
+
+/** Enables or disables asynchronous delivery to the log callback. When enabled, messages are
+    queued in a bounded ring buffer and delivered to the callback in order, on a single
+    background thread, so a slow callback doesn't stall the threads that log. If the ring is
+    full, the message is dropped; see \ref CBLLog_DroppedMessageCount.
+    @param capacity  The number of messages the ring can hold, or 0 to deliver messages
+                     synchronously (the default.) The messages already queued are delivered
+                     before this returns. */
+void CBLLog_SetCallbackAsync(unsigned capacity) CBLAPI;
+
+/** Blocks until every message queued for asynchronous delivery when this is called has been
+    delivered to the callback. Does nothing if asynchronous delivery is disabled.
+    @warning  Don't call this from the log callback itself. */
+void CBLLog_FlushCallback(void) CBLAPI;
+
+/** Returns the number of messages dropped because the asynchronous delivery ring was full. */
+uint64_t CBLLog_DroppedMessageCount(void) CBLAPI;
+
 /** @} */
 
 
@@ -120,6 +155,10 @@ typedef struct {
     uint32_t maxRotateCount; ///< Max number of older log files to keep (in addition to current one.)
     size_t maxSize;          ///< The size in bytes at which a file will be rotated out (best effort).
     bool usePlaintext;       ///< Whether or not to log in plaintext (as opposed to binary.) Plaintext logging is slower and bigger.
+    bool deferFormatting;    ///< If true, \ref CBL_Log passes its format string and arguments through unformatted, so
+                             ///< binary log files store them as-is; messages are only formatted for the console or
+                             ///< callback, if those are enabled at that level. The format string should then only use
+                             ///< the common `printf` conversions (`%d %u %x %s %.*s %p %f %g`, with `l`/`ll`/`z` sizes.)
 } CBLLogFileConfiguration;
 
 /** Gets the current file logging configuration, or NULL if none is configured. */
@@ -128,6 +167,62 @@ const CBLLogFileConfiguration* _cbl_nullable CBLLog_FileConfig(void) CBLAPI;
 /** Sets the file logging configuration, and begins logging to files. */
 bool CBLLog_SetFileConfig(CBLLogFileConfiguration, CBLError* _cbl_nullable outError) CBLAPI;
 
+/** Decodes a binary log file, as written when `usePlaintext` is false, into a text file.
+    This doesn't need an open database, so it can be used offline, e.g. by a tool that reads log
+    files collected from devices.
+    @param binaryPath  The path of the binary (`.cbllog`) log file.
+    @param outputPath  The path of the text file to write; it's overwritten if it exists.
+    @param outError  On failure, the error is written here.
+    @return  True on success, false on failure. */
+bool CBLLog_DecodeFile(FLString binaryPath,
+                       FLString outputPath,
+                       CBLError* _cbl_nullable outError) CBLAPI;
+
+/** @} */
+
+
+
+/** \name Tracing
+    @{
+    Timing spans around costly operations, for finding out where time goes in production. Tracing
+    is off by default, and then costs no more than an atomic load per operation. */
+
+/** Operations that are traced. */
+typedef CBL_ENUM(uint8_t, CBLTraceOperation) {
+    kCBLTraceDocumentSave,          ///< Saving or deleting a document (`detail` is the doc ID)
+    kCBLTraceDocumentGet,           ///< Reading a document (`detail` is the doc ID)
+    kCBLTraceQueryExecute,          ///< Running a query
+    kCBLTraceResultSetNext,         ///< Advancing a query result set to its next row
+    kCBLTraceBlobInstall,           ///< Storing a new blob's contents (`detail` is the digest)
+    kCBLTraceConflictResolution,    ///< Resolving a replication conflict (`detail` is the doc ID)
+    kCBLTraceNotification,          ///< Calling change listeners
+};
+
+/** A completed span, as passed to a \ref CBLTraceCallback. */
+typedef struct {
+    CBLTraceOperation operation;    ///< The operation that was timed
+    uint64_t spanID;                ///< Unique (per process) nonzero ID of this span
+    uint64_t parentID;              ///< ID of the enclosing span on the same thread, or 0
+    int64_t startTime;              ///< Monotonic start time, in nanoseconds (not wall-clock time)
+    int64_t duration;               ///< Elapsed time, in nanoseconds
+    FLString detail;                ///< The document ID etc., if any; only valid during the callback
+} CBLTraceSpan;
+
+/** A callback that receives each sampled span when it ends. It's called synchronously on the
+    thread that performed the operation, possibly with internal locks held, so it should be fast
+    and must not call back into Couchbase Lite; typically it copies the span into a buffer.
+    A span ends after the spans nested in it, so children are reported before their parent. */
+typedef void (*CBLTraceCallback)(void* _cbl_nullable context, const CBLTraceSpan* span);
+
+/** Sets or clears the trace callback.
+    @param callback  The callback, or NULL to disable tracing.
+    @param context  An arbitrary value passed to the callback.
+    @param sampleRate  The fraction of operations to trace, from 0.0 to 1.0. The decision is made
+                       per top-level span; the spans nested in it are traced along with it. */
+void CBL_SetTraceCallback(CBLTraceCallback _cbl_nullable callback,
+                          void* _cbl_nullable context,
+                          double sampleRate) CBLAPI;
+
 /** @} */
 
 /** @} */
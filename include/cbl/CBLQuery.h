@@ -73,6 +73,108 @@ CBLQuery* _cbl_nullable CBLDatabase_CreateQuery(const CBLDatabase* db,
 
 CBL_REFCOUNTED(CBLQuery*, Query);
 
+/** Returns the number of documents matching a WHERE expression, without creating a query or
+    result set. The query wrapping the expression is compiled through the database's query
+    cache, if it's enabled (see \ref CBLDatabaseConfiguration.queryCacheCapacity), so polling
+    the same count is cheap.
+    @param db  The database to query.
+    @param language  The language of the expression: a N1QL expression like `type = 'user'`,
+                    or a JSON (or JSON5) expression like `['=', ['.type'], 'user']`.
+    @param whereExpr  The expression each document must match.
+    @param parameters  Values of the expression's `$` parameters, or NULL.
+    @param outError  On failure, the error will be written here.
+    @return  The number of matching documents, or -1 on failure. */
+int64_t CBLDatabase_QueryCount(const CBLDatabase* db,
+                               CBLQueryLanguage language,
+                               FLString whereExpr,
+                               FLDict _cbl_nullable parameters,
+                               CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Returns true if any document matches a WHERE expression. This is like
+    \ref CBLDatabase_QueryCount, but stops at the first match.
+    @param db  The database to query.
+    @param language  The language of the expression.
+    @param whereExpr  The expression a document must match.
+    @param parameters  Values of the expression's `$` parameters, or NULL.
+    @param outError  On failure, the error will be written here; check `outError->code`
+                    to tell a failure from a false result.
+    @return  True if a document matches. */
+bool CBLDatabase_QueryExists(const CBLDatabase* db,
+                             CBLQueryLanguage language,
+                             FLString whereExpr,
+                             FLDict _cbl_nullable parameters,
+                             CBLError* _cbl_nullable outError) CBLAPI;
+
+/** The configuration of a query created by \ref CBLDatabase_CreateFullTextPageQuery. */
+typedef struct {
+    FLString indexName;         ///< The full-text index to search
+    FLString columns;           ///< Result columns in N1QL, like `name, email`; may be empty
+    FLString where;             ///< An extra N1QL condition the documents must meet, or null
+    unsigned pageSize;          ///< The number of rows per page; 0 means 20
+} CBLFullTextPageConfiguration;
+
+/** Creates a full-text search query that returns its matches a page at a time, best first, for
+    use with \ref CBLQuery_ExecutePageAfter. Each page resumes after the last row of the one
+    before -- "keyset" pagination -- instead of skipping rows with `OFFSET`, so a deep page
+    doesn't have to produce, and then throw away, every row before it.
+    The query has the given columns followed by `_rank`, the match's `RANK()`, and `_id`, the
+    document ID. The text to search for is the `match` parameter; set it, and the values of
+    any parameters used in the columns or condition, with \ref CBLQuery_SetParameters. The
+    parameters `firstPage`, `afterRank` and `afterID` are reserved for the pagination.
+    The query is compiled through the database's query cache, like \ref CBLDatabase_CreateQuery.
+    @param db  The database to query.
+    @param config  The index to search, the columns, and the page size.
+    @param outError  On failure, the error will be written here.
+    @return  The new query object. */
+_cbl_warn_unused
+CBLQuery* _cbl_nullable CBLDatabase_CreateFullTextPageQuery(const CBLDatabase* db,
+                                                             CBLFullTextPageConfiguration config,
+                                                             CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Statistics of a database's compiled-query cache.
+    (See \ref CBLDatabaseConfiguration.queryCacheCapacity.) */
+typedef struct {
+    uint64_t hits;          ///< Number of queries created from a cached compiled query
+    uint64_t misses;        ///< Number of queries that had to be compiled and were cached
+    unsigned count;         ///< Number of compiled queries currently cached
+    unsigned capacity;      ///< Maximum number of compiled queries cached
+} CBLQueryCacheStats;
+
+/** Returns statistics of the database's compiled-query cache. */
+CBLQueryCacheStats CBLDatabase_QueryCacheStats(const CBLDatabase* db) CBLAPI;
+
+/** A callback notifying that \ref CBLDatabase_PrecompileQueries has finished.
+    @param context  The value given to \ref CBLDatabase_PrecompileQueries.
+    @param compiled  The number of queries compiled into the cache.
+    @param failed  The number of queries that failed to compile; their errors are logged. */
+typedef void (*CBLQueryPrecompileCallback)(void* _cbl_nullable context,
+                                           unsigned compiled,
+                                           unsigned failed);
+
+/** Compiles queries into the database's compiled-query cache on a background thread, so that
+    later calls to \ref CBLDatabase_CreateQuery with the same language and strings return at once.
+    Call this right after opening the database with the app's usual queries, to take their
+    compilation off the critical path of startup.
+    The cache must be enabled (see \ref CBLDatabaseConfiguration.queryCacheCapacity), and should
+    be large enough to hold all the queries, otherwise the first ones are evicted.
+    @note  Each compilation briefly holds the database's lock, just as \ref CBLDatabase_CreateQuery
+           does. Compiled queries are kept in memory only; they're not persisted in the database.
+    @param db  The database.
+    @param language  The language of the queries.
+    @param queries  The query strings, which are copied.
+    @param count  The number of queries.
+    @param callback  An optional callback, called on the background thread when done.
+    @param context  An arbitrary value passed to the callback.
+    @param outError  On failure to start, the error is written here.
+    @return  True if compilation started, false if the cache is disabled. */
+bool CBLDatabase_PrecompileQueries(CBLDatabase* db,
+                                   CBLQueryLanguage language,
+                                   const FLString queries[_cbl_nonnull],
+                                   size_t count,
+                                   CBLQueryPrecompileCallback _cbl_nullable callback,
+                                   void* _cbl_nullable context,
+                                   CBLError* _cbl_nullable outError) CBLAPI;
+
 /** Assigns values to the query's parameters.
     These values will be substited for those parameters whenever the query is executed,
     until they are next assigned.
@@ -98,6 +200,59 @@ _cbl_warn_unused
 CBLResultSet* _cbl_nullable CBLQuery_Execute(CBLQuery*,
                                              CBLError* _cbl_nullable outError) CBLAPI;
 
+/** Runs the query with the given parameter values, instead of the ones assigned with
+    \ref CBLQuery_SetParameters (which are left unchanged.)
+    Unlike setting parameters and then calling \ref CBLQuery_Execute, this is safe to call on
+    the same query from multiple threads at once, so they can share one compiled query.
+    @note  You must release the result set when you're finished with it.
+    @param query  The query.
+    @param parameters  The parameter values for this run, as a Fleece dictionary, or NULL for
+                       no parameters.
+    @param outError  On failure, the error will be written here.
+    @return  The query results, or NULL on failure. */
+_cbl_warn_unused
+CBLResultSet* _cbl_nullable CBLQuery_ExecuteWithParameters(CBLQuery* query,
+                                                           FLDict _cbl_nullable parameters,
+                                                           CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Runs a query created by \ref CBLDatabase_CreateFullTextPageQuery, returning the page of
+    results after the given row: pass the `_rank` and `_id` of the last row of the previous
+    page, or a null `afterDocID` for the first page. The query's own parameters are used too.
+    @note  You must release the result set when you're finished with it.
+    @param query  The full-text page query.
+    @param afterRank  The `_rank` of the last row of the previous page.
+    @param afterDocID  The `_id` of the last row of the previous page, or null for the first.
+    @param outError  On failure, the error will be written here.
+    @return  The page of results, or NULL on failure. */
+_cbl_warn_unused
+CBLResultSet* _cbl_nullable CBLQuery_ExecutePageAfter(CBLQuery* query,
+                                                      double afterRank,
+                                                      FLString afterDocID,
+                                                      CBLError* _cbl_nullable outError) CBLAPI;
+
+/** A callback that's given the results of \ref CBLQuery_ExecuteAsync.
+    @param context  The `context` given to \ref CBLQuery_ExecuteAsync.
+    @param query  The query that was run.
+    @param results  The query results, or NULL on failure. They're released after the callback
+                    returns, so retain them if you want to keep using them.
+    @param error  The reason the query failed, or NULL if it succeeded. */
+typedef void (*CBLQueryExecuteCompletion)(void* _cbl_nullable context,
+                                          CBLQuery* query,
+                                          CBLResultSet* _cbl_nullable results,
+                                          const CBLError* _cbl_nullable error);
+
+/** Runs the query on a background thread, with its current parameters, and passes the results
+    to a callback. This keeps a slow query from blocking the calling thread.
+    The callback is called like a database change listener: on the background thread, or, if
+    \ref CBLDatabase_BufferNotifications has been called, by \ref CBLDatabase_SendNotifications.
+    @note  The query is retained until the callback has been called.
+    @param query  The query.
+    @param completion  The callback to pass the results to (may be NULL.)
+    @param context  An arbitrary value to be passed to the callback. */
+void CBLQuery_ExecuteAsync(CBLQuery* query,
+                           CBLQueryExecuteCompletion _cbl_nullable completion,
+                           void* _cbl_nullable context) CBLAPI;
+
 /** Returns information about the query, including the translated SQLite form, and the search
     strategy. You can use this to help optimize the query: the word `SCAN` in the strategy
     indicates a linear scan of the entire database, which should be avoided by adding an index.
@@ -173,6 +328,68 @@ FLArray CBLResultSet_ResultArray(const CBLResultSet*) CBLAPI;
             If you want to keep it for longer, call \ref FLDict_Retain (and release it when done.) */
 FLDict CBLResultSet_ResultDict(const CBLResultSet*) CBLAPI;
 
+/** Advances the result set by up to \p maxRows results at once, storing their column values
+    in caller-supplied arrays, one per column. This is much more efficient than calling
+    \ref CBLResultSet_Next and \ref CBLResultSet_ValueAtIndex for every row, especially from
+    other languages.
+    \p outColumns must point to an array of \ref CBLQuery_ColumnCount pointers, each pointing to
+    an array of at least \p maxRows `FLValue`s; the value of column `c` of the `i`th row read
+    is stored in `outColumns[c][i]`. (A NULL value indicates `MISSING`.)
+    The values remain valid as long as the result set.
+    Afterwards, the current result (as seen by \ref CBLResultSet_ValueAtIndex etc.) is the last
+    one that was read.
+    @param rs  The result set.
+    @param maxRows  The maximum number of results to read.
+    @param outColumns  The arrays where the column values will be stored.
+    @return  The number of results read; if less than \p maxRows, there are no more results. */
+unsigned CBLResultSet_NextBatch(CBLResultSet* rs,
+                                unsigned maxRows,
+                                FLValue _cbl_nullable * const outColumns[_cbl_nonnull]) CBLAPI;
+
+/** Advances the result set by up to \p maxRows results, returning them as a single new Fleece
+    array whose items are arrays of column values (as with \ref CBLResultSet_ResultArray.)
+    The array is independent of the result set, and remains valid until released.
+    @note  You must release the result with \ref FLArray_Release when you're done with it.
+    @param rs  The result set.
+    @param maxRows  The maximum number of results to read.
+    @return  An array of up to \p maxRows results, or NULL if there are no more results. */
+_cbl_warn_unused
+FLArray _cbl_nullable CBLResultSet_NextPage(CBLResultSet* rs,
+                                            unsigned maxRows) CBLAPI;
+
+/** Types of column buffer for \ref CBLResultSet_NextColumns. */
+typedef CBL_ENUM(uint32_t, CBLColumnType) {
+    kCBLColumnInt64,        ///< Values are stored as `int64_t`
+    kCBLColumnDouble,       ///< Values are stored as `double`
+    kCBLColumnSlice,        ///< Values (strings or data) are stored as `FLSlice`
+};
+
+/** Describes a caller-supplied buffer that receives the values of one column. */
+typedef struct {
+    unsigned column;                    ///< The index of the column to read
+    CBLColumnType type;                 ///< The type of the values to store
+    void* values;                       ///< An array of `maxRows` items of the desired type
+    bool* _cbl_nullable present;        ///< Optional array of `maxRows` has-a-value flags
+} CBLColumnBuffer;
+
+/** Advances the result set by up to \p maxRows results at once, converting the values of the
+    selected columns to native types and storing them in contiguous caller-supplied buffers.
+    This skips the Fleece value wrappers entirely, which makes it the fastest way to transfer
+    numeric results.
+    A value that is missing or has the wrong type is stored as 0 (or an empty slice), and the
+    corresponding item of the buffer's `present` array, if any, is set to false.
+    Strings and data stored in a \ref kCBLColumnSlice buffer remain valid as long as the
+    result set.
+    @param rs  The result set.
+    @param maxRows  The maximum number of results to read.
+    @param buffers  An array of column buffer descriptors.
+    @param bufferCount  The number of items in \p buffers.
+    @return  The number of results read; if less than \p maxRows, there are no more results. */
+unsigned CBLResultSet_NextColumns(CBLResultSet* rs,
+                                  unsigned maxRows,
+                                  const CBLColumnBuffer buffers[_cbl_nonnull],
+                                  unsigned bufferCount) CBLAPI;
+
 /** Returns the Query that created this ResultSet. */
 CBLQuery* CBLResultSet_GetQuery(const CBLResultSet *rs) CBLAPI;
 
@@ -181,6 +398,87 @@ CBL_REFCOUNTED(CBLResultSet*, ResultSet);
 /** @} */
 
 
+/** \name  Fan-out queries
+    @{
+    A fan-out query runs one query on many databases -- for example one per tenant -- and
+    returns all their rows through one iterator. The query is compiled through each database's
+    query cache, and up to `maxThreads` databases are queried at once on background threads.
+    Like a \ref CBLResultSet, the iterator starts _before_ the first row:
+
+    ```
+    CBLFanOutOptions options = {.ordered = true, .orderByColumn = 0, .limit = 100};
+    CBLFanOutResults *rs = CBL_FanOutQuery(dbs, nDBs, kCBLN1QLLanguage, query, NULL,
+                                           &options, &error);
+    while (CBLFanOutResults_Next(rs, &error)) {
+        FLValue aValue = CBLFanOutResults_ValueAtIndex(rs, 0);
+        ...
+    }
+    CBLFanOutResults_Release(rs);
+    ```
+ */
+
+/** Options for \ref CBL_FanOutQuery. Zero-initialize it for the defaults. */
+typedef struct {
+    /** True to merge the databases' rows in order of column `orderByColumn`; the query itself
+        must have the matching `ORDER BY`. Rows are then only returned once every database has
+        been queried. If false, each database's rows are returned as soon as they're ready,
+        in no particular order of databases. */
+    bool ordered;
+    unsigned orderByColumn;     ///< The index of the column the rows are sorted by
+    bool descending;            ///< True if the query sorts in descending order
+    /** The maximum number of rows to return, or 0 for no limit. No more than this many rows
+        are read from any one database, and once they've been returned, databases not yet
+        queried are skipped. To have SQLite stop early too, give the query its own `LIMIT`. */
+    uint64_t limit;
+    unsigned maxThreads;        ///< Max number of databases queried at once; 0 means 4
+} CBLFanOutOptions;
+
+/** Runs a query on a number of databases, returning an iterator over all their rows.
+    The query runs in the background; \ref CBLFanOutResults_Next waits for rows as needed.
+    @note  You must release the results when you're finished with them. Releasing them early
+           stops any databases from being queried that haven't been yet.
+    @param dbs  The databases to query. They must stay open until the results are released.
+    @param count  The number of databases.
+    @param language  The query language.
+    @param queryString  The query string.
+    @param parameters  Values of the query's parameters, or NULL.
+    @param options  Ordering, limit and thread count, or NULL for the defaults.
+    @param outError  On failure, the error will be written here.
+    @return  The results, or NULL on failure. A query that fails to compile on a database is
+             reported by \ref CBLFanOutResults_Next. */
+_cbl_warn_unused
+CBLFanOutResults* _cbl_nullable CBL_FanOutQuery(const CBLDatabase* const dbs[_cbl_nonnull],
+                                                size_t count,
+                                                CBLQueryLanguage language,
+                                                FLString queryString,
+                                                FLDict _cbl_nullable parameters,
+                                                const CBLFanOutOptions* _cbl_nullable options,
+                                                CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Moves to the next row of a fan-out query's results, waiting if it's not ready yet.
+    @param rs  The results.
+    @param outError  If the query failed on any database, the error is written here.
+    @return  True if there's a row, false at the end or on failure. */
+bool CBLFanOutResults_Next(CBLFanOutResults* rs,
+                           CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Returns the value of a column of the current row, or NULL if there's no such column.
+    The value remains valid until the next call to \ref CBLFanOutResults_Next. */
+FLValue _cbl_nullable CBLFanOutResults_ValueAtIndex(const CBLFanOutResults* rs,
+                                                    unsigned index) CBLAPI;
+
+/** Returns the current row as an array of column values.
+    The array remains valid until the next call to \ref CBLFanOutResults_Next. */
+FLArray _cbl_nullable CBLFanOutResults_ResultArray(const CBLFanOutResults* rs) CBLAPI;
+
+/** Returns the database the current row came from. */
+const CBLDatabase* _cbl_nullable CBLFanOutResults_Database(const CBLFanOutResults* rs) CBLAPI;
+
+CBL_REFCOUNTED(CBLFanOutResults*, FanOutResults);
+
+/** @} */
+
+
 
 /** \name  Change listener
     @{
@@ -221,6 +519,44 @@ CBLListenerToken* CBLQuery_AddChangeListener(CBLQuery* query,
                                              CBLQueryChangeListener listener,
                                              void* _cbl_nullable context) CBLAPI;
 
+/** Options that limit how often a live query re-runs, trading freshness for CPU time.
+    Zero values mean no limit. */
+typedef struct {
+    /** The minimum time between re-runs of the query, in milliseconds. */
+    unsigned minIntervalMs;
+    /** How long the database must go without changes before the query re-runs, in milliseconds.
+        This keeps a continuous stream of changes, as from a pull replication, from re-running
+        the query until the stream pauses. */
+    unsigned debounceMs;
+} CBLQueryListenerOptions;
+
+/** Registers a change listener callback with a query, like \ref CBLQuery_AddChangeListener,
+    but limits how often the query re-runs.
+
+    While the listener is waiting out the interval or debounce delay, the query isn't observed;
+    the database's last sequence is checked to see if it has to re-run once the delay is over.
+    @param query  The query to observe.
+    @param options  The throttling options, or NULL for the default behavior.
+    @param listener  The callback to be invoked.
+    @param context  An opaque value that will be passed to the callback.
+    @return  A token to be passed to \ref CBLListener_Remove when it's time to remove the
+            listener.*/
+_cbl_warn_unused
+CBLListenerToken* CBLQuery_AddChangeListenerWithOptions(CBLQuery* query,
+                                                        const CBLQueryListenerOptions* _cbl_nullable options,
+                                                        CBLQueryChangeListener listener,
+                                                        void* _cbl_nullable context) CBLAPI;
+
+/** Pauses or resumes a query listener. While paused, the query doesn't re-run and the listener
+    isn't called. On resuming, the query re-runs and the listener is called with the current
+    results.
+    @param query  The query being listened to.
+    @param listener  The query listener's token.
+    @param paused  True to pause, false to resume. */
+void CBLQuery_SetListenerPaused(CBLQuery* query,
+                                CBLListenerToken* listener,
+                                bool paused) CBLAPI;
+
 /** Returns the query's _entire_ current result set, after it's been announced via a call to the
     listener's callback.
     @note  You must release the result set when you're finished with it.
@@ -233,6 +569,53 @@ CBLResultSet* _cbl_nullable CBLQuery_CopyCurrentResults(const CBLQuery* query,
                                                         CBLListenerToken *listener,
                                                         CBLError* _cbl_nullable outError) CBLAPI;
 
+
+/** The row-level differences between a live query's previous and current results, as reported
+    to a \ref CBLQueryDeltaListener. Rows are matched up between the two result sets by the value
+    of a key column. The arrays are only valid during the callback. */
+typedef struct {
+    CBLResultSet* results;          ///< The new results, positioned before the first row
+    const unsigned* _cbl_nullable inserted; ///< Indexes (in the new results) of inserted rows
+    size_t insertedCount;           ///< Number of items in `inserted`
+    const unsigned* _cbl_nullable removed;  ///< Indexes (in the previous results) of removed rows
+    size_t removedCount;            ///< Number of items in `removed`
+    const unsigned* _cbl_nullable changed;  ///< Indexes (in the new results) of changed rows
+    size_t changedCount;            ///< Number of items in `changed`
+} CBLQueryDelta;
+
+/** A callback to be invoked after a query's results have changed, with the row-level
+    differences from the previously delivered results. The first call reports every row as
+    inserted.
+    @note The result set in the delta is released after the callback returns; call
+          \ref CBLResultSet_Retain if you need to keep it.
+    @param context  The same `context` value that you passed when adding the listener.
+    @param query  The query that triggered the listener.
+    @param token  The token returned when the listener was added.
+    @param delta  The differences from the previous results. */
+typedef void (*CBLQueryDeltaListener)(void* _cbl_nullable context,
+                                      CBLQuery* query,
+                                      CBLListenerToken* token,
+                                      const CBLQueryDelta* delta);
+
+/** Registers a change listener that's told which rows were inserted, removed or changed, instead
+    of having to re-read the entire result set after every change. The diff is computed on
+    the background thread that re-runs the query, so the callback only has to apply it.
+
+    Rows are identified by the value of the column `keyColumn`, typically the document ID
+    (`META().id` in N1QL), which should be unique within the results. A row whose key is in both
+    result sets but whose other columns differ is reported as changed.
+    @param query  The query to observe.
+    @param keyColumn  The index of the column that identifies each row.
+    @param listener  The callback to be invoked.
+    @param context  An opaque value that will be passed to the callback.
+    @return  A token to be passed to \ref CBLListener_Remove when it's time to remove the
+            listener.*/
+_cbl_warn_unused
+CBLListenerToken* CBLQuery_AddDeltaListener(CBLQuery* query,
+                                            unsigned keyColumn,
+                                            CBLQueryDeltaListener listener,
+                                            void* _cbl_nullable context) CBLAPI;
+
 /** @} */
 
 
@@ -271,6 +654,13 @@ typedef struct {
     /** The expressions describing each coloumn of the index. The expressions could be specified
         in a JSON Array or in N1QL syntax using comma delimiter. */
     FLString expressions;
+
+    /** An optional expression that restricts the index to the documents it's true for, making
+        a *partial index*: e.g. `["=", [".type"], "order"]` to index only orders. This makes the
+        index smaller, and saving other documents doesn't have to update it. A query only uses it
+        if its own `WHERE` clause implies this condition, e.g. by including it in an `AND`.
+        Must be in JSON, which also requires `expressionLanguage` to be \ref kCBLJSONLanguage. */
+    FLString where;
 } CBLValueIndexConfiguration;
 
 /** Creates a value index.
@@ -308,6 +698,17 @@ typedef struct {
         If left null,  or set to an unrecognized language, no language-specific behaviors
         such as stemming and stop-word removal occur. */
     FLString language;
+
+    /** Set to true to turn off word stemming, while still removing the language's stop-words.
+        The index is then smaller and faster to search, but "big" no longer matches "bigger".
+        Defaults to false. Prefix searches like `'avoc*'` work either way. */
+    bool disableStemming;
+
+    /** Words to leave out of the index, replacing the language's default list: a string of
+        words separated by spaces. An empty string means no stop-words at all; null means the
+        language's default list. Leaving out very common words keeps the index small, and
+        speeds up ranking, which has to weigh every occurrence of each word searched for. */
+    FLString stopWords;
 } CBLFullTextIndexConfiguration;
 
 /** Creates a full-text index.
@@ -319,6 +720,31 @@ bool CBLDatabase_CreateFullTextIndex(CBLDatabase *db,
                                      CBLFullTextIndexConfiguration config,
                                      CBLError* _cbl_nullable outError) CBLAPI;
 
+/** The types of index. */
+typedef CBL_ENUM(uint8_t, CBLIndexType) {
+    kCBLValueIndex,                 ///< A value index, configured by `valueConfig`
+    kCBLFullTextIndex,              ///< A full-text index, configured by `fullTextConfig`
+};
+
+/** One of the indexes to create with \ref CBLDatabase_CreateIndexes. Only the configuration
+    matching the `type` is used. */
+typedef struct {
+    FLString name;                                  ///< The name of the index
+    CBLIndexType type;                              ///< The type of index
+    CBLValueIndexConfiguration valueConfig;         ///< The configuration of a value index
+    CBLFullTextIndexConfiguration fullTextConfig;   ///< The configuration of a full-text index
+} CBLIndexSpec;
+
+/** Creates a number of value and/or full-text indexes, in a single transaction. This is faster
+    than creating them one at a time, since the database is only committed (and synced to disk)
+    once, and a failure to create any of them leaves none of them created.
+    Each index follows the rules of \ref CBLDatabase_CreateValueIndex or
+    \ref CBLDatabase_CreateFullTextIndex about existing indexes of the same name. */
+bool CBLDatabase_CreateIndexes(CBLDatabase *db,
+                               const CBLIndexSpec specs[_cbl_nonnull],
+                               size_t count,
+                               CBLError* _cbl_nullable outError) CBLAPI;
+
 /** Deletes an index given its name. */
 bool CBLDatabase_DeleteIndex(CBLDatabase *db,
                              FLString name,
@@ -329,6 +755,90 @@ bool CBLDatabase_DeleteIndex(CBLDatabase *db,
 _cbl_warn_unused
 FLArray CBLDatabase_GetIndexNames(CBLDatabase *db) CBLAPI;
 
+/** Enables or disables counting, for each index, of the queries whose plans use it; either way,
+    the counts are reset. The counting happens when a query is compiled, and costs an
+    extra `EXPLAIN` of the query. It's off by default. */
+void CBLDatabase_SetIndexStatsEnabled(CBLDatabase *db, bool enabled) CBLAPI;
+
+/** Returns information about the indexes on this database, as a Fleece dictionary mapping each
+    index's name to a dictionary of its properties: its `name`, `type` and `expr` as stored by
+    the database and, if enabled by \ref CBLDatabase_SetIndexStatsEnabled, its `queryCount`,
+    the number of queries compiled since then that use it. An index whose count stays at zero
+    while the app runs its usual queries is probably unused, and only slowing down saves.
+    @note  You are responsible for releasing the returned Fleece dictionary. */
+_cbl_warn_unused
+FLDict CBLDatabase_GetIndexStats(CBLDatabase *db) CBLAPI;
+
+
+/** An index being created in the background by \ref CBLDatabase_CreateValueIndexAsync or
+    \ref CBLDatabase_CreateFullTextIndexAsync. */
+typedef struct CBLIndexBuild CBLIndexBuild;
+CBL_REFCOUNTED(CBLIndexBuild*, IndexBuild);
+
+/** The states of a background index build. */
+typedef CBL_ENUM(uint8_t, CBLIndexBuildState) {
+    kCBLIndexBuildPending,      ///< Not begun yet
+    kCBLIndexBuildRunning,      ///< Reading the documents and building the index
+    kCBLIndexBuildFinished,     ///< The index exists, and queries use it
+    kCBLIndexBuildFailed,       ///< The index couldn't be created; the listener gets the error
+    kCBLIndexBuildCancelled,    ///< Cancelled by \ref CBLIndexBuild_Cancel; the index doesn't exist
+};
+
+/** A callback notifying of a change of a background index build's state.
+    @warning  This is called on the background thread building the index.
+    @param context  The value given when the build was started.
+    @param build  The index build.
+    @param state  Its new state.
+    @param error  The error, if the state is \ref kCBLIndexBuildFailed; else NULL. */
+typedef void (*CBLIndexBuildListener)(void* _cbl_nullable context,
+                                      CBLIndexBuild* build,
+                                      CBLIndexBuildState state,
+                                      const CBLError* _cbl_nullable error);
+
+/** Creates a value index in the background, like \ref CBLDatabase_CreateValueIndex but without
+    holding up other uses of the database while it's built.
+
+    The build uses its own connection to the database file, so this database's lock isn't held
+    meanwhile: reads and queries go on as usual, and queries continue to run without the index
+    until it's complete. Writes do have to wait for the build to commit, since SQLite allows only
+    one writer at a time, and a write that waits longer than its busy timeout (10 seconds) fails
+    with a \ref kCBLErrorBusy error. So this is best used to index a large database that's
+    mostly read, or during a lull in writes.
+    Closing or deleting the database cancels the build, and waits for it to finish.
+    @note  You are responsible for releasing the returned object; doing so doesn't cancel it.
+    @param db  The database.
+    @param name  The name of the index.
+    @param config  The index configuration.
+    @param listener  An optional callback notified of the build's progress, on its thread.
+    @param context  An arbitrary value passed to the listener.
+    @param outError  On failure to start the build, the error is written here.
+    @return  The index build, or NULL on failure. */
+_cbl_warn_unused
+CBLIndexBuild* _cbl_nullable CBLDatabase_CreateValueIndexAsync(CBLDatabase *db,
+                                                               FLString name,
+                                                               CBLValueIndexConfiguration config,
+                                                               CBLIndexBuildListener _cbl_nullable listener,
+                                                               void* _cbl_nullable context,
+                                                               CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Creates a full-text index in the background; see \ref CBLDatabase_CreateValueIndexAsync. */
+_cbl_warn_unused
+CBLIndexBuild* _cbl_nullable CBLDatabase_CreateFullTextIndexAsync(CBLDatabase *db,
+                                                                  FLString name,
+                                                                  CBLFullTextIndexConfiguration config,
+                                                                  CBLIndexBuildListener _cbl_nullable listener,
+                                                                  void* _cbl_nullable context,
+                                                                  CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Returns the current state of a background index build. */
+CBLIndexBuildState CBLIndexBuild_State(const CBLIndexBuild*) CBLAPI;
+
+/** Cancels a background index build. If it hasn't begun, it won't; if it's running, the index is
+    deleted once it's built, since an index is built in a single step that can't be interrupted.
+    Either way the build ends in the \ref kCBLIndexBuildCancelled state, unless it already
+    finished or failed. */
+void CBLIndexBuild_Cancel(CBLIndexBuild*) CBLAPI;
+
 /** @} */
 /** @} */
 
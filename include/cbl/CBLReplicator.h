@@ -132,6 +132,30 @@ typedef const CBLDocument* _cbl_nullable (*CBLConflictResolver)(void* _cbl_nulla
 /** Default conflict resolver. This always returns `localDocument`. */
 CBL_PUBLIC extern const CBLConflictResolver CBLDefaultConflictResolver;
 
+/** A callback reporting the progress of \ref CBLDatabase_ResolveAllConflicts. It's called after
+    each chunk of conflicted documents has been resolved and saved.
+    @param context  The context given to \ref CBLDatabase_ResolveAllConflicts.
+    @param processed  The number of conflicted documents processed so far.
+    @param failed  The number of those that couldn't be resolved. */
+typedef void (*CBLConflictSweepProgress)(void* _cbl_nullable context,
+                                         uint64_t processed,
+                                         uint64_t failed);
+
+/** Resolves every unresolved conflict in the database, such as those left behind when a
+    replicator stopped before its conflict resolvers finished. Conflicted documents are
+    processed in chunks, and each chunk's resolutions are saved in a single transaction.
+    @param db  The database.
+    @param resolver  The conflict resolver to use, or NULL for the default resolver.
+    @param context  Value passed to the resolver and the progress callback.
+    @param progress  Optional callback to report progress.
+    @param outError  On failure, the error (of the first failed document) will be written here.
+    @return  True if all conflicts were resolved, false if any failed. */
+bool CBLDatabase_ResolveAllConflicts(CBLDatabase* db,
+                                     CBLConflictResolver _cbl_nullable resolver,
+                                     void* _cbl_nullable context,
+                                     CBLConflictSweepProgress _cbl_nullable progress,
+                                     CBLError* _cbl_nullable outError) CBLAPI;
+
 
 /** Types of proxy servers, for CBLProxySettings. */
 typedef CBL_ENUM(uint8_t, CBLProxyType) {
@@ -181,6 +205,43 @@ typedef FLSliceResult (*CBLPropertyDecryptor) (
     CBLError* error             ///< On return: error (Optional)
 );
 
+/** One property passed to a \ref CBLPropertyBatchEncryptor or \ref CBLPropertyBatchDecryptor. */
+typedef struct {
+    FLString keyPath;           ///< Key path of the property
+    FLSlice input;              ///< Property data to be encrypted or decrypted
+    FLString algorithm;         ///< Decryption only: algorithm name
+    FLString kid;               ///< Decryption only: encryption key identifier, if any
+    FLSliceResult output;       ///< On return: the encrypted or decrypted data
+} CBLCryptoProperty;
+
+/** Callback that encrypts all the \ref CBLEncryptable properties of a pushed document at once,
+    so that a key can be fetched once per document and the work spread across the properties.
+    Set each property's `output`; the same algorithm and key ID are used for all of them.
+    \note   A null `output`, or returning false, fails the document with \ref kCBLErrorCrypto,
+            as with \ref CBLPropertyEncryptor. */
+typedef bool (*CBLPropertyBatchEncryptor) (
+    void* context,              ///< Replicator’s context
+    FLString documentID,        ///< Document ID
+    FLDict properties,          ///< Document properties
+    unsigned count,             ///< Number of properties to encrypt
+    CBLCryptoProperty* props,   ///< The properties to encrypt
+    FLStringResult* algorithm,  ///< On return: algorithm name (Optional: Default Value is 'CB_MOBILE_CUSTOM')
+    FLStringResult* kid,        ///< On return: encryption key identifier (Optional)
+    CBLError* error             ///< On return: error (Optional)
+);
+
+/** Callback that decrypts all the encrypted properties of a pulled document at once.
+    Set each property's `output`; a null `output` skips decrypting that property, as with
+    \ref CBLPropertyDecryptor. Returning false fails the document with \ref kCBLErrorCrypto. */
+typedef bool (*CBLPropertyBatchDecryptor) (
+    void* context,              ///< Replicator’s context
+    FLString documentID,        ///< Document ID
+    FLDict properties,          ///< Document properties
+    unsigned count,             ///< Number of properties to decrypt
+    CBLCryptoProperty* props,   ///< The properties to decrypt
+    CBLError* error             ///< On return: error (Optional)
+);
+
 #endif
 
 /** The configuration of a replicator. */
@@ -218,13 +279,32 @@ typedef struct {
     FLArray _cbl_nullable documentIDs;                ///< Optional set of document IDs to replicate
     CBLReplicationFilter _cbl_nullable pushFilter;    ///< Optional callback to filter which docs are pushed
     CBLReplicationFilter _cbl_nullable pullFilter;    ///< Optional callback to validate incoming docs
+    FLString pushFilterExpression;      ///< Optional JSON query expression docs must match to be pushed
+    FLString pullFilterExpression;      ///< Optional JSON query expression incoming docs must match
+                                        ///< The expressions are evaluated directly against the revision bodies,
+                                        ///< before the corresponding filter callback (if any) is called.
     CBLConflictResolver _cbl_nullable conflictResolver;///< Optional conflict-resolver callback
     void* _cbl_nullable context;                      ///< Arbitrary value that will be passed to callbacks
+    //-- Conflict Resolution:
+    unsigned maxConflictResolvers;      ///< Max number of conflicts resolved concurrently. Specify 0 to use the default value of 2.
+    unsigned conflictResolverBatchSize; ///< Max number of conflicts a resolver task takes at once. Specify 0 to use the default value of 64.
+                                        ///< Conflicts resolved by the default resolver are saved in one transaction per batch.
+    //-- Document Events:
+    unsigned documentEventsFlushInterval; ///< Milliseconds to buffer events for document replication listeners before
+                                          ///< delivering them as one batch. Specify 0 to deliver them as they happen.
+    //-- Compression:
+    int compressionLevel;               ///< Message compression level, from 1 (fastest) to 9 (smallest). Specify 0 to use the default,
+                                        ///< or -1 to disable compression.
+                                        ///< (Batch sizes can't be configured, since LiteCore's replicator has no options for them.)
     
 #ifdef COUCHBASE_ENTERPRISE
     //-- Property Encryption
     CBLPropertyEncryptor propertyEncryptor;           ///< Optional callback to encrypt \ref CBLEncryptable values.
     CBLPropertyDecryptor propertyDecryptor;           ///< Optional callback to decrypt encrypted \ref CBLEncryptable values.
+    CBLPropertyBatchEncryptor propertyBatchEncryptor; ///< Optional callback to encrypt all of a document's \ref CBLEncryptable
+                                                      ///< values at once. If set, it's used instead of `propertyEncryptor`.
+    CBLPropertyBatchDecryptor propertyBatchDecryptor; ///< Optional callback to decrypt all of a document's encrypted values
+                                                      ///< at once. If set, it's used instead of `propertyDecryptor`.
 #endif
 
 } CBLReplicatorConfiguration;
@@ -341,6 +421,68 @@ bool CBLReplicator_IsDocumentPending(CBLReplicator *repl,
                                      FLString docID,
                                      CBLError* _cbl_nullable outError) CBLAPI;
 
+/** Returns the number of documents with local changes that have not yet been pushed to the
+    server by this replicator. This is much cheaper than counting the result of
+    \ref CBLReplicator_PendingDocumentIDs, and repeated calls are nearly free while nothing
+    has changed (no local saves and no push progress.)
+
+    \note  A zero result means there are no pending documents, _or_ there was an error.
+           To tell the difference, compare the error code to zero. */
+uint64_t CBLReplicator_PendingDocumentCount(CBLReplicator *repl,
+                                            CBLError* _cbl_nullable outError) CBLAPI;
+
+/** Returns a page of the IDs of the documents with local changes that have not yet been
+    pushed. Pages come from the same snapshot as \ref CBLReplicator_PendingDocumentCount, so
+    paging through them with increasing offsets is cheap, and consistent as long as nothing
+    changes in between.
+    @param repl  The replicator.
+    @param offset  The index of the first ID to return.
+    @param limit  The maximum number of IDs to return.
+    @param outError  On failure, the error will be written here.
+    @return  An array of document IDs, empty if `offset` is beyond the end; or NULL on error.
+    \warning  You are responsible for releasing the returned array via \ref FLValue_Release. */
+_cbl_warn_unused
+FLArray _cbl_nullable CBLReplicator_PendingDocumentIDsPage(CBLReplicator *repl,
+                                                           uint64_t offset,
+                                                           unsigned limit,
+                                                           CBLError* _cbl_nullable outError) CBLAPI;
+
+
+/** The number of buckets in \ref CBLReplicatorMetrics.revsPerBatch. */
+#define kCBLReplicatorBatchSizeBuckets 6
+
+/** Cumulative throughput and latency metrics of a replicator, since it was created.
+    Times are totals of wall-clock time spent in the callbacks and conflict resolvers. */
+typedef struct {
+    double   runningSeconds;            ///< Total time the replicator has been running
+    uint64_t documentsPushed;           ///< Documents pushed successfully
+    uint64_t documentsPulled;           ///< Documents pulled successfully
+    double   documentsPushedPerSecond;  ///< documentsPushed / runningSeconds
+    double   documentsPulledPerSecond;  ///< documentsPulled / runningSeconds
+    uint64_t bytesTransferred;          ///< Approximate bytes transferred, in either direction
+    double   bytesPerSecond;            ///< bytesTransferred / runningSeconds
+    /** Histogram of the number of revisions the replicator reported at once. Bucket `i`
+        counts batches of at least 4^i revisions and less than 4^(i+1); the last bucket
+        counts all larger batches. */
+    uint64_t revsPerBatch[kCBLReplicatorBatchSizeBuckets];
+    uint64_t filterCalls;               ///< Push/pull filter calls (expressions and callbacks)
+    double   filterSeconds;             ///< Time spent in push/pull filters
+    uint64_t encryptorCalls;            ///< Property encryptor calls (EE)
+    double   encryptorSeconds;          ///< Time spent in the property encryptor (EE)
+    uint64_t decryptorCalls;            ///< Property decryptor calls (EE)
+    double   decryptorSeconds;          ///< Time spent in the property decryptor (EE)
+    uint64_t conflictsResolved;         ///< Conflicts resolved (successfully or not)
+    double   conflictResolverSeconds;   ///< Time spent resolving conflicts
+    uint64_t pendingDocumentCount;      ///< Local documents waiting to be pushed
+    uint64_t reconnectCount;            ///< Times the replicator reconnected after losing its connection
+} CBLReplicatorMetrics;
+
+/** Returns the replicator's metrics.
+    \note  The first call enables per-document progress reporting inside the replicator, which
+           is needed to count documents per direction; documents replicated before then
+           are only counted in `bytesTransferred`. */
+CBLReplicatorMetrics CBLReplicator_Metrics(CBLReplicator*) CBLAPI;
+
 
 /** A callback that notifies you when the replicator's status changes.
     @warning  This callback will be called on a background thread managed by the replicator.
@@ -389,6 +531,58 @@ CBLReplicator_AddDocumentReplicationListener(CBLReplicator*,
                                              void* _cbl_nullable context) CBLAPI;
 
 /** @} */
+
+
+
+/** \name  Replicator Groups
+    @{
+    A replicator group schedules several replicators, for example ones partitioned by channel
+    against the same server, so that they don't all compete for the database and the network at
+    once. At most `maxActive` members of a group are connecting or busy at the same time; members
+    with a higher priority get a slot first. A member that's idle or offline doesn't use a slot.
+    If a member becomes busy while all slots are held by lower-priority members, the
+    lowest-priority one is suspended (see \ref CBLReplicator_SetSuspended) until a slot frees up.
+
+    \note  Each member still has its own connection to the remote endpoint.
+ */
+
+/** Schedules a set of replicators. (In the public API, an opaque type.) */
+typedef struct CBLReplicatorGroup CBLReplicatorGroup;
+
+CBL_REFCOUNTED(CBLReplicatorGroup*, ReplicatorGroup);
+
+/** Creates an empty replicator group.
+    @param maxActive  The maximum number of members that may be connecting or busy at once,
+                      or 0 for no limit. */
+_cbl_warn_unused
+CBLReplicatorGroup* CBLReplicatorGroup_Create(unsigned maxActive) CBLAPI;
+
+/** Adds a replicator to a group. If the group has been started, the replicator will be started
+    as soon as it gets a slot. Does nothing if the replicator is already a member.
+    @param group  The replicator group.
+    @param replicator  The replicator. It should not be started or stopped directly while it's
+                       a member of the group.
+    @param priority  The replicator's priority; higher values are scheduled first. */
+void CBLReplicatorGroup_Add(CBLReplicatorGroup* group,
+                            CBLReplicator* replicator,
+                            int priority) CBLAPI;
+
+/** Removes a replicator from a group, without stopping it. */
+void CBLReplicatorGroup_Remove(CBLReplicatorGroup*, CBLReplicator*) CBLAPI;
+
+/** Starts the group's replicators, in priority order, as slots become available. Members that
+    have stopped since the group was last started are started again.
+    @param group  The replicator group.
+    @param resetCheckpoint  Passed to \ref CBLReplicator_Start for each member. */
+void CBLReplicatorGroup_Start(CBLReplicatorGroup* group, bool resetCheckpoint) CBLAPI;
+
+/** Stops all the group's replicators, asynchronously, and starts no new ones. */
+void CBLReplicatorGroup_Stop(CBLReplicatorGroup*) CBLAPI;
+
+/** Returns the number of members currently holding a slot, i.e. connecting or busy. */
+unsigned CBLReplicatorGroup_ActiveCount(CBLReplicatorGroup*) CBLAPI;
+
+/** @} */
 /** @} */
 
 CBL_CAPI_END
@@ -0,0 +1,97 @@
+//
+// CBLAsync_Internal.hh
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "CBLLog_Internal.hh"
+#include "c4Base.h"
+#include "Internal.hh"
+#include <deque>
+#include <functional>
+#include <mutex>
+
+CBL_ASSUME_NONNULL_BEGIN
+
+namespace cbl_internal {
+
+    /** Runs a database's asynchronous operations on LiteCore's task pool. Writes go through a
+        single queue, one at a time and in order, since they'd only contend for the database lock
+        anyway; reads get a few workers of their own, so a burst of them can't take over the pool
+        or make the writes wait. */
+    class AsyncExecutor : public fleece::RefCounted {
+    public:
+        using Task = std::function<void()>;
+
+        static constexpr unsigned kMaxReadWorkers = 2;
+
+        /// Queues a task. Tasks shouldn't throw; if one does, the exception is logged.
+        void submit(bool isWrite, Task task) {
+            Queue &queue = isWrite ? _writes : _reads;
+            LOCK(_mutex);
+            queue.tasks.push_back(std::move(task));
+            if (queue.activeWorkers < queue.maxWorkers) {
+                ++queue.activeWorkers;
+                retain(this);       // released at the end of drain()
+                if (isWrite)
+                    c4_runAsyncTask([](void *c) {auto e = (AsyncExecutor*)c; e->drain(e->_writes);},
+                                    this);
+                else
+                    c4_runAsyncTask([](void *c) {auto e = (AsyncExecutor*)c; e->drain(e->_reads);},
+                                    this);
+            }
+        }
+
+    private:
+        struct Queue {
+            explicit Queue(unsigned max)    :maxWorkers(max) { }
+            unsigned const      maxWorkers;
+            unsigned            activeWorkers {0};
+            std::deque<Task>    tasks;
+        };
+
+        void drain(Queue &queue) noexcept {
+            while (true) {
+                Task task;
+                {
+                    LOCK(_mutex);
+                    if (queue.tasks.empty()) {
+                        --queue.activeWorkers;
+                        break;
+                    }
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                try {
+                    task();
+                } catch (...) {
+                    C4Error error = C4Error::fromCurrentException();
+                    CBL_Log(kCBLLogDomainDatabase, kCBLLogWarning,
+                            "Asynchronous database operation threw an exception: %s",
+                            error.description().c_str());
+                }
+            }
+            release(this);
+        }
+
+        std::mutex  _mutex;
+        Queue       _writes {1};
+        Queue       _reads {kMaxReadWorkers};
+    };
+
+}
+
+CBL_ASSUME_NONNULL_END
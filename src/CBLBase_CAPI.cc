@@ -20,7 +20,10 @@
 #include "CBLPrivate.h"
 #include "Internal.hh"
 #include "Listener.hh"
+#include <atomic>
 #include <iostream>
+#include <new>
+#include <thread>
 
 
 static_assert(sizeof(CBLError) == sizeof(C4Error));
@@ -56,6 +59,84 @@ void CBL_Release(CBLRefCounted *self) noexcept {
 }
 
 
+namespace cbl_internal {
+    // Whether the allocator can still be changed. CBL_SetAllocator and the first allocation
+    // each make one atomic transition, so an object can't be allocated while it's changing.
+    enum AllocatorState : uint8_t {
+        kAllocatorUnused,       // No objects allocated yet
+        kAllocatorChanging,     // CBL_SetAllocator is storing the allocator
+        kAllocatorInUse,        // Objects have been allocated; the allocator is fixed
+    };
+
+    static CBLAllocator                     sAllocatorStorage;
+    static const CBLAllocator*              sAllocator {nullptr};   // Guarded by sAllocatorState
+    static std::atomic<uint8_t>             sAllocatorState {kAllocatorUnused};
+
+    // Fixes the allocator before the first object is allocated, waiting if CBL_SetAllocator
+    // is in the middle of changing it.
+    static void fixAllocator() {
+        uint8_t state = sAllocatorState.load(std::memory_order_acquire);
+        while (state != kAllocatorInUse) {
+            if (state == kAllocatorChanging) {
+                std::this_thread::yield();
+                state = sAllocatorState.load(std::memory_order_acquire);
+            } else {
+                sAllocatorState.compare_exchange_weak(state, kAllocatorInUse,
+                                                      std::memory_order_acq_rel,
+                                                      std::memory_order_acquire);
+            }
+        }
+    }
+
+    void* allocateObject(size_t size) {
+        if (_usuallyFalse(sAllocatorState.load(std::memory_order_acquire) != kAllocatorInUse))
+            fixAllocator();
+        const CBLAllocator *allocator = sAllocator;
+        if (!allocator)
+            return ::operator new(size);
+        void *ptr = allocator->allocate(allocator->context, size);
+        if (!ptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+
+    void deallocateObject(void *ptr, size_t size) noexcept {
+        // The allocator can't have changed since the object was allocated:
+        const CBLAllocator *allocator = sAllocator;
+        if (!allocator)
+            ::operator delete(ptr);
+        else
+            allocator->deallocate(allocator->context, ptr, size);
+    }
+
+    static bool setAllocator(const CBLAllocator* _cbl_nullable allocator) {
+        uint8_t state = kAllocatorUnused;
+        while (!sAllocatorState.compare_exchange_weak(state, kAllocatorChanging,
+                                                      std::memory_order_acquire,
+                                                      std::memory_order_relaxed)) {
+            if (state == kAllocatorInUse)
+                return false;
+            if (state == kAllocatorChanging)
+                std::this_thread::yield();      // Another thread is setting it
+            state = kAllocatorUnused;
+        }
+        if (allocator) {
+            sAllocatorStorage = *allocator;
+            sAllocator = &sAllocatorStorage;
+        } else {
+            sAllocator = nullptr;
+        }
+        sAllocatorState.store(kAllocatorUnused, std::memory_order_release);
+        return true;
+    }
+}
+
+
+bool CBL_SetAllocator(const CBLAllocator* allocator) noexcept {
+    return cbl_internal::setAllocator(allocator);
+}
+
+
 unsigned CBL_InstanceCount() noexcept {
     return fleece::InstanceCounted::liveInstanceCount();
 }
@@ -0,0 +1,224 @@
+//
+// CBLBlobStore_Internal.hh
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "CBLDatabase_Internal.hh"
+#include "c4BlobStore.hh"
+#include "c4DocEnumerator.hh"
+#include "Internal.hh"
+#include "FilePath.hh"
+#include "function_ref.hh"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+CBL_ASSUME_NONNULL_BEGIN
+
+namespace cbl_internal {
+
+    // A file in a database's blob store.
+    struct BlobFile {
+        std::string digest;         // Digest string, i.e. "sha1-" plus base64
+        uint64_t    size;
+    };
+
+
+    // Lists the files in a database's blob store. LiteCore names each file after the base64
+    // digest of its content, with '/' changed to '_', plus ".blob".
+    static inline std::vector<BlobFile> listBlobFiles(const CBLDatabase *db) {
+        std::vector<BlobFile> files;
+        litecore::FilePath dir = litecore::FilePath(std::string(db->path()), "")
+                                                        .subdirectoryNamed("Attachments");
+        if (!dir.existsAsDir())
+            return files;           // No blobs have ever been saved
+        const slice kExtension = ".blob"_sl;
+        dir.forEachFile([&](const litecore::FilePath &file) {
+            std::string fileName = file.fileName();
+            slice name(fileName);
+            if (!name.hasSuffix(kExtension))
+                return;
+            int64_t size;
+            try {
+                size = file.dataSize();
+            } catch (...) {
+                return;             // Deleted meanwhile
+            }
+            if (size < 0)
+                return;
+            std::string digest = "sha1-" + std::string(name.upTo(name.size - kExtension.size));
+            std::replace(digest.begin(), digest.end(), '_', '/');
+            files.push_back({std::move(digest), uint64_t(size)});
+        });
+        return files;
+    }
+
+
+    // Calls `callback` with the digest of every blob referenced in a document body, including
+    // legacy `_attachments`.
+    static inline void forEachBlobReference(Value value,
+                                            fleece::function_ref<void(slice digest)> callback,
+                                            bool isAttachment = false)
+    {
+        if (Dict dict = value.asDict(); dict) {
+            if (isAttachment || C4Blob::isBlob(dict)) {
+                if (slice digest = dict[kCBLBlobDigestProperty].asString(); digest) {
+                    callback(digest);
+                    return;
+                }
+            }
+            for (Dict::iterator i(dict); i; ++i) {
+                if (Dict attachments = i.value().asDict();
+                        attachments && i.keyString() == "_attachments"_sl) {
+                    for (Dict::iterator a(attachments); a; ++a)
+                        forEachBlobReference(a.value(), callback, true);
+                } else {
+                    forEachBlobReference(i.value(), callback);
+                }
+            }
+        } else if (Array array = value.asArray(); array) {
+            for (Array::iterator i(array); i; ++i)
+                forEachBlobReference(i.value(), callback);
+        }
+    }
+
+
+    // Calls `callback` for the blobs referenced by every stored revision of a document.
+    static inline void forEachBlobReference(C4Document *c4doc,
+                                            fleece::function_ref<void(slice digest)> callback)
+    {
+        do {
+            if (c4doc->loadRevisionBody())
+                forEachBlobReference(Dict(c4doc->getProperties()), callback);
+        } while (c4doc->selectNextRevision());
+    }
+
+}
+
+
+/** An incremental mark-and-sweep collector of the blobs no document revision refers to.
+    It first scans the documents a batch at a time, noting the blobs they use, then deletes
+    the others a batch at a time. Only blobs that existed when it started are candidates; and
+    before each batch of deletions it rescans the documents changed since it last looked, so a
+    blob that one of them started using is kept. */
+struct CBLBlobGC final : public CBLRefCounted {
+public:
+    explicit CBLBlobGC(CBLDatabase *db)
+    :_db(db)
+    {
+        _markedSequence = _db->useLocked()->getLastSequence();
+        _candidates = cbl_internal::listBlobFiles(db);
+        _progress.blobsFound = _candidates.size();
+    }
+
+    /// Performs up to `batchSize` units of work (documents scanned or blobs considered for
+    /// deletion.) Returns false when there's nothing left to do.
+    bool step(unsigned batchSize) {
+        if (_progress.done)
+            return false;
+        if (!_marked)
+            mark(batchSize);
+        else
+            sweep(batchSize);
+        return !_progress.done;
+    }
+
+    CBLBlobGCProgress progress() const          {return _progress;}
+
+protected:
+    ~CBLBlobGC() {
+        if (_enum)
+            _db->useLocked([&](C4Database*) { _enum = nullptr; });
+    }
+
+private:
+    void markDoc(C4Database *c4db, slice docID) {
+        Retained<C4Document> c4doc = c4db->getDocument(docID, false, kDocGetAll);
+        if (c4doc)
+            cbl_internal::forEachBlobReference(c4doc, [&](slice digest) {
+                _reachable.insert(std::string(digest));
+            });
+        ++_progress.docsScanned;
+    }
+
+    // Scans the next batch of documents.
+    void mark(unsigned batchSize) {
+        try {
+            _db->useLocked([&](C4Database *c4db) {
+                if (!_enum)
+                    _enum = std::make_unique<C4DocEnumerator>(c4db, C4EnumeratorOptions{
+                                                    kC4IncludeNonConflicted | kC4IncludeDeleted});
+                for (unsigned n = 0; n < batchSize; ++n) {
+                    if (!_enum->next()) {
+                        _enum = nullptr;
+                        _marked = true;
+                        break;
+                    }
+                    markDoc(c4db, _enum->documentInfo().docID);
+                }
+            });
+        } catch (...) {
+            _db->useLocked([&](C4Database*) { _enum = nullptr; });
+            throw;
+        }
+    }
+
+    // Catches up with changed documents, then deletes the next batch of unused blobs. This
+    // holds the blob GC lock, so no save on any handle can be between installing its new blobs
+    // early and committing; and a transaction, so none can be installing them in its own.
+    void sweep(unsigned batchSize) {
+        auto gc = _db->lockBlobGC();    // Keeps saves from installing blobs not yet referenced
+        _db->useLocked([&](C4Database *c4db) {
+            C4Database::Transaction t(c4db);
+            C4EnumeratorOptions options {kC4IncludeNonConflicted | kC4IncludeDeleted};
+            C4DocEnumerator e(c4db, _markedSequence, options);
+            while (e.next()) {
+                C4DocumentInfo info = e.documentInfo();
+                markDoc(c4db, info.docID);
+                _markedSequence = info.sequence;
+            }
+
+            C4BlobStore &store = c4db->getBlobStore();
+            for (unsigned n = 0; n < batchSize && _next < _candidates.size(); ++n, ++_next) {
+                auto &file = _candidates[_next];
+                if (_reachable.count(file.digest))
+                    continue;
+                if (auto key = C4BlobKey::withDigestString(file.digest); key) {
+                    store.deleteBlob(*key);
+                    ++_progress.blobsDeleted;
+                    _progress.bytesFreed += file.size;
+                }
+            }
+            if (_next >= _candidates.size())
+                _progress.done = true;
+            t.commit();     // (Nothing was written)
+        });
+    }
+
+    Retained<CBLDatabase>                   _db;
+    std::vector<cbl_internal::BlobFile>     _candidates;        // Blobs that existed at start
+    size_t                                  _next {0};          // Next candidate to sweep
+    std::unordered_set<std::string>         _reachable;         // Digests of blobs in use
+    C4SequenceNumber                        _markedSequence;    // Docs up to here are marked
+    std::unique_ptr<C4DocEnumerator>        _enum;              // Used while marking
+    bool                                    _marked {false};
+    CBLBlobGCProgress                       _progress {};
+};
+
+CBL_ASSUME_NONNULL_END
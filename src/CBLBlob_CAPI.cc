@@ -17,6 +17,14 @@
 //
 
 #include "CBLBlob_Internal.hh"
+#include "CBLBlobStore_Internal.hh"
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 using namespace fleece;
@@ -48,12 +56,56 @@ FLString CBLBlob_Digest(const CBLBlob* blob) noexcept {
     return blob->digest();
 }
 
+CBLBlobCacheStats CBLDatabase_BlobCacheStats(const CBLDatabase* db) noexcept {
+    return db->blobCacheStats();
+}
+
+bool CBLDatabase_GetBlobStoreStats(const CBLDatabase* db,
+                                   CBLBlobStoreStats* outStats,
+                                   CBLBlobSize* outLargest,
+                                   size_t maxLargest,
+                                   CBLError* outError) noexcept
+{
+    try {
+        *outStats = db->blobStoreStats(outLargest, maxLargest);
+        return true;
+    } catchAndBridge(outError)
+}
+
+CBLBlobGC* CBLDatabase_NewBlobGC(CBLDatabase* db, CBLError* outError) noexcept {
+    try {
+        return retain(new CBLBlobGC(db));
+    } catchAndBridge(outError)
+}
+
+bool CBLBlobGC_Step(CBLBlobGC* gc, unsigned batchSize, CBLError* outError) noexcept {
+    try {
+        if (outError)
+            outError->code = 0;
+        return gc->step(batchSize ? batchSize : 100);
+    } catchAndBridge(outError)
+}
+
+CBLBlobGCProgress CBLBlobGC_Progress(const CBLBlobGC* gc) noexcept {
+    return gc->progress();
+}
+
 FLSliceResult CBLBlob_Content(const CBLBlob* blob, CBLError *outError) noexcept {
     try {
         return FLSliceResult(blob->content());
     } catchAndBridge(outError)
 }
 
+FLSliceResult CBLBlob_ReadRange(const CBLBlob* blob,
+                                uint64_t offset,
+                                uint64_t length,
+                                CBLError *outError) noexcept
+{
+    try {
+        return FLSliceResult(blob->readRange(offset, length));
+    } catchAndBridge(outError)
+}
+
 CBLBlobReadStream* CBLBlob_OpenContentStream(const CBLBlob* blob, CBLError *outError) noexcept {
     try {
         return blob->openContentStream().release();
@@ -70,15 +122,108 @@ int CBLBlobReader_Read(CBLBlobReadStream* stream,
     } catchAndBridgeReturning(outError, -1)
 }
 
+bool CBLBlobReader_Seek(CBLBlobReadStream* stream,
+                        uint64_t offset,
+                        CBLError *outError) noexcept
+{
+    try {
+        if (int64_t(offset) > stream->getLength())
+            C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter,
+                           "Can't seek past the end of the blob");
+        stream->seek(int64_t(offset));
+        return true;
+    } catchAndBridge(outError)
+}
+
+int64_t CBLBlobReader_Length(CBLBlobReadStream* stream, CBLError *outError) noexcept {
+    try {
+        return stream->getLength();
+    } catchAndBridgeReturning(outError, -1)
+}
+
 void CBLBlobReader_Close(CBLBlobReadStream* stream) noexcept {
     delete stream;
 }
 
+CBLBlobContentMap* CBLBlob_MapContent(const CBLBlob* blob, CBLError *outError) noexcept {
+    try {
+        return new CBLBlobContentMap(*blob);
+    } catchAndBridge(outError)
+}
+
+FLSlice CBLBlobContentMap_Content(const CBLBlobContentMap* map) noexcept {
+    return map->content();
+}
+
+bool CBLBlobContentMap_IsMapped(const CBLBlobContentMap* map) noexcept {
+    return map->isMapped();
+}
+
+int CBLBlobContentMap_FileDescriptor(const CBLBlobContentMap* map) noexcept {
+    return map->fileDescriptor();
+}
+
+void CBLBlobContentMap_Close(CBLBlobContentMap* map) noexcept {
+    delete map;
+}
+
 bool CBLBlob_Equals(CBLBlob* blob, CBLBlob* anotherBlob) noexcept {
     return FLSlice_Equal(blob->digest(), anotherBlob->digest());
 }
 
 
+#pragma mark - MAPPING BLOBS:
+
+
+CBLBlobContentMap::CBLBlobContentMap(const CBLBlob &blob) {
+#ifndef _WIN32
+    if (blob.database()) {
+        alloc_slice path;
+        try {
+            path = blob.blobStore()->getFilePath(blob.key());
+        } catch (...) {
+            // An encrypted blob's file is unreadable, and some blobs may not be in a file;
+            // those fall back to reading the content into memory:
+            C4Error err = C4Error::fromCurrentException();
+            if (!(err == C4Error{LiteCoreDomain, kC4ErrorWrongFormat})
+                    && !(err == C4Error{LiteCoreDomain, kC4ErrorUnsupported}))
+                throw;
+        }
+        if (path) {
+            _fd = ::open(string(path).c_str(), O_RDONLY | O_CLOEXEC);
+            if (_fd < 0)
+                C4Error::raise(POSIXDomain, errno, "Couldn't open blob file");
+            struct stat st;
+            if (::fstat(_fd, &st) == 0) {
+                _mappedSize = size_t(st.st_size);
+                if (_mappedSize == 0)
+                    return;
+                void *addr = ::mmap(nullptr, _mappedSize, PROT_READ, MAP_PRIVATE, _fd, 0);
+                if (addr != MAP_FAILED) {
+                    _mapped = addr;
+                    return;
+                }
+            }
+            int err = errno;
+            ::close(_fd);
+            C4Error::raise(POSIXDomain, err, "Couldn't map blob file");
+        }
+    }
+#endif
+    _content = blob.content();
+}
+
+
+CBLBlobContentMap::~CBLBlobContentMap() {
+#ifndef _WIN32
+    if (_mapped)
+        ::munmap(_mapped, _mappedSize);
+    if (_fd >= 0)
+        ::close(_fd);
+#endif
+}
+
+
 #pragma mark - CREATING BLOBS:
 
 
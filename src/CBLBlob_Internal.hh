@@ -27,6 +27,7 @@
 #include "c4Document.hh"
 #include "fleece/Fleece.hh"
 #include "fleece/Mutable.hh"
+#include <algorithm>
 #include <mutex>
 #include "betterassert.hh"
 
@@ -42,7 +43,10 @@ public:
 
     Dict properties() const                                 {return _properties.asDict();}
 
-    virtual alloc_slice content() const                     {return blobStore()->getContents(_key);}
+    virtual alloc_slice content() const {
+        if (!_db) C4Error::raise(LiteCoreDomain, kC4ErrorNotFound, "Unsaved blob");
+        return _db->getBlobContents(_key);
+    }
 
     virtual void install(CBLDatabase *db) {
         C4Error::raise(LiteCoreDomain, kC4ErrorUnsupported, "No support for re-installing blob getting from database.");
@@ -50,6 +54,9 @@ public:
     
     inline std::unique_ptr<CBLBlobReadStream> openContentStream() const;
 
+    /// Reads up to `length` bytes of the content starting at `offset`, seeking past the rest.
+    virtual inline alloc_slice readRange(uint64_t offset, uint64_t length) const;
+
     alloc_slice createJSON() const {
         if (!_properties)
             return fleece::nullslice;
@@ -135,8 +142,20 @@ protected:
         return _db->blobStore();
     }
 
+    // Clips a range to content of size `size`; if `content` is given, returns that part of it.
+    static slice rangeOf(uint64_t size, uint64_t offset, uint64_t &length,
+                         slice content = fleece::nullslice)
+    {
+        if (offset > size)
+            C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter,
+                           "Offset %llu is past the end of the blob", (unsigned long long)offset);
+        length = std::min(length, size - offset);
+        return content ? slice(content.offset(size_t(offset)), size_t(length)) : slice();
+    }
+
 private:
     friend struct CBLBlobReadStream;
+    friend struct CBLBlobContentMap;
 
     fleece::RetainedValue const       _properties;
     C4BlobKey                         _key;
@@ -166,7 +185,17 @@ public:
         return CBLBlob::content();
     }
 
+    virtual alloc_slice readRange(uint64_t offset, uint64_t length) const override {
+        {
+            LOCK(_mutex);
+            if (_content)
+                return alloc_slice(rangeOf(_content.size, offset, length, _content));
+        }
+        return CBLBlob::readRange(offset, length);
+    }
+
     virtual void install(CBLDatabase *db) override {
+        cbl_internal::TraceSpan span(kCBLTraceBlobInstall, digest());
         {
             LOCK(_mutex);
             CBL_Log(kCBLLogDomainDatabase, kCBLLogInfo, "Saving new blob '%.*s'", FMTSLICE(digest()));
@@ -211,11 +240,51 @@ struct CBLBlobReadStream {
     size_t read(void *buffer, size_t maxBytes)  {return _c4stream.read(buffer, maxBytes);}
     int64_t getLength() const                   {return _c4stream.getLength();}
     void seek(int64_t pos)                      {return _c4stream.seek(pos);}
+
+    // Reads until `size` bytes have been read or the end is reached; returns the count read.
+    size_t readFully(void *buffer, size_t size) {
+        size_t total = 0;
+        while (total < size) {
+            size_t n = read((uint8_t*)buffer + total, size - total);
+            if (n == 0)
+                break;
+            total += n;
+        }
+        return total;
+    }
 private:
     C4ReadStream _c4stream;
 };
 
 
+inline alloc_slice CBLBlob::readRange(uint64_t offset, uint64_t length) const {
+    CBLBlobReadStream stream(*this);
+    rangeOf(uint64_t(stream.getLength()), offset, length);
+    alloc_slice result(size_t(length));
+    if (length > 0) {
+        stream.seek(int64_t(offset));
+        result.shorten(stream.readFully((void*)result.buf, result.size));
+    }
+    return result;
+}
+
+
+
+struct CBLBlobContentMap {
+    explicit CBLBlobContentMap(const CBLBlob &blob);
+    ~CBLBlobContentMap();
+    slice content() const                       {return _mapped ? slice(_mapped, _mappedSize)
+                                                                : slice(_content);}
+    bool isMapped() const                       {return _mapped != nullptr;}
+    int fileDescriptor() const                  {return _fd;}
+private:
+    alloc_slice           _content;             // Content read into memory, if not mapped
+    void* _cbl_nullable   _mapped {nullptr};    // Address of mapped file
+    size_t                _mappedSize {0};
+    int                   _fd {-1};             // Blob file, if it's accessible
+};
+
+
 
 struct CBLBlobWriteStream {
     CBLBlobWriteStream(CBLDatabase *db)         :_c4stream(*db->blobStore()) { }
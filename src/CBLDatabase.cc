@@ -18,20 +18,46 @@
 
 #include "CBLDatabase_Internal.hh"
 #include "CBLBlob_Internal.hh"
+#include "CBLBlobStore_Internal.hh"
 #include "CBLDocument_Internal.hh"
 #include "CBLQuery_Internal.hh"
 #include "CBLPrivate.h"
+#include "c4DocEnumerator.hh"
 #include "c4Observer.hh"
 #include "c4Query.hh"
 #include "Internal.hh"
 #include "function_ref.hh"
 #include "PlatformCompat.hh"
+#include "Stopwatch.hh"
+#include "Timer.hh"
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <thread>
+#include <unordered_set>
 #include <sys/stat.h>
 
 #ifndef CMAKE
 #include <unistd.h>
 #endif
 
+#ifndef _MSC_VER
+#include <dirent.h>
+#include <fcntl.h>
+#include <random>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#elif defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#endif
+
 using namespace std;
 using namespace fleece;
 using namespace cbl_internal;
@@ -54,13 +80,821 @@ std::string CBLDatabase::defaultDirectory() {
 static_assert(sizeof(CBLEncryptionKey::bytes) == sizeof(C4EncryptionKey::bytes),
               "C4EncryptionKey and CBLEncryptionKey size do not match");
 
+// Zeroes memory; writing through a volatile pointer keeps the compiler from eliding the stores.
+static void secureZero(void *buf, size_t size) {
+    volatile uint8_t *bytes = (volatile uint8_t*)buf;
+    for (size_t i = 0; i < size; ++i)
+        bytes[i] = 0;
+}
+
 bool CBLEncryptionKey_FromPassword(CBLEncryptionKey *key, FLString password) CBLAPI {
-    auto c4key = C4EncryptionKeyFromPassword(password, kC4EncryptionAES256);    //FIXME: Catch
-    key->algorithm = CBLEncryptionAlgorithm(c4key.algorithm);
-    memcpy(key->bytes, c4key.bytes, sizeof(key->bytes));
-    return true;
+    try {
+        auto c4key = C4EncryptionKeyFromPassword(password, kC4EncryptionAES256);
+        key->algorithm = CBLEncryptionAlgorithm(c4key.algorithm);
+        memcpy(key->bytes, c4key.bytes, sizeof(key->bytes));
+        secureZero(c4key.bytes, sizeof(c4key.bytes));
+        return true;
+    } catchAndWarn()
+}
+
+
+void CBLEncryptionKey_Clear(CBLEncryptionKey *key) CBLAPI {
+    secureZero(key->bytes, sizeof(key->bytes));
+    key->algorithm = kCBLEncryptionNone;
+}
+
+
+void CBLDatabase::changeEncryptionKey(const CBLEncryptionKey *newKey) {
+    C4EncryptionKey c4key = asC4Key(newKey);
+    // Keep the readers out while the file is rewritten, then close them, so they'll reopen with
+    // the new key when next used:
+    vector<unique_lock<mutex>> readerLocks;
+    for (auto &reader : _readers)
+        readerLocks.emplace_back(reader->mutex);
+    useLocked()->rekey(&c4key);
+    _readerConfig.encryptionKey = c4key;
+    secureZero(c4key.bytes, sizeof(c4key.bytes));
+    for (auto &reader : _readers) {
+        if (reader->c4db) {
+            reader->c4db->close();
+            reader->c4db = nullptr;
+        }
+    }
+}
+#endif
+
+
+#pragma mark - FILE COPYING:
+
+
+#ifndef _MSC_VER
+namespace {
+
+    // A file or directory in a database bundle, relative to the bundle.
+    struct BundleItem {
+        string   path;
+        bool     isDir;
+        uint64_t size;
+    };
+
+
+    [[noreturn]] void raiseFileError(const char *what, const string &path) {
+        C4Error::raise(POSIXDomain, errno, "%s %s", what, path.c_str());
+    }
+
+
+    // Lists the contents of a directory tree; each directory comes before its contents.
+    void listTree(const string &root, const string &rel, vector<BundleItem> &items) {
+        unique_ptr<DIR, decltype(&closedir)> dir(opendir((root + rel).c_str()), &closedir);
+        if (!dir)
+            raiseFileError("Couldn't read directory", root + rel);
+        while (dirent *entry = readdir(dir.get())) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+            string path = rel + "/" + entry->d_name;
+            struct stat st;
+            if (stat((root + path).c_str(), &st) != 0)
+                raiseFileError("Couldn't stat", root + path);
+            if (S_ISDIR(st.st_mode)) {
+                items.push_back({path, true, 0});
+                listTree(root, path, items);
+            } else {
+                items.push_back({path, false, uint64_t(st.st_size)});
+            }
+        }
+    }
+
+
+    void removeTree(const string &path) {
+        vector<BundleItem> items;
+        try {
+            listTree(path, "", items);
+        } catch (...) {
+            return;     // doesn't exist, or can't be read; nothing to be done about it
+        }
+        for (auto i = items.rbegin(); i != items.rend(); ++i)
+            (i->isDir ? rmdir : unlink)((path + i->path).c_str());
+        rmdir(path.c_str());
+    }
+
+
+    // Copies a bundle to `to`, either by cloning every file, or (if `clone` is false) by copying
+    // their contents. Returns false if cloning isn't supported by the filesystem.
+    bool copyTree(const string &from, const string &to, bool clone,
+                  CBLCopyProgressCallback _cbl_nullable progress, void* _cbl_nullable context)
+    {
+#ifdef __APPLE__
+        // clonefile clones a whole directory tree in one call:
+        if (clone) {
+            if (clonefile(from.c_str(), to.c_str(), 0) == 0)
+                return true;
+            if (errno == ENOTSUP || errno == EXDEV)
+                return false;
+            raiseFileError("Couldn't clone", from);
+        }
+#elif !defined(FICLONE)
+        if (clone)
+            return false;
+#endif
+        vector<BundleItem> items;
+        listTree(from, "", items);
+        uint64_t total = 0, copied = 0;
+        for (auto &item : items)
+            total += item.size;
+
+        if (mkdir(to.c_str(), 0755) != 0)
+            raiseFileError("Couldn't create directory", to);
+        vector<char> buffer;
+        for (auto &item : items) {
+            string src = from + item.path, dst = to + item.path;
+            if (item.isDir) {
+                if (mkdir(dst.c_str(), 0755) != 0)
+                    raiseFileError("Couldn't create directory", dst);
+                continue;
+            }
+            int in = open(src.c_str(), O_RDONLY);
+            if (in < 0)
+                raiseFileError("Couldn't open", src);
+            int out = open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if (out < 0) {
+                close(in);
+                raiseFileError("Couldn't create", dst);
+            }
+            auto closeBoth = [&] { close(in); close(out); };
+#if defined(FICLONE)
+            if (clone) {
+                if (ioctl(out, FICLONE, in) == 0) {
+                    closeBoth();
+                    continue;
+                }
+                int err = errno;
+                closeBoth();
+                if (err == EOPNOTSUPP || err == EXDEV || err == EINVAL || err == ENOTTY)
+                    return false;
+                errno = err;
+                raiseFileError("Couldn't clone", src);
+            }
+#endif
+            if (buffer.empty())
+                buffer.resize(1 << 20);
+            while (true) {
+                ssize_t n = read(in, buffer.data(), buffer.size());
+                if (n == 0)
+                    break;
+                if (n < 0 || write(out, buffer.data(), size_t(n)) != n) {
+                    int err = errno;
+                    closeBoth();
+                    errno = err;
+                    raiseFileError("Couldn't copy", src);
+                }
+                copied += n;
+                if (progress)
+                    progress(context, copied, total);
+            }
+            closeBoth();
+        }
+        return true;
+    }
+
+
+    // Gives a copied database new UUIDs, as C4Database::copyNamed does, so that it's distinct
+    // from the original when replicating. LiteCore keeps them in the raw "info" store.
+    void resetUUIDs(slice name, const C4DatabaseConfig2 &config) {
+        random_device random;
+        Retained<C4Database> c4db = C4Database::openNamed(name, config);
+        {
+            C4Database::Transaction t(c4db);
+            for (slice key : {"publicUUID"_sl, "privateUUID"_sl}) {
+                C4UUID uuid;
+                for (auto &byte : uuid.bytes)
+                    byte = uint8_t(random());
+                uuid.bytes[6] = (uuid.bytes[6] & 0x0F) | 0x40;     // RFC 4122 version 4 (random)
+                uuid.bytes[8] = (uuid.bytes[8] & 0x3F) | 0x80;
+                c4db->putRawDocument("info"_sl, C4RawDocument{key, nullslice,
+                                                             slice(&uuid, sizeof(uuid))});
+            }
+            t.commit();
+        }
+        c4db->close();
+    }
+
+}
+#endif
+
+
+void CBLDatabase::copyDatabase(slice fromPath,
+                               slice toName,
+                               const CBLDatabaseConfiguration *config,
+                               CBLCopyProgressCallback progress,
+                               void *context)
+{
+    CBLLog_Init();
+    C4DatabaseConfig2 c4config = asC4Config(config);
+#ifndef _MSC_VER
+    // Make the copy alongside the destination, so it can be cloned from the source if they're
+    // on the same filesystem and moved into place when it's ready:
+    string from(fromPath);
+    while (from.size() > 1 && from.back() == '/')
+        from.pop_back();
+    string dir(slice(c4config.parentDirectory));
+    string to = dir + "/" + string(toName) + ".cblite2";
+    string tempName = string(toName) + "~copy";
+    string temp = dir + "/" + tempName + ".cblite2";
+    struct stat st;
+    if (stat(to.c_str(), &st) == 0)
+        C4Error::raise(LiteCoreDomain, kC4ErrorConflict,
+                       "Database '%.*s' already exists", FMTSLICE(toName));
+    removeTree(temp);       // in case an earlier copy was interrupted
+
+    try {
+        if (!copyTree(from, temp, true, nullptr, nullptr)) {
+            removeTree(temp);
+            if (!progress) {
+                // The byte copy doesn't need to be watched, so leave it to LiteCore:
+                C4Database::copyNamed(fromPath, toName, c4config);
+                return;
+            }
+            copyTree(from, temp, false, progress, context);
+        }
+        resetUUIDs(slice(tempName), c4config);
+        if (rename(temp.c_str(), to.c_str()) != 0)
+            raiseFileError("Couldn't move copied database to", to);
+    } catch (...) {
+        removeTree(temp);
+        throw;
+    }
+#else
+    C4Database::copyNamed(fromPath, toName, c4config);
+#endif
+}
+
+
+#pragma mark - STORAGE TUNING:
+
+
+// Sets a SQLite pragma on a connection, through LiteCore's hook for running raw SQL.
+static void setPragma(C4Database *c4db, const char *name, long long value) {
+    char sql[80];
+    snprintf(sql, sizeof(sql), "PRAGMA %s=%lld", name, value);
+    c4db->rawQuery(slice(sql));
+}
+
+
+void CBLDatabase::tuneConnection(C4Database *c4db, bool isReader) const {
+    const CBLStorageTuning &tuning = _storageTuning;
+    if (unsigned sizeKB = _pageCacheSize; sizeKB > 0)
+        setPragma(c4db, "cache_size", -(long long)sizeKB);     // negative means KB, not pages
+    if (tuning.mmapSize > 0)
+        setPragma(c4db, "mmap_size", (long long)tuning.mmapSize);
+    // The rest only affect writing:
+    if (isReader)
+        return;
+    if (tuning.walAutoCheckpoint > 0)
+        setPragma(c4db, "wal_autocheckpoint", tuning.walAutoCheckpoint);
+    if (tuning.syncMode != kCBLSyncDefault)
+        setPragma(c4db, "synchronous", tuning.syncMode - kCBLSyncOff);  // OFF=0, NORMAL=1, FULL=2
 }
+
+
+void CBLDatabase::setPageCacheSize(unsigned sizeKB) {
+    if (sizeKB == 0)
+        C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter, "Page cache size must be nonzero");
+    _pageCacheSize = sizeKB;
+    setPragma(useLocked().get(), "cache_size", -(long long)sizeKB);
+    for (auto &reader : _readers) {
+        LOCK(reader->mutex);
+        if (reader->c4db)
+            setPragma(reader->c4db, "cache_size", -(long long)sizeKB);
+    }
+}
+
+
+#pragma mark - SHARED HANDLES:
+
+
+namespace {
+
+    // The process-wide cache of database handles used by CBLDatabase_OpenShared.
+    class DatabaseHandleCache {
+    public:
+        static DatabaseHandleCache& instance() {
+            static auto sInstance = new DatabaseHandleCache;   // never freed
+            return *sInstance;
+        }
+
+        void setLimits(unsigned maxOpen, double idleTimeout) {
+            {
+                LOCK(_mutex);
+                _maxOpen = maxOpen;
+                _idleTimeout = std::chrono::duration<double>(max(idleTimeout, 0.0));
+            }
+            sweep();
+        }
+
+        Retained<CBLDatabase> open(slice name, const CBLDatabaseConfiguration* _cbl_nullable config) {
+            string key = keyFor(name, config);
+            CBLDatabaseConfiguration settings = config ? *config
+                                                       : CBLDatabase::defaultConfiguration();
+            settings.directory = nullslice;     // already part of the key, and may not outlive us
+            bool enabled;
+            {
+                LOCK(_mutex);
+                enabled = (_maxOpen > 0);
+                if (Entry *entry = find(key, settings)) {
+                    entry->idleSince = {};
+                    return entry->db;
+                }
+            }
+            // Open outside the lock, since it may take a while:
+            Retained<CBLDatabase> db = CBLDatabase::open(name, config);
+            if (!enabled)
+                return db;
+            {
+                LOCK(_mutex);
+                if (Entry *entry = find(key, settings))
+                    return entry->db;           // Another thread got there first; use its handle
+                _entries.push_back({key, settings, db, {}});
+            }
+            sweep();
+            return db;
+        }
+
+        // Closes all the idle handles.
+        void closeIdle() {
+            sweep(true);
+        }
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        struct Entry {
+            string                      key;        // Directory and name
+            CBLDatabaseConfiguration    settings;   // The config it was opened with, sans directory
+            Retained<CBLDatabase>       db;
+            clock::time_point           idleSince;  // When first seen idle, or zero if in use
+        };
+
+        static string keyFor(slice name, const CBLDatabaseConfiguration* _cbl_nullable config) {
+            string key(config && config->directory.buf
+                            ? slice(config->directory)
+                            : slice(CBLDatabase::defaultConfiguration().directory));
+            while (key.size() > 1 && (key.back() == '/' || key.back() == '\\'))
+                key.pop_back();
+            key += '/';
+            key += string(name);
+            return key;
+        }
+
+        static bool sameSettings(const CBLDatabaseConfiguration &a,
+                                 const CBLDatabaseConfiguration &b)
+        {
+#ifdef COUCHBASE_ENTERPRISE
+            if (a.encryptionKey.algorithm != b.encryptionKey.algorithm
+                    || (a.encryptionKey.algorithm != kCBLEncryptionNone
+                        && memcmp(a.encryptionKey.bytes, b.encryptionKey.bytes,
+                                  sizeof(a.encryptionKey.bytes)) != 0))
+                return false;
 #endif
+            return a.readerCount == b.readerCount
+                && a.queryCacheCapacity == b.queryCacheCapacity
+                && a.blobCacheCapacity == b.blobCacheCapacity
+                && a.lazyReaders == b.lazyReaders
+                && a.storage.pageCacheSize == b.storage.pageCacheSize
+                && a.storage.mmapSize == b.storage.mmapSize
+                && a.storage.walAutoCheckpoint == b.storage.walAutoCheckpoint
+                && a.storage.syncMode == b.storage.syncMode;
+        }
+
+        // Returns the entry for `key`, or null if there's none. Throws if the entry's handle was
+        // opened with different settings. Must be called with the mutex locked.
+        Entry* _cbl_nullable find(const string &key, const CBLDatabaseConfiguration &settings) {
+            for (auto &entry : _entries) {
+                if (entry.key == key) {
+                    if (!sameSettings(entry.settings, settings))
+                        C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter,
+                                       "Database '%s' is already open in the shared cache"
+                                       " with a different configuration", key.c_str());
+                    return &entry;
+                }
+            }
+            return nullptr;
+        }
+
+        // Removes handles that have been idle too long, or are over the limit (or all idle ones,
+        // if `allIdle` is true), then closes them.
+        void sweep(bool allIdle =false) {
+            vector<Retained<CBLDatabase>> closing;
+            {
+                LOCK(_mutex);
+                auto now = clock::now();
+                vector<Entry*> idle;
+                for (auto &entry : _entries) {
+                    if (entry.db->refCount() > 1) {
+                        entry.idleSince = {};
+                    } else {
+                        if (entry.idleSince == clock::time_point{})
+                            entry.idleSince = now;
+                        idle.push_back(&entry);
+                    }
+                }
+                // Close the longest-idle handles over the limit, and those idle too long:
+                sort(idle.begin(), idle.end(), [](Entry *a, Entry *b) {
+                    return a->idleSince < b->idleSince;
+                });
+                size_t excess = (idle.size() > _maxOpen) ? idle.size() - _maxOpen : 0;
+                for (size_t i = 0; i < idle.size(); ++i) {
+                    if (allIdle || i < excess || now - idle[i]->idleSince >= _idleTimeout)
+                        closing.push_back(std::move(idle[i]->db));
+                }
+                _entries.erase(std::remove_if(_entries.begin(), _entries.end(),
+                                              [](const Entry &e) {return !e.db;}),
+                               _entries.end());
+                if (!_entries.empty() && !_timer.scheduled()) {
+                    auto interval = max(std::chrono::duration<double>(0.1), _idleTimeout / 2);
+                    _timer.fireAfter(std::chrono::duration_cast<clock::duration>(interval));
+                }
+            }
+            for (auto &db : closing) {
+                try {
+                    db->close();
+                } catch (...) {
+                    C4Error error = C4Error::fromCurrentException();
+                    CBL_Log(kCBLLogDomainDatabase, kCBLLogWarning,
+                            "Couldn't close idle shared database '%.*s': %s",
+                            FMTSLICE(db->name()), error.description().c_str());
+                }
+            }
+        }
+
+        std::mutex                          _mutex;
+        vector<Entry>                       _entries;
+        unsigned                            _maxOpen {0};
+        std::chrono::duration<double>       _idleTimeout {60.0};
+        litecore::actor::Timer              _timer {[this] {sweep();}};
+    };
+
+}
+
+
+Retained<CBLDatabase> CBLDatabase::openShared(slice name,
+                                              const CBLDatabaseConfiguration* _cbl_nullable config)
+{
+    return DatabaseHandleCache::instance().open(name, config);
+}
+
+
+void CBLDatabase::setSharedCacheLimits(unsigned maxOpen, double idleTimeout) {
+    DatabaseHandleCache::instance().setLimits(maxOpen, idleTimeout);
+}
+
+
+#pragma mark - MEMORY:
+
+
+namespace {
+
+    // Every CBLDatabase instance, for CBL_HandleMemoryPressure. An instance removes itself at
+    // the start of its destructor, so while the mutex is held, those in the set stay valid.
+    struct InstanceRegistry {
+        std::mutex                          mutex;
+        std::unordered_set<CBLDatabase*>    instances;
+    };
+
+    InstanceRegistry& instanceRegistry() {
+        static auto sRegistry = new InstanceRegistry;     // never freed
+        return *sRegistry;
+    }
+
+}
+
+
+void CBLDatabase::registerInstance(CBLDatabase *db, bool add) {
+    auto &registry = instanceRegistry();
+    LOCK(registry.mutex);
+    if (add)
+        registry.instances.insert(db);
+    else
+        registry.instances.erase(db);
+}
+
+
+std::shared_ptr<std::shared_mutex> CBLDatabase::blobGCMutexFor(slice path) {
+    static std::mutex sMutex;
+    static auto sMutexes = new unordered_map<string, std::weak_ptr<std::shared_mutex>>; // never freed
+    LOCK(sMutex);
+    for (auto i = sMutexes->begin(); i != sMutexes->end(); ) {
+        if (i->second.expired())
+            i = sMutexes->erase(i);
+        else
+            ++i;
+    }
+    auto &entry = (*sMutexes)[string(path)];
+    auto mutex = entry.lock();
+    if (!mutex) {
+        mutex = make_shared<std::shared_mutex>();
+        entry = mutex;
+    }
+    return mutex;
+}
+
+
+void CBLDatabase::releaseMemory(CBLMemoryPressure level) {
+    clearBlobCache();
+    if (level >= kCBLMemoryPressureCritical)
+        clearQueryCache();
+    // SQLite frees the unused pages of a connection's cache on `PRAGMA shrink_memory`:
+    useLocked()->rawQuery("PRAGMA shrink_memory"_sl);
+    for (auto &reader : _readers) {
+        LOCK(reader->mutex);
+        if (reader->c4db)
+            reader->c4db->rawQuery("PRAGMA shrink_memory"_sl);
+    }
+}
+
+
+void CBLDatabase::releaseAllMemory(CBLMemoryPressure level) {
+    if (level >= kCBLMemoryPressureCritical)
+        DatabaseHandleCache::instance().closeIdle();
+
+    auto &registry = instanceRegistry();
+    LOCK(registry.mutex);
+    for (CBLDatabase *db : registry.instances) {
+        try {
+            db->releaseMemory(level);
+        } catch (...) {
+            // Most likely the database has been closed, so it has nothing to release.
+            C4Error error = C4Error::fromCurrentException();
+            CBL_Log(kCBLLogDomainDatabase, kCBLLogVerbose,
+                    "Couldn't release memory of a database: %s", error.description().c_str());
+        }
+    }
+}
+
+
+CBLMemoryStats CBLDatabase::memoryStats() const {
+    CBLMemoryStats stats = {};
+    {
+        LOCK(_blobCacheMutex);
+        stats.blobCacheBytes = _blobCacheSize;
+    }
+    {
+        auto c4db = useLocked();
+        stats.cachedQueries = unsigned(_queryCache.size());
+        stats.openConnections = 1;
+    }
+    for (auto &reader : _readers) {
+        LOCK(reader->mutex);
+        if (reader->c4db)
+            ++stats.openConnections;
+    }
+    stats.pageCacheLimit = uint64_t(_pageCacheSize) * 1024 * stats.openConnections;
+    return stats;
+}
+
+
+#pragma mark - MAINTENANCE:
+
+
+void CBLDatabase::scheduleMaintenance(std::vector<CBLMaintenanceType> steps,
+                                      double timeBudget,
+                                      CBLMaintenanceProgressCallback _cbl_nullable callback,
+                                      void* _cbl_nullable context)
+{
+    // The steps run on their own connection to the file. The task is registered as a
+    // stoppable, so closing or deleting the database stops it after the current step, and
+    // waits for its connection to be closed:
+    struct Task : public CBLStoppable {
+        Retained<CBLDatabase>               db;
+        alloc_slice                         name, dir;
+        C4DatabaseConfig2                   config;
+        std::vector<CBLMaintenanceType>     steps;
+        double                              timeBudget;
+        CBLMaintenanceProgressCallback _cbl_nullable callback;
+        void* _cbl_nullable                 context;
+        std::atomic<bool>                   stopped {false};
+
+        void stop() override {
+            stopped = true;
+        }
+
+        void run() {
+            Stopwatch st;
+            auto nSteps = unsigned(steps.size());
+            unsigned done = 0;
+            C4Error error = {};
+            try {
+                Retained<C4Database> c4db = C4Database::openNamed(name, config);
+                while (done < nSteps && !stopped) {
+                    std::unique_lock<std::shared_mutex> gc;
+                    // Compaction deletes unreferenced blobs. It's safe to hold the lock while
+                    // the compaction waits for other connections' transactions, since saves
+                    // only try to lock it (see CBLDatabase::tryLockPendingBlobs):
+                    if (steps[done] == kCBLMaintenanceTypeCompact)
+                        gc = db->lockBlobGC();
+                    c4db->maintenance(C4MaintenanceType(steps[done]));
+                    gc = {};
+                    ++done;
+                    if (done == nSteps || (timeBudget > 0 && st.elapsed() >= timeBudget))
+                        break;
+                    if (callback && !callback(context, done, nSteps, false, nullptr))
+                        break;
+                }
+                c4db->close();
+            } catch (...) {
+                error = C4Error::fromCurrentException();
+                CBL_Log(kCBLLogDomainDatabase, kCBLLogWarning,
+                        "Scheduled maintenance of '%.*s' failed at step %u: %s",
+                        FMTSLICE(name), done + 1, error.description().c_str());
+            }
+            db->unregisterStoppable(this);
+            if (callback)
+                callback(context, done, nSteps, true, error.code ? external(&error) : nullptr);
+        }
+    };
+
+    auto task = make_unique<Task>();
+    {
+        auto c4db = useLocked();
+        task->name = c4db->getName();
+        task->config = c4db->getConfiguration();
+    }
+    task->db = this;
+    task->dir = task->config.parentDirectory;
+    task->config.parentDirectory = task->dir;
+    task->config.flags &= ~(kC4DB_Create | kC4DB_ReadOnly);
+    task->steps = std::move(steps);
+    task->timeBudget = timeBudget;
+    task->callback = callback;
+    task->context = context;
+    if (!registerStoppable(task.get()))
+        C4Error::raise(LiteCoreDomain, kC4ErrorNotOpen, "Database is closing");
+
+    // Not the LiteCore task pool, since compacting a large database can take minutes:
+    std::thread([task = std::move(task)] { task->run(); }).detach();
+}
+
+
+#pragma mark - EXPIRATION & PURGING:
+
+
+// Bulk operations commit a transaction per this many documents, so the transaction (and the
+// WAL) doesn't grow without limit:
+static constexpr size_t kBulkTransactionSize = 2000;
+
+
+// Calls `fn` with each document ID, holding the lock throughout, in chunked transactions.
+// Returns the number of calls that returned true.
+static uint64_t forEachDocInChunks(C4Database *c4db, const FLString docIDs[], size_t count,
+                                   function_ref<bool(C4Collection*,slice)> fn)
+{
+    C4Collection *collection = c4db->getDefaultCollection();
+    uint64_t n = 0;
+    for (size_t start = 0; start < count; start += kBulkTransactionSize) {
+        C4Database::Transaction t(c4db);
+        size_t end = std::min(count, start + kBulkTransactionSize);
+        for (size_t i = start; i < end; ++i) {
+            if (fn(collection, docIDs[i]))
+                ++n;
+        }
+        t.commit();
+    }
+    return n;
+}
+
+
+uint64_t CBLDatabase::setDocumentsExpiration(const FLString docIDs[], size_t count,
+                                             CBLTimestamp expiration)
+{
+    LockStats::CallerScope caller(kCBLLockCallerSave);
+    return forEachDocInChunks(useLocked().get(), docIDs, count,
+                              [&](C4Collection *collection, slice docID) {
+        return collection->setExpiration(docID, expiration);
+    });
+}
+
+
+uint64_t CBLDatabase::purgeDocuments(const FLString docIDs[], size_t count) {
+    LockStats::CallerScope caller(kCBLLockCallerSave);
+    return forEachDocInChunks(useLocked().get(), docIDs, count,
+                              [&](C4Collection *collection, slice docID) {
+        return collection->purgeDocument(docID);
+    });
+}
+
+
+uint64_t CBLDatabase::purgeDocumentsWhere(slice where) {
+    string queryStr = "SELECT meta().id FROM _ WHERE " + string(where);
+    LockStats::CallerScope caller(kCBLLockCallerSave);
+    auto c4db = useLocked();
+    int errPos;
+    Retained<C4Query> query = c4db->newQuery(kC4N1QLQuery, slice(queryStr), &errPos);
+    if (!query)
+        C4Error::raise(LiteCoreDomain, kC4ErrorInvalidQuery,
+                       "Invalid purge condition: %.*s", FMTSLICE(where));
+    std::vector<alloc_slice> docIDs;
+    auto e = query->run(nullptr, nullslice);
+    while (e.next())
+        docIDs.emplace_back(Array::iterator(e.columns()).value().asString());
+    std::vector<FLString> ids(docIDs.begin(), docIDs.end());
+    return purgeDocuments(ids.data(), ids.size());
+}
+
+
+uint64_t CBLDatabase::purgeExpiredDocuments(unsigned batchSize, double timeBudget) {
+    static constexpr unsigned kDefaultBatchSize = 100;
+    if (batchSize == 0)
+        batchSize = kDefaultBatchSize;
+    Stopwatch st;
+
+    // The expiration column is indexed, so finding each batch is cheap:
+    char queryStr[160];
+    snprintf(queryStr, sizeof(queryStr),
+             "SELECT meta().id FROM _ WHERE meta().expiration > 0 AND meta().expiration <= %lld"
+             " LIMIT %u", (long long)c4_now(), batchSize);
+    LockStats::CallerScope caller(kCBLLockCallerSave);
+    Retained<C4Query> query = useLocked()->newQuery(kC4N1QLQuery, slice(queryStr), nullptr);
+
+    uint64_t purged = 0;
+    unsigned found;
+    do {
+        auto c4db = useLocked();
+        std::vector<alloc_slice> docIDs;
+        auto e = query->run(nullptr, nullslice);
+        while (e.next())
+            docIDs.emplace_back(Array::iterator(e.columns()).value().asString());
+        found = unsigned(docIDs.size());
+
+        C4Collection *collection = c4db->getDefaultCollection();
+        C4Database::Transaction t(c4db.get());
+        for (auto &docID : docIDs) {
+            if (collection->purgeDocument(docID))
+                ++purged;
+        }
+        t.commit();
+    } while (found == batchSize && !(timeBudget > 0 && st.elapsed() >= timeBudget));
+    return purged;
+}
+
+
+#pragma mark - CHANGES FEED:
+
+
+uint64_t CBLDatabase::enumerateChanges(uint64_t sinceSequence, unsigned batchSize,
+                                       bool includeBodies, ChangesCallback callback) const
+{
+    static constexpr unsigned kDefaultBatchSize = 1000;
+    if (batchSize == 0)
+        batchSize = kDefaultBatchSize;
+    C4EnumeratorOptions options = {kC4IncludeNonConflicted | kC4IncludeDeleted};
+    if (includeBodies)
+        options.flags |= kC4IncludeBodies;
+
+    // The records point into these, which have to outlive the callback:
+    struct Change {
+        alloc_slice             docID, revID;
+        Retained<C4Document>    doc;
+    };
+    std::vector<Change> changes;
+    std::vector<CBLChangedDocument> records;
+    changes.reserve(batchSize);
+    records.reserve(batchSize);
+
+    // Read a batch at a time, releasing the lock while the callback is called. The enumerator
+    // resumes from the last sequence, so it doesn't have to stay open between batches:
+    uint64_t lastSequence = sinceSequence;
+    bool more = true;
+    while (more) {
+        changes.clear();
+        records.clear();
+        {
+            auto c4db = useLocked();
+            C4DocEnumerator e(c4db.get(), C4SequenceNumber(lastSequence), options);
+            while (records.size() < batchSize && (more = e.next())) {
+                C4DocumentInfo info = e.documentInfo();
+                Change &change = changes.emplace_back();
+                change.docID = alloc_slice(info.docID);
+                change.revID = alloc_slice(info.revID);
+                CBLChangedDocument record = {};
+                record.docID = change.docID;
+                record.revisionID = change.revID;
+                record.sequence = uint64_t(info.sequence);
+                record.flags = CBLChangeFlags(info.flags & (kDocDeleted | kDocConflicted
+                                                            | kDocHasAttachments));
+                if (includeBodies && !(info.flags & kDocDeleted)) {
+                    change.doc = e.getDocument();
+                    record.properties = change.doc->getProperties();
+                }
+                records.push_back(record);
+            }
+        }
+        if (records.empty())
+            break;
+        lastSequence = records.back().sequence;
+        if (!callback(records.data(), unsigned(records.size())))
+            break;
+    }
+    return lastSequence;
+}
 
 
 #pragma mark - QUERY:
@@ -70,21 +904,248 @@ Retained<CBLQuery> CBLDatabase::createQuery(CBLQueryLanguage language,
                                             slice queryString,
                                             int* _cbl_nullable outErrPos) const
 {
+    if (_queryCacheCapacity > 0)
+        return createCachedQuery(language, queryString, outErrPos);
+
     alloc_slice json;
     if (language == kCBLJSONLanguage) {
         json = convertJSON5(queryString); // allow JSON5 as a convenience
         queryString = json;
     }
-    auto c4query = _c4db.useLocked()->newQuery((C4QueryLanguage)language, queryString, outErrPos);
+    LockStats::CallerScope caller(kCBLLockCallerQuery);
+    auto c4db = useLocked();
+    auto c4query = c4db->newQuery((C4QueryLanguage)language, queryString, outErrPos);
+    if (!c4query)
+        return nullptr;
+    recordIndexUsage(c4query);
+    return new CBLQuery(this, language, queryString, std::move(c4query), _c4db);
+}
+
+
+Retained<CBLQuery> CBLDatabase::createCachedQuery(CBLQueryLanguage language,
+                                                  slice queryString,
+                                                  int* _cbl_nullable outErrPos) const
+{
+    // The key is the language followed by the query string as given, so that a cache hit
+    // skips the JSON5 conversion too:
+    alloc_slice key(1 + queryString.size);
+    *(uint8_t*)key.buf = uint8_t(language);
+    memcpy((uint8_t*)key.buf + 1, queryString.buf, queryString.size);
+
+    LockStats::CallerScope caller(kCBLLockCallerQuery);
+    auto c4db = useLocked();
+    if (auto i = _queryCacheIndex.find(key); i != _queryCacheIndex.end()) {
+        ++_queryCacheHits;
+        _queryCache.splice(_queryCache.begin(), _queryCache, i->second);
+        CachedQuery &entry = *i->second;
+        return new CBLQuery(this, language, entry.source, Retained<C4Query>(entry.c4query),
+                            entry.readerQueries, _c4db);
+    }
+
+    ++_queryCacheMisses;
+    alloc_slice source(queryString);
+    if (language == kCBLJSONLanguage)
+        source = convertJSON5(queryString); // allow JSON5 as a convenience
+    auto c4query = c4db->newQuery((C4QueryLanguage)language, source, outErrPos);
     if (!c4query)
         return nullptr;
-    return new CBLQuery(this, std::move(c4query), _c4db);
+    recordIndexUsage(c4query);
+    auto readerQueries = std::make_shared<ReaderQueries>(readerCount());
+    _queryCache.push_front({key, source, c4query, readerQueries});
+    _queryCacheIndex[key] = _queryCache.begin();
+    while (_queryCache.size() > _queryCacheCapacity) {
+        _queryCacheIndex.erase(_queryCache.back().key);
+        _queryCache.pop_back();
+    }
+    return new CBLQuery(this, language, source, std::move(c4query), readerQueries, _c4db);
+}
+
+
+int64_t CBLDatabase::runScalarQuery(CBLQueryLanguage language,
+                                    slice whereExpr,
+                                    Dict parameters,
+                                    bool exists) const
+{
+    // The wrapping query's text only depends on the expression, so it gets cached like any other:
+    string where(whereExpr), queryString;
+    if (language == kCBLN1QLLanguage) {
+        if (exists)
+            queryString = "SELECT 1 FROM _ WHERE (" + where + ") LIMIT 1";
+        else
+            queryString = "SELECT COUNT(*) FROM _ WHERE (" + where + ")";
+    } else {
+        if (exists)
+            queryString = "{\"WHAT\":[[\"._id\"]],\"WHERE\":" + where + ",\"LIMIT\":1}";
+        else
+            queryString = "{\"WHAT\":[[\"COUNT()\",[\"._id\"]]],\"WHERE\":" + where + "}";
+    }
+
+    Retained<CBLQuery> query = createQuery(language, queryString, nullptr);
+    if (!query)
+        C4Error::raise(LiteCoreDomain, kC4ErrorInvalidQuery, "Invalid WHERE expression");
+    C4Query::Enumerator e = query->run(parameters);
+    if (!e.next())
+        return 0;
+    return exists ? 1 : e.column(0).asInt();
+}
+
+
+Retained<CBLQuery>
+CBLDatabase::createFullTextPageQuery(const CBLFullTextPageConfiguration &config) const {
+    if (!config.indexName.buf || config.indexName.size == 0)
+        C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter, "Missing full-text index name");
+    string index = "`" + string(slice(config.indexName)) + "`";
+    string rank = "RANK(" + index + ")";
+    unsigned pageSize = config.pageSize ? config.pageSize : 20;
+
+    // The ordering is by (rank, docID), so a page can resume after the last row of the one
+    // before by comparing with that row's pair, which the caller passes as parameters:
+    string queryString = "SELECT ";
+    if (config.columns.buf && config.columns.size > 0)
+        queryString += string(slice(config.columns)) + ", ";
+    queryString += rank + " AS _rank, META().id AS _id FROM _ WHERE MATCH(" + index + ", $match)";
+    if (config.where.buf && config.where.size > 0)
+        queryString += " AND (" + string(slice(config.where)) + ")";
+    queryString += " AND ($firstPage OR " + rank + " < $afterRank OR (" + rank
+                 + " = $afterRank AND META().id > $afterID))"
+                 + " ORDER BY " + rank + " DESC, META().id LIMIT " + to_string(pageSize);
+
+    Retained<CBLQuery> query = createQuery(kCBLN1QLLanguage, queryString, nullptr);
+    if (!query)
+        C4Error::raise(LiteCoreDomain, kC4ErrorInvalidQuery,
+                       "Invalid full-text page query: %s", queryString.c_str());
+    return query;
+}
+
+
+void CBLDatabase::precompileQueries(CBLQueryLanguage language,
+                                    std::vector<alloc_slice> queries,
+                                    CBLQueryPrecompileCallback _cbl_nullable callback,
+                                    void* _cbl_nullable context)
+{
+    if (_queryCacheCapacity == 0)
+        C4Error::raise(LiteCoreDomain, kC4ErrorUnsupported,
+                       "Precompiling queries requires a query cache (queryCacheCapacity)");
+
+    struct Task {
+        Retained<CBLDatabase>               db;
+        CBLQueryLanguage                    language;
+        std::vector<alloc_slice>            queries;
+        CBLQueryPrecompileCallback _cbl_nullable callback;
+        void* _cbl_nullable                 context;
+    };
+    auto task = new Task{this, language, std::move(queries), callback, context};
+    c4_runAsyncTask([](void *ctx) {
+        unique_ptr<Task> task((Task*)ctx);
+        unsigned compiled = 0, failed = 0;
+        for (auto &queryString : task->queries) {
+            C4Error error = {};
+            int errPos = -1;
+            try {
+                if (task->db->createCachedQuery(task->language, queryString, &errPos))
+                    ++compiled;
+                else
+                    error = C4Error::make(LiteCoreDomain, kC4ErrorInvalidQuery);
+            } catch (...) {
+                error = C4Error::fromCurrentException();
+            }
+            if (error.code) {
+                ++failed;
+                CBL_Log(kCBLLogDomainQuery, kCBLLogWarning,
+                        "Precompiling query failed (at %d): %s -- %.*s",
+                        errPos, error.description().c_str(), FMTSLICE(queryString));
+            }
+        }
+        if (task->callback)
+            task->callback(task->context, compiled, failed);
+    }, task);
+}
+
+
+// Finds the indexes named in a newly compiled query's plan. In SQLite's plan, a value index
+// appears as "USING [COVERING] INDEX name", and a full-text index as its table "kv_default::name".
+void CBLDatabase::recordIndexUsage(C4Query *c4query) const {
+    if (!_indexStatsEnabled)
+        return;
+    alloc_slice explanation = c4query->explain();
+    unordered_set<string> used;
+    auto addNameAt = [&](const uint8_t *start) {
+        auto end = start, limit = (const uint8_t*)explanation.end();
+        while (end < limit && !isspace(*end) && *end != '"' && *end != '(' && *end != ')')
+            ++end;
+        if (end > start)
+            used.emplace((const char*)start, end - start);
+    };
+    for (slice marker : {" INDEX "_sl, "::"_sl}) {
+        slice rest = explanation;
+        while (const uint8_t *found = rest.find(marker).buf) {
+            addNameAt(found + marker.size);
+            rest.setStart(found + marker.size);
+        }
+    }
+    for (auto &name : used)
+        ++_indexQueryCounts[name];
+}
+
+
+MutableDict CBLDatabase::indexStats() const {
+    auto c4db = useLocked();
+    Doc doc(c4db->getIndexesInfo());
+    auto stats = MutableDict::newDict();
+    for (Array::iterator i(doc.root().asArray()); i; ++i) {
+        Dict info = i.value().asDict();
+        slice name = info["name"].asString();
+        MutableDict entry = info.mutableCopy();
+        if (_indexStatsEnabled) {
+            auto count = _indexQueryCounts.find(string(name));
+            entry["queryCount"_sl] = (count != _indexQueryCounts.end()) ? count->second : 0;
+        }
+        stats[name] = entry;
+    }
+    return stats;
+}
+
+
+Retained<SharedQueryObserver> CBLDatabase::observeQuery(QueryListenerToken *token,
+                                                        slice key,
+                                                        const CBLQuery *query,
+                                                        slice parameters)
+{
+    LOCK(_queryObserversMutex);
+    Retained<SharedQueryObserver> obs;
+    if (auto i = _queryObservers.find(key); i != _queryObservers.end()) {
+        obs = i->second;
+    } else {
+        // The observer gets its own C4Query, since observing follows the C4Query's parameters:
+        Retained<C4Query> c4query = useLocked()->newQuery((C4QueryLanguage)query->_language,
+                                                          query->_queryString, nullptr);
+        c4query->setParameters(parameters);
+        obs = new SharedQueryObserver(alloc_slice(key), std::move(c4query));
+        _queryObservers.emplace(obs->key(), obs.get());
+    }
+    obs->subscribe(token);
+    return obs;
+}
+
+
+void CBLDatabase::unobserveQuery(SharedQueryObserver *obs, QueryListenerToken *token) {
+    LOCK(_queryObserversMutex);
+    if (obs->unsubscribe(token))
+        _queryObservers.erase(obs->key());
 }
 
 
 namespace cbl_internal {
 
     void ListenerToken<CBLQueryChangeListener>::queryChanged() {
+        // Delta listeners diff the new results here, on the observer's thread; they only need to
+        // be notified if there wasn't already a notification pending.
+        if (_paused || !_enabled)
+            return;
+        if (_timer && !beginSuspension())
+            return;
+        if (_delta && !updateDelta())
+            return;
         _query->database()->notify(this);
     }
 
@@ -94,6 +1155,8 @@ namespace cbl_internal {
 
     // Custom subclass of CBLListenerToken for document listeners.
     // (It implements the ListenerToken<> template so that it will work with Listeners<>.)
+    // Instead of each having its own C4DocumentObserver, these are called by the database's
+    // observer (see CBLDatabase::callDocListeners), so many of them can be registered cheaply.
     template<>
     struct ListenerToken<CBLDocumentChangeListener> : public CBLListenerToken {
     public:
@@ -101,39 +1164,46 @@ namespace cbl_internal {
         :CBLListenerToken((const void*)callback, context)
         ,_db(db)
         ,_docID(docID)
-        {
-            auto c4db = _db->useLocked(); // locks DB mutex
-            _c4obs = c4db->getDefaultCollection()->observeDocument(docID,
-                                         [this](C4DocumentObserver*, slice docID, C4SequenceNumber)
-                                         {
-                                             this->docChanged();
-                                         });
-        }
-
-        ~ListenerToken() {
-            auto c4db = _db->useLocked(); // locks DB mutex
-            _c4obs = nullptr;
-        }
+        { }
 
         CBLDocumentChangeListener callback() const {
             return (CBLDocumentChangeListener)_callback.load();
         }
 
+        slice docID() const                 {return _docID;}
+
         // this is called indirectly by CBLDatabase::sendNotifications
-        void call(const CBLDatabase*, FLString) {
+        void call() {
             auto cb = callback();
-            if (cb)
-                cb(_context, _db, _docID);
+            CBLDatabase *db;
+            {
+                LOCK(_dbMutex);
+                db = _db;
+            }
+            if (cb && db)
+                cb(_context, db, _docID);
         }
 
-    private:
-        void docChanged() {
-            _db->notify(this, _db, _docID);
+        // The app may still hold the token after the database is gone, so the database is only
+        // touched while the token is registered with it.
+        void remove() override {
+            LOCK(_dbMutex);
+            if (_db && _owner)
+                _db->removeDocListener(this);
+            CBLListenerToken::remove();
+        }
+
+        // Called by the database's destructor; afterwards the token won't touch the database.
+        void databaseClosing() {
+            LOCK(_dbMutex);
+            _db = nullptr;
+            removed();
         }
 
-        CBLDatabase* _db;
+    private:
+        std::mutex   _dbMutex;
+        CBLDatabase* _cbl_nullable _db;
         alloc_slice _docID;
-        unique_ptr<C4DocumentObserver> _c4obs;
     };
 
 }
@@ -143,9 +1213,700 @@ Retained<CBLListenerToken> CBLDatabase::addDocListener(slice docID,
                                                        CBLDocumentChangeListener listener,
                                                        void *context)
 {
-    auto token = new ListenerToken<CBLDocumentChangeListener>(this, docID, listener, context);
-    _docListeners.add(token);
-    return token;
+    return addListener([&]{
+        auto token = new DocListenerToken(this, docID, listener, context);
+        _docListeners.add(token);
+        LOCK(_docListenerMapMutex);
+        auto i = _docListenerMap.find(docID);
+        if (i == _docListenerMap.end()) {
+            alloc_slice key(docID);
+            i = _docListenerMap.emplace(key, DocListenerEntry{key, {}}).first;
+        }
+        i->second.tokens.push_back(token);
+        return Retained<CBLListenerToken>(token);
+    });
+}
+
+
+void CBLDatabase::removeDocListener(DocListenerToken *token) {
+    LOCK(_docListenerMapMutex);
+    auto i = _docListenerMap.find(token->docID());
+    if (i == _docListenerMap.end())
+        return;
+    auto &tokens = i->second.tokens;
+    tokens.erase(std::remove(tokens.begin(), tokens.end(), token), tokens.end());
+    if (tokens.empty())
+        _docListenerMap.erase(i);
+}
+
+
+void CBLDatabase::callDocListeners(unsigned nChanges, const FLString docIDs[]) {
+    // Tokens in the map are also retained by `_docListeners`, so it's safe to retain them here:
+    vector<Retained<DocListenerToken>> tokens;
+    {
+        LOCK(_docListenerMapMutex);
+        for (unsigned c = 0; c < nChanges; ++c) {
+            if (auto i = _docListenerMap.find(docIDs[c]); i != _docListenerMap.end())
+                tokens.insert(tokens.end(), i->second.tokens.begin(), i->second.tokens.end());
+        }
+    }
+    for (auto &token : tokens)
+        token->call();
+}
+
+
+#pragma mark - COALESCED DATABASE LISTENERS:
+
+
+namespace cbl_internal {
+
+    // A database change listener that collects changed doc IDs, and calls its callback with
+    // them once per interval (or sooner, when `maxBatchSize` distinct docs have changed.)
+    struct CoalescingChangeListener : public CBLListenerToken {
+    public:
+        static constexpr unsigned kDefaultIntervalMs = 50;
+
+        CoalescingChangeListener(CBLDatabase *db,
+                                 const CBLChangeCoalescingOptions &options,
+                                 CBLDatabaseChangeListener callback,
+                                 void *context)
+        :CBLListenerToken((const void*)callback, context)
+        ,_db(db)
+        ,_interval(options.intervalMs ? options.intervalMs : kDefaultIntervalMs)
+        ,_maxBatchSize(options.maxBatchSize)
+        ,_timer([this]{ deliver(); })
+        { }
+
+        CBLDatabaseChangeListener callback() const {
+            return (CBLDatabaseChangeListener)_callback.load();
+        }
+
+        // Called from CBLDatabase::callDBListeners.
+        void addChanges(unsigned nChanges, const FLString docIDs[]) {
+            bool deliverNow = false;
+            {
+                LOCK(_mutex);
+                for (unsigned i = 0; i < nChanges; ++i) {
+                    if (_pendingSet.find(docIDs[i]) == _pendingSet.end()) {
+                        _pending.emplace_back(docIDs[i]);
+                        _pendingSet.insert(_pending.back());
+                    }
+                }
+                if (_maxBatchSize > 0 && _pending.size() >= _maxBatchSize)
+                    deliverNow = true;
+                else if (!_pending.empty() && !_timer.scheduled())
+                    _timer.fireAfter(_interval);
+            }
+            if (deliverNow)
+                deliver();
+        }
+
+        // Calls the callback with the delivered doc IDs, in batches of at most `_maxBatchSize`.
+        // This is called indirectly by CBLDatabase::sendNotifications.
+        void call() {
+            DocIDs docIDs;
+            {
+                LOCK(_mutex);
+                std::swap(docIDs, _ready);
+                _notified = false;
+            }
+            auto cb = callback();
+            CBLDatabase *db;
+            {
+                LOCK(_dbMutex);
+                db = _db;
+            }
+            if (!cb || !db || docIDs.empty())
+                return;
+            size_t batchSize = _maxBatchSize ? _maxBatchSize : docIDs.size();
+            std::vector<FLString> flDocIDs(std::min(batchSize, docIDs.size()));
+            for (size_t start = 0; start < docIDs.size(); start += batchSize) {
+                size_t n = std::min(batchSize, docIDs.size() - start);
+                for (size_t i = 0; i < n; ++i)
+                    flDocIDs[i] = docIDs[start + i];
+                cb(_context, db, unsigned(n), flDocIDs.data());
+            }
+        }
+
+        void remove() override {
+            stopDelivering();
+            CBLListenerToken::remove();
+        }
+
+        // Called by the database's destructor; afterwards the token won't touch the database.
+        void databaseClosing() {
+            stopDelivering();
+            removed();
+        }
+
+    private:
+        using DocIDs = std::vector<alloc_slice>;
+
+        // Moves the pending doc IDs to the list to be passed to the callback, and queues a
+        // notification unless one is already queued.
+        // (If this is called early because the batch filled up, the timer may still fire later;
+        // then it just delivers whatever has changed since.)
+        void deliver() {
+            {
+                LOCK(_mutex);
+                if (_pending.empty() || !callback())
+                    return;
+                if (_ready.empty())
+                    std::swap(_ready, _pending);
+                else
+                    _ready.insert(_ready.end(), std::make_move_iterator(_pending.begin()),
+                                  std::make_move_iterator(_pending.end()));
+                _pending.clear();
+                _pendingSet.clear();
+                if (_notified)
+                    return;
+                _notified = true;
+            }
+            // Hold `_dbMutex` so the database can't go away meanwhile. (It's recursive because,
+            // without a notification queue, the callback is called right here and may remove
+            // the token.)
+            LOCK(_dbMutex);
+            if (_db)
+                _db->notify(this);
+        }
+
+        // Stops the timer, and makes sure that no call in progress will use `_db` from now on.
+        void stopDelivering() {
+            {
+                LOCK(_dbMutex);
+                _db = nullptr;
+            }
+            _timer.stop();
+        }
+
+        std::recursive_mutex                _dbMutex;
+        CBLDatabase* _cbl_nullable          _db;        // Null once removed or closing
+        std::chrono::milliseconds const     _interval;
+        size_t const                        _maxBatchSize;
+        std::mutex                          _mutex;
+        DocIDs                              _pending;       // Changed doc IDs, in order
+        std::unordered_set<slice>           _pendingSet;    // Points into `_pending`'s slices
+        DocIDs                              _ready;         // Doc IDs to pass to the callback
+        bool                                _notified {false}; // Is a call() queued?
+        litecore::actor::Timer              _timer;
+    };
+
+}
+
+
+Retained<CBLListenerToken> CBLDatabase::addCoalescedListener(const CBLChangeCoalescingOptions *options,
+                                                             CBLDatabaseChangeListener listener,
+                                                             void *context)
+{
+    return addListener([&]{
+        Retained<CBLListenerToken> token = new CoalescingChangeListener(
+                                    this, (options ? *options : CBLChangeCoalescingOptions{}),
+                                    listener, context);
+        _coalescedListeners.add(token);
+        return token;
+    });
+}
+
+
+void CBLDatabase::callCoalescedListeners(unsigned nChanges, const FLString docIDs[]) {
+    auto snapshot = _coalescedListeners.tokens();
+    for (auto &token : *snapshot)
+        ((CoalescingChangeListener*)token.get())->addChanges(nChanges, docIDs);
+}
+
+
+void CBLDatabase::detachListenerTokens() {
+    _docListeners.forEach([](DocListenerToken *token) {
+        token->databaseClosing();
+    });
+    auto snapshot = _coalescedListeners.tokens();
+    for (auto &token : *snapshot)
+        ((CoalescingChangeListener*)token.get())->databaseClosing();
+}
+
+
+#pragma mark - IMPORT & EXPORT:
+
+
+namespace {
+
+    // A document parsed from a line of JSON, ready to be saved.
+    struct ImportedDoc {
+        alloc_slice docID;
+        Doc         body;
+    };
+
+
+    // Parses a chunk of JSON-lines text into docs. (This runs on a background thread.)
+    vector<ImportedDoc> parseJSONLines(alloc_slice text, alloc_slice idProperty) {
+        vector<ImportedDoc> docs;
+        auto pos = (const char*)text.buf, end = pos + text.size;
+        while (pos < end) {
+            auto eol = (const char*)memchr(pos, '\n', end - pos);
+            if (!eol)
+                eol = end;
+            slice line(pos, eol);
+            pos = eol + 1;
+            while (line.size > 0 && isspace((unsigned char)line[line.size - 1]))
+                line = slice(line.buf, line.size - 1);
+            if (line.size == 0)
+                continue;
+
+            FLError flErr;
+            Doc body = Doc::fromJSON(line, &flErr);
+            if (!body)
+                C4Error::raise(FleeceDomain, flErr, "Invalid JSON in import data");
+            Dict root = body.root().asDict();
+            if (!root)
+                C4Error::raise(FleeceDomain, kFLJSONError, "Import data line is not a JSON object");
+            alloc_slice docID;
+            if (idProperty)
+                docID = root[idProperty].asString();
+            if (!docID)
+                docID = C4Document::createDocID();
+            docs.push_back({docID, body});
+        }
+        return docs;
+    }
+
+
+    // A fixed set of threads parsing batches of JSON lines. Results are taken in the order the
+    // batches were submitted. The caller keeps the number of pending batches (submitted but not
+    // yet taken) bounded, so the queue and the parsed results don't grow without limit.
+    class ImportParsers {
+    public:
+        ImportParsers(unsigned threadCount, alloc_slice idProperty)
+        :_idProperty(std::move(idProperty))
+        {
+            try {
+                for (unsigned i = 0; i < threadCount; ++i)
+                    _threads.emplace_back([this] {work();});
+            } catch (...) {
+                stop();
+                throw;
+            }
+        }
+
+        ~ImportParsers() {
+            stop();
+        }
+
+        size_t pending() const {
+            lock_guard<mutex> lock(_mutex);
+            return size_t(_nextSubmit - _nextTake);
+        }
+
+        void submit(alloc_slice text) {
+            {
+                lock_guard<mutex> lock(_mutex);
+                _queue.emplace_back(_nextSubmit++, std::move(text));
+            }
+            _cond.notify_all();
+        }
+
+        // Waits for the oldest pending batch to be parsed, and returns it.
+        vector<ImportedDoc> takeNext() {
+            unique_lock<mutex> lock(_mutex);
+            _cond.wait(lock, [&] {return _results.count(_nextTake) > 0;});
+            auto i = _results.find(_nextTake++);
+            Result result = std::move(i->second);
+            _results.erase(i);
+            if (result.error)
+                rethrow_exception(result.error);
+            return std::move(result.docs);
+        }
+
+    private:
+        struct Result {
+            vector<ImportedDoc> docs;
+            exception_ptr       error;
+        };
+
+        void work() {
+            unique_lock<mutex> lock(_mutex);
+            while (true) {
+                _cond.wait(lock, [&] {return _stopping || !_queue.empty();});
+                if (_stopping)
+                    return;
+                auto [seq, text] = std::move(_queue.front());
+                _queue.pop_front();
+                lock.unlock();
+                Result result;
+                try {
+                    result.docs = parseJSONLines(std::move(text), _idProperty);
+                } catch (...) {
+                    result.error = current_exception();
+                }
+                lock.lock();
+                _results.emplace(seq, std::move(result));
+                _cond.notify_all();
+            }
+        }
+
+        void stop() {
+            {
+                lock_guard<mutex> lock(_mutex);
+                _stopping = true;
+            }
+            _cond.notify_all();
+            for (auto &t : _threads)
+                t.join();
+            _threads.clear();
+        }
+
+        alloc_slice const                       _idProperty;
+        mutable mutex                           _mutex;
+        condition_variable                      _cond;
+        deque<pair<uint64_t, alloc_slice>>      _queue;         // Batches waiting for a thread
+        map<uint64_t, Result>                   _results;       // Parsed, not yet taken
+        uint64_t                                _nextSubmit {0}, _nextTake {0};
+        bool                                    _stopping {false};
+        vector<thread>                          _threads;
+    };
+
+
+    // Saves the docs in a single transaction, replacing any existing revisions.
+    void saveImportedDocs(C4Database *c4db, const vector<ImportedDoc> &docs) {
+        C4Database::Transaction t(c4db);
+        for (auto &doc : docs) {
+            Dict root = doc.body.root().asDict();
+            SharedEncoder enc(c4db->sharedFleeceEncoder());
+            enc.writeValue(root);
+            FLError flErr;
+            alloc_slice body = enc.finish(&flErr);
+            if (!body)
+                C4Error::raise(FleeceDomain, flErr);
+            C4RevisionFlags revFlags = C4Document::dictContainsBlobs(root) ? kRevHasAttachments : 0;
+
+            C4DocPutRequest rq = {};
+            rq.allocedBody = {body.buf, body.size};
+            rq.docID = doc.docID;
+            rq.revFlags = revFlags;
+            rq.save = true;
+            C4Error c4err;
+            Retained<C4Document> newDoc = c4db->putDocument(rq, nullptr, &c4err);
+            if (!newDoc) {
+                if (c4err != C4Error{LiteCoreDomain, kC4ErrorConflict})
+                    C4Error::raise(c4err);
+                // The doc already exists, so update its current revision:
+                newDoc = c4db->getDocument(doc.docID, true, kDocGetCurrentRev);
+                if (!newDoc || !newDoc->update(body, revFlags))
+                    C4Error::raise(LiteCoreDomain, kC4ErrorConflict,
+                                   "Couldn't replace document '%.*s'", FMTSLICE(doc.docID));
+            }
+        }
+        t.commit();
+    }
+
+}
+
+
+uint64_t CBLDatabase::importJSONLines(ImportReader read, const CBLImportOptions *options) {
+    static constexpr unsigned kDefaultBatchSize = 1000;
+    static constexpr size_t kReadBufferSize = 1 << 20;
+
+    CBLImportOptions opt = options ? *options : CBLImportOptions{};
+    unsigned batchSize = opt.batchSize ? opt.batchSize : kDefaultBatchSize;
+    unsigned workerCount = opt.workerCount;
+    if (workerCount == 0) {
+        unsigned cores = thread::hardware_concurrency();
+        workerCount = (cores > 1) ? cores - 1 : 1;
+    }
+    alloc_slice idProperty(opt.idProperty);
+
+    ImportParsers parsers(workerCount, idProperty);
+    uint64_t docCount = 0, bytesRead = 0;
+    bool stopped = false;
+
+    // Waits for the oldest batch to be parsed, saves it, and reports progress:
+    auto saveNextBatch = [&] {
+        vector<ImportedDoc> docs = parsers.takeNext();
+        useLocked([&](C4Database *c4db) {
+            saveImportedDocs(c4db, docs);
+        });
+        docCount += docs.size();
+        if (opt.progress && !opt.progress(opt.context, docCount, bytesRead))
+            stopped = true;
+    };
+
+    // Hands a chunk of complete lines to the parser threads. Once there's a batch for every
+    // worker, saves one before returning, so at most `workerCount` batches are in memory.
+    auto parseBatch = [&](slice text) {
+        parsers.submit(alloc_slice(text));
+        if (parsers.pending() > workerCount)
+            saveNextBatch();
+    };
+
+    string buffer;
+    size_t scanned = 0, lineCount = 0;
+    vector<char> chunk(kReadBufferSize);
+    while (!stopped) {
+        int64_t n = read(chunk.data(), chunk.size());
+        if (n < 0)
+            C4Error::raise(LiteCoreDomain, kC4ErrorIOError, "Couldn't read import data");
+        else if (n == 0)
+            break;
+        bytesRead += n;
+        buffer.append(chunk.data(), size_t(n));
+
+        // Find the complete lines, and parse them in batches:
+        size_t batchStart = 0;
+        while (!stopped) {
+            size_t eol = buffer.find('\n', scanned);
+            if (eol == string::npos)
+                break;
+            scanned = eol + 1;
+            if (++lineCount == batchSize) {
+                parseBatch(slice(&buffer[batchStart], scanned - batchStart));
+                batchStart = scanned;
+                lineCount = 0;
+            }
+        }
+        buffer.erase(0, batchStart);
+        scanned -= batchStart;
+    }
+
+    if (!stopped && !buffer.empty())
+        parseBatch(slice(buffer));
+    while (!stopped && parsers.pending() > 0)
+        saveNextBatch();
+    return docCount;
+}
+
+
+uint64_t CBLDatabase::importJSONLines(slice path, const CBLImportOptions *options) {
+    unique_ptr<FILE, decltype(&fclose)> file(fopen(string(path).c_str(), "rb"), &fclose);
+    if (!file)
+        C4Error::raise(POSIXDomain, errno, "Couldn't open %.*s", FMTSLICE(path));
+    return importJSONLines([&](void *buffer, size_t size) -> int64_t {
+        size_t n = fread(buffer, 1, size, file.get());
+        return ferror(file.get()) ? -1 : int64_t(n);
+    }, options);
+}
+
+
+namespace {
+
+    // Buffers JSON lines and passes them to an ExportWriter in large chunks.
+    class JSONLinesBuffer {
+    public:
+        static constexpr size_t kChunkSize = 1 << 20;
+
+        explicit JSONLinesBuffer(CBLDatabase::ExportWriter write)
+        :_write(write)
+        {
+            _buffer.reserve(kChunkSize + kChunkSize / 4);
+        }
+
+        bool full() const                   {return _buffer.size() >= kChunkSize;}
+
+        void addLine(slice json) {
+            _buffer.append((const char*)json.buf, json.size);
+            _buffer += '\n';
+        }
+
+        // Adds a JSON object, inserting a string property into it first.
+        void addLine(slice json, slice key, slice value) {
+            _buffer += '{';
+            appendString(key);
+            _buffer += ':';
+            appendString(value);
+            if (json.size > 2)
+                _buffer += ',';
+            addLine(slice((const char*)json.buf + 1, json.size - 1));
+        }
+
+        void flush() {
+            if (!_buffer.empty()) {
+                if (!_write(slice(_buffer)))
+                    C4Error::raise(LiteCoreDomain, kC4ErrorIOError, "Export writer failed");
+                _buffer.clear();
+            }
+        }
+
+    private:
+        void appendString(slice str) {
+            _buffer += '"';
+            for (uint8_t c : str) {
+                if (c == '"' || c == '\\') {
+                    _buffer += '\\';
+                    _buffer += char(c);
+                } else if (c < 0x20) {
+                    char escape[8];
+                    snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    _buffer += escape;
+                } else {
+                    _buffer += char(c);
+                }
+            }
+            _buffer += '"';
+        }
+
+        CBLDatabase::ExportWriter _write;
+        string _buffer;
+    };
+
+}
+
+
+uint64_t CBLDatabase::exportJSONLines(CBLQuery *query, slice idProperty, ExportWriter write) {
+    JSONLinesBuffer buffer(write);
+    uint64_t count = 0;
+
+    if (query) {
+        if (query->database() != this)
+            C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter,
+                           "Query belongs to a different database");
+        // LiteCore has already collected the results by the time execute() returns, so iterating
+        // them doesn't require the database lock:
+        Retained<CBLResultSet> rs = query->execute();
+        unsigned nCols = query->columnCount();
+        JSONEncoder enc;
+        while (rs->next()) {
+            enc.beginDict(nCols);
+            for (unsigned i = 0; i < nCols; ++i) {
+                if (Value value = rs->column(i); value) {
+                    enc.writeKey(query->columnName(i));
+                    enc.writeValue(value);
+                }
+            }
+            enc.endDict();
+            buffer.addLine(enc.finish());
+            enc.reset();
+            ++count;
+            if (buffer.full())
+                buffer.flush();
+        }
+    } else {
+        // Page through the docs in ID order, releasing the lock while each chunk is written.
+        // Every page is a new query for the IDs after the last one written, so nothing is left
+        // open across the lock releases for a concurrent write or close to invalidate:
+        static constexpr unsigned kPageSize = 1000;
+        char queryStr[120];
+        snprintf(queryStr, sizeof(queryStr),
+                 "SELECT meta().id FROM _ WHERE meta().id > $after ORDER BY meta().id LIMIT %u",
+                 kPageSize);
+        Retained<C4Query> pageQuery = useLocked()->newQuery(kC4N1QLQuery, slice(queryStr),
+                                                            nullptr);
+        JSONEncoder enc;
+        alloc_slice lastDocID(""_sl);
+        bool more = true;
+        while (more) {
+            useLocked([&](C4Database *c4db) {
+                while (more && !buffer.full()) {
+                    Encoder penc;
+                    penc.beginDict();
+                    penc.writeKey("after"_sl);
+                    penc.writeString(lastDocID);
+                    penc.endDict();
+                    alloc_slice params = penc.finish();
+                    auto e = pageQuery->run(nullptr, params);
+                    unsigned rows = 0;
+                    while (!buffer.full() && e.next()) {
+                        ++rows;
+                        lastDocID = Array::iterator(e.columns()).value().asString();
+                        Retained<C4Document> doc = c4db->getDocument(lastDocID, true,
+                                                                     kDocGetCurrentRev);
+                        Dict body = doc->getProperties();
+                        if (!idProperty) {
+                            buffer.addLine(doc->bodyAsJSON(false));
+                        } else if (!body[idProperty]) {
+                            buffer.addLine(doc->bodyAsJSON(false), idProperty, doc->docID());
+                        } else {
+                            // The body has a property of that name already; the ID replaces it,
+                            // rather than the line having the key twice:
+                            enc.beginDict();
+                            enc.writeKey(idProperty);
+                            enc.writeString(doc->docID());
+                            for (Dict::iterator i(body); i; ++i) {
+                                if (i.keyString() != idProperty) {
+                                    enc.writeKey(i.keyString());
+                                    enc.writeValue(i.value());
+                                }
+                            }
+                            enc.endDict();
+                            buffer.addLine(enc.finish());
+                            enc.reset();
+                        }
+                        ++count;
+                    }
+                    // A short page means there are no more docs; a full buffer means there
+                    // may be:
+                    more = buffer.full() || rows == kPageSize;
+                }
+            });
+            buffer.flush();
+        }
+    }
+
+    buffer.flush();
+    return count;
+}
+
+#pragma mark - BLOB STORE:
+
+
+CBLBlobStoreStats CBLDatabase::blobStoreStats(CBLBlobSize *largest, size_t maxLargest) const {
+    static constexpr unsigned kBatchSize = 1000;
+
+    CBLBlobStoreStats stats = {};
+    vector<BlobFile> files = listBlobFiles(this);
+    unordered_map<string, uint64_t> sizes;
+    for (auto &file : files) {
+        sizes.emplace(file.digest, file.size);
+        stats.totalBytes += file.size;
+    }
+    stats.blobCount = files.size();
+
+    // Scan the current revisions a batch at a time, so the database isn't locked for long:
+    unordered_set<string> reachable;
+    auto addReference = [&](slice digest) {
+        auto i = sizes.find(string(digest));
+        if (i == sizes.end())
+            return;         // Missing blob; nothing to count
+        ++stats.referenceCount;
+        stats.referencedBytes += i->second;
+        if (reachable.insert(i->first).second) {
+            ++stats.reachableCount;
+            stats.reachableBytes += i->second;
+        }
+    };
+    unique_ptr<C4DocEnumerator> e;
+    bool more = !files.empty();
+    try {
+        while (more) {
+            useLocked([&](C4Database *c4db) {
+                if (!e)
+                    e = make_unique<C4DocEnumerator>(c4db, C4EnumeratorOptions{
+                                                    kC4IncludeNonConflicted | kC4IncludeBodies});
+                for (unsigned n = 0; n < kBatchSize && (more = e->next()); ++n) {
+                    if (e->documentInfo().flags & kDocHasAttachments) {
+                        Retained<C4Document> doc = e->getDocument();
+                        forEachBlobReference(Dict(doc->getProperties()), addReference);
+                    }
+                }
+                if (!more)
+                    e = nullptr;
+            });
+        }
+    } catch (...) {
+        useLocked([&](C4Database*) { e = nullptr; });
+        throw;
+    }
+
+    if (largest && maxLargest > 0) {
+        size_t n = min(maxLargest, files.size());
+        partial_sort(files.begin(), files.begin() + n, files.end(),
+                     [](const BlobFile &a, const BlobFile &b) {return a.size > b.size;});
+        for (size_t i = 0; i < n; ++i) {
+            CBLBlobSize &item = largest[i];
+            item = {};
+            strncpy(item.digest, files[i].digest.c_str(), sizeof(item.digest) - 1);
+            item.size = files[i].size;
+        }
+        stats.largestCount = n;
+    }
+    return stats;
 }
 
 
@@ -167,3 +1928,101 @@ Retained<CBLBlob> CBLDatabase::getBlob(FLDict properties) {
 void CBLDatabase::saveBlob(CBLBlob* blob) {
     blob->install(this);
 }
+
+
+alloc_slice CBLDatabase::getBlobContents(const C4BlobKey &key) const {
+    if (_blobCacheCapacity == 0)
+        return blobStore()->getContents(key);
+
+    slice keyBytes(key.bytes, sizeof(key.bytes));
+    {
+        LOCK(_blobCacheMutex);
+        if (auto i = _blobCacheIndex.find(keyBytes); i != _blobCacheIndex.end()) {
+            ++_blobCacheHits;
+            _blobCache.splice(_blobCache.begin(), _blobCache, i->second);
+            return i->second->content;
+        }
+        ++_blobCacheMisses;
+    }
+
+    // Read the blob without holding the cache's lock:
+    alloc_slice content = blobStore()->getContents(key);
+    if (content.size > _blobCacheCapacity / 4)
+        return content;
+
+    LOCK(_blobCacheMutex);
+    if (_blobCacheIndex.find(keyBytes) == _blobCacheIndex.end()) {
+        _blobCache.push_front({key, content});
+        auto &entry = _blobCache.front();
+        _blobCacheIndex[slice(entry.key.bytes, sizeof(entry.key.bytes))] = _blobCache.begin();
+        _blobCacheSize += content.size;
+        while (_blobCacheSize > _blobCacheCapacity) {
+            auto &last = _blobCache.back();
+            _blobCacheSize -= last.content.size;
+            _blobCacheIndex.erase(slice(last.key.bytes, sizeof(last.key.bytes)));
+            _blobCache.pop_back();
+        }
+    }
+    return content;
+}
+
+
+// Helpers from LiteCore's task pool that CBLDatabase::saveBlobs uses, besides the caller's thread.
+static constexpr size_t kMaxBlobInstallHelpers = 3;
+
+
+void CBLDatabase::saveBlobs(CBLBlob* const blobs[], size_t count) {
+    // Installing a blob from memory writes & digests its file, so spread them over a few threads;
+    // the blob store's files are independent of each other and of the database's lock.
+    size_t nHelpers = std::min(count, kMaxBlobInstallHelpers + 1) - 1;
+    if (count == 0 || nHelpers == 0 || std::thread::hardware_concurrency() <= 1) {
+        for (size_t i = 0; i < count; ++i)
+            blobs[i]->install(this);
+        return;
+    }
+
+    // The caller only waits until every blob is done, not for every helper to have run, so a
+    // helper the pool gets to late must find the batch still there (with nothing left to do):
+    struct Batch {
+        CBLDatabase*                db;
+        CBLBlob* const*             blobs;
+        size_t                      count;
+        std::atomic<size_t>         next {0};
+        std::mutex                  mutex;
+        std::condition_variable     cond;
+        size_t                      finished {0};
+        std::exception_ptr          error;
+
+        void work() {
+            for (size_t i; (i = next++) < count; ) {
+                std::exception_ptr x;
+                try {
+                    blobs[i]->install(db);
+                } catch (...) {
+                    x = std::current_exception();
+                }
+                LOCK(mutex);
+                if (x && !error)
+                    error = x;
+                if (++finished == count)
+                    cond.notify_all();
+            }
+        }
+    };
+    auto batch = std::make_shared<Batch>();
+    batch->db = this;
+    batch->blobs = blobs;
+    batch->count = count;
+    for (size_t h = 0; h < nHelpers; ++h) {
+        c4_runAsyncTask([](void *context) {
+            std::unique_ptr<std::shared_ptr<Batch>> b((std::shared_ptr<Batch>*)context);
+            (*b)->work();
+        }, new std::shared_ptr<Batch>(batch));
+    }
+    batch->work();
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->cond.wait(lock, [&] {return batch->finished == count;});
+    if (batch->error)
+        std::rethrow_exception(batch->error);
+}
@@ -17,6 +17,7 @@
 //
 
 #include "CBLDatabase_Internal.hh"
+#include "CBLDocEnumerator_Internal.hh"
 #include "CBLDocument_Internal.hh"
 #include "CBLBlob_Internal.hh"
 #include "CBLDatabase.h"
@@ -52,6 +53,20 @@ bool CBL_CopyDatabase(FLString fromPath,
 }
 
 
+bool CBL_CopyDatabaseWithProgress(FLString fromPath,
+                                  FLString toName,
+                                  const CBLDatabaseConfiguration* config,
+                                  CBLCopyProgressCallback progress,
+                                  void* context,
+                                  CBLError* outError) noexcept
+{
+    try {
+        CBLDatabase::copyDatabase(fromPath, toName, config, progress, context);
+        return true;
+    } catchAndBridge(outError)
+}
+
+
 bool CBL_DeleteDatabase(FLString name,
                         FLString inDirectory,
                         CBLError *outError) noexcept
@@ -72,6 +87,23 @@ CBLDatabase* CBLDatabase_Open(FLString name,
 }
 
 
+CBLDatabase* CBLDatabase_OpenShared(FLString name,
+                                    const CBLDatabaseConfiguration *config,
+                                    CBLError *outError) noexcept
+{
+    try {
+        return CBLDatabase::openShared(name, config).detach();
+    } catchAndBridge(outError)
+}
+
+
+void CBL_SetDatabaseCacheLimits(unsigned maxOpen, double idleTimeout) noexcept {
+    try {
+        CBLDatabase::setSharedCacheLimits(maxOpen, idleTimeout);
+    } catchAndBridgeReturning(nullptr, )
+}
+
+
 bool CBLDatabase_Close(CBLDatabase* db, CBLError* outError) noexcept {
     try {
         if (db)
@@ -111,6 +143,27 @@ bool CBLDatabase_ChangeEncryptionKey(CBLDatabase *db,
         return true;
     } catchAndBridge(outError)
 }
+
+void CBLDatabase_ChangeEncryptionKeyAsync(CBLDatabase *db,
+                                          const CBLEncryptionKey *newKey,
+                                          CBLChangeEncryptionKeyCompletion completion,
+                                          void* context) noexcept
+{
+    try {
+        Retained<CBLDatabase> retainedDB = db;
+        CBLEncryptionKey key = newKey ? *newKey : CBLEncryptionKey{};
+        db->runAsync(true, [=]() mutable {
+            CBLError error = {};
+            bool changed = CBLDatabase_ChangeEncryptionKey(retainedDB, &key, &error);
+            CBLEncryptionKey_Clear(&key);
+            if (completion) {
+                retainedDB->notifyAsync([=] {
+                    completion(context, retainedDB, changed ? nullptr : &error);
+                });
+            }
+        });
+    } catchAndBridgeReturning(nullptr, )
+}
 #endif
 
 bool CBLDatabase_PerformMaintenance(CBLDatabase* db,
@@ -123,6 +176,21 @@ bool CBLDatabase_PerformMaintenance(CBLDatabase* db,
     } catchAndBridge(outError)
 }
 
+bool CBLDatabase_ScheduleMaintenance(CBLDatabase* db,
+                                     const CBLMaintenanceType steps[],
+                                     size_t count,
+                                     double timeBudget,
+                                     CBLMaintenanceProgressCallback callback,
+                                     void* context,
+                                     CBLError* outError) noexcept
+{
+    try {
+        db->scheduleMaintenance(vector<CBLMaintenanceType>(steps, steps + count),
+                                timeBudget, callback, context);
+        return true;
+    } catchAndBridge(outError)
+}
+
 
 FLString CBLDatabase_Name(const CBLDatabase* db) noexcept {
     return db->name();
@@ -142,6 +210,43 @@ uint64_t CBLDatabase_Count(const CBLDatabase* db) noexcept {
     } catchAndWarn();
 }
 
+void CBLDatabase_SetLockStatsEnabled(CBLDatabase* db, bool enabled) noexcept {
+    db->lockStats().setEnabled(enabled);
+}
+
+CBLLockStats CBLDatabase_GetLockStats(const CBLDatabase* db) noexcept {
+    return db->lockStats().get();
+}
+
+bool CBLDatabase_SetPageCacheSize(CBLDatabase* db, unsigned sizeKB, CBLError* outError) noexcept {
+    try {
+        db->setPageCacheSize(sizeKB);
+        return true;
+    } catchAndBridge(outError)
+}
+
+void CBLDatabase_ReleaseMemory(CBLDatabase* db, CBLMemoryPressure level) noexcept {
+    try {
+        db->releaseMemory(level);
+    } catchAndBridgeReturning(nullptr, )
+}
+
+void CBL_HandleMemoryPressure(CBLMemoryPressure level) noexcept {
+    try {
+        CBLDatabase::releaseAllMemory(level);
+    } catchAndBridgeReturning(nullptr, )
+}
+
+CBLMemoryStats CBLDatabase_GetMemoryStats(const CBLDatabase* db) noexcept {
+    try {
+        return db->memoryStats();
+    } catchAndWarn()
+}
+
+CBLDatabaseOpenStats CBLDatabase_GetOpenStats(const CBLDatabase* db) noexcept {
+    return db->openStats();
+}
+
 uint64_t CBLDatabase_LastSequence(const CBLDatabase* db) noexcept {
     try {
         return db->lastSequence();
@@ -149,6 +254,62 @@ uint64_t CBLDatabase_LastSequence(const CBLDatabase* db) noexcept {
 }
 
 
+#pragma mark - IMPORT & EXPORT:
+
+
+bool CBLDatabase_ImportJSONLines(CBLDatabase* db,
+                                 FLString path,
+                                 const CBLImportOptions* options,
+                                 uint64_t* outDocCount,
+                                 CBLError* outError) noexcept
+{
+    try {
+        uint64_t n = db->importJSONLines(path, options);
+        if (outDocCount)
+            *outDocCount = n;
+        return true;
+    } catchAndBridge(outError)
+}
+
+
+bool CBLDatabase_ImportJSONLinesFromReader(CBLDatabase* db,
+                                           CBLImportReader reader,
+                                           void* readerContext,
+                                           const CBLImportOptions* options,
+                                           uint64_t* outDocCount,
+                                           CBLError* outError) noexcept
+{
+    try {
+        uint64_t n = db->importJSONLines([&](void *buffer, size_t size) {
+            return reader(readerContext, buffer, size);
+        }, options);
+        if (outDocCount)
+            *outDocCount = n;
+        return true;
+    } catchAndBridge(outError)
+}
+
+
+
+bool CBLDatabase_ExportJSONLines(CBLDatabase* db,
+                                 CBLQuery* query,
+                                 FLString idProperty,
+                                 CBLExportWriter writer,
+                                 void* context,
+                                 uint64_t* outCount,
+                                 CBLError* outError) noexcept
+{
+    try {
+        uint64_t n = db->exportJSONLines(query, idProperty, [&](slice data) {
+            return writer(context, data.buf, data.size);
+        });
+        if (outCount)
+            *outCount = n;
+        return true;
+    } catchAndBridge(outError)
+}
+
+
 #pragma mark - DOCUMENTS:
 
 
@@ -164,6 +325,77 @@ const CBLDocument* CBLDatabase_GetDocument(const CBLDatabase* db, FLString docID
 }
 
 
+bool CBLDatabase_GetDocuments(const CBLDatabase* db,
+                              const FLString docIDs[],
+                              size_t count,
+                              const CBLDocument* outDocs[],
+                              CBLError* outError) noexcept
+{
+    try {
+        auto docs = db->getDocuments(docIDs, count);
+        for (size_t i = 0; i < count; ++i)
+            outDocs[i] = std::move(docs[i]).detach();
+        return true;
+    } catchAndBridge(outError)
+}
+
+
+FLDict CBLDatabase_GetDocumentsProperties(const CBLDatabase* db,
+                                          const FLString docIDs[],
+                                          size_t count,
+                                          CBLError* outError) noexcept
+{
+    try {
+        Doc doc = db->getDocumentsProperties(docIDs, count);
+        return FLDict_Retain(doc.root().asDict());
+    } catchAndBridge(outError)
+}
+
+
+void CBLDatabase_GetDocumentAsync(const CBLDatabase* db,
+                                  FLString docID,
+                                  CBLGetDocumentCompletion completion,
+                                  void* context) noexcept
+{
+    try {
+        RetainedConst<CBLDatabase> retainedDB = db;
+        db->runAsync(false, [=, id = alloc_slice(docID)] {
+            RetainedConst<CBLDocument> doc;
+            CBLError error = {};
+            try {
+                doc = retainedDB->getDocument(id);
+            } catch (...) {
+                error = external(C4Error::fromCurrentException());
+            }
+            retainedDB->notifyAsync([=] {
+                completion(context, doc, error.code ? &error : nullptr);
+            });
+        });
+    } catchAndBridgeReturning(nullptr, )
+}
+
+
+CBLDocEnumerator* CBLDatabase_EnumerateDocuments(const CBLDatabase* db,
+                                                 const CBLDocEnumeratorOptions* options,
+                                                 CBLError* outError) noexcept
+{
+    try {
+        return retain(new CBLDocEnumerator(const_cast<CBLDatabase*>(db),
+                                           options ? *options : CBLDocEnumeratorOptions{}));
+    } catchAndBridge(outError)
+}
+
+
+const CBLDocument* CBLDocEnumerator_Next(CBLDocEnumerator* e, CBLError* outError) noexcept {
+    try {
+        auto doc = e->next();
+        if (!doc && outError)
+            outError->code = 0;
+        return doc;
+    } catchAndBridge(outError)
+}
+
+
 CBLDocument* CBLDatabase_GetMutableDocument(CBLDatabase* db, FLString docID,
                                             CBLError* outError) noexcept
 {
@@ -212,6 +444,46 @@ bool CBLDatabase_SaveDocumentWithConflictHandler(CBLDatabase* db,
     } catchAndBridge(outError)
 }
 
+bool CBLDatabase_SaveDocuments(CBLDatabase* db,
+                               CBLDocument* const docs[],
+                               size_t count,
+                               CBLConcurrencyControl concurrency,
+                               CBLError* outResults,
+                               CBLError* outError) noexcept
+{
+    try {
+        C4Error error = CBLDocument::saveDocuments(db, docs, count, concurrency,
+                                                   internal(outResults));
+        if (!error.code)
+            return true;
+        if (outError)
+            *outError = external(error);
+        return false;
+    } catchAndBridge(outError)
+}
+
+void CBLDatabase_SaveDocumentAsync(CBLDatabase* db,
+                                   CBLDocument* doc,
+                                   CBLConcurrencyControl concurrency,
+                                   CBLSaveDocumentCompletion completion,
+                                   void* context) noexcept
+{
+    try {
+        Retained<CBLDatabase> retainedDB = db;
+        Retained<CBLDocument> retainedDoc = doc;
+        db->runAsync(true, [=] {
+            CBLError error = {};
+            bool saved = CBLDatabase_SaveDocumentWithConcurrencyControl(retainedDB, retainedDoc,
+                                                                        concurrency, &error);
+            if (completion) {
+                retainedDB->notifyAsync([=] {
+                    completion(context, retainedDoc, saved, saved ? nullptr : &error);
+                });
+            }
+        });
+    } catchAndBridgeReturning(nullptr, )
+}
+
 bool CBLDatabase_DeleteDocument(CBLDatabase *db,
                                 const CBLDocument* doc,
                                 CBLError* outError) noexcept
@@ -268,6 +540,25 @@ bool CBLDatabase_PurgeDocumentByID(CBLDatabase* db,
     } catchAndBridge(outError)
 }
 
+int64_t CBLDatabase_PurgeDocuments(CBLDatabase* db,
+                                   const FLString docIDs[],
+                                   size_t count,
+                                   CBLError* outError) noexcept
+{
+    try {
+        return int64_t(db->purgeDocuments(docIDs, count));
+    } catchAndBridgeReturning(outError, -1)
+}
+
+int64_t CBLDatabase_PurgeDocumentsWhere(CBLDatabase* db,
+                                        FLString where,
+                                        CBLError* outError) noexcept
+{
+    try {
+        return int64_t(db->purgeDocumentsWhere(where));
+    } catchAndBridgeReturning(outError, -1)
+}
+
 CBLTimestamp CBLDatabase_GetDocumentExpiration(CBLDatabase* db,
                                                FLSlice docID,
                                                CBLError* outError) noexcept
@@ -288,6 +579,53 @@ bool CBLDatabase_SetDocumentExpiration(CBLDatabase* db,
     } catchAndBridge(outError)
 }
 
+int64_t CBLDatabase_SetDocumentsExpiration(CBLDatabase* db,
+                                           const FLString docIDs[],
+                                           size_t count,
+                                           CBLTimestamp expiration,
+                                           CBLError* outError) noexcept
+{
+    try {
+        return int64_t(db->setDocumentsExpiration(docIDs, count, expiration));
+    } catchAndBridgeReturning(outError, -1)
+}
+
+CBLTimestamp CBLDatabase_NextDocumentExpiration(CBLDatabase* db, CBLError* outError) noexcept {
+    try {
+        return db->nextDocumentExpiration();
+    } catchAndBridgeReturning(outError, -1)
+}
+
+int64_t CBLDatabase_PurgeExpiredDocuments(CBLDatabase* db,
+                                          unsigned batchSize,
+                                          double timeBudget,
+                                          CBLError* outError) noexcept
+{
+    try {
+        return int64_t(db->purgeExpiredDocuments(batchSize, timeBudget));
+    } catchAndBridgeReturning(outError, -1)
+}
+
+
+
+#pragma mark - CHANGES FEED:
+
+
+int64_t CBLDatabase_EnumerateChanges(const CBLDatabase* db,
+                                     uint64_t sinceSequence,
+                                     unsigned batchSize,
+                                     bool includeBodies,
+                                     CBLChangesCallback callback,
+                                     void* context,
+                                     CBLError* outError) noexcept
+{
+    try {
+        return int64_t(db->enumerateChanges(sinceSequence, batchSize, includeBodies,
+                                            [&](const CBLChangedDocument changes[], unsigned n) {
+            return callback(context, changes, n);
+        }));
+    } catchAndBridgeReturning(outError, -1)
+}
 
 #pragma mark - QUERIES:
 
@@ -315,6 +653,50 @@ bool CBLDatabase_CreateFullTextIndex(CBLDatabase *db,
 }
 
 
+bool CBLDatabase_CreateIndexes(CBLDatabase *db,
+                               const CBLIndexSpec specs[],
+                               size_t count,
+                               CBLError *outError) noexcept
+{
+    try {
+        db->createIndexes(specs, count);
+        return true;
+    } catchAndBridge(outError)
+}
+
+CBLIndexBuild* CBLDatabase_CreateValueIndexAsync(CBLDatabase *db,
+                                                 FLString name,
+                                                 CBLValueIndexConfiguration config,
+                                                 CBLIndexBuildListener listener,
+                                                 void *context,
+                                                 CBLError *outError) noexcept
+{
+    try {
+        return db->createIndexAsync(IndexSpec(name, config), listener, context).detach();
+    } catchAndBridge(outError)
+}
+
+CBLIndexBuild* CBLDatabase_CreateFullTextIndexAsync(CBLDatabase *db,
+                                                    FLString name,
+                                                    CBLFullTextIndexConfiguration config,
+                                                    CBLIndexBuildListener listener,
+                                                    void *context,
+                                                    CBLError *outError) noexcept
+{
+    try {
+        return db->createIndexAsync(IndexSpec(name, config), listener, context).detach();
+    } catchAndBridge(outError)
+}
+
+CBLIndexBuildState CBLIndexBuild_State(const CBLIndexBuild* build) noexcept {
+    return build->state();
+}
+
+void CBLIndexBuild_Cancel(CBLIndexBuild* build) noexcept {
+    build->cancel();
+}
+
+
 bool CBLDatabase_DeleteIndex(CBLDatabase *db,
                              FLString name,
                              CBLError *outError) noexcept
@@ -333,6 +715,20 @@ FLArray CBLDatabase_GetIndexNames(CBLDatabase *db) noexcept {
 }
 
 
+void CBLDatabase_SetIndexStatsEnabled(CBLDatabase *db, bool enabled) noexcept {
+    try {
+        db->setIndexStatsEnabled(enabled);
+    } catchAndBridgeReturning(nullptr, )
+}
+
+
+FLDict CBLDatabase_GetIndexStats(CBLDatabase *db) noexcept {
+    try {
+        return FLMutableDict_Retain(db->indexStats());
+    } catchAndWarn()
+}
+
+
 CBLListenerToken* CBLDatabase_AddChangeListener(const CBLDatabase* constdb,
                                                 CBLDatabaseChangeListener listener,
                                                 void *context) noexcept
@@ -341,6 +737,18 @@ CBLListenerToken* CBLDatabase_AddChangeListener(const CBLDatabase* constdb,
 }
 
 
+CBLListenerToken* CBLDatabase_AddCoalescedChangeListener(const CBLDatabase* constdb,
+                                                         const CBLChangeCoalescingOptions* options,
+                                                         CBLDatabaseChangeListener listener,
+                                                         void *context) noexcept
+{
+    try {
+        return const_cast<CBLDatabase*>(constdb)->addCoalescedListener(options, listener,
+                                                                       context).detach();
+    } catchAndWarn()
+}
+
+
 CBLListenerToken* CBLDatabase_AddChangeDetailListener(const CBLDatabase* constdb,
                                                       CBLDatabaseChangeDetailListener listener,
                                                       void *context) noexcept
@@ -393,3 +801,13 @@ bool CBLDatabase_SaveBlob(CBLDatabase* db, CBLBlob* blob,
         return true;
     } catchAndBridge(outError)
 }
+
+
+bool CBLDatabase_SaveBlobs(CBLDatabase* db, CBLBlob* const blobs[], size_t count,
+                           CBLError* _cbl_nullable outError) noexcept
+{
+    try {
+        db->saveBlobs(blobs, count);
+        return true;
+    } catchAndBridge(outError)
+}
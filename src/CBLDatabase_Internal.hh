@@ -18,27 +18,46 @@
 
 #pragma once
 #include "CBLDatabase.h"
+#include "CBLAsync_Internal.hh"
+#include "CBLBlob.h"
 #include "CBLDocument_Internal.hh"
+#include "CBLIndex_Internal.hh"
 #include "CBLLog_Internal.hh"
+#include "CBLTrace_Internal.hh"
 #include "CBLPrivate.h"
+#include "c4BlobStore.hh"
 #include "c4Collection.hh"
 #include "c4Database.hh"
 #include "c4Observer.hh"
+#include "c4Query.hh"
 #include "Error.hh"
 #include "Internal.hh"
 #include "Listener.hh"
+#include "LockStats.hh"
 #include "access_lock.hh"
 #include "function_ref.hh"
 #include "fleece/Mutable.hh"
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 CBL_ASSUME_NONNULL_BEGIN
 
 namespace cbl_internal {
     class AllConflictsResolver;
     struct CBLLocalEndpoint;
+    struct CoalescingChangeListener;
+    class SharedQueryObserver;
 }
 
 
@@ -59,12 +78,9 @@ public:
 
     static void copyDatabase(slice fromPath,
                              slice toName,
-                             const CBLDatabaseConfiguration* _cbl_nullable config)
-    {
-        CBLLog_Init();
-        C4DatabaseConfig2 c4config = asC4Config(config);
-        C4Database::copyNamed(fromPath, toName, c4config);
-    }
+                             const CBLDatabaseConfiguration* _cbl_nullable config,
+                             CBLCopyProgressCallback _cbl_nullable progress =nullptr,
+                             void* _cbl_nullable context =nullptr);
 
     static void deleteDatabase(slice name, slice inDirectory) {
         CBLLog_Init();
@@ -80,34 +96,88 @@ public:
                            "The context hasn't been initialized. Call CBL_Init(CBLInitContext*) to initialize the context");
         }
 #endif
+        using namespace std::chrono;
+        auto start = steady_clock::now();
         CBLLog_Init();
+        if (config && config->storage.syncMode > kCBLSyncFull)
+            C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter, "Invalid syncMode %d",
+                           int(config->storage.syncMode));
         C4DatabaseConfig2 c4config = asC4Config(config);
+        auto setupDone = steady_clock::now();
         Retained<C4Database> c4db = C4Database::openNamed(name, c4config);
-        return new CBLDatabase(c4db, name, c4config.parentDirectory);
+        auto openDone = steady_clock::now();
+        Retained<CBLDatabase> db = new CBLDatabase(c4db, name, c4config.parentDirectory);
+        if (config) {
+            db->_storageTuning = config->storage;
+            db->_pageCacheSize = config->storage.pageCacheSize;
+            db->tuneConnection(c4db, false);
+        }
+        if (config && config->readerCount > 0)
+            db->openReaders(name, c4config, config->readerCount, config->lazyReaders);
+        if (config) {
+            db->_queryCacheCapacity = config->queryCacheCapacity;
+            db->_blobCacheCapacity = config->blobCacheCapacity;
+        }
+        auto end = steady_clock::now();
+
+        auto nanos = [](auto d) {return uint64_t(duration_cast<nanoseconds>(d).count());};
+        db->_openStats = {nanos(setupDone - start), nanos(openDone - setupDone),
+                          nanos(end - openDone), nanos(end - start)};
+        CBL_Log(kCBLLogDomainDatabase, kCBLLogVerbose,
+                "Opened database '%.*s' in %.3fms (setup %.3fms, open %.3fms, readers %.3fms)",
+                FMTSLICE(name), db->_openStats.totalTime / 1e6, db->_openStats.setupTime / 1e6,
+                db->_openStats.openTime / 1e6, db->_openStats.readersTime / 1e6);
+        return db;
     }
 
+    /// Opens a database through the process-wide handle cache; see CBLDatabase_OpenShared.
+    static Retained<CBLDatabase> openShared(slice name,
+                                            const CBLDatabaseConfiguration* _cbl_nullable config);
+
+    static void setSharedCacheLimits(unsigned maxOpen, double idleTimeout);
+
     void performMaintenance(CBLMaintenanceType type) {
-        _c4db.useLocked()->maintenance((C4MaintenanceType)type);
+        std::unique_lock<std::shared_mutex> gc;
+        if (type == kCBLMaintenanceTypeCompact)
+            gc = lockBlobGC();      // Compaction deletes unreferenced blobs
+        useLocked()->maintenance((C4MaintenanceType)type);
     }
 
+    void scheduleMaintenance(std::vector<CBLMaintenanceType> steps,
+                             double timeBudget,
+                             CBLMaintenanceProgressCallback _cbl_nullable callback,
+                             void* _cbl_nullable context);
+
 #ifdef COUCHBASE_ENTERPRISE
-    void changeEncryptionKey(const CBLEncryptionKey* _cbl_nullable newKey) {
-        C4EncryptionKey c4key = asC4Key(newKey);
-        _c4db.useLocked()->rekey(&c4key);
-    }
+    void changeEncryptionKey(const CBLEncryptionKey* _cbl_nullable newKey);
 #endif
 
-    void beginTransaction()                          {_c4db.useLocked()->beginTransaction();}
-    void endTransaction(bool commit)                 {_c4db.useLocked()->endTransaction(commit);}
+    void beginTransaction() {
+        auto c4db = useLocked();
+        c4db->beginTransaction();
+        ++_transactionDepth;
+    }
+
+    void endTransaction(bool commit) {
+        auto c4db = useLocked();
+        c4db->endTransaction(commit);
+        --_transactionDepth;
+    }
     
     void close() {
         stopActiveStoppables();
-        _c4db.useLocked()->close();
+        clearQueryCache();
+        clearBlobCache();
+        closeReaders();
+        useLocked()->close();
     }
     
     void closeAndDelete() {
         stopActiveStoppables();
-        _c4db.useLocked()->closeAndDeleteFile();
+        clearQueryCache();
+        clearBlobCache();
+        closeReaders();
+        useLocked()->closeAndDeleteFile();
     }
 
 
@@ -116,18 +186,42 @@ public:
 
     slice name() const noexcept                      {return _c4db.useLocked()->getName();}
     alloc_slice path() const                         {return _c4db.useLocked()->getPath();}
+    CBLDatabaseOpenStats openStats() const noexcept  {return _openStats;}
+
+    // Sets the page cache size of the main connection and any open readers.
+    void setPageCacheSize(unsigned sizeKB);
+
+    // Empties or shrinks caches; see CBLDatabase_ReleaseMemory.
+    void releaseMemory(CBLMemoryPressure);
+
+    // Calls `releaseMemory` on every open CBLDatabase.
+    static void releaseAllMemory(CBLMemoryPressure);
+
+    CBLMemoryStats memoryStats() const;
     
     CBLDatabaseConfiguration config() const noexcept {
         auto &c4config = _c4db.useLocked()->getConfiguration();
+        CBLDatabaseConfiguration config = {};
+        config.directory = c4config.parentDirectory;
 #ifdef COUCHBASE_ENTERPRISE
-        return {c4config.parentDirectory, asCBLKey(c4config.encryptionKey)};
-#else
-        return {c4config.parentDirectory};
+        config.encryptionKey = asCBLKey(c4config.encryptionKey);
 #endif
+        config.readerCount = unsigned(_readers.size());
+        config.queryCacheCapacity = _queryCacheCapacity;
+        config.blobCacheCapacity = _blobCacheCapacity;
+        config.lazyReaders = _lazyReaders;
+        config.storage = _storageTuning;
+        config.storage.pageCacheSize = _pageCacheSize;
+        return config;
     }
 
-    uint64_t count() const                           {return _c4db.useLocked()->getDocumentCount();}
-    uint64_t lastSequence() const                    {return _c4db.useLocked()->getLastSequence();}
+    uint64_t count() const {
+        return useReader<uint64_t>([](C4Database *c4db, int) {return c4db->getDocumentCount();});
+    }
+
+    uint64_t lastSequence() const {
+        return useReader<uint64_t>([](C4Database *c4db, int) {return c4db->getLastSequence();});
+    }
 
 
 #pragma mark - Documents:
@@ -141,6 +235,45 @@ public:
         return _getDocument(docID, true, true);
     }
 
+    // Gets multiple immutable docs (null for nonexistent ones), locking the database only once.
+    std::vector<RetainedConst<CBLDocument>> getDocuments(const FLString docIDs[],
+                                                         size_t count) const
+    {
+        std::vector<RetainedConst<CBLDocument>> docs(count);
+        useReader<void>([&](C4Database *c4db, int) {
+            for (size_t i = 0; i < count; ++i) {
+                Retained<C4Document> c4doc = _getC4Document(c4db, docIDs[i], kDocGetCurrentRev);
+                if (c4doc && !(c4doc->flags() & kDocDeleted))
+                    docs[i] = new CBLDocument(docIDs[i], const_cast<CBLDatabase*>(this),
+                                              c4doc, false);
+            }
+        });
+        return docs;
+    }
+
+    // Returns a Dict mapping the IDs of the existing docs to their properties.
+    Doc getDocumentsProperties(const FLString docIDs[], size_t count) const {
+        Encoder enc;
+        enc.beginDict(count);
+        std::unordered_set<slice> written;      // A Dict can't have a key twice
+        useReader<void>([&](C4Database *c4db, int) {
+            for (size_t i = 0; i < count; ++i) {
+                if (!written.insert(docIDs[i]).second)
+                    continue;
+                Retained<C4Document> c4doc = _getC4Document(c4db, docIDs[i], kDocGetCurrentRev);
+                if (c4doc && !(c4doc->flags() & kDocDeleted)) {
+                    enc.writeKey(docIDs[i]);
+                    enc.writeValue(Dict(c4doc->getProperties()));
+                }
+            }
+        });
+        enc.endDict();
+        Doc doc = enc.finishDoc();
+        if (!doc)
+            C4Error::raise(FleeceDomain, enc.error(), "%s", enc.errorMessage());
+        return doc;
+    }
+
     bool deleteDocument(const CBLDocument *doc,
                         CBLConcurrencyControl concurrency)
     {
@@ -150,8 +283,9 @@ public:
     }
 
     bool deleteDocument(slice docID) {
-        auto c4db = _c4db.useLocked();
-        C4Database::Transaction t(c4db);
+        LockStats::CallerScope caller(kCBLLockCallerSave);
+        auto c4db = useLocked();
+        C4Database::Transaction t(c4db.get());
         Retained<C4Document> c4doc = c4db->getDocument(docID, false, kDocGetCurrentRev);
         if (c4doc)
             c4doc = c4doc->update(fleece::nullslice, kRevDeleted);
@@ -162,18 +296,42 @@ public:
     }
 
     bool purgeDocument(slice docID) {
-        return _c4db.useLocked()->purgeDocument(docID);
+        LockStats::CallerScope caller(kCBLLockCallerSave);
+        return useLocked()->purgeDocument(docID);
     }
 
     CBLTimestamp getDocumentExpiration(slice docID) {
-        return _c4db.useLocked()->getDefaultCollection()->getExpiration(docID);
+        return useLocked()->getDefaultCollection()->getExpiration(docID);
     }
 
     void setDocumentExpiration(slice docID, CBLTimestamp expiration) {
-        auto c4db = _c4db.useLocked();
+        auto c4db = useLocked();
         c4db->getDefaultCollection()->setExpiration(docID, expiration);
     }
 
+    CBLTimestamp nextDocumentExpiration() const {
+        return useLocked()->getDefaultCollection()->nextDocExpiration();
+    }
+
+    uint64_t setDocumentsExpiration(const FLString docIDs[_cbl_nonnull], size_t count,
+                                    CBLTimestamp expiration);
+
+    uint64_t purgeExpiredDocuments(unsigned batchSize, double timeBudget);
+
+    uint64_t purgeDocuments(const FLString docIDs[_cbl_nonnull], size_t count);
+
+    uint64_t purgeDocumentsWhere(slice where);
+
+
+#pragma mark - Changes feed:
+
+
+    // Called with each batch of changes; returns false to stop.
+    using ChangesCallback = fleece::function_ref<bool(const CBLChangedDocument[], unsigned)>;
+
+    uint64_t enumerateChanges(uint64_t sinceSequence, unsigned batchSize, bool includeBodies,
+                              ChangesCallback) const;
+
 
 #pragma mark - Queries & Indexes:
 
@@ -181,32 +339,93 @@ public:
     Retained<CBLQuery> createQuery(CBLQueryLanguage language,
                                    slice queryString,
                                    int* _cbl_nullable outErrPos) const;
+
+    Retained<CBLQuery> createCachedQuery(CBLQueryLanguage language,
+                                         slice queryString,
+                                         int* _cbl_nullable outErrPos) const;
+
+    /// Returns the number of documents matching a WHERE expression.
+    int64_t queryCount(CBLQueryLanguage language, slice whereExpr, Dict parameters) const {
+        return runScalarQuery(language, whereExpr, parameters, false);
+    }
+
+    /// Returns true if any document matches a WHERE expression.
+    bool queryExists(CBLQueryLanguage language, slice whereExpr, Dict parameters) const {
+        return runScalarQuery(language, whereExpr, parameters, true) != 0;
+    }
+
+    /// Creates a query returning a page of full-text matches, best first, after a given
+    /// (rank, docID); see `CBLQuery::executePageAfter`.
+    Retained<CBLQuery> createFullTextPageQuery(const CBLFullTextPageConfiguration&) const;
+
+    void precompileQueries(CBLQueryLanguage language,
+                           std::vector<alloc_slice> queries,
+                           CBLQueryPrecompileCallback _cbl_nullable callback,
+                           void* _cbl_nullable context);
+
+    CBLQueryCacheStats queryCacheStats() const {
+        auto c4db = useLocked();
+        return {_queryCacheHits, _queryCacheMisses, unsigned(_queryCache.size()),
+                _queryCacheCapacity};
+    }
     
     void createValueIndex(slice name, CBLValueIndexConfiguration config) {
-        C4IndexOptions options = {};
-        _c4db.useLocked()->createIndex(name, config.expressions, (C4QueryLanguage)config.expressionLanguage,
-                                       kC4ValueIndex, &options);
+        IndexSpec(name, config).createIn(useLocked().get());
     }
     
     void createFullTextIndex(slice name, CBLFullTextIndexConfiguration config) {
-        C4IndexOptions options = {};
-        options.ignoreDiacritics = config.ignoreAccents;
-        
-        std::string languageStr;
-        if (config.language.buf) {
-            languageStr = std::string(config.language);
-            options.language = languageStr.c_str();
+        IndexSpec(name, config).createIn(useLocked().get());
+    }
+
+    void createIndexes(const CBLIndexSpec specs[_cbl_nonnull], size_t count) {
+        std::vector<IndexSpec> indexes;
+        indexes.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            switch (specs[i].type) {
+                case kCBLValueIndex:
+                    indexes.emplace_back(specs[i].name, specs[i].valueConfig);
+                    break;
+                case kCBLFullTextIndex:
+                    indexes.emplace_back(specs[i].name, specs[i].fullTextConfig);
+                    break;
+                default:
+                    C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter,
+                                   "Invalid type of index '%.*s'", FMTSLICE(slice(specs[i].name)));
+            }
+        }
+        auto c4db = useLocked();
+        C4Database::Transaction t(c4db.get());
+        for (auto &index : indexes)
+            index.createIn(c4db.get());
+        t.commit();
+    }
+
+    /// Starts building an index on a background connection; see CBLIndex_Internal.hh.
+    /// The build is a stoppable, so closing the database cancels it and waits for its connection.
+    Retained<CBLIndexBuild> createIndexAsync(IndexSpec spec,
+                                             CBLIndexBuildListener _cbl_nullable listener,
+                                             void* _cbl_nullable context)
+    {
+        Retained<CBLIndexBuild> build;
+        {
+            auto c4db = useLocked();
+            build = new CBLIndexBuild(std::move(spec), c4db->getName(), c4db->getConfiguration(),
+                                      listener, context);
         }
-        _c4db.useLocked()->createIndex(name, config.expressions, (C4QueryLanguage)config.expressionLanguage,
-                                       kC4FullTextIndex, &options);
+        if (!registerStoppable(build))
+            C4Error::raise(LiteCoreDomain, kC4ErrorNotOpen, "Database is closing");
+        build->start([db = Retained<CBLDatabase>(this), b = build.get()] {
+            db->unregisterStoppable(b);
+        });
+        return build;
     }
 
     void deleteIndex(slice name) {
-        _c4db.useLocked()->deleteIndex(name);
+        useLocked()->deleteIndex(name);
     }
 
     fleece::MutableArray indexNames() {
-        Doc doc(_c4db.useLocked()->getIndexesInfo());
+        Doc doc(useLocked()->getIndexesInfo());
         auto indexes = fleece::MutableArray::newArray();
         for (Array::iterator i(doc.root().asArray()); i; ++i) {
             Dict info = i.value().asDict();
@@ -215,6 +434,16 @@ public:
         return indexes;
     }
 
+    /// Enables or disables counting of the queries that use each index; either way, the counts
+    /// are reset.
+    void setIndexStatsEnabled(bool enabled) {
+        auto c4db = useLocked();
+        _indexQueryCounts.clear();
+        _indexStatsEnabled = enabled;
+    }
+
+    fleece::MutableDict indexStats() const;
+
 
 #pragma mark - Listeners:
 
@@ -231,6 +460,10 @@ public:
         return addListener([&]{ return _detailListeners.add(listener, ctx); });
     }
 
+    Retained<CBLListenerToken> addCoalescedListener(const CBLChangeCoalescingOptions* _cbl_nullable,
+                                                    CBLDatabaseChangeListener,
+                                                    void* _cbl_nullable context);
+
     Retained<CBLListenerToken> addDocListener(slice docID,
                                               CBLDocumentChangeListener,
                                               void* _cbl_nullable context);
@@ -244,12 +477,89 @@ public:
     }
 
 
+#pragma mark - Async operations:
+
+
+    // Runs `task` on a background thread. Writes run one at a time, in the order submitted;
+    // reads may run concurrently.
+    void runAsync(bool isWrite, std::function<void()> task) const {
+        cbl_internal::AsyncExecutor *executor;
+        {
+            LOCK(_asyncMutex);
+            if (!_asyncExecutor)
+                _asyncExecutor = new cbl_internal::AsyncExecutor();
+            executor = _asyncExecutor;
+        }
+        executor->submit(isWrite, std::move(task));
+    }
+
+    // Calls an async operation's completion the way listeners are called: right away, or, if
+    // notifications are buffered, when the app calls `CBLDatabase_SendNotifications`.
+    void notifyAsync(std::function<void()> completion) const {
+        struct Completion final : public CBLRefCounted {
+            explicit Completion(std::function<void()> fn)  :function(std::move(fn)) { }
+            std::function<void()> const function;
+        };
+        notify({[](CBLRefCounted *c, void*) { ((Completion*)c)->function(); },
+                new Completion(std::move(completion)), nullptr});
+    }
+
+
+#pragma mark - Import & Export:
+
+
+    // Reads up to `size` bytes into `buffer`, returning the number read, 0 at EOF or -1 on error.
+    using ImportReader = fleece::function_ref<int64_t(void *buffer, size_t size)>;
+
+    uint64_t importJSONLines(ImportReader, const CBLImportOptions* _cbl_nullable);
+
+    uint64_t importJSONLines(slice path, const CBLImportOptions* _cbl_nullable);
+
+    // Writes a chunk of output, returning false on failure.
+    using ExportWriter = fleece::function_ref<bool(slice data)>;
+
+    uint64_t exportJSONLines(CBLQuery* _cbl_nullable, slice idProperty, ExportWriter);
+
+
 #pragma mark - Binding Dev Support for Blob:
     
     
     Retained<CBLBlob> getBlob(FLDict properties);
     
     void saveBlob(CBLBlob* blob);
+
+    // Reads a blob's content, from the blob cache if it's enabled.
+    alloc_slice getBlobContents(const C4BlobKey&) const;
+
+    CBLBlobCacheStats blobCacheStats() const {
+        LOCK(_blobCacheMutex);
+        return {_blobCacheHits, _blobCacheMisses, unsigned(_blobCache.size()), _blobCacheSize,
+                _blobCacheCapacity};
+    }
+
+    // Installs several new blobs, concurrently. Doesn't lock the database.
+    void saveBlobs(CBLBlob* const _cbl_nonnull blobs[], size_t count);
+
+    // A save that installs its new blobs before it locks the database holds this shared until
+    // its transaction ends, since until then nothing refers to those blobs; whatever deletes
+    // unreferenced blobs (compaction, or a CBLBlobGC sweep) holds it exclusively. It's shared
+    // by every handle on the database file.
+    // Saves only try to lock it, and install their blobs inside their transaction instead if
+    // it's busy; so nothing holding a transaction ever waits for it, and the collector may
+    // hold it while it waits for a transaction.
+    std::shared_lock<std::shared_mutex> tryLockPendingBlobs() const {
+        return std::shared_lock<std::shared_mutex>(*_blobGCMutex, std::try_to_lock);
+    }
+
+    std::unique_lock<std::shared_mutex> lockBlobGC() const {
+        return std::unique_lock<std::shared_mutex>(*_blobGCMutex);
+    }
+
+    // True while a transaction begun by beginTransaction is open.
+    bool inTransaction() const          {return _transactionDepth > 0;}
+
+    // Scans the blob store and the documents' current revisions.
+    CBLBlobStoreStats blobStoreStats(CBLBlobSize* _cbl_nullable largest, size_t maxLargest) const;
     
 
 #pragma mark - Internals:
@@ -259,46 +569,127 @@ protected:
     friend struct CBLBlob;
     friend struct CBLNewBlob;
     friend struct CBLBlobWriteStream;
+    friend struct CBLDocEnumerator;
     friend struct CBLDocument;
+    friend struct CBLQuery;
     friend struct CBLReplicator;
     friend struct CBLURLEndpointListener;
     friend class cbl_internal::AllConflictsResolver;
     friend struct cbl_internal::CBLLocalEndpoint;
+    friend struct cbl_internal::CoalescingChangeListener;
     friend struct cbl_internal::ListenerToken<CBLDocumentChangeListener>;
     friend struct cbl_internal::ListenerToken<CBLQueryChangeListener>;
 
     C4BlobStore* blobStore() const                   {return &_c4db.useLocked()->getBlobStore();}
 
-    template <class LISTENER, class... Args>
-    void notify(ListenerToken<LISTENER>* _cbl_nonnull listener, Args... args) const {
-        Retained<ListenerToken<LISTENER>> retained = listener;
-        notify([=]() {
-            retained->call(args...);
-        });
+    // Queues a call to the token's `call()` method.
+    template <class TOKEN>
+    void notify(TOKEN* _cbl_nonnull token) const {
+        notify(Notification::calling(token));
     }
 
-    void notify(Notification n) const   {const_cast<CBLDatabase*>(this)->_notificationQueue.add(n);}
+    void notify(Notification n) const   {const_cast<CBLDatabase*>(this)->_notificationQueue.add(std::move(n));}
+
+    using LockStats = cbl_internal::LockStats;
+
+    LockStats& lockStats() const      { return _lockStats; }
 
-    auto useLocked()                  { return _c4db.useLocked(); }
+    // The `useLocked` methods lock `_c4db`, recording the lock's stats if they're enabled.
+    using C4DatabaseLock = litecore::access_lock<Retained<C4Database>>;
+    auto useLocked()                  { return LockStats::Locked<C4DatabaseLock>(_lockStats, _c4db); }
+    auto useLocked() const            { return LockStats::Locked<const C4DatabaseLock>(_lockStats, _c4db); }
     template <class LAMBDA>
-    void useLocked(LAMBDA callback)   { _c4db.useLocked(callback); }
+    void useLocked(LAMBDA callback) {
+        LockStats::Timer timer(_lockStats);
+        _c4db.useLocked([&](Retained<C4Database> &c4db) {
+            timer.acquired();
+            callback(c4db);
+        });
+    }
+    template <class RESULT, class LAMBDA>
+    RESULT useLocked(LAMBDA callback) {
+        LockStats::Timer timer(_lockStats);
+        return _c4db.useLocked<RESULT>([&](Retained<C4Database> &c4db) -> RESULT {
+            timer.acquired();
+            return callback(c4db);
+        });
+    }
+
+    // Calls the callback with a C4Database to read from, and the index of the reader connection
+    // (or -1 if it's the main connection.) A free reader is used if there is one; the main
+    // connection is used if there's no reader pool or if a transaction is open, so that reads
+    // see the uncommitted changes as before.
     template <class RESULT, class LAMBDA>
-    RESULT useLocked(LAMBDA callback) { return _c4db.useLocked<RESULT>(callback); }
+    RESULT useReader(LAMBDA callback) const {
+        if (_readers.empty() || _transactionDepth > 0) {
+            auto c4db = useLocked();
+            return callback((C4Database*)c4db.get(), -1);
+        }
+        size_t n = _readers.size();
+        size_t first = _nextReader++ % n;
+        for (size_t i = 0; i < n; ++i) {
+            size_t index = (first + i) % n;
+            std::unique_lock<std::mutex> lock(_readers[index]->mutex, std::try_to_lock);
+            if (lock.owns_lock())
+                return callback(openedReader(*_readers[index]), int(index));
+        }
+        // All readers are busy; wait for one:
+        std::unique_lock<std::mutex> lock(_readers[first]->mutex);
+        return callback(openedReader(*_readers[first]), int(first));
+    }
+
+    size_t readerCount() const        { return _readers.size(); }
+
+    // A query compiled on a reader connection, and the connection it was compiled on. (If that
+    // connection has been reopened since, as after a rekey, the query has to be compiled again.)
+    struct ReaderQuery {
+        Retained<C4Query>       c4query;
+        Retained<C4Database>    c4db;
+    };
+
+    // Queries compiled on each reader connection; item `i` is only accessed while reader `i`
+    // is locked.
+    using ReaderQueries = std::vector<ReaderQuery>;
 
 private:
     CBLDatabase(C4Database* _cbl_nonnull db, slice name_, slice dir_)
     :_c4db(std::move(db))
+    ,_blobGCMutex(blobGCMutexFor(db->getPath()))
     ,_dir(dir_)
     ,_notificationQueue(this)
-    { }
+    {
+        registerInstance(this, true);
+    }
 
     virtual ~CBLDatabase() {
+        registerInstance(this, false);
+        detachListenerTokens();
         _c4db.useLocked([&](Retained<C4Database> &c4db) {
+            {
+                LOCK(_docListenerMapMutex);
+                _docListenerMap.clear();
+            }
             _docListeners.clear();
+            _coalescedListeners.clear();
             _observer = nullptr;
+            _queryCacheIndex.clear();
+            _queryCache.clear();
         });
     }
 
+    void clearQueryCache() {
+        auto c4db = _c4db.useLocked();
+        _queryCacheIndex.clear();
+        _queryCache.clear();
+    }
+
+    void clearBlobCache() {
+        LOCK(_blobCacheMutex);
+        _blobCacheIndex.clear();
+        _blobCache.clear();
+        _blobCacheSize = 0;
+    }
+
     // Default location for databases. This is platform-dependent.
     static std::string defaultDirectory();
 
@@ -347,11 +738,12 @@ private:
         }
     }
 
-    Retained<CBLDocument> _getDocument(slice docID, bool isMutable, bool allRevisions) const {
-        C4DocContentLevel content = (allRevisions ? kDocGetAll : kDocGetCurrentRev);
-        Retained<C4Document> c4doc = nullptr;
+    // Gets a C4Document, returning null (and logging a warning) if the docID is invalid.
+    static Retained<C4Document> _getC4Document(C4Database *c4db, slice docID,
+                                               C4DocContentLevel content)
+    {
         try {
-            c4doc = _c4db.useLocked()->getDocument(docID, true, content);
+            return c4db->getDocument(docID, true, content);
         } catch (litecore::error& e) {
             if (e == litecore::error::BadDocID) {
                 CBL_Log(kCBLLogDomainDatabase, kCBLLogWarning,
@@ -360,13 +752,88 @@ private:
             }
             throw;
         }
+    }
+
+    Retained<CBLDocument> _getDocument(slice docID, bool isMutable, bool allRevisions) const {
+        cbl_internal::TraceSpan span(kCBLTraceDocumentGet, docID);
+        C4DocContentLevel content = (allRevisions ? kDocGetAll : kDocGetCurrentRev);
+        LockStats::CallerScope caller(kCBLLockCallerGet);
+        Retained<C4Document> c4doc = nullptr;
+        if (isMutable) {
+            // A mutable doc may be saved, so it has to come from the writeable connection:
+            auto c4db = useLocked();
+            c4doc = _getC4Document((C4Database*)c4db.get(), docID, content);
+        } else {
+            c4doc = useReader<Retained<C4Document>>([&](C4Database *c4db, int) {
+                return _getC4Document(c4db, docID, content);
+            });
+        }
         if (!c4doc || (!allRevisions && (c4doc->flags() & kDocDeleted)))
             return nullptr;
         return new CBLDocument(docID, const_cast<CBLDatabase*>(this), c4doc, isMutable);
     }
 
+    void recordIndexUsage(C4Query*) const;
+
+    // Runs a COUNT(*) or existence query wrapping a WHERE expression, returning its value.
+    int64_t runScalarQuery(CBLQueryLanguage, slice whereExpr, Dict parameters,
+                           bool exists) const;
+
+    // Adds or removes an instance in the registry used by `releaseAllMemory`.
+    static void registerInstance(CBLDatabase*, bool add);
+
+    // Returns the blob GC mutex of the database file at `path` (see tryLockPendingBlobs.)
+    static std::shared_ptr<std::shared_mutex> blobGCMutexFor(slice path);
+
+    // Applies the configuration's storage tuning to a newly opened connection.
+    void tuneConnection(C4Database*, bool isReader) const;
+
+    // An extra read-only connection to the database file, opened if the configuration's
+    // `readerCount` is nonzero. (If `lazyReaders` is set, `c4db` is null until first used.)
+    struct Reader {
+        std::mutex                              mutex;
+        Retained<C4Database>                    c4db;
+    };
+
+    void openReaders(slice name, C4DatabaseConfig2 c4config, unsigned count, bool lazy) {
+        c4config.flags = kC4DB_ReadOnly;
+        _lazyReaders = lazy;
+        // Keep what's needed to open them later (if they're lazy, or after a rekey); the config
+        // has to point to my copy of the directory:
+        _readerName = name;
+        _readerConfig = c4config;
+        _readerConfig.parentDirectory = _dir;
+        _readers.reserve(count);
+        for (unsigned i = 0; i < count; ++i) {
+            auto reader = std::make_unique<Reader>();
+            if (!lazy) {
+                reader->c4db = C4Database::openNamed(name, c4config);
+                tuneConnection(reader->c4db, true);
+            }
+            _readers.push_back(std::move(reader));
+        }
+    }
+
+    // Returns a reader's connection, opening it if it's lazy; the reader must be locked.
+    C4Database* openedReader(Reader &reader) const {
+        if (_usuallyFalse(!reader.c4db)) {
+            reader.c4db = C4Database::openNamed(_readerName, _readerConfig);
+            tuneConnection(reader.c4db, true);
+        }
+        return reader.c4db;
+    }
+
+    void closeReaders() {
+        for (auto &reader : _readers) {
+            LOCK(reader->mutex);
+            if (reader->c4db)
+                reader->c4db->close();
+        }
+    }
+
     Retained<CBLListenerToken> addListener(fleece::function_ref<Retained<CBLListenerToken>()> cb) {
-        auto c4db = _c4db.useLocked(); // locks DB mutex, so the callback can run thread-safe
+        LockStats::CallerScope caller(kCBLLockCallerListener);
+        auto c4db = useLocked(); // locks DB mutex, so the callback can run thread-safe
         Retained<CBLListenerToken> token = cb();
         if (!_observer)
             _observer = c4db->getDefaultCollection()->observe([this](C4DatabaseObserver*) { this->databaseChanged(); });
@@ -374,11 +841,16 @@ private:
     }
 
     void databaseChanged() {
-        notify(std::bind(&CBLDatabase::callDBListeners, this));
+        // Only one call to callDBListeners needs to be pending, since it reads all the changes:
+        if (!_dbChangePending.exchange(true)) {
+            notify({[](CBLRefCounted*, void *db) { ((CBLDatabase*)db)->callDBListeners(); },
+                    nullptr, this});
+        }
     }
 
     void callDBListeners() {
         static const uint32_t kMaxChanges = 100;
+        _dbChangePending = false;
         while (true) {
             C4DatabaseObserver::Change c4changes[kMaxChanges];
             bool external;
@@ -389,16 +861,41 @@ private:
             static_assert(sizeof(CBLDatabaseChange) == sizeof(C4DatabaseObserver::Change));
             _detailListeners.call(this, nChanges, (const CBLDatabaseChange*)c4changes);
 
-            if (!_listeners.empty()) {
+            if (!_listeners.empty() || !_coalescedListeners.empty() || !_docListeners.empty()) {
                 FLString docIDs[kMaxChanges];
                 for (uint32_t i = 0; i < nChanges; ++i)
                 docIDs[i] = c4changes[i].docID;
                 _listeners.call(this, nChanges, docIDs);
+                if (!_coalescedListeners.empty())
+                    callCoalescedListeners(nChanges, docIDs);
+                if (!_docListeners.empty())
+                    callDocListeners(nChanges, docIDs);
             }
         }
     }
 
-    void callDocListeners();
+    void callCoalescedListeners(unsigned nChanges, const FLString docIDs[]);
+
+    using DocListenerToken = cbl_internal::ListenerToken<CBLDocumentChangeListener>;
+
+    void callDocListeners(unsigned nChanges, const FLString docIDs[]);
+
+    void removeDocListener(DocListenerToken* _cbl_nonnull);
+
+    // Tells listener tokens, which the app may hold on to, that the database is going away.
+    void detachListenerTokens();
+
+    using QueryListenerToken = cbl_internal::ListenerToken<CBLQueryChangeListener>;
+    using SharedQueryObserver = cbl_internal::SharedQueryObserver;
+
+    // Subscribes a query listener to the shared observer for `key` (see CBLQuery::_observerKey),
+    // creating the observer if there's none yet.
+    Retained<SharedQueryObserver> observeQuery(QueryListenerToken* _cbl_nonnull,
+                                               slice key,
+                                               const CBLQuery* _cbl_nonnull,
+                                               slice parameters);
+
+    void unobserveQuery(SharedQueryObserver* _cbl_nonnull, QueryListenerToken* _cbl_nonnull);
     
     void stopActiveStoppables() {
         std::unordered_set<CBLStoppable*> stoppables;
@@ -440,13 +937,75 @@ private:
 
     template <class T> using Listeners = cbl_internal::Listeners<T>;
 
+    // An entry in the compiled-query cache.
+    struct CachedQuery {
+        alloc_slice                             key;            // Language + original source
+        alloc_slice                             source;         // Source as compiled
+        Retained<C4Query>                       c4query;
+        std::shared_ptr<ReaderQueries>          readerQueries;
+    };
+    using QueryCacheList = std::list<CachedQuery>;
+
     litecore::access_lock<Retained<C4Database>> _c4db;
+    mutable LockStats                           _lockStats;
+    CBLDatabaseOpenStats                        _openStats {};
+    CBLStorageTuning                            _storageTuning {};
+    std::atomic<unsigned>                       _pageCacheSize {0};  // Overrides _storageTuning's
+    std::vector<std::unique_ptr<Reader>>        _readers;
+    bool                                        _lazyReaders {false};
+    alloc_slice                                 _readerName;    // Set if there are readers
+    C4DatabaseConfig2                           _readerConfig {};
+    mutable std::atomic<size_t>                 _nextReader {0};
+    std::atomic<int>                            _transactionDepth {0};
+    // The query cache is guarded by `_c4db`'s lock. The list is in MRU order.
+    mutable QueryCacheList                      _queryCache;
+    mutable std::unordered_map<slice, QueryCacheList::iterator> _queryCacheIndex;
+    unsigned                                    _queryCacheCapacity {0};
+    mutable uint64_t                            _queryCacheHits {0};
+    mutable uint64_t                            _queryCacheMisses {0};
+    // Number of queries compiled whose plan uses each index; guarded by `_c4db`'s lock.
+    std::atomic<bool>                           _indexStatsEnabled {false};
+    mutable std::unordered_map<std::string, uint64_t> _indexQueryCounts;
+
+    // The blob content cache has its own lock, since blobs are read without the database lock.
+    // The list is in MRU order; the index's keys point into the entries' keys.
+    struct CachedBlob {
+        C4BlobKey                               key;
+        alloc_slice                             content;
+    };
+    using BlobCacheList = std::list<CachedBlob>;
+    mutable std::mutex                          _blobCacheMutex;
+    mutable BlobCacheList                       _blobCache;
+    mutable std::unordered_map<slice, BlobCacheList::iterator> _blobCacheIndex;
+    size_t                                      _blobCacheCapacity {0};
+    mutable size_t                              _blobCacheSize {0};
+    mutable uint64_t                            _blobCacheHits {0};
+    mutable uint64_t                            _blobCacheMisses {0};
+    std::shared_ptr<std::shared_mutex> const    _blobGCMutex;   // See tryLockPendingBlobs()
     alloc_slice const                           _dir;
     std::unique_ptr<C4DatabaseObserver>         _observer;
     Listeners<CBLDatabaseChangeListener>        _listeners;
     Listeners<CBLDatabaseChangeDetailListener>  _detailListeners;
+    cbl_internal::ListenersBase                 _coalescedListeners; // CoalescingChangeListeners
+    std::atomic<bool>                           _dbChangePending {false};
+
+    // Document listeners are called from callDBListeners; this maps each doc ID to its tokens.
+    // (The key points into the entry's `docID`.)
+    struct DocListenerEntry {
+        alloc_slice                             docID;
+        std::vector<DocListenerToken*>          tokens;
+    };
+    std::mutex                                  _docListenerMapMutex;
+    std::unordered_map<slice, DocListenerEntry> _docListenerMap;
+
+    // Live queries, keyed by source & parameters. An observer is only in the map while it has
+    // subscribers, each of which retains it. (The key points into the observer's key.)
+    std::mutex                                  _queryObserversMutex;
+    std::unordered_map<slice, SharedQueryObserver*> _queryObservers;
     Listeners<CBLDocumentChangeListener>        _docListeners;
     NotificationQueue                           _notificationQueue;
+    mutable std::mutex                          _asyncMutex;
+    mutable Retained<cbl_internal::AsyncExecutor> _asyncExecutor;     // Created on first use
     
     // For Active Stoppables:
     bool                                        _stopping {false};
@@ -0,0 +1,130 @@
+//
+// CBLDocEnumerator_Internal.hh
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "CBLDatabase_Internal.hh"
+#include "CBLDocument_Internal.hh"
+#include "c4DocEnumerator.hh"
+#include "Internal.hh"
+#include <memory>
+#include <vector>
+
+CBL_ASSUME_NONNULL_BEGIN
+
+/** Iterates over a database's documents, reading them a batch at a time from a C4DocEnumerator
+    on the database's main connection. The C4DocEnumerator stays open between batches, and is
+    only used (and freed) while the database is locked. */
+struct CBLDocEnumerator final : public CBLRefCounted {
+public:
+    static constexpr unsigned kDefaultBatchSize = 100;
+
+    CBLDocEnumerator(CBLDatabase *db, const CBLDocEnumeratorOptions &options)
+    :_db(db)
+    ,_startID(options.startDocID)
+    ,_endID(options.endDocID)
+    ,_descending((options.flags & kCBLEnumerateDescending) != 0)
+    ,_batchSize(options.batchSize ? options.batchSize : kDefaultBatchSize)
+    {
+        _c4options.flags = kC4IncludeNonConflicted;
+        if (options.flags & kCBLEnumerateIncludeDeleted)
+            _c4options.flags |= kC4IncludeDeleted;
+        if (!(options.flags & kCBLEnumerateMetadataOnly))
+            _c4options.flags |= kC4IncludeBodies;
+        if (_descending)
+            _c4options.flags |= kC4Descending;
+    }
+
+    /// Returns the next document, or null at the end.
+    const CBLDocument* _cbl_nullable next() {
+        if (_pos >= _batch.size() && !readBatch())
+            return nullptr;
+        return _batch[_pos++];
+    }
+
+protected:
+    ~CBLDocEnumerator() {
+        closeEnumerator();
+    }
+
+private:
+    // True if `docID` comes before the start of the range, in enumeration order.
+    bool beforeStart(slice docID) const {
+        return _startID && (_descending ? docID.compare(_startID) > 0
+                                        : docID.compare(_startID) < 0);
+    }
+
+    // True if `docID` comes after the end of the range, in enumeration order.
+    bool afterEnd(slice docID) const {
+        return _endID && (_descending ? docID.compare(_endID) < 0
+                                      : docID.compare(_endID) > 0);
+    }
+
+    bool readBatch() {
+        _batch.clear();
+        _pos = 0;
+        if (_done)
+            return false;
+        try {
+            _db->useLocked([&](C4Database *c4db) {
+                if (!_enum)
+                    _enum = std::make_unique<C4DocEnumerator>(c4db, _c4options);
+                while (_batch.size() < _batchSize) {
+                    if (!_enum->next()) {
+                        _done = true;
+                        break;
+                    }
+                    // LiteCore's enumerator has no key range, so the range is applied here:
+                    C4DocumentInfo info = _enum->documentInfo();
+                    slice docID(info.docID);
+                    if (beforeStart(docID))
+                        continue;
+                    if (afterEnd(docID)) {
+                        _done = true;
+                        break;
+                    }
+                    Retained<C4Document> c4doc = _enum->getDocument();
+                    _batch.emplace_back(new CBLDocument(c4doc->docID(), _db, c4doc, false));
+                }
+                if (_done)
+                    _enum = nullptr;
+            });
+        } catch (...) {
+            _done = true;
+            closeEnumerator();
+            throw;
+        }
+        return !_batch.empty();
+    }
+
+    void closeEnumerator() {
+        if (_enum)
+            _db->useLocked([&](C4Database*) { _enum = nullptr; });
+    }
+
+    Retained<CBLDatabase>                   _db;
+    alloc_slice const                       _startID, _endID;
+    bool const                              _descending;
+    unsigned const                          _batchSize;
+    C4EnumeratorOptions                     _c4options {};
+    std::unique_ptr<C4DocEnumerator>        _enum;
+    std::vector<RetainedConst<CBLDocument>> _batch;
+    size_t                                  _pos {0};
+    bool                                    _done {false};
+};
+
+CBL_ASSUME_NONNULL_END
@@ -20,6 +20,7 @@
 #include "CBLPrivate.h"
 #include "CBLDocument_Internal.hh"
 #include "CBLBlob_Internal.hh"
+#include "CBLTrace_Internal.hh"
 #include "c4BlobStore.hh"
 #include "c4Private.h"
 #include "betterassert.hh"
@@ -67,8 +68,14 @@ CBLDocument::~CBLDocument() {
 
 
 bool CBLDocument::save(CBLDatabase* db, const SaveOptions &opt) {
+    TraceSpan span(kCBLTraceDocumentSave, docID());
+    LockStats::CallerScope caller(kCBLLockCallerSave);
     Retained<C4Document> orignalDoc = nullptr, savingDoc = nullptr;
     bool success = false, retrying = false;
+
+    std::shared_lock<std::shared_mutex> pendingBlobs;
+    if (!opt.deleting)
+        installNewBlobs(db, pendingBlobs);
     
     do {
         bool handleConflictNeeded = false;
@@ -111,7 +118,11 @@ bool CBLDocument::save(CBLDatabase* db, const SaveOptions &opt) {
             Retained<C4Document> newDoc = nullptr;
             conflictingDoc = nullptr;
             
-            if (savingDoc) {
+            bool stale = (savingDoc && !useWriteableRevision(c4db, savingDoc));
+            
+            if (stale) {
+                // Conflict; handled below.
+            } else if (savingDoc) {
                 // Update existing doc:
                 newDoc = savingDoc->update(body, revFlags);
             } else {
@@ -174,12 +185,119 @@ bool CBLDocument::save(CBLDatabase* db, const SaveOptions &opt) {
 }
 
 
+bool CBLDocument::useWriteableRevision(C4Database* c4db, Retained<C4Document> &savingDoc) const {
+    if (savingDoc->database() == c4db)
+        return true;
+    Retained<C4Document> current = c4db->getDocument(_docID, true, kDocGetCurrentRev);
+    if (!current || current->selectedRev().revID != savingDoc->selectedRev().revID)
+        return false;
+    savingDoc = current;
+    return true;
+}
+
+
+Retained<C4Document> CBLDocument::saveInTransaction(CBLDatabase* db,
+                                                    C4Database* c4db,
+                                                    CBLConcurrencyControl concurrency)
+{
+    auto c4doc = _c4doc.useLocked();
+    checkMutable();
+    checkDBMatches(_db, db);
+
+    C4RevisionFlags revFlags;
+    alloc_slice body = encodeBody(db, c4db, false, revFlags);
+
+    Retained<C4Document> savingDoc = c4doc.get();
+    bool stale = (savingDoc && !useWriteableRevision(c4db, savingDoc));
+    while (true) {
+        Retained<C4Document> newDoc = nullptr;
+        if (stale) {
+            // Conflict with a doc loaded from a reader connection
+        } else if (savingDoc) {
+            newDoc = savingDoc->update(body, revFlags);
+        } else {
+            C4DocPutRequest rq = {};
+            rq.allocedBody = {body.buf, body.size};
+            rq.docID = _docID;
+            rq.revFlags = revFlags;
+            rq.save = true;
+            C4Error c4err;
+            newDoc = c4db->putDocument(rq, nullptr, &c4err);
+            if (!newDoc && c4err != C4Error{LiteCoreDomain, kC4ErrorConflict})
+                C4Error::raise(c4err);
+        }
+        if (newDoc || concurrency != kCBLConcurrencyControlLastWriteWins)
+            return newDoc;
+        // Last-write-wins; load current revision and retry:
+        savingDoc = c4db->getDocument(_docID, true, kDocGetCurrentRev);
+        stale = false;
+    }
+}
+
+
+C4Error CBLDocument::saveDocuments(CBLDatabase* db,
+                                   CBLDocument* const docs[],
+                                   size_t count,
+                                   CBLConcurrencyControl concurrency,
+                                   C4Error* outResults)
+{
+    C4Error firstError = {};
+    vector<Retained<C4Document>> newDocs(count);
+    vector<C4Error> blobErrors(count);
+    std::shared_lock<std::shared_mutex> pendingBlobs;
+    for (size_t i = 0; i < count; ++i) {
+        try {
+            docs[i]->installNewBlobs(db, pendingBlobs);
+        } catch (...) {
+            blobErrors[i] = C4Error::fromCurrentException();
+        }
+    }
+    db->useLocked([&](C4Database *c4db) {
+        C4Database::Transaction t(c4db);
+        for (size_t i = 0; i < count; ++i) {
+            C4Error error = blobErrors[i];
+            try {
+                if (!error.code)
+                    newDocs[i] = docs[i]->saveInTransaction(db, c4db, concurrency);
+                if (!newDocs[i])
+                    error = {LiteCoreDomain, kC4ErrorConflict};
+            } catch (...) {
+                error = C4Error::fromCurrentException();
+            }
+            if (error.code && !firstError.code)
+                firstError = error;
+            if (outResults)
+                outResults[i] = error;
+        }
+        t.commit();
+
+        // Now that the changes are committed, update the document objects:
+        for (size_t i = 0; i < count; ++i) {
+            if (newDocs[i]) {
+                CBLDocument *doc = docs[i];
+                auto c4doc = doc->_c4doc.useLocked();
+                doc->_db = db;
+                c4doc.get() = move(newDocs[i]);
+                doc->_revID = c4doc->selectedRev().revID;
+            }
+        }
+    });
+    return firstError;
+}
+
+
 alloc_slice CBLDocument::encodeBody(CBLDatabase* db,
                                     C4Database* c4db,
                                     bool releaseNewBlob,
                                     C4RevisionFlags &outRevFlags) const
 {
     auto c4doc = _c4doc.useLocked();
+    // If the properties are the current revision's, unmodified, its body is saved as-is:
+    if (slice base = unmodifiedRevisionBody(); base) {
+        outRevFlags = c4doc->selectedRev().flags & kRevHasAttachments;
+        return alloc_slice(base);
+    }
+
     // Save new blobs and check encryptables in arrays:
     bool hasBlobs = saveBlobsAndCheckEncryptables(db, releaseNewBlob);
     outRevFlags = hasBlobs ? kRevHasAttachments : 0;
@@ -195,6 +313,44 @@ alloc_slice CBLDocument::encodeBody(CBLDatabase* db,
 }
 
 
+slice CBLDocument::unmodifiedRevisionBody() const {
+    auto c4doc = _c4doc.useLocked();
+    if (!c4doc || _fromJSON)
+        return nullslice;
+    slice body = c4doc->getRevisionBody();
+    if (!body || !_properties)
+        return body;        // Properties were never accessed
+    FLMutableDict props = _properties.asDict().asMutable();
+    if (!props || FLMutableDict_IsChanged(props))
+        return nullslice;
+    // The properties must still be a copy of this revision's, not a replacement dict:
+    Dict source = FLMutableDict_GetSource(props);
+    return (source && body.containsAddress((FLDict)source)) ? body : nullslice;
+}
+
+
+bool CBLDocument::isPlainJSON() const {
+    auto c4doc = _c4doc.useLocked();
+    if (!_fromJSON || !_plainJSON)
+        return false;
+    if (!_properties)
+        return true;        // Properties were never accessed
+    FLMutableDict props = _properties.asDict().asMutable();
+    return props && !FLMutableDict_IsChanged(props)
+                 && _fromJSON.data().containsAddress(FLMutableDict_GetSource(props));
+}
+
+
+slice CBLDocument::unchangedSubtreesBody() const {
+    // Immutable containers within the current revision's body were already checked when that
+    // revision was saved; if it had no blobs, there's nothing left to find in them.
+    auto c4doc = _c4doc.useLocked();
+    if (!c4doc || (c4doc->selectedRev().flags & kRevHasAttachments))
+        return nullslice;
+    return c4doc->getRevisionBody();
+}
+
+
 #pragma mark - REPLICATOR CONFLICT RESOLUTION:
 
 
@@ -207,9 +363,6 @@ bool CBLDocument::resolveConflict(Resolution resolution, const CBLDocument * _cb
     _properties = nullptr;
     _fromJSON = nullptr;
 
-    // Remote Revision always win so that the resolved revision will not conflict with the remote:
-    slice winner(c4doc->selectedRev().revID), loser(c4doc->revID());
-    
     return _db->useLocked<bool>([&](C4Database *c4db) {
         C4Database::Transaction t(c4db);
 
@@ -218,7 +371,18 @@ bool CBLDocument::resolveConflict(Resolution resolution, const CBLDocument * _cb
         // When useLocal (local wins) or useMerge is true, the new revision will be created
         // under the remote branch which is the winning branch. When useRemote (remote wins)
         // is true, the remote revision will be kept as is and the losing branch will be pruned.
-        if (resolution != Resolution::useRemote) {
+        if (resolution == Resolution::useLocalRevision) {
+            // Copy the current revision's body, then go back to the remote revision:
+            alloc_slice remoteRevID(c4doc->selectedRev().revID);
+            if (!c4doc->selectCurrentRevision() || !c4doc->loadRevisionBody())
+                C4Error::raise(LiteCoreDomain, kC4ErrorNotFound,
+                               "Local revision body is not available");
+            mergeBody = c4doc->getRevisionBody();
+            mergeFlags = c4doc->selectedRev().flags & kRevHasAttachments;
+            if (!c4doc->selectRevision(remoteRevID, false))
+                C4Error::raise(LiteCoreDomain, kC4ErrorNotFound,
+                               "Remote revision is no longer available");
+        } else if (resolution != Resolution::useRemote) {
             if (resolveDoc) {
                 mergeBody = resolveDoc->encodeBody(_db, c4db, true, mergeFlags);
             } else {
@@ -227,6 +391,9 @@ bool CBLDocument::resolveConflict(Resolution resolution, const CBLDocument * _cb
             }
         }
 
+        // Remote Revision always win so that the resolved revision will not conflict with the remote:
+        slice winner(c4doc->selectedRev().revID), loser(c4doc->revID());
+
         try {
             c4doc->resolveConflict(winner, loser, mergeBody, mergeFlags);
         } catch (...) {
@@ -243,42 +410,99 @@ bool CBLDocument::resolveConflict(Resolution resolution, const CBLDocument * _cb
 }
 
 
+CBLDocument::Resolution CBLDocument::defaultConflictResolution() const {
+    auto c4doc = _c4doc.useLocked();
+    if (!c4doc)
+        C4Error::raise(LiteCoreDomain, kC4ErrorNotFound, "Document has not been saved to a database");
+
+    const C4Revision &remote = c4doc->selectedRev();
+    if (remote.flags & kRevDeleted)
+        return Resolution::useRemote;
+    if (c4doc->flags() & kDocDeleted)
+        return Resolution::useLocal;
+
+    slice localRevID = c4doc->revID();
+    unsigned remoteGen = C4Document::getRevIDGeneration(remote.revID);
+    unsigned localGen = C4Document::getRevIDGeneration(localRevID);
+    if (remoteGen != localGen)
+        return (remoteGen > localGen) ? Resolution::useRemote : Resolution::useLocalRevision;
+    return (localRevID.compare(remote.revID) > 0) ? Resolution::useLocalRevision
+                                                  : Resolution::useRemote;
+}
+
+
 #pragma mark - BLOBS:
 
 
-using UnretainedValueToBlobMap = litecore::access_lock<std::unordered_map<slice, CBLNewBlob*>>;
+// New blobs are registered process-wide by digest, since a blob isn't tied to a database until
+// it's installed. The registry is sharded by digest, so that threads creating or saving
+// different blobs (e.g. in different databases) don't all contend for one mutex.
+namespace {
+    class NewBlobRegistry {
+    public:
+        void insert(CBLNewBlob *blob) {
+            Shard &s = shard(blob->digest());
+            LOCK(s.mutex);
+            s.blobs.insert({blob->digest(), blob});
+        }
+
+        void erase(CBLNewBlob *blob) {
+            Shard &s = shard(blob->digest());
+            LOCK(s.mutex);
+            s.blobs.erase(blob->digest());
+        }
+
+        CBLNewBlob* _cbl_nullable find(slice digest) {
+            Shard &s = shard(digest);
+            LOCK(s.mutex);
+            auto i = s.blobs.find(digest);
+            return (i != s.blobs.end()) ? i->second : nullptr;
+        }
+
+    private:
+        static constexpr size_t kNumShards = 16;
+
+        struct alignas(64) Shard {      // (aligned to keep shards' mutexes in separate cache lines)
+            std::mutex                          mutex;
+            std::unordered_map<slice, CBLNewBlob*> blobs;
+        };
+
+        Shard& shard(slice digest) {
+            return _shards[std::hash<slice>()(digest) % kNumShards];
+        }
+
+        Shard _shards[kNumShards];
+    };
+}
 
-static UnretainedValueToBlobMap& newBlobs() {
-    static UnretainedValueToBlobMap sNewBlobs;
+static NewBlobRegistry& newBlobs() {
+    static NewBlobRegistry sNewBlobs;
     return sNewBlobs;
 }
 
 
 void CBLDocument::registerNewBlob(CBLNewBlob* blob) {
-    newBlobs().useLocked()->insert({blob->digest(), blob});
+    newBlobs().insert(blob);
 }
 
 
 void CBLDocument::unregisterNewBlob(CBLNewBlob* blob) {
-    newBlobs().useLocked().get().erase(blob->digest());
+    newBlobs().erase(blob);
 }
 
 
 CBLNewBlob* CBLDocument::findNewBlob(FLDict dict) {
     if (!Dict(dict).asMutable())
         return nullptr;
-    return newBlobs().useLocked<CBLNewBlob*>([dict](auto &newBlobs) -> CBLNewBlob* {
-        auto digest = Dict(dict)[kCBLBlobDigestProperty].asString();
-        assert(digest);
-        auto i = newBlobs.find(digest);
-        if (i == newBlobs.end()) {
-            CBL_Log(kCBLLogDomainDatabase, kCBLLogWarning,
-                    "New blob instance looked up with digest '%.*s' was not found; the blob might have already been installed.",
-                    FMTSLICE(digest));
-            return nullptr;
-        }
-        return i->second;
-    });
+    auto digest = Dict(dict)[kCBLBlobDigestProperty].asString();
+    assert(digest);
+    CBLNewBlob *blob = newBlobs().find(digest);
+    if (!blob) {
+        CBL_Log(kCBLLogDomainDatabase, kCBLLogWarning,
+                "New blob instance looked up with digest '%.*s' was not found; the blob might have already been installed.",
+                FMTSLICE(digest));
+    }
+    return blob;
 }
 
 
@@ -320,6 +544,45 @@ CBLEncryptable* CBLDocument::getEncryptableValue(FLDict dict) {
 #endif
 
 
+void CBLDocument::installNewBlobs(CBLDatabase *db,
+                                  std::shared_lock<std::shared_mutex> &pendingBlobs) const
+{
+    vector<CBLBlob*> blobs;
+    {
+        auto c4doc = _c4doc.useLocked();
+        if (!isMutable() || isPlainJSON())
+            return;
+        checkDBMatches(_db, db);
+        for (DeepIterator i(properties()); i; ++i) {
+            // An immutable collection can't contain new blobs:
+            if (Dict dict = i.value().asDict(); dict) {
+                if (!dict.asMutable()) {
+                    i.skipChildren();
+                } else if (FLDict_IsBlob(dict)) {
+                    if (CBLNewBlob *newBlob = findNewBlob(dict); newBlob)
+                        blobs.push_back(newBlob);
+                    i.skipChildren();
+                }
+            } else if (Array array = i.value().asArray(); array && !array.asMutable()) {
+                i.skipChildren();
+            }
+        }
+    }
+    if (blobs.empty())
+        return;
+    if (!pendingBlobs.owns_lock()) {
+        // In a transaction, or while a blob GC holds the lock, leave the blobs to encodeBody,
+        // which installs them inside the save's transaction:
+        if (db->inTransaction())
+            return;
+        pendingBlobs = db->tryLockPendingBlobs();
+        if (!pendingBlobs.owns_lock())
+            return;
+    }
+    db->saveBlobs(blobs.data(), blobs.size());
+}
+
+
 bool CBLDocument::saveBlobsAndCheckEncryptables(CBLDatabase *db, bool releaseNewBlob) const {
     // Walk through the Fleece object tree, looking for new mutable blob Dicts to install,
     // and also checking if there are any blobs at all (mutable or not.)
@@ -337,8 +600,11 @@ bool CBLDocument::saveBlobsAndCheckEncryptables(CBLDatabase *db, bool releaseNew
     auto c4doc = _c4doc.useLocked();
     if (!isMutable())
         return C4Blob::dictContainsBlobs(properties());
+    if (isPlainJSON())
+        return false;
     
     bool foundBlobs = false;
+    slice unchangedBody = unchangedSubtreesBody();
     
     // In EE, encryptables need to be checked, but this adds a lot of overhead so in CE this will be
     // skipped. By defining a constant bool like this, the compiler should optimize out all of the
@@ -350,6 +616,11 @@ bool CBLDocument::saveBlobsAndCheckEncryptables(CBLDatabase *db, bool releaseNew
 #endif
 
     for (DeepIterator i(properties()); i; ++i) {
+        if (unchangedBody.containsAddress((FLValue)i.value())) {
+            // An immutable value from the current revision, which had no blobs.
+            i.skipChildren();
+            continue;
+        }
         Dict dict = i.value().asDict();
         if (dict) {
             if (validateEncryptables && FLDict_IsEncryptableValue(dict)) {
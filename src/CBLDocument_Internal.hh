@@ -23,6 +23,7 @@
 #include "access_lock.hh"
 #include "fleece/Fleece.hh"
 #include "fleece/Mutable.hh"
+#include <shared_mutex>
 #include <unordered_map>
 
 CBL_ASSUME_NONNULL_BEGIN
@@ -44,29 +45,55 @@ public:
 
     // Mutable copy of another CBLDocument
     CBLDocument(const CBLDocument* otherDoc)
-    :CBLDocument(otherDoc->_docID,
+    :CBLDocument(otherDoc->docID(),
                  otherDoc->_db,
                  const_cast<C4Document*>(otherDoc->_c4doc.useLocked().get()),
                  true)
     {
         if (otherDoc->isMutable()) {
             auto other = otherDoc->_c4doc.useLocked();
+            // Only the other doc's mutable containers (the ones that were modified, and their
+            // parents) are copied; the immutable ones are shared until they're modified too.
+            // The JSON they may point into is shared along with them.
+            _fromJSON = otherDoc->_fromJSON;
+            _plainJSON = otherDoc->_plainJSON;
             if (otherDoc->_properties)
-                _properties = otherDoc->_properties.asDict().mutableCopy(kFLDeepCopyImmutables);
+                _properties = otherDoc->_properties.asDict().mutableCopy(kFLDeepCopy);
         }
     }
 
 
-    // Document loaded from db without a C4Document (e.g. a replicator validation callback)
-    CBLDocument(CBLDatabase *db,
-                slice docID,
-                slice revID,
-                C4RevisionFlags revFlags,
-                Dict body)
-    :CBLDocument(docID, db, nullptr, false)
-    {
+    // Reusable immutable document for replication filter callbacks; its docID, revID and body
+    // are borrowed from the replicator for the duration of a callback. (See CBLReplicator::_filter.)
+    explicit CBLDocument(CBLDatabase *db)
+    :CBLDocument(nullslice, db, nullptr, false)
+    { }
+
+
+    // Points a filter document at a revision, without copying anything.
+    void borrowRevision(slice docID, slice revID, Dict body) {
+        _borrowedDocID = docID;
+        _borrowedRevID = revID;
         _properties = body;
-        _revID = revID;
+    }
+
+
+    // Ends a borrow. If the callback retained the document, it gets its own copies of the IDs;
+    // otherwise it's reset so it can be reused. Returns true if it can be reused.
+    bool endBorrow() {
+        bool reusable = (refCount() == 1);
+        if (reusable) {
+            _properties = nullptr;
+            _blobs.clear();
+#ifdef COUCHBASE_ENTERPRISE
+            _encryptables.clear();
+#endif
+        } else {
+            _docID = alloc_slice(_borrowedDocID);
+            _revID = alloc_slice(_borrowedRevID);
+        }
+        _borrowedDocID = _borrowedRevID = nullslice;
+        return reusable;
     }
 
 
@@ -82,9 +109,9 @@ public:
     CBLDatabase*  _cbl_nullable database() const{return _db;}
     bool exists() const                         {return _c4doc.useLocked().get() != nullptr;}
     bool isMutable() const                      {return _mutable;}
-    slice docID() const                         {return _docID;}
-    slice revisionID() const                    {return _revID;}
-    unsigned generation() const                 {return C4Document::getRevIDGeneration(_revID);}
+    slice docID() const                         {return _docID ? slice(_docID) : _borrowedDocID;}
+    slice revisionID() const                    {return _revID ? slice(_revID) : _borrowedRevID;}
+    unsigned generation() const                 {return C4Document::getRevIDGeneration(revisionID());}
 
     uint64_t sequence() const {
         auto c4doc = _c4doc.useLocked();
@@ -123,6 +150,9 @@ public:
             if (storage)
                 _properties = Value::fromData(storage);
             if (_mutable) {
+                // A shallow copy: nested containers stay immutable until they're modified via
+                // FLMutableDict_GetMutableDict etc., which copies only those on the path to the
+                // change. An edit then costs the same whatever the document's size.
                 if (_properties)
                     _properties = _properties.asDict().mutableCopy();
                 if (!_properties)
@@ -167,6 +197,9 @@ public:
         // it'll get a mutable version of this.
         _fromJSON = fromJSON;
         _properties = nullptr;
+        // JSON without these can't contain blobs (or legacy attachments) or encryptables:
+        _plainJSON = !json.find(slice("@type")) && !json.find(slice("_attachments"))
+                     && !json.find(slice("\\u"));
     }
 
 
@@ -208,6 +241,16 @@ public:
     };
 
     bool save(CBLDatabase* db, const SaveOptions &opt);
+
+    // Saves a batch of docs in a single transaction, holding the database lock only once.
+    // If `outResults` is non-null, the status of each doc is written to it (zero on success,
+    // kC4ErrorConflict if the doc was in conflict.) Returns the status of the first doc that
+    // couldn't be saved, or a zero error if all of them were saved.
+    static C4Error saveDocuments(CBLDatabase* db,
+                                 CBLDocument* const _cbl_nonnull docs[],
+                                 size_t count,
+                                 CBLConcurrencyControl concurrency,
+                                 C4Error* _cbl_nullable outResults);
     
 
 #pragma mark - Conflict resolution:
@@ -242,16 +285,23 @@ public:
     enum class Resolution {
         useLocal,
         useRemote,
-        useMerge
+        useMerge,
+        useLocalRevision        // Keep the body of the document's current (local) revision
     };
 
     
     // Resolve conflict for pull replication; The document itself is the conflict (remote) doc.
     // When saving the resolution, the remote branch will always win so that the saved doc
     // will not be conflicted when it is push to the remote server. When the resolution is
-    // useRemote, the resolveDoc will be ignore.
+    // useRemote or useLocalRevision, the resolveDoc will be ignore.
     bool resolveConflict(Resolution resolution, const CBLDocument* _cbl_nullable resolveDoc);
 
+    // Applies the built-in conflict policy to the selected (remote) revision and the current
+    // (local) revision, using only their revision metadata: a deletion wins, else the higher
+    // generation wins, else the higher revID wins. A winning local deletion is returned as
+    // useLocal, which must be resolved with a null resolveDoc.
+    Resolution defaultConflictResolution() const;
+
 
 #pragma mark - Utils:
     
@@ -265,6 +315,7 @@ public:
 
 private:
     friend struct CBLDatabase;
+    friend struct CBLDocEnumerator;
 
     CBLDocument(slice docID, CBLDatabase* _cbl_nullable db,
                 C4Document* _cbl_nullable c4doc, bool isMutable);
@@ -288,7 +339,29 @@ private:
     // any encryptables in an array and throw an unsupported error if that occurs.
     //
     bool saveBlobsAndCheckEncryptables(CBLDatabase *db, bool releaseNewBlob) const;
+
+    // Installs the document's new blobs, concurrently, before saving. This is called before
+    // the database is locked, so that writing blob files doesn't block other database users;
+    // saveBlobsAndCheckEncryptables then finds nothing left to install.
+    // If there are any, `pendingBlobs` is first locked (unless it already is) with
+    // CBLDatabase::tryLockPendingBlobs; the caller must keep it locked until the save's
+    // transaction has ended, so the blobs can't be garbage-collected before they're referenced.
+    // If the database has a transaction open, or the lock is busy, this installs nothing and
+    // saveBlobsAndCheckEncryptables installs the blobs inside the save's transaction.
+    void installNewBlobs(CBLDatabase *db, std::shared_lock<std::shared_mutex> &pendingBlobs) const;
     
+    // Returns the current revision's body if the properties are an unmodified copy of it
+    // (or were never accessed), so it can be saved without re-encoding; else null.
+    slice unmodifiedRevisionBody() const;
+
+    // Returns the current revision's body if it has no blobs, else null. Values in it are
+    // skipped by saveBlobsAndCheckEncryptables, since only modified branches can hold new ones.
+    slice unchangedSubtreesBody() const;
+
+    // True if the properties are unmodified JSON that can't contain any blobs or encryptables,
+    // so saveBlobsAndCheckEncryptables has nothing to look for.
+    bool isPlainJSON() const;
+
     // Encode the document body and install new blobs if found into the database.
     //
     // The releaseNewBlob option tells whether the new blob object should be released after
@@ -302,6 +375,17 @@ private:
                            bool releaseNewBlob,
                            C4RevisionFlags &outRevFlags) const;
 
+    // If `savingDoc` was loaded through one of the database's read-only connections, replaces
+    // it with the same revision loaded through the writeable connection `c4db`, so that it can
+    // be updated. Returns false if the doc has been changed since then (i.e. it's a conflict.)
+    bool useWriteableRevision(C4Database* c4db, Retained<C4Document> &savingDoc) const;
+
+    // Saves the doc within a transaction that's already open on `c4db`, returning the new
+    // C4Document, or null on a conflict. Doesn't update the document object itself.
+    Retained<C4Document> saveInTransaction(CBLDatabase* db,
+                                           C4Database* c4db,
+                                           CBLConcurrencyControl concurrency);
+
     // Custom object cache:
     using ValueToBlobMap = std::unordered_map<FLDict, Retained<CBLBlob>>;
 #ifdef COUCHBASE_ENTERPRISE
@@ -310,9 +394,12 @@ private:
 
     Retained<CBLDatabase>         _db;              // Database (null for new doc)
     litecore::access_lock<Retained<C4Document>>  _c4doc;           // LiteCore doc (null for new doc)
-    alloc_slice const             _docID;           // Document ID (never empty)
+    alloc_slice                   _docID;           // Document ID (empty only while borrowing)
     mutable alloc_slice           _revID;           // Revision ID
+    slice                         _borrowedDocID;   // Filter docs: borrowed document ID
+    slice                         _borrowedRevID;   // Filter docs: borrowed revision ID
     fleece::Doc                   _fromJSON;        // Properties read from JSON
+    bool                          _plainJSON {false}; // _fromJSON has no blobs or encryptables
     mutable fleece::RetainedValue _properties;      // Properties, initialized lazily
     ValueToBlobMap                _blobs;           // Maps Dicts in _properties to CBLBlobs
 #ifdef COUCHBASE_ENTERPRISE
@@ -0,0 +1,329 @@
+//
+// CBLFanOutQuery_Internal.hh
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "CBLDatabase_Internal.hh"
+#include "CBLQuery_Internal.hh"
+#include "CBLLog_Internal.hh"
+#include "c4Base.h"
+#include "Internal.hh"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+CBL_ASSUME_NONNULL_BEGIN
+
+/** The results of running one query on a number of databases. Up to `maxThreads` workers on
+    LiteCore's task pool take the databases one at a time, run the query (compiled through that
+    database's query cache), and copy its rows into a Fleece document. When unordered, `next`
+    returns each database's rows as soon as they're ready; when ordered, it waits for all of
+    them and merges the sorted rows. Either way each database only has to produce `limit` rows,
+    and once the consumer has had `limit` rows, databases not yet queried are skipped.
+    The workers don't retain this object; instead its destructor stops them and waits. */
+struct CBLFanOutResults final : public CBLRefCounted {
+public:
+    static constexpr unsigned kDefaultMaxThreads = 4;
+
+    CBLFanOutResults(std::vector<Retained<CBLDatabase>> dbs,
+                     CBLQueryLanguage language,
+                     slice queryString,
+                     Dict parameters,
+                     const CBLFanOutOptions &options)
+    :_dbs(std::move(dbs))
+    ,_language(language)
+    ,_queryString(queryString)
+    ,_ordered(options.ordered)
+    ,_orderByColumn(options.orderByColumn)
+    ,_descending(options.descending)
+    ,_limit(options.limit)
+    ,_maxThreads(options.maxThreads ? options.maxThreads : kDefaultMaxThreads)
+    {
+        if (parameters) {
+            Encoder enc;
+            enc.writeValue(parameters);
+            _parameters = enc.finish();
+            if (!_parameters)
+                C4Error::raise(FleeceDomain, enc.error(), "%s", enc.errorMessage());
+        }
+        if (_ordered)
+            _outputs.resize(_dbs.size());
+    }
+
+    /// Stops the workers, and waits for any query still running to notice.
+    ~CBLFanOutResults() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _stopped = true;
+        _cond.wait(lock, [&] {return _activeWorkers == 0;});
+    }
+
+    /// Starts the workers.
+    void start() {
+        LOCK(_mutex);
+        unsigned workers = unsigned(std::min(size_t(_maxThreads), _dbs.size()));
+        for (unsigned i = 0; i < workers; ++i) {
+            ++_activeWorkers;
+            c4_runAsyncTask([](void *r) {((CBLFanOutResults*)r)->work();}, this);
+        }
+    }
+
+    /// Moves to the next row, waiting if necessary. Returns false at the end; throws if the
+    /// query failed on any database.
+    bool next() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_limit > 0 && _returned >= _limit) {
+            finish();
+            return false;
+        }
+        bool found = _ordered ? nextMerged(lock) : nextUnordered(lock);
+        if (found)
+            ++_returned;
+        else
+            finish();
+        return found;
+    }
+
+    /// The current row's column values.
+    Array row() const {
+        return _current ? _current->rows[uint32_t(_current->pos)].asArray() : Array();
+    }
+
+    /// The database the current row came from.
+    const CBLDatabase* _cbl_nullable database() const {
+        return _current ? _dbs[_current->db].get() : nullptr;
+    }
+
+private:
+    // The rows one database produced.
+    struct Output {
+        Doc     doc;                // Owns the rows
+        Array   rows;               // An array of rows, each an array of column values
+        size_t  db {0};             // Index in `_dbs`
+        size_t  pos {0};            // Index of the current row
+        bool    done {false};       // True once the database has been queried
+
+        Value key(unsigned col) const   {return rows[uint32_t(pos)].asArray()[col];}
+    };
+
+    // Worker loop: queries databases until there are none left.
+    void work() noexcept {
+        while (true) {
+            size_t db;
+            {
+                LOCK(_mutex);
+                if (_stopped || _nextDB >= _dbs.size()) {
+                    if (--_activeWorkers == 0)
+                        _cond.notify_all();
+                    break;
+                }
+                db = _nextDB++;
+            }
+            Output output;
+            C4Error error = {};
+            try {
+                output = query(db);
+            } catch (...) {
+                error = C4Error::fromCurrentException();
+                CBL_Log(kCBLLogDomainQuery, kCBLLogWarning,
+                        "Fan-out query failed on database '%.*s': %s",
+                        FMTSLICE(_dbs[db]->name()), error.description().c_str());
+            }
+            {
+                LOCK(_mutex);
+                if (error.code) {
+                    if (!_error.code)
+                        _error = error;
+                    _stopped = true;
+                } else if (_ordered) {
+                    _outputs[db] = std::move(output);
+                } else {
+                    _ready.push_back(std::move(output));
+                }
+                ++_finishedDBs;
+            }
+            _cond.notify_all();
+        }
+    }
+
+    // Runs the query on one database, copying up to `_limit` rows.
+    Output query(size_t db) const {
+        Retained<CBLQuery> query = _dbs[db]->createQuery(_language, _queryString, nullptr);
+        if (!query)
+            C4Error::raise(LiteCoreDomain, kC4ErrorInvalidQuery, "Invalid fan-out query");
+        Dict parameters;
+        if (_parameters)
+            parameters = Value::fromData(_parameters, kFLTrusted).asDict();
+        C4Query::Enumerator e = query->run(parameters);
+        unsigned nCols = query->columnCount();
+        if (_ordered && _orderByColumn >= nCols)
+            C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter,
+                           "Fan-out query has no column %u to merge by", _orderByColumn);
+
+        Encoder enc;
+        enc.beginArray();
+        for (uint64_t n = 0; (_limit == 0 || n < _limit) && !stopped() && e.next(); ++n) {
+            enc.beginArray(nCols);
+            for (unsigned col = 0; col < nCols; ++col)
+                enc.writeValue(e.column(col));
+            enc.endArray();
+        }
+        enc.endArray();
+        Output output;
+        output.doc = enc.finishDoc();
+        if (!output.doc)
+            C4Error::raise(FleeceDomain, enc.error(), "%s", enc.errorMessage());
+        output.rows = output.doc.root().asArray();
+        output.db = db;
+        output.done = true;
+        return output;
+    }
+
+    bool stopped() const {
+        LOCK(_mutex);
+        return _stopped;
+    }
+
+    // Called at the end: tells the workers not to start on any more databases.
+    void finish() {
+        _stopped = true;
+        _current = nullptr;
+    }
+
+    void checkError() {
+        if (_error.code) {
+            C4Error error = _error;
+            _error = {};
+            error.raise();
+        }
+    }
+
+    bool nextUnordered(std::unique_lock<std::mutex> &lock) {
+        if (_current && ++_current->pos < _current->rows.count())
+            return true;
+        while (true) {
+            _cond.wait(lock, [&] {
+                return !_ready.empty() || _error.code || _finishedDBs == _dbs.size()
+                    || (_stopped && _activeWorkers == 0);
+            });
+            checkError();
+            if (_ready.empty())
+                return false;
+            _currentOutput = std::move(_ready.front());
+            _ready.pop_front();
+            _current = &_currentOutput;
+            if (_current->rows.count() > 0)
+                return true;
+        }
+    }
+
+    // True if output `a`'s current row should come after output `b`'s.
+    bool after(size_t a, size_t b) const {
+        int cmp = compare(_outputs[a].key(_orderByColumn), _outputs[b].key(_orderByColumn));
+        return _descending ? (cmp < 0) : (cmp > 0);
+    }
+
+    bool nextMerged(std::unique_lock<std::mutex> &lock) {
+        auto heapOrder = [this](size_t a, size_t b) {return after(a, b);};
+        if (!_merging) {
+            _cond.wait(lock, [&] {
+                return _error.code || _finishedDBs == _dbs.size()
+                    || (_stopped && _activeWorkers == 0);
+            });
+            checkError();
+            for (size_t i = 0; i < _outputs.size(); ++i)
+                if (_outputs[i].done && _outputs[i].rows.count() > 0)
+                    _heap.push_back(i);
+            std::make_heap(_heap.begin(), _heap.end(), heapOrder);
+            _merging = true;
+        } else if (_current) {
+            // Advance the output the last row came from, and put it back in the heap:
+            std::pop_heap(_heap.begin(), _heap.end(), heapOrder);
+            if (++_current->pos < _current->rows.count())
+                std::push_heap(_heap.begin(), _heap.end(), heapOrder);
+            else
+                _heap.pop_back();
+        }
+        if (_heap.empty()) {
+            _current = nullptr;
+            return false;
+        }
+        _current = &_outputs[_heap.front()];
+        return true;
+    }
+
+    // Orders values the way N1QL does: missing, null, booleans, numbers, strings, then others.
+    static int compare(Value a, Value b) {
+        auto rank = [](Value v) {
+            switch (v.type()) {
+                case kFLUndefined:  return 0;
+                case kFLNull:       return 1;
+                case kFLBoolean:    return 2;
+                case kFLNumber:     return 3;
+                case kFLString:     return 4;
+                case kFLData:       return 5;
+                case kFLArray:      return 6;
+                case kFLDict:       return 7;
+            }
+            return 8;
+        };
+        int ra = rank(a), rb = rank(b);
+        if (ra != rb)
+            return ra < rb ? -1 : 1;
+        switch (a.type()) {
+            case kFLBoolean:
+                return int(a.asBool()) - int(b.asBool());
+            case kFLNumber: {
+                double da = a.asDouble(), db = b.asDouble();
+                return (da < db) ? -1 : (da > db);
+            }
+            case kFLString:
+            case kFLData:
+                return a.asData().compare(b.asData());
+            default:
+                return 0;
+        }
+    }
+
+    std::vector<Retained<CBLDatabase>> const _dbs;
+    CBLQueryLanguage const          _language;
+    alloc_slice const               _queryString;
+    alloc_slice                     _parameters;        // Encoded parameters, or null
+    bool const                      _ordered;
+    unsigned const                  _orderByColumn;
+    bool const                      _descending;
+    uint64_t const                  _limit;
+    unsigned const                  _maxThreads;
+
+    mutable std::mutex              _mutex;
+    std::condition_variable         _cond;
+    size_t                          _nextDB {0};        // Next database for a worker to query
+    size_t                          _finishedDBs {0};   // Databases queried (or failed)
+    unsigned                        _activeWorkers {0};
+    bool                            _stopped {false};   // Tells the workers to stop
+    C4Error                         _error {};          // First error, until thrown by next()
+    std::deque<Output>              _ready;             // Unordered: outputs not yet read
+    std::vector<Output>             _outputs;           // Ordered: outputs indexed by database
+    std::vector<size_t>             _heap;              // Ordered: outputs with rows left
+    bool                            _merging {false};   // Ordered: true once `_heap` is built
+    Output                          _currentOutput;     // Unordered: the one being read
+    Output* _cbl_nullable           _current {nullptr}; // The output the current row is in
+    uint64_t                        _returned {0};      // Rows returned by next()
+};
+
+CBL_ASSUME_NONNULL_END
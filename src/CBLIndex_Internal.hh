@@ -0,0 +1,196 @@
+//
+// CBLIndex_Internal.hh
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "CBLQuery.h"
+#include "CBLLog_Internal.hh"
+#include "c4Database.hh"
+#include "Internal.hh"
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+
+CBL_ASSUME_NONNULL_BEGIN
+
+namespace cbl_internal {
+
+    /** A value or full-text index to be created: a copy of its configuration, which owns the
+        strings that the configuration structs only point to. */
+    struct IndexSpec {
+        fleece::alloc_slice name;
+        C4IndexType         type;
+        C4QueryLanguage     language;
+        fleece::alloc_slice expressions;
+        bool                ignoreDiacritics {false};
+        bool                disableStemming {false};
+        std::string         ftsLanguage;
+        std::optional<std::string> stopWords;
+
+        IndexSpec(fleece::slice name_, const CBLValueIndexConfiguration &config)
+        :name(name_)
+        ,type(kC4ValueIndex)
+        ,language(C4QueryLanguage(config.expressionLanguage))
+        ,expressions(config.where.buf ? partialIndexJSON(config)
+                                      : fleece::alloc_slice(config.expressions))
+        { }
+
+        IndexSpec(fleece::slice name_, const CBLFullTextIndexConfiguration &config)
+        :name(name_)
+        ,type(kC4FullTextIndex)
+        ,language(C4QueryLanguage(config.expressionLanguage))
+        ,expressions(config.expressions)
+        ,ignoreDiacritics(config.ignoreAccents)
+        ,disableStemming(config.disableStemming)
+        {
+            if (config.language.buf)
+                ftsLanguage = std::string(fleece::slice(config.language));
+            if (config.stopWords.buf)
+                stopWords = std::string(fleece::slice(config.stopWords));
+        }
+
+        // LiteCore takes a value index's WHERE clause as part of its JSON spec:
+        // `{"WHAT": [expressions...], "WHERE": condition}`.
+        static fleece::alloc_slice partialIndexJSON(const CBLValueIndexConfiguration &config) {
+            if (config.expressionLanguage != kCBLJSONLanguage)
+                C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter,
+                               "A partial index's expressions and 'where' must be in JSON");
+            fleece::Doc what = fleece::Doc::fromJSON(config.expressions);
+            fleece::Doc where = fleece::Doc::fromJSON(config.where);
+            if (!what || !where)
+                C4Error::raise(LiteCoreDomain, kC4ErrorInvalidQuery, "Invalid JSON in index spec");
+            fleece::JSONEncoder enc;
+            enc.beginDict(2);
+            enc.writeKey("WHAT");
+            enc.writeValue(what.root());
+            enc.writeKey("WHERE");
+            enc.writeValue(where.root());
+            enc.endDict();
+            return enc.finish();
+        }
+
+        void createIn(C4Database *c4db) const {
+            C4IndexOptions options = {};
+            options.ignoreDiacritics = ignoreDiacritics;
+            options.disableStemming = disableStemming;
+            if (!ftsLanguage.empty())
+                options.language = ftsLanguage.c_str();
+            if (stopWords)
+                options.stopWords = stopWords->c_str();
+            c4db->createIndex(name, expressions, language, type, &options);
+        }
+    };
+
+}
+
+
+/** An index being created in the background, on its own connection to the database file; it
+    doesn't retain the CBLDatabase, and never touches its connection or lock. */
+struct CBLIndexBuild final : public CBLRefCounted, public CBLStoppable {
+public:
+    CBLIndexBuild(IndexSpec spec,
+                  slice dbName,
+                  const C4DatabaseConfig2 &dbConfig,
+                  CBLIndexBuildListener _cbl_nullable listener,
+                  void* _cbl_nullable context)
+    :_spec(std::move(spec))
+    ,_dbName(dbName)
+    ,_dbDir(dbConfig.parentDirectory)
+    ,_dbConfig(dbConfig)
+    ,_listener(listener)
+    ,_context(context)
+    {
+        _dbConfig.parentDirectory = _dbDir;
+        _dbConfig.flags &= ~(kC4DB_Create | kC4DB_ReadOnly);
+    }
+
+    CBLIndexBuildState state() const            {return _state;}
+
+    void cancel() {
+        _cancelled = true;
+    }
+
+    /// Called when the database closes; it then waits for `onDone`.
+    void stop() override {
+        cancel();
+    }
+
+    /// Starts the build on a new thread, which retains this object until it's done. (Not the
+    /// LiteCore task pool, since building an index of a large database can take minutes.)
+    /// `onDone` is called once the build's connection is closed, before the final state change.
+    void start(std::function<void()> onDone) {
+        retain(this);
+        std::thread([this, onDone = std::move(onDone)] {
+            run(onDone);
+            release(this);
+        }).detach();
+    }
+
+private:
+    void run(const std::function<void()> &onDone) {
+        C4Error error = {};
+        bool cancelled = true;
+        if (updateState(kCBLIndexBuildRunning, nullptr)) {
+            try {
+                Retained<C4Database> c4db = C4Database::openNamed(_dbName, _dbConfig);
+                _spec.createIn(c4db);
+                // LiteCore builds an index in one statement, so there's no stopping it midway;
+                // the best we can do is undo it.
+                cancelled = _cancelled;
+                if (cancelled)
+                    c4db->deleteIndex(_spec.name);
+                c4db->close();
+            } catch (...) {
+                error = C4Error::fromCurrentException();
+            }
+        }
+        onDone();
+        if (error.code)
+            updateState(kCBLIndexBuildFailed, &error);
+        else if (cancelled)
+            updateState(kCBLIndexBuildCancelled, nullptr);
+        else
+            updateState(kCBLIndexBuildFinished, nullptr);
+    }
+
+    // Sets the state and calls the listener; returns false if cancelled before it began.
+    bool updateState(CBLIndexBuildState state, const C4Error* _cbl_nullable error) {
+        if (state == kCBLIndexBuildRunning && _cancelled)
+            return false;
+        _state = state;
+        if (error) {
+            CBL_Log(kCBLLogDomainQuery, kCBLLogWarning, "Background build of index '%.*s' failed: %s",
+                    FMTSLICE(_spec.name), error->description().c_str());
+        }
+        if (_listener)
+            _listener(_context, this, state, (const CBLError*)error);
+        return true;
+    }
+
+    IndexSpec const                     _spec;
+    alloc_slice const                   _dbName;
+    alloc_slice const                   _dbDir;
+    C4DatabaseConfig2                   _dbConfig;
+    CBLIndexBuildListener _cbl_nullable _listener;
+    void* _cbl_nullable                 _context;
+    std::atomic<CBLIndexBuildState>     _state {kCBLIndexBuildPending};
+    std::atomic<bool>                   _cancelled {false};
+};
+
+CBL_ASSUME_NONNULL_END
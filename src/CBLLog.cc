@@ -18,6 +18,7 @@
 
 #include "CBLLog.h"
 #include "CBLLog_Internal.hh"
+#include "CBLTrace_Internal.hh"
 #include "CBLPrivate.h"
 #include "c4Base.hh"
 #include "Internal.hh"
@@ -25,10 +26,18 @@
 #include "betterassert.hh"
 #include "LogDecoder.hh"
 #include "ParseDate.hh"
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace fleece;
@@ -41,19 +50,52 @@ static const char* const kLogLevelNames[] = {"debug", "verbose", "info", "warnin
 static const size_t kDefaultLogFileConfigMaxSize = 500 * 1024;
 static const int32_t kDefaultLogFileConfigMaxRotateCount = 1;
 
+static constexpr int kNumDomains = sizeof(kC4Domains)/sizeof(kC4Domains[0]);
+
 static atomic<CBLLogLevel> sConsoleLogLevel = kCBLLogWarning;
 
 static atomic<CBLLogCallback> sCustomCallback = nullptr;
 static atomic<CBLLogLevel> sCustomLogLevel = kCBLLogWarning;
 
+// The levels set for each sink and domain, guarded by sLevelsMutex:
+static mutex sLevelsMutex;
+static CBLLogLevel sDomainLevels[2][kNumDomains] = {
+    {kCBLLogWarning, kCBLLogWarning, kCBLLogWarning, kCBLLogWarning},
+    {kCBLLogWarning, kCBLLogWarning, kCBLLogWarning, kCBLLogWarning},
+};
+
+// The effective levels, packed 4 bits each so that a single atomic load tells whether a message
+// is wanted anywhere: the console's per domain, then the callback's (kCBLLogNone if there's no
+// callback), then the log files'.
+static constexpr uint64_t packLevels(CBLLogLevel level) {
+    uint64_t packed = 0;
+    for (int i = 0; i <= 2 * kNumDomains; ++i)
+        packed |= uint64_t(level) << (4 * i);
+    return packed;
+}
+static atomic<uint64_t> sEffectiveLevels = packLevels(kCBLLogNone);
+
+static inline CBLLogLevel effectiveLevel(uint64_t levels, int sink, int domain) {
+    return CBLLogLevel((levels >> (4 * (sink * kNumDomains + domain))) & 0xF);
+}
+static inline CBLLogLevel effectiveFileLevel(uint64_t levels) {
+    return CBLLogLevel((levels >> (4 * 2 * kNumDomains)) & 0xF);
+}
+
+namespace {
+    class LogRing;
+}
+static atomic<LogRing*> sAsyncRing = nullptr;
+static atomic<uint64_t> sDroppedMessages = 0;
+
+static atomic<bool> sDeferFormatting = false;
+
 static CBLLogFileConfiguration sLogFileConfig;
 static alloc_slice sLogFileDir;
 
 static void c4LogCallback(C4LogDomain domain, C4LogLevel level, const char *fmt, va_list args);
 
-static C4LogLevel effectiveC4CallbackLogLevel();
-
-static void updateC4CallbackLogLevel();
+static void updateLevels();
 
 static CBLLogDomain getCBLLogDomain(C4LogDomain domain);
 
@@ -62,14 +104,9 @@ static CBLLogDomain getCBLLogDomain(C4LogDomain domain);
 static once_flag initFlag;
 void CBLLog_Init() {
     call_once(initFlag, [](){
-        // Initialize log level of each domain to debug (lowest level):
-        for (int i = 0; i < sizeof(kC4Domains)/sizeof(kC4Domains[0]); ++i) {
-            C4LogDomain domain = kC4Domains[i];
-            c4log_setLevel(domain, kC4LogDebug);
-        }
-        
-        // Register log callback:
-        c4log_writeToCallback(effectiveC4CallbackLogLevel(), &c4LogCallback, true /*preformatted*/);
+        // Register log callback, then set the level of each domain:
+        c4log_writeToCallback(kC4LogNone, &c4LogCallback, true /*preformatted*/);
+        updateLevels();
     });
 }
 
@@ -81,8 +118,13 @@ CBLLogLevel CBLLog_ConsoleLevel() CBLAPI {
 
 void CBLLog_SetConsoleLevel(CBLLogLevel level) CBLAPI {
     CBLLog_Init();
-    if (sConsoleLogLevel.exchange(level) != level)
-        updateC4CallbackLogLevel();
+    {
+        LOCK(sLevelsMutex);
+        sConsoleLogLevel = level;
+        for (auto &domainLevel : sDomainLevels[kCBLLogSinkConsole])
+            domainLevel = level;
+    }
+    updateLevels();
 }
 
 
@@ -93,8 +135,34 @@ CBLLogLevel CBLLog_CallbackLevel() CBLAPI {
 
 void CBLLog_SetCallbackLevel(CBLLogLevel level) CBLAPI {
     CBLLog_Init();
-    if (sCustomLogLevel.exchange(level) != level)
-        updateC4CallbackLogLevel();
+    {
+        LOCK(sLevelsMutex);
+        sCustomLogLevel = level;
+        for (auto &domainLevel : sDomainLevels[kCBLLogSinkCallback])
+            domainLevel = level;
+    }
+    updateLevels();
+}
+
+
+CBLLogLevel CBLLog_DomainLevel(CBLLogSink sink, CBLLogDomain domain) CBLAPI {
+    precondition((sink <= kCBLLogSinkCallback));
+    precondition((domain <= kCBLLogDomainNetwork));
+    LOCK(sLevelsMutex);
+    return sDomainLevels[sink][domain];
+}
+
+
+void CBLLog_SetDomainLevel(CBLLogSink sink, CBLLogDomain domain, CBLLogLevel level) CBLAPI {
+    precondition((sink <= kCBLLogSinkCallback));
+    precondition((domain <= kCBLLogDomainNetwork));
+    precondition((level <= kCBLLogNone));
+    CBLLog_Init();
+    {
+        LOCK(sLevelsMutex);
+        sDomainLevels[sink][domain] = level;
+    }
+    updateLevels();
 }
 
 
@@ -106,29 +174,195 @@ CBLLogCallback CBLLog_Callback() CBLAPI {
 void CBLLog_SetCallback(CBLLogCallback callback) CBLAPI {
     CBLLog_Init();
     if (sCustomCallback.exchange(callback) != callback)
-        updateC4CallbackLogLevel();
+        updateLevels();
 }
 
 
-static C4LogLevel effectiveC4CallbackLogLevel() {
-    CBLLogLevel customLogLevel = sCustomCallback != nullptr ? sCustomLogLevel.load() : kCBLLogNone;
-    return C4LogLevel(std::min(sConsoleLogLevel.load(), customLogLevel));
+// Recomputes sEffectiveLevels, and sets LiteCore's callback level and the level of each domain
+// to the lowest any sink wants, so LiteCore doesn't format messages that no sink wants.
+static void updateLevels() {
+    LOCK(sLevelsMutex);
+    bool hasCallback = (sCustomCallback != nullptr);
+    CBLLogLevel fileLevel = sLogFileConfig.directory.buf ? sLogFileConfig.level : kCBLLogNone;
+    uint64_t packed = 0;
+    CBLLogLevel callbackMin = kCBLLogNone;
+    for (int d = 0; d < kNumDomains; ++d) {
+        CBLLogLevel console = sDomainLevels[kCBLLogSinkConsole][d];
+        CBLLogLevel custom = hasCallback ? sDomainLevels[kCBLLogSinkCallback][d] : kCBLLogNone;
+        packed |= uint64_t(console) << (4 * d);
+        packed |= uint64_t(custom) << (4 * (kNumDomains + d));
+        CBLLogLevel domainMin = std::min(console, custom);
+        callbackMin = std::min(callbackMin, domainMin);
+        c4log_setLevel(kC4Domains[d], C4LogLevel(std::min(domainMin, fileLevel)));
+    }
+    packed |= uint64_t(fileLevel) << (4 * 2 * kNumDomains);
+    sEffectiveLevels = packed;
+
+    if (c4log_callbackLevel() != C4LogLevel(callbackMin))
+        c4log_setCallbackLevel(C4LogLevel(callbackMin));
 }
 
 
-static void updateC4CallbackLogLevel() {
-    C4LogLevel level = effectiveC4CallbackLogLevel();
-    if (c4log_callbackLevel() != level)
-        c4log_setCallbackLevel(level);
+// Returns true if any sink wants a message of this domain and level.
+static inline bool shouldLog(CBLLogDomain domain, CBLLogLevel level) {
+    uint64_t levels = sEffectiveLevels.load(memory_order_relaxed);
+    return level >= effectiveLevel(levels, kCBLLogSinkConsole, domain)
+        || level >= effectiveLevel(levels, kCBLLogSinkCallback, domain)
+        || level >= effectiveFileLevel(levels);
+}
+
+
+#pragma mark - ASYNC CALLBACK DELIVERY:
+
+
+namespace {
+    /** A bounded queue of log messages for the custom callback, with many producers (the
+        logging threads) and one consumer thread that delivers them, after Dmitry Vyukov's
+        bounded MPMC queue. Producers never block or take a lock while the consumer is busy;
+        if the ring is full the message is dropped and counted. Each slot's string keeps its
+        capacity, so once the ring has warmed up, queuing a message doesn't allocate. */
+    class LogRing {
+    public:
+        explicit LogRing(size_t capacity) {
+            size_t size = 2;
+            while (size < capacity)
+                size <<= 1;
+            _mask = size - 1;
+            _slots = make_unique<Slot[]>(size);
+            for (size_t i = 0; i < size; ++i)
+                _slots[i].seq.store(i, memory_order_relaxed);
+            thread([this]{ run(); }).detach();
+        }
+
+        void push(CBLLogDomain domain, CBLLogLevel level, slice message) {
+            size_t pos = _head.load(memory_order_relaxed);
+            Slot *slot;
+            while (true) {
+                slot = &_slots[pos & _mask];
+                size_t seq = slot->seq.load(memory_order_acquire);
+                auto diff = intptr_t(seq) - intptr_t(pos);
+                if (diff == 0) {
+                    if (_head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                        break;
+                } else if (diff < 0) {
+                    ++sDroppedMessages;     // ring is full
+                    return;
+                } else {
+                    pos = _head.load(memory_order_relaxed);
+                }
+            }
+            slot->domain = domain;
+            slot->level = level;
+            slot->message.assign((const char*)message.buf, message.size);
+            slot->seq.store(pos + 1);
+            if (_sleeping) {
+                lock_guard<mutex> lock(_mutex);
+                _wake.notify_one();
+            }
+        }
+
+        // Blocks until every message queued before the call has been delivered.
+        void flush() {
+            size_t target = _head.load();
+            unique_lock<mutex> lock(_mutex);
+            _wake.notify_one();
+            _delivered.wait(lock, [&]{ return _tail >= target || _exited; });
+        }
+
+        // Delivers the remaining messages, then stops the consumer thread.
+        void stop() {
+            unique_lock<mutex> lock(_mutex);
+            _stopping = true;
+            _wake.notify_one();
+            _delivered.wait(lock, [&]{ return _exited; });
+        }
+
+    private:
+        struct Slot {
+            atomic<size_t>  seq;
+            CBLLogDomain    domain;
+            CBLLogLevel     level;
+            string          message;
+        };
+
+        bool ready() const {
+            return _slots[_tail & _mask].seq.load() == _tail + 1;
+        }
+
+        void run() {
+            while (true) {
+                // Deliver everything that's queued, as one batch:
+                bool delivered = false;
+                while (ready()) {
+                    Slot &slot = _slots[_tail & _mask];
+                    if (CBLLogCallback callback = sCustomCallback; callback)
+                        callback(slot.domain, slot.level, slice(slot.message));
+                    slot.seq.store(_tail + _mask + 1, memory_order_release);
+                    _tail.store(_tail + 1);
+                    delivered = true;
+                }
+
+                unique_lock<mutex> lock(_mutex);
+                if (delivered)
+                    _delivered.notify_all();
+                if (_stopping && !ready()) {
+                    _exited = true;
+                    _delivered.notify_all();
+                    return;
+                }
+                _sleeping = true;
+                _wake.wait(lock, [&]{ return ready() || _stopping; });
+                _sleeping = false;
+            }
+        }
+
+        unique_ptr<Slot[]>      _slots;
+        size_t                  _mask;
+        atomic<size_t>          _head {0};          // Next position to push to
+        atomic<size_t>          _tail {0};          // Next position to deliver (consumer only)
+        mutex                   _mutex;
+        condition_variable      _wake;              // Wakes the consumer thread
+        condition_variable      _delivered;         // Signals flush() and stop()
+        atomic<bool>            _sleeping {false};
+        bool                    _stopping {false};
+        bool                    _exited {false};
+    };
+}
+
+
+static mutex sAsyncMutex;
+
+void CBLLog_SetCallbackAsync(unsigned capacity) CBLAPI {
+    CBLLog_Init();
+    LOCK(sAsyncMutex);
+    LogRing *old = sAsyncRing.exchange(capacity > 0 ? new LogRing(capacity) : nullptr);
+    if (old) {
+        // Deliver what's left. The ring itself is not freed, since a logging thread may still
+        // be about to push to it.
+        old->stop();
+    }
+}
+
+
+void CBLLog_FlushCallback(void) CBLAPI {
+    LOCK(sAsyncMutex);
+    if (LogRing *ring = sAsyncRing; ring)
+        ring->flush();
+}
+
+
+uint64_t CBLLog_DroppedMessageCount(void) CBLAPI {
+    return sDroppedMessages;
 }
 
 
 static void c4LogCallback(C4LogDomain domain, C4LogLevel level, const char *msg, va_list args) {
     CBLLogLevel msgLevel = CBLLogLevel(level);
+    CBLLogDomain cblDomain = getCBLLogDomain(domain);
+    uint64_t levels = sEffectiveLevels.load(memory_order_relaxed);
     
     // Log to console:
-    CBLLogLevel consoleLogLevel = sConsoleLogLevel;
-    if (msgLevel >= consoleLogLevel) {
+    if (msgLevel >= effectiveLevel(levels, kCBLLogSinkConsole, cblDomain)) {
         auto domainName = c4log_getDomainName(domain);
         auto levelName = kLogLevelNames[(int)level];
         
@@ -143,10 +377,12 @@ static void c4LogCallback(C4LogDomain domain, C4LogLevel level, const char *msg,
     if (!callback)
         return;
     
-    CBLLogLevel customLogLevel = sCustomLogLevel;
-    if (msgLevel >= customLogLevel) {
+    if (msgLevel >= effectiveLevel(levels, kCBLLogSinkCallback, cblDomain)) {
         // msg is preformatted
-        callback(getCBLLogDomain(domain), msgLevel, slice(msg));
+        if (LogRing *ring = sAsyncRing; ring)
+            ring->push(cblDomain, msgLevel, slice(msg));
+        else
+            callback(cblDomain, msgLevel, slice(msg));
     }
 }
 
@@ -166,22 +402,29 @@ static CBLLogDomain getCBLLogDomain(C4LogDomain domain) {
 void CBL_Log(CBLLogDomain domain, CBLLogLevel level, const char *format, ...) CBLAPI {
     precondition((domain <= kCBLLogDomainNetwork));
     precondition((level <= kCBLLogNone));
-    char *message = nullptr;
+    if (!shouldLog(domain, level))
+        return;
     va_list args;
     va_start(args, format);
-    vasprintf(&message, format, args);
+    if (sDeferFormatting) {
+        // Let LiteCore store the format string and raw arguments in the binary log:
+        c4vlog(kC4Domains[domain], C4LogLevel(level), format, args);
+    } else {
+        char *message = nullptr;
+        vasprintf(&message, format, args);
+        C4LogToAt(kC4Domains[domain], C4LogLevel(level), "%s", message);
+        free(message);
+    }
     va_end(args);
-    C4LogToAt(kC4Domains[domain], C4LogLevel(level), "%s", message);
-    free(message);
 }
 
 
 void CBL_LogMessage(CBLLogDomain domain, CBLLogLevel level, FLString message) CBLAPI {
     precondition((domain <= kCBLLogDomainNetwork));
     precondition((level <= kCBLLogNone));
-    if (message.buf == nullptr)
+    if (message.buf == nullptr || !shouldLog(domain, level))
         return;
-    CBL_Log(domain, level, "%.*s", (int) message.size, (char *) message.buf);
+    C4LogToAt(kC4Domains[domain], C4LogLevel(level), "%.*s", (int) message.size, (char *) message.buf);
 }
 
 
@@ -211,7 +454,125 @@ bool CBLLog_SetFileConfig(CBLLogFileConfiguration config, CBLError *outError) CB
     c4opt.use_plaintext     = config.usePlaintext;
     c4opt.header            = slice(header);
     
-    return c4log_writeToBinaryFile(c4opt, internal(outError));
+    sDeferFormatting = config.deferFormatting;
+    bool ok = c4log_writeToBinaryFile(c4opt, internal(outError));
+    updateLevels();
+    return ok;
+}
+
+
+bool CBLLog_DecodeFile(FLString binaryPath, FLString outputPath, CBLError *outError) CBLAPI {
+    try {
+        ifstream in(string(slice(binaryPath)), ifstream::in | ifstream::binary);
+        if (!in)
+            C4Error::raise(LiteCoreDomain, kC4ErrorNotFound,
+                           "Can't open log file %.*s", FMTSLICE(slice(binaryPath)));
+        in.exceptions(ifstream::badbit);
+        ofstream out(string(slice(outputPath)), ofstream::out | ofstream::trunc);
+        if (!out)
+            C4Error::raise(LiteCoreDomain, kC4ErrorCantOpenFile,
+                           "Can't create %.*s", FMTSLICE(slice(outputPath)));
+
+        vector<string> levelNames(begin(kLogLevelNames), end(kLogLevelNames));
+        LogDecoder decoder(in);
+        decoder.decodeTo(out, levelNames);
+        out.close();
+        if (!out)
+            C4Error::raise(LiteCoreDomain, kC4ErrorIOError,
+                           "Couldn't write %.*s", FMTSLICE(slice(outputPath)));
+        return true;
+    } catchAndBridge(outError)
+}
+
+
+#pragma mark - TRACING:
+
+
+using namespace cbl_internal;
+
+atomic<const TraceSpan::Config*> TraceSpan::sConfig = nullptr;
+
+static atomic<uint64_t> sNextSpanID = 1;
+static thread_local TraceSpan* sCurrentSpan = nullptr;
+static thread_local uint32_t sSampleSeed = 0;
+
+
+// A per-thread xorshift generator; it only needs to be cheap, not good.
+static uint32_t sampleRandom() {
+    uint32_t x = sSampleSeed;
+    if (_usuallyFalse(x == 0))
+        x = uint32_t(hash<thread::id>()(this_thread::get_id())) | 1;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sSampleSeed = x;
+    return x;
+}
+
+
+static int64_t traceClock() {
+    using namespace chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+
+void TraceSpan::setCallback(CBLTraceCallback callback, void *context, double sampleRate) {
+    static mutex sMutex;
+    static vector<unique_ptr<Config>> sRetired;
+    LOCK(sMutex);
+    const Config *config = nullptr;
+    if (callback) {
+        sampleRate = std::max(0.0, std::min(sampleRate, 1.0));
+        auto threshold = uint64_t(sampleRate * double(uint64_t(1) << 32));
+        sRetired.emplace_back(new Config{callback, context, threshold});
+        config = sRetired.back().get();
+    }
+    // Configs are never freed, since a span on another thread may still be using one; this only
+    // costs a few bytes each time the callback is changed.
+    sConfig.store(config);
+}
+
+
+void TraceSpan::begin(CBLTraceOperation op, slice detail) {
+    TraceSpan *parent = sCurrentSpan;
+    if (parent) {
+        // A nested span is traced iff its parent is:
+        if (!parent->_traced)
+            return;
+        _config = parent->_config;
+    } else {
+        _config = sConfig.load(memory_order_acquire);
+        if (!_config)
+            return;
+    }
+    // Even an unsampled top-level span becomes the thread's current span, so that the spans
+    // nested in it aren't sampled on their own:
+    _parent = parent;
+    _pushed = true;
+    sCurrentSpan = this;
+    if (!parent && sampleRandom() >= _config->threshold)
+        return;
+
+    _traced = true;
+    _span.operation = op;
+    _span.spanID = sNextSpanID++;
+    _span.parentID = parent ? parent->_span.spanID : 0;
+    _span.detail = detail;
+    _span.startTime = traceClock();
+}
+
+
+void TraceSpan::end() {
+    sCurrentSpan = _parent;
+    if (_traced) {
+        _span.duration = traceClock() - _span.startTime;
+        _config->callback(_config->context, &_span);
+    }
+}
+
+
+void CBL_SetTraceCallback(CBLTraceCallback callback, void *context, double sampleRate) CBLAPI {
+    TraceSpan::setCallback(callback, context, sampleRate);
 }
 
 
@@ -17,10 +17,8 @@
 //
 
 /**
- * Initialize the log level of each log domains to DEBUG so that
- * the log level of all domains could be controlled by using c4log_setCallbackLevel()
- * and c4log_writeToBinaryFile() and setup the log callback with the WARNING as its default
- * log level.
+ * Setup the log callback, and initialize the log level of each log domain to the lowest level
+ * wanted by the console, the callback or the log files for that domain (WARNING by default.)
  *
  * This method is safe to call multiple times but the initializing logic will be executed only
  * once when the method is called the first time.
@@ -26,8 +26,132 @@ using namespace std;
 using namespace fleece;
 
 
+#pragma mark - QUERY:
+
+
+void CBLQuery::_encodeParameters(Encoder &enc) {
+    alloc_slice encodedParameters = enc.finish();
+    if (!encodedParameters)
+        C4Error::raise(FleeceDomain, enc.error(), "%s", enc.errorMessage());
+    {
+        auto c4query = _c4query.useLocked();
+        _parameters = encodedParameters;
+        if (!_shared)
+            c4query->setParameters(encodedParameters);
+    }
+    // Live queries are observed by source and parameters, so move the listeners to the
+    // observer for the new parameters:
+    _listeners.forEach([](ListenerToken<CBLQueryChangeListener> *token) {
+        token->bindObserver();
+    });
+}
+
+
+alloc_slice CBLQuery::_observerKey(alloc_slice &parameters) const {
+    // Language, source length, source, parameters:
+    {
+        auto c4query = _c4query.useLocked();
+        parameters = _parameters;
+    }
+    uint32_t sourceSize = uint32_t(_queryString.size);
+    alloc_slice key(1 + sizeof(sourceSize) + _queryString.size + parameters.size);
+    auto dst = (uint8_t*)key.buf;
+    *dst++ = uint8_t(_language);
+    memcpy(dst, &sourceSize, sizeof(sourceSize));
+    dst += sizeof(sourceSize);
+    memcpy(dst, _queryString.buf, _queryString.size);
+    dst += _queryString.size;
+    if (parameters.size > 0)
+        memcpy(dst, parameters.buf, parameters.size);
+    return key;
+}
+
+
+#pragma mark - SHARED QUERY OBSERVER:
+
+
+SharedQueryObserver::SharedQueryObserver(alloc_slice key, Retained<C4Query> c4query)
+:_key(std::move(key))
+,_c4query(std::move(c4query))
+{
+    _c4obs = _c4query->observe([this](C4QueryObserver*) { this->changed(); });
+}
+
+
+void SharedQueryObserver::subscribe(Token *token) {
+    LOCK(_mutex);
+    _subscribers.push_back({token, false});
+}
+
+
+bool SharedQueryObserver::unsubscribe(Token *token) {
+    LOCK(_mutex);
+    for (auto i = _subscribers.begin(); i != _subscribers.end(); ++i) {
+        if (i->token == token) {
+            if (i->observing && --_observingCount == 0)
+                _c4obs->setEnabled(false);
+            _subscribers.erase(i);
+            break;
+        }
+    }
+    return _subscribers.empty();
+}
+
+
+void SharedQueryObserver::setObserving(Token *token, bool observing) {
+    bool deliverNow = false;
+    {
+        LOCK(_mutex);
+        for (auto &sub : _subscribers) {
+            if (sub.token == token) {
+                if (sub.observing == observing)
+                    return;
+                sub.observing = observing;
+                if (observing) {
+                    if (_observingCount++ == 0)
+                        _c4obs->setEnabled(true);       // The query will run & call changed()
+                    else
+                        deliverNow = _hasResults;
+                } else {
+                    if (--_observingCount == 0)
+                        _c4obs->setEnabled(false);
+                }
+                break;
+            }
+        }
+    }
+    if (deliverNow)
+        token->queryChanged();
+}
+
+
+// Called by the C4QueryObserver when there are new results; fans them out to the
+// observing subscribers.
+void SharedQueryObserver::changed() {
+    std::vector<Retained<Token>> tokens;
+    {
+        LOCK(_mutex);
+        _hasResults = true;
+        tokens.reserve(_observingCount);
+        for (auto &sub : _subscribers) {
+            if (sub.observing)
+                tokens.emplace_back(sub.token);
+        }
+    }
+    for (auto &token : tokens)
+        token->queryChanged();
+}
+
+
+#pragma mark - QUERY LISTENER:
+
+
 void ListenerToken<CBLQueryChangeListener>::setEnabled(bool enabled) {
-    auto c4query = _query->_c4query.useLocked();
+    if (enabled && _timer) {
+        LOCK(_throttleMutex);
+        _sequenceAtRun = _query->database()->lastSequence();
+        _suspended = _suspendPending = false;
+    }
     CBLDatabase* db = const_cast<CBLDatabase*>(_query->database());
     if (enabled) {
         if (!db->registerStoppable(this)) {
@@ -36,12 +160,246 @@ void ListenerToken<CBLQueryChangeListener>::setEnabled(bool enabled) {
             return;
         }
     }
-    _c4obs->setEnabled(enabled);
+    _enabled = enabled;
+    if (auto obs = observer(); obs)
+        obs->setObserving(this, enabled && !_paused);
     if (!enabled)
         db->unregisterStoppable(this);
 }
 
 
+void ListenerToken<CBLQueryChangeListener>::bindObserver() {
+    alloc_slice parameters;
+    alloc_slice key = _query->_observerKey(parameters);
+    Retained<SharedQueryObserver> oldObs = observer();
+    if (oldObs && oldObs->key() == key)
+        return;
+    CBLDatabase* db = const_cast<CBLDatabase*>(_query->database());
+    Retained<SharedQueryObserver> newObs = db->observeQuery(this, key, _query, parameters);
+    {
+        LOCK(_observerMutex);
+        _observer = newObs;
+    }
+    if (oldObs) {
+        db->unobserveQuery(oldObs, this);
+        if (_enabled && !_paused) {
+            if (_timer) {
+                LOCK(_throttleMutex);
+                _suspended = _suspendPending = false;
+            }
+            newObs->setObserving(this, true);
+        }
+    }
+}
+
+
+void ListenerToken<CBLQueryChangeListener>::unbindObserver() {
+    Retained<SharedQueryObserver> obs;
+    {
+        LOCK(_observerMutex);
+        std::swap(obs, _observer);
+    }
+    if (obs)
+        const_cast<CBLDatabase*>(_query->database())->unobserveQuery(obs, this);
+}
+
+
+void ListenerToken<CBLQueryChangeListener>::setPaused(bool paused) {
+    if (_paused.exchange(paused) == paused)
+        return;
+    if (!paused && _timer) {
+        LOCK(_throttleMutex);
+        _sequenceAtRun = _query->database()->lastSequence();
+        _suspended = _suspendPending = false;
+    }
+    setObserving(!paused);
+}
+
+
+// Starts or stops observing without unregistering from the database.
+void ListenerToken<CBLQueryChangeListener>::setObserving(bool observing) {
+    if (!_enabled)
+        return;
+    if (auto obs = observer(); obs)
+        obs->setObserving(this, observing);
+}
+
+
+// Called from queryChanged() if the listener is throttled. Returns false if the listener is
+// already suspended and should ignore these results. Otherwise schedules the timer to stop
+// observing -- this isn't done directly, since we're inside the observer's callback.
+bool ListenerToken<CBLQueryChangeListener>::beginSuspension() {
+    LOCK(_throttleMutex);
+    if (_suspended)
+        return false;
+    _suspended = _suspendPending = true;
+    _timer->fireAfter(std::chrono::milliseconds(0));
+    return true;
+}
+
+
+// Stops observing after a run, then decides when the database has changed enough, for long
+// enough, to run the query again.
+void ListenerToken<CBLQueryChangeListener>::throttleTimerFired() {
+    if (!_enabled || _paused)
+        return;     // setEnabled() or setPaused() will start observing again
+    bool suspendNow = false;
+    {
+        LOCK(_throttleMutex);
+        if (_suspendPending) {
+            _suspendPending = false;
+            _sequenceSeen = _sequenceAtRun;
+            unsigned delay = _options.minIntervalMs ? _options.minIntervalMs : _options.debounceMs;
+            _timer->fireAfter(std::chrono::milliseconds(delay));
+            suspendNow = true;
+        }
+    }
+    if (suspendNow) {
+        setObserving(false);
+        return;
+    }
+
+    uint64_t sequence;
+    try {
+        sequence = _query->database()->lastSequence();
+    } catch (...) {
+        C4Error error = C4Error::fromCurrentException();
+        CBL_Log(kCBLLogDomainQuery, kCBLLogWarning, "Live query couldn't check the database: %s",
+                error.description().c_str());
+        return;
+    }
+    {
+        LOCK(_throttleMutex);
+        if (sequence == _sequenceAtRun) {
+            // Nothing's changed since the last run; check again later:
+            unsigned delay = std::max(_options.minIntervalMs, _options.debounceMs);
+            _timer->fireAfter(std::chrono::milliseconds(delay));
+            return;
+        }
+        if (_options.debounceMs > 0 && sequence != _sequenceSeen) {
+            // The database is still changing; wait for it to settle down:
+            _sequenceSeen = sequence;
+            _timer->fireAfter(std::chrono::milliseconds(_options.debounceMs));
+            return;
+        }
+        _sequenceAtRun = sequence;
+        _suspended = false;
+    }
+    setObserving(true);     // This makes LiteCore re-run the query, unless it's already running
+}
+
+
+// Called on the query observer's thread when the results change. Computes the delta between
+// the new results and the last delivered ones. Returns true if the listener should be notified.
+bool ListenerToken<CBLQueryChangeListener>::updateDelta() {
+    Retained<SharedQueryObserver> obs = observer();
+    if (!obs)
+        return false;
+    std::optional<C4Query::Enumerator> qe;
+    try {
+        qe.emplace(obs->getEnumerator());
+    } catch (...) {
+        C4Error error = C4Error::fromCurrentException();
+        CBL_Log(kCBLLogDomainQuery, kCBLLogWarning, "Live query failed: %s",
+                error.description().c_str());
+        return false;
+    }
+
+    const unsigned keyColumn = _delta->keyColumn;
+    std::vector<RowSignature> rows;
+    while (qe->next()) {
+        RowSignature row;
+        size_t hash = 0;
+        unsigned col = 0;
+        for (Array::iterator i(qe->columns()); i; ++i, ++col) {
+            alloc_slice json = i.value().toJSON();
+            if (col == keyColumn)
+                row.key = json;
+            hash = hash * 31 + std::hash<slice>{}(json);
+        }
+        row.contentHash = hash;
+        rows.push_back(std::move(row));
+    }
+    qe->restart();
+
+    std::lock_guard<std::mutex> lock(_delta->mutex);
+    auto &delivered = _delta->delivered;
+
+    // Match rows by key; if a key appears more than once, only its first instances are matched:
+    std::unordered_map<slice, unsigned> oldIndex;
+    oldIndex.reserve(delivered.size());
+    for (unsigned i = 0; i < delivered.size(); ++i)
+        oldIndex.emplace(delivered[i].key, i);
+    std::vector<bool> matched(delivered.size(), false);
+
+    std::vector<unsigned> inserted, removed, changed;
+    for (unsigned i = 0; i < rows.size(); ++i) {
+        auto found = oldIndex.find(rows[i].key);
+        if (found != oldIndex.end() && !matched[found->second]) {
+            matched[found->second] = true;
+            if (delivered[found->second].contentHash != rows[i].contentHash)
+                changed.push_back(i);
+        } else {
+            inserted.push_back(i);
+        }
+    }
+    for (unsigned i = 0; i < delivered.size(); ++i) {
+        if (!matched[i])
+            removed.push_back(i);
+    }
+
+    // A newer pending delta replaces an undelivered one, since both are relative to `delivered`:
+    _delta->rows = std::move(rows);
+    _delta->results = std::move(qe);
+    _delta->inserted = std::move(inserted);
+    _delta->removed = std::move(removed);
+    _delta->changed = std::move(changed);
+    bool wasPending = _delta->pending;
+    _delta->pending = true;
+    return !wasPending;
+}
+
+
+// Called on the notification thread; delivers the pending delta, if any.
+void ListenerToken<CBLQueryChangeListener>::callDelta() {
+    std::optional<C4Query::Enumerator> qe;
+    std::vector<unsigned> inserted, removed, changed;
+    {
+        std::lock_guard<std::mutex> lock(_delta->mutex);
+        if (!_delta->pending)
+            return;
+        _delta->pending = false;
+        if (_delta->everDelivered && _delta->inserted.empty() && _delta->removed.empty()
+                && _delta->changed.empty()) {
+            _delta->results.reset();
+            return;     // Nothing visible changed
+        }
+        _delta->everDelivered = true;
+        _delta->delivered = std::move(_delta->rows);
+        _delta->rows.clear();
+        qe = std::move(_delta->results);
+        _delta->results.reset();
+        inserted = std::move(_delta->inserted);
+        removed = std::move(_delta->removed);
+        changed = std::move(_delta->changed);
+    }
+
+    auto cb = (CBLQueryDeltaListener)_callback.load();
+    if (!cb)
+        return;
+    Retained<CBLResultSet> results = new CBLResultSet(_query, std::move(*qe));
+    CBLQueryDelta delta = {};
+    delta.results = results;
+    delta.inserted = inserted.data();
+    delta.insertedCount = inserted.size();
+    delta.removed = removed.data();
+    delta.removedCount = removed.size();
+    delta.changed = changed.data();
+    delta.changedCount = changed.size();
+    cb(_context, _query, this, &delta);
+}
+
+
 CBLResultSet::CBLResultSet(CBLQuery* query, C4Query::Enumerator qe)
 :_query(query)
 ,_enum(std::move(qe))
@@ -55,6 +413,7 @@ CBLResultSet::~CBLResultSet() {
 
 
 bool CBLResultSet::next() {
+    cbl_internal::TraceSpan span(kCBLTraceResultSetNext);
     _asArray = nullptr;
     _asDict = nullptr;
     _blobs.clear();
@@ -117,6 +476,81 @@ Dict CBLResultSet::asDict() const {
 }
 
 
+unsigned CBLResultSet::nextBatch(unsigned maxRows, FLValue* const outColumns[]) {
+    unsigned nCols = _query->columnCount();
+    unsigned nRows = 0;
+    while (nRows < maxRows && next()) {
+        for (unsigned col = 0; col < nCols; ++col)
+            outColumns[col][nRows] = column(col);
+        ++nRows;
+    }
+    return nRows;
+}
+
+
+Doc CBLResultSet::nextPage(unsigned maxRows) {
+    unsigned nCols = _query->columnCount();
+    unsigned nRows = 0;
+    Encoder enc;
+    enc.beginArray(maxRows);
+    while (nRows < maxRows && next()) {
+        enc.beginArray(nCols);
+        for (unsigned col = 0; col < nCols; ++col) {
+            Value val = column(col);
+            enc.writeValue(val ? val : Value(kFLUndefinedValue));
+        }
+        enc.endArray();
+        ++nRows;
+    }
+    enc.endArray();
+    if (nRows == 0)
+        return Doc();
+    Doc doc = enc.finishDoc();
+    if (!doc)
+        C4Error::raise(FleeceDomain, enc.error(), "%s", enc.errorMessage());
+    return doc;
+}
+
+
+unsigned CBLResultSet::nextColumns(unsigned maxRows,
+                                   const CBLColumnBuffer buffers[],
+                                   unsigned bufferCount)
+{
+    unsigned nRows = 0;
+    while (nRows < maxRows && next()) {
+        for (unsigned b = 0; b < bufferCount; ++b) {
+            const CBLColumnBuffer &buf = buffers[b];
+            Value val = column(buf.column);
+            FLValueType type = val.type();
+            bool present;
+            switch (buf.type) {
+                case kCBLColumnInt64:
+                    present = (type == kFLNumber || type == kFLBoolean);
+                    ((int64_t*)buf.values)[nRows] = present ? val.asInt() : 0;
+                    break;
+                case kCBLColumnDouble:
+                    present = (type == kFLNumber);
+                    ((double*)buf.values)[nRows] = present ? val.asDouble() : 0.0;
+                    break;
+                case kCBLColumnSlice:
+                    present = (type == kFLString || type == kFLData);
+                    ((FLSlice*)buf.values)[nRows] = !present ? nullslice
+                                                  : (type == kFLString) ? val.asString()
+                                                                        : val.asData();
+                    break;
+                default:
+                    C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter,
+                                   "Invalid column buffer type");
+            }
+            if (buf.present)
+                buf.present[nRows] = present;
+        }
+        ++nRows;
+    }
+    return nRows;
+}
+
+
 Retained<CBLResultSet> CBLResultSet::containing(Value v) {
     return (CBLResultSet*) Doc::containing(v).associated("CBLResultSet");
 }
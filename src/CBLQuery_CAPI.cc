@@ -18,6 +18,7 @@
 
 #include "CBLQuery.h"
 #include "CBLDatabase_Internal.hh"
+#include "CBLFanOutQuery_Internal.hh"
 #include "CBLQuery_Internal.hh"
 #include <string>
 
@@ -39,6 +40,60 @@ CBLQuery* CBLDatabase_CreateQuery(const CBLDatabase* db,
     } catchAndBridge(outError)
 }
 
+int64_t CBLDatabase_QueryCount(const CBLDatabase* db,
+                               CBLQueryLanguage language,
+                               FLString whereExpr,
+                               FLDict parameters,
+                               CBLError* outError) noexcept
+{
+    try {
+        return db->queryCount(language, whereExpr, parameters);
+    } catchAndBridgeReturning(outError, -1)
+}
+
+bool CBLDatabase_QueryExists(const CBLDatabase* db,
+                             CBLQueryLanguage language,
+                             FLString whereExpr,
+                             FLDict parameters,
+                             CBLError* outError) noexcept
+{
+    try {
+        if (outError)
+            outError->code = 0;
+        return db->queryExists(language, whereExpr, parameters);
+    } catchAndBridge(outError)
+}
+
+CBLQuery* CBLDatabase_CreateFullTextPageQuery(const CBLDatabase* db,
+                                              CBLFullTextPageConfiguration config,
+                                              CBLError* outError) noexcept
+{
+    try {
+        return db->createFullTextPageQuery(config).detach();
+    } catchAndBridge(outError)
+}
+
+CBLQueryCacheStats CBLDatabase_QueryCacheStats(const CBLDatabase* db) noexcept {
+    try {
+        return db->queryCacheStats();
+    } catchAndWarn()
+}
+
+bool CBLDatabase_PrecompileQueries(CBLDatabase* db,
+                                   CBLQueryLanguage language,
+                                   const FLString queries[],
+                                   size_t count,
+                                   CBLQueryPrecompileCallback callback,
+                                   void* context,
+                                   CBLError* outError) noexcept
+{
+    try {
+        db->precompileQueries(language, vector<fleece::alloc_slice>(queries, queries + count),
+                              callback, context);
+        return true;
+    } catchAndBridge(outError)
+}
+
 FLDict CBLQuery_Parameters(const CBLQuery* query) noexcept {
     return query->parameters();
 }
@@ -53,6 +108,34 @@ CBLResultSet* CBLQuery_Execute(CBLQuery* query, CBLError* outError) noexcept {
     } catchAndBridge(outError)
 }
 
+CBLResultSet* CBLQuery_ExecutePageAfter(CBLQuery* query,
+                                        double afterRank,
+                                        FLString afterDocID,
+                                        CBLError* outError) noexcept
+{
+    try {
+        return query->executePageAfter(afterRank, afterDocID).detach();
+    } catchAndBridge(outError)
+}
+
+CBLResultSet* CBLQuery_ExecuteWithParameters(CBLQuery* query,
+                                             FLDict parameters,
+                                             CBLError* outError) noexcept
+{
+    try {
+        return query->execute(parameters).detach();
+    } catchAndBridge(outError)
+}
+
+void CBLQuery_ExecuteAsync(CBLQuery* query,
+                           CBLQueryExecuteCompletion completion,
+                           void* context) noexcept
+{
+    try {
+        query->executeAsync(completion, context);
+    } catchAndBridgeReturning(nullptr, )
+}
+
 FLSliceResult CBLQuery_Explain(const CBLQuery* query) noexcept {
     try {
         return FLSliceResult(query->explain());
@@ -74,6 +157,39 @@ CBLListenerToken* CBLQuery_AddChangeListener(CBLQuery* query,
     return query->addChangeListener(listener, context).detach();
 }
 
+CBLListenerToken* CBLQuery_AddChangeListenerWithOptions(CBLQuery* query,
+                                                        const CBLQueryListenerOptions *options,
+                                                        CBLQueryChangeListener listener,
+                                                        void *context) noexcept
+{
+    return query->addChangeListener(listener, context, options).detach();
+}
+
+void CBLQuery_SetListenerPaused(CBLQuery* query,
+                                CBLListenerToken *token,
+                                bool paused) noexcept
+{
+    try {
+        auto listener = query->getChangeListener(token);
+        if (!listener) {
+            CBL_Log(kCBLLogDomainQuery, kCBLLogWarning,
+                    "Listener token is not valid for this query");
+            return;
+        }
+        listener->setPaused(paused);
+    } catchAndBridgeReturning(nullptr, )
+}
+
+CBLListenerToken* CBLQuery_AddDeltaListener(CBLQuery* query,
+                                            unsigned keyColumn,
+                                            CBLQueryDeltaListener listener,
+                                            void *context) noexcept
+{
+    try {
+        return query->addDeltaListener(keyColumn, listener, context).detach();
+    } catchAndWarn();
+}
+
 CBLResultSet* CBLQuery_CopyCurrentResults(const CBLQuery* query,
                                           CBLListenerToken *token,
                                           CBLError *outError) noexcept
@@ -109,6 +225,72 @@ FLDict CBLResultSet_ResultDict(const CBLResultSet *rs) noexcept {
     return rs->asDict();
 }
 
+unsigned CBLResultSet_NextBatch(CBLResultSet* rs,
+                                unsigned maxRows,
+                                FLValue* const outColumns[]) noexcept
+{
+    try {
+        return rs->nextBatch(maxRows, outColumns);
+    } catchAndWarn();
+}
+
+FLArray CBLResultSet_NextPage(CBLResultSet* rs, unsigned maxRows) noexcept {
+    try {
+        fleece::Doc page = rs->nextPage(maxRows);
+        return page ? FLArray_Retain(page.root().asArray()) : nullptr;
+    } catchAndWarn();
+}
+
+unsigned CBLResultSet_NextColumns(CBLResultSet* rs,
+                                  unsigned maxRows,
+                                  const CBLColumnBuffer buffers[],
+                                  unsigned bufferCount) noexcept
+{
+    try {
+        return rs->nextColumns(maxRows, buffers, bufferCount);
+    } catchAndWarn();
+}
+
 CBLQuery* CBLResultSet_GetQuery(const CBLResultSet *rs) noexcept {
     return rs->query();
 }
+
+
+CBLFanOutResults* CBL_FanOutQuery(const CBLDatabase* const dbs[],
+                                  size_t count,
+                                  CBLQueryLanguage language,
+                                  FLString queryString,
+                                  FLDict parameters,
+                                  const CBLFanOutOptions* options,
+                                  CBLError* outError) noexcept
+{
+    try {
+        vector<Retained<CBLDatabase>> databases;
+        databases.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            databases.emplace_back(const_cast<CBLDatabase*>(dbs[i]));
+        auto results = make_retained<CBLFanOutResults>(move(databases), language, queryString,
+                                                       parameters,
+                                                       options ? *options : CBLFanOutOptions{});
+        results->start();
+        return move(results).detach();
+    } catchAndBridge(outError)
+}
+
+bool CBLFanOutResults_Next(CBLFanOutResults* rs, CBLError* outError) noexcept {
+    try {
+        return rs->next();
+    } catchAndBridge(outError)
+}
+
+FLValue CBLFanOutResults_ValueAtIndex(const CBLFanOutResults* rs, unsigned index) noexcept {
+    return rs->row()[index];
+}
+
+FLArray CBLFanOutResults_ResultArray(const CBLFanOutResults* rs) noexcept {
+    return rs->row();
+}
+
+const CBLDatabase* CBLFanOutResults_Database(const CBLFanOutResults* rs) noexcept {
+    return rs->database();
+}
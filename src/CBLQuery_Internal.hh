@@ -11,10 +11,13 @@
 #include "Listener.hh"
 #include "c4Query.hh"
 #include "access_lock.hh"
+#include "Timer.hh"
 #include "fleece/Fleece.hh"
 #include "fleece/Mutable.hh"
+#include <mutex>
 #include <optional>
 #include <unordered_map>
+#include <vector>
 
 
 CBL_ASSUME_NONNULL_BEGIN
@@ -66,6 +69,53 @@ public:
 
     inline Retained<CBLResultSet> execute();
 
+    /// Runs the query with the given parameters, leaving its own parameters unchanged; a null
+    /// `parameters` means none. Any number of threads may call this at once on the same query.
+    Retained<CBLResultSet> execute(Dict parameters) {
+        return _execute(parameters ? _encode(parameters) : alloc_slice());
+    }
+
+    /// Like `execute(Dict)`, but returns LiteCore's enumerator instead of a result set; for
+    /// callers that only read a value or two. A null `parameters` skips the encoding.
+    C4Query::Enumerator run(Dict parameters) {
+        return _run(parameters ? _encode(parameters) : alloc_slice());
+    }
+
+    /// Runs a full-text page query (see `CBLDatabase::createFullTextPageQuery`) with its current
+    /// parameters plus the pagination ones, returning the rows after the given one.
+    Retained<CBLResultSet> executePageAfter(double afterRank, slice afterDocID) {
+        Dict parameters;
+        alloc_slice ownParameters;
+        {
+            auto c4query = _c4query.useLocked();
+            ownParameters = _parameters;
+        }
+        if (ownParameters)
+            parameters = Value::fromData(ownParameters, kFLTrusted).asDict();
+
+        Encoder enc;
+        enc.beginDict();
+        for (Dict::iterator i(parameters); i; ++i) {
+            enc.writeKey(i.keyString());
+            enc.writeValue(i.value());
+        }
+        enc.writeKey("firstPage"_sl);
+        enc.writeBool(afterDocID.buf == nullptr);
+        enc.writeKey("afterRank"_sl);
+        enc.writeDouble(afterRank);
+        enc.writeKey("afterID"_sl);
+        enc.writeString(afterDocID.buf ? afterDocID : ""_sl);
+        enc.endDict();
+        alloc_slice encodedParameters = enc.finish();
+        if (!encodedParameters)
+            C4Error::raise(FleeceDomain, enc.error(), "%s", enc.errorMessage());
+        return _execute(encodedParameters);
+    }
+
+    /// Runs the query on a background thread with its current parameters, then calls the
+    /// completion via the database's notification queue.
+    inline void executeAsync(CBLQueryExecuteCompletion _cbl_nullable, void* _cbl_nullable context);
+
     using ColumnNamesMap = std::unordered_map<slice, uint32_t>;
 
     int columnNamed(slice name) const {
@@ -82,7 +132,12 @@ public:
     }
 
     inline Retained<CBLListenerToken> addChangeListener(CBLQueryChangeListener listener,
-                                                        void* _cbl_nullable context);
+                                                        void* _cbl_nullable context,
+                                                        const CBLQueryListenerOptions* _cbl_nullable options =nullptr);
+
+    inline Retained<CBLListenerToken> addDeltaListener(unsigned keyColumn,
+                                                       CBLQueryDeltaListener listener,
+                                                       void* _cbl_nullable context);
 
     ListenerToken<CBLQueryChangeListener>* getChangeListener(CBLListenerToken *token) const {
         return _listeners.find(token);
@@ -93,23 +148,59 @@ private:
     friend struct cbl_internal::ListenerToken<CBLQueryChangeListener>;
 
     CBLQuery(const CBLDatabase *db,
+             CBLQueryLanguage language,
+             slice queryString,
+             Retained<C4Query>&& c4query,
+             const litecore::access_lock<Retained<C4Database>> &owner)
+    :_c4query(std::move(c4query), owner)
+    ,_database(db)
+    ,_language(language)
+    ,_queryString(queryString)
+    ,_readerQueries(std::make_shared<CBLDatabase::ReaderQueries>(db->readerCount()))
+    ,_shared(false)
+    { }
+
+    // Constructor for a query whose compiled form comes from the database's query cache,
+    // and may be shared with other CBLQuery instances.
+    CBLQuery(const CBLDatabase *db,
+             CBLQueryLanguage language,
+             slice queryString,
              Retained<C4Query>&& c4query,
+             std::shared_ptr<CBLDatabase::ReaderQueries> readerQueries,
              const litecore::access_lock<Retained<C4Database>> &owner)
     :_c4query(std::move(c4query), owner)
     ,_database(db)
+    ,_language(language)
+    ,_queryString(queryString)
+    ,_readerQueries(std::move(readerQueries))
+    ,_shared(true)
     { }
 
-    void _encodeParameters(Encoder &enc) {
+    static alloc_slice _encode(Dict parameters) {
+        Encoder enc;
+        enc.writeValue(parameters);
         alloc_slice encodedParameters = enc.finish();
         if (!encodedParameters)
             C4Error::raise(FleeceDomain, enc.error(), "%s", enc.errorMessage());
-        _parameters = encodedParameters;
-        _c4query.useLocked()->setParameters(encodedParameters);
+        return encodedParameters;
     }
 
+    inline Retained<CBLResultSet> _execute(alloc_slice parameters);
+    inline C4Query::Enumerator _run(alloc_slice parameters);
+
+    void _encodeParameters(Encoder &enc);
+
+    // The key identifying this query's source and current parameters in the database's
+    // registry of live queries (see CBLDatabase::observeQuery.) Also returns the parameters.
+    alloc_slice _observerKey(alloc_slice &outParameters) const;
+
     litecore::shared_access_lock<Retained<C4Query>> _c4query;// Thread-safe access to C4Query
     RetainedConst<CBLDatabase>          _database;          // Owning database
     alloc_slice                         _parameters;        // Fleece-encoded param values
+    CBLQueryLanguage const              _language;          // Language of _queryString
+    alloc_slice const                   _queryString;       // Source, for compiling on readers
+    std::shared_ptr<CBLDatabase::ReaderQueries> _readerQueries; // Compiled on each reader
+    bool                                _shared;            // True if _c4query is from the cache
     mutable std::optional<ColumnNamesMap>    _columnNames;       // Maps colum name to index
     mutable std::once_flag                   _onceColumnNames;   // For lazy init of _columnNames
     Listeners<CBLQueryChangeListener>   _listeners;         // Query listeners
@@ -135,6 +226,12 @@ public:
 
     Dict asDict() const;
 
+    unsigned nextBatch(unsigned maxRows, FLValue _cbl_nullable * const outColumns[]);
+
+    Doc nextPage(unsigned maxRows);
+
+    unsigned nextColumns(unsigned maxRows, const CBLColumnBuffer buffers[], unsigned bufferCount);
+
     CBLQuery* query() const             {return _query;}
 
     static Retained<CBLResultSet> containing(Value v);
@@ -168,6 +265,49 @@ private:
 
 namespace cbl_internal {
 
+    template<> struct ListenerToken<CBLQueryChangeListener>;
+
+    // A C4QueryObserver shared by the listeners of all queries with the same source and
+    // parameters, so LiteCore only re-runs that query once per change, and every listener sees
+    // the same results. Instances are registered with the database while they have subscribers;
+    // see CBLDatabase::observeQuery.
+    class SharedQueryObserver final : public fleece::RefCounted {
+    public:
+        using Token = ListenerToken<CBLQueryChangeListener>;
+
+        SharedQueryObserver(alloc_slice key, Retained<C4Query> c4query);
+
+        slice key() const                       {return _key;}
+
+        // Starts or stops observing on behalf of a subscriber. LiteCore's observer is enabled
+        // while any subscriber is observing. If it already was, the subscriber is told of the
+        // current results right away.
+        void setObserving(Token*, bool observing);
+
+        C4Query::Enumerator getEnumerator()     {return _c4obs->getEnumerator(false);}
+
+    private:
+        friend struct ::CBLDatabase;
+
+        struct Subscriber {
+            Token*  token;
+            bool    observing;
+        };
+
+        void subscribe(Token*);                 // Called by CBLDatabase, with its registry locked
+        bool unsubscribe(Token*);               // Returns true if no subscribers are left
+        void changed();
+
+        alloc_slice const                   _key;
+        Retained<C4Query> const             _c4query;
+        std::unique_ptr<C4QueryObserver>    _c4obs;
+        std::mutex                          _mutex;
+        std::vector<Subscriber>             _subscribers;
+        size_t                              _observingCount {0};
+        bool                                _hasResults {false};  // Has the query run yet?
+    };
+
+
     // Custom subclass of CBLListenerToken for query listeners.
     // (It implements the ListenerToken<> template so that it will work with Listeners<>.)
     template<>
@@ -175,42 +315,73 @@ namespace cbl_internal {
     public:
         ListenerToken(CBLQuery *query,
                       CBLQueryChangeListener callback,
-                      void* _cbl_nullable context)
+                      void* _cbl_nullable context,
+                      const CBLQueryListenerOptions* _cbl_nullable options =nullptr)
         :CBLListenerToken((const void*)callback, context)
         ,_query(query)
         {
-            query->_c4query.useLocked([&](C4Query *c4query) {
-                _c4obs = c4query->observe([this](C4QueryObserver*) { this->queryChanged(); });
-            });
+            bindObserver();
+            if (options && (options->minIntervalMs > 0 || options->debounceMs > 0)) {
+                _options = *options;
+                _timer = std::make_unique<litecore::actor::Timer>([this]{ throttleTimerFired(); });
+            }
+        }
+
+        // Creates a listener that's called with row-level deltas (see CBLQuery_AddDeltaListener)
+        ListenerToken(CBLQuery *query,
+                      unsigned keyColumn,
+                      CBLQueryDeltaListener callback,
+                      void* _cbl_nullable context)
+        :ListenerToken(query, (CBLQueryChangeListener)nullptr, context)
+        {
+            _callback = (const void*)callback;
+            _delta = std::make_unique<DeltaState>();
+            _delta->keyColumn = keyColumn;
         }
         
         ~ListenerToken() {
             // Note:
-            // When calling CBLListener_Remove(CBLListenerToken*), the ListenerToken object
-            // will be released. Hence its `_c4obs` will be freed, which will result in
-            // disabing and freed its LiveQuerier object.
+            // CBLListener_Remove(CBLListenerToken*) unsubscribes from the shared observer, and
+            // when the last subscriber leaves, the C4QueryObserver is freed, which disables and
+            // frees its LiveQuerier object.
             //
             // Explicity disabling here to unregister iteself (CBLStoppable) from the database
-            // so that the database can be safely closed. This would mean that the `_c4obs` will
-            // try to disabling itself again when it's free, however, that when disabing second
-            // time, the disabing logic will be mostly no ops.
+            // so that the database can be safely closed.
             setEnabled(false);
+            unbindObserver();
         }
 
         void setEnabled(bool enabled);
 
+        void setPaused(bool paused);
+
+        // Subscribes to the shared observer for the query's current parameters.
+        void bindObserver();
+
+        void remove() override {
+            unbindObserver();
+            CBLListenerToken::remove();
+        }
+
         CBLQueryChangeListener callback() const {
             return (CBLQueryChangeListener)_callback.load();
         }
 
         void call() {
+            if (_delta) {
+                callDelta();
+                return;
+            }
             CBLQueryChangeListener cb = callback();
             if (cb)
                 cb(_context, _query, this);
         }
 
         Retained<CBLResultSet> resultSet() {
-            return new CBLResultSet(_query, _c4obs->getEnumerator(false));
+            Retained<SharedQueryObserver> obs = observer();
+            if (!obs)
+                C4Error::raise(LiteCoreDomain, kC4ErrorNotFound, "Listener has been removed");
+            return new CBLResultSet(_query, obs->getEnumerator());
         }
         
         // CBLStoppable :
@@ -220,24 +391,159 @@ namespace cbl_internal {
         }
         
     private:
+        // A result row's identity and content, as used for diffing
+        struct RowSignature {
+            alloc_slice key;                    // JSON of the key column
+            size_t      contentHash;            // Hash of the JSON of all columns
+        };
+
+        // State of a delta listener. The pending delta is computed on the observer's thread,
+        // against the rows that were last delivered, and is picked up by callDelta().
+        struct DeltaState {
+            unsigned                   keyColumn;
+            std::mutex                 mutex;
+            std::vector<RowSignature>  delivered;   // Rows as of the last callback
+            std::vector<RowSignature>  rows;        // Rows of the pending results
+            std::optional<C4Query::Enumerator> results; // Pending results, rewound
+            std::vector<unsigned>      inserted, removed, changed;
+            bool                       pending {false};
+            bool                       everDelivered {false};
+        };
+
+        friend class SharedQueryObserver;
+
         void queryChanged();    // defn is in CBLDatabase.cc, to prevent circular hdr dependency
+        bool updateDelta();
+        void callDelta();
+        void unbindObserver();
+        void setObserving(bool observing);
+        bool beginSuspension();
+        void throttleTimerFired();
+
+        Retained<SharedQueryObserver> observer() {
+            LOCK(_observerMutex);
+            return _observer;
+        }
 
         Retained<CBLQuery>  _query;
-        std::unique_ptr<C4QueryObserver> _c4obs;
+        std::mutex          _observerMutex;
+        Retained<SharedQueryObserver> _observer;    // Runs the query; guarded by _observerMutex
+        std::unique_ptr<DeltaState> _delta;     // Only for delta listeners
+
+        // Throttling & pausing. While suspended, this listener stops observing, so LiteCore
+        // doesn't re-run the query for it; the timer checks the database's sequence to see if
+        // it's changed. (Suspending happens on the timer's thread, not in the observer callback.)
+        CBLQueryListenerOptions _options {};
+        std::mutex          _throttleMutex;
+        std::atomic<bool>   _enabled {false};       // Between setEnabled(true) and (false)
+        std::atomic<bool>   _paused {false};        // Paused by the app
+        bool                _suspended {false};     // Ignoring results until the timer says
+        bool                _suspendPending {false};// Timer should stop observing
+        uint64_t            _sequenceAtRun {0};     // DB sequence when the query last started
+        uint64_t            _sequenceSeen {0};      // DB sequence at the last timer check
+        std::unique_ptr<litecore::actor::Timer> _timer; // Only if throttled; must be last
     };
 
 }
 
 
 inline fleece::Retained<CBLResultSet> CBLQuery::execute() {
-    auto qe = _c4query.useLocked()->run();
-    return retained(new CBLResultSet(this, std::move(qe)));
+    alloc_slice parameters;
+    {
+        auto c4query = _c4query.useLocked();
+        parameters = _parameters;
+    }
+    return _execute(parameters);
+}
+
+
+inline void CBLQuery::executeAsync(CBLQueryExecuteCompletion completion, void *context) {
+    alloc_slice parameters;
+    {
+        auto c4query = _c4query.useLocked();
+        parameters = _parameters;
+    }
+    Retained<CBLQuery> query = this;
+    _database->runAsync(false, [=] {
+        Retained<CBLResultSet> results;
+        CBLError error = {};
+        try {
+            results = query->_execute(parameters);
+        } catch (...) {
+            error = external(C4Error::fromCurrentException());
+        }
+        if (completion) {
+            query->_database->notifyAsync([=] {
+                completion(context, query, results, results ? nullptr : &error);
+            });
+        }
+    });
+}
+
+
+inline fleece::Retained<CBLResultSet> CBLQuery::_execute(alloc_slice parameters) {
+    return retained(new CBLResultSet(this, _run(parameters)));
+}
+
+
+inline C4Query::Enumerator CBLQuery::_run(alloc_slice parameters) {
+    cbl_internal::TraceSpan span(kCBLTraceQueryExecute);
+    cbl_internal::LockStats::CallerScope caller(kCBLLockCallerQuery);
+    // The parameters are passed to each run, instead of being stored in the C4Query, since
+    // the C4Query may be shared with other CBLQuery instances or with concurrent runs:
+    auto runMain = [&] {
+        // `_c4query` shares the database's lock, so this counts in its stats:
+        cbl_internal::LockStats::Timer timer(_database->lockStats());
+        auto c4query = _c4query.useLocked();
+        timer.acquired();
+        return c4query->run(nullptr, parameters);
+    };
+
+    std::shared_ptr<CBLDatabase::ReaderQueries> readerQueries;
+    {
+        auto c4query = _c4query.useLocked();
+        readerQueries = _readerQueries;
+    }
+    if (readerQueries->empty())
+        return runMain();
+
+    return _database->useReader<C4Query::Enumerator>([&](C4Database *c4db, int reader) {
+        if (reader < 0)
+            return runMain();
+        // Each reader's copy of the query is only accessed while that reader is locked:
+        CBLDatabase::ReaderQuery &rq = (*readerQueries)[reader];
+        if (!rq.c4query || rq.c4db != c4db) {
+            rq.c4query = c4db->newQuery((C4QueryLanguage)_language, _queryString, nullptr);
+            rq.c4db = c4db;
+        }
+        return rq.c4query->run(nullptr, parameters);
+    });
+}
+
+
+inline fleece::Retained<CBLListenerToken>
+CBLQuery::addChangeListener(CBLQueryChangeListener listener,
+                            void* _cbl_nullable context,
+                            const CBLQueryListenerOptions* _cbl_nullable options)
+{
+    auto token = retained(new ListenerToken<CBLQueryChangeListener>(this, listener, context,
+                                                                     options));
+    _listeners.add(token);
+    token->setEnabled(true);
+    return token;
 }
 
 
 inline fleece::Retained<CBLListenerToken>
-CBLQuery::addChangeListener(CBLQueryChangeListener listener, void* _cbl_nullable context) {
-    auto token = retained(new ListenerToken<CBLQueryChangeListener>(this, listener, context));
+CBLQuery::addDeltaListener(unsigned keyColumn,
+                           CBLQueryDeltaListener listener,
+                           void* _cbl_nullable context)
+{
+    if (keyColumn >= columnCount())
+        C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter,
+                       "Key column %u is out of range", keyColumn);
+    auto token = retained(new ListenerToken<CBLQueryChangeListener>(this, keyColumn,
+                                                                     listener, context));
     _listeners.add(token);
     token->setEnabled(true);
     return token;
@@ -183,6 +183,8 @@ namespace cbl_internal {
             documentIDs = FLArray_MutableCopy(documentIDs, kFLDeepCopyImmutables);
             pinnedServerCertificate = (_pinnedServerCert = pinnedServerCertificate);
             trustedRootCertificates = (_trustedRootCerts = trustedRootCertificates);
+            pushFilterExpression = (_pushFilterExpression = pushFilterExpression);
+            pullFilterExpression = (_pullFilterExpression = pullFilterExpression);
             if (proxy) {
                 _proxy = *proxy;
                 proxy = &_proxy;
@@ -212,6 +214,8 @@ namespace cbl_internal {
             else if (proxy && (proxy->type > kCBLProxyHTTPS ||
                                                     !proxy->hostname.buf || !proxy->port))
                 problem = "Invalid replicator proxy settings";
+            else if (compressionLevel < -1 || compressionLevel > 9)
+                problem = "Invalid replicator compression level";
 
             if (problem)
                 C4Error::raise(LiteCoreDomain, kC4ErrorInvalidParameter, "%s", problem);
@@ -270,6 +274,11 @@ namespace cbl_internal {
                 enc.writeKey(slice(kC4ReplicatorHeartbeatInterval));
                 enc.writeUInt(heartbeat);
             }
+
+            if (compressionLevel != 0) {
+                enc.writeKey(slice(kC4ReplicatorCompressionLevel));
+                enc.writeInt(compressionLevel < 0 ? 0 : compressionLevel);
+            }
         }
 
         ReplicatorConfiguration(const ReplicatorConfiguration&) =delete;
@@ -285,6 +294,7 @@ namespace cbl_internal {
         }
         
         alloc_slice      _pinnedServerCert, _trustedRootCerts;
+        alloc_slice      _pushFilterExpression, _pullFilterExpression;
         CBLProxySettings _proxy;
         alloc_slice      _proxyHostname, _proxyUsername, _proxyPassword;
     };
@@ -0,0 +1,315 @@
+//
+//  CBLReplicatorGroup_Internal.hh
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "CBLReplicator_Internal.hh"
+#include "c4Base.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+CBL_ASSUME_NONNULL_BEGIN
+
+
+/** Schedules a set of replicators so that at most `maxActive` of them are connecting or busy at
+    once, preferring the ones with higher priority. A member that's idle or offline doesn't count
+    against the budget. If a member becomes busy while the budget is used up by lower-priority
+    members, the lowest of those is suspended until a slot frees up again. */
+struct CBLReplicatorGroup final : public CBLRefCounted {
+public:
+    explicit CBLReplicatorGroup(unsigned maxActive)
+    :_maxActive(maxActive)
+    ,_link(new Link(this))
+    { }
+
+
+    ~CBLReplicatorGroup() {
+        // Cut off the listeners and queued tasks first, waiting for any that are running.
+        // Then let go of the members, resuming the ones I suspended:
+        _link->clear();
+        for (auto &m : _members) {
+            m.token->remove();
+            if (m.state == kSuspended || m.wasSuspended)
+                m.repl->setSuspended(false);
+        }
+    }
+
+
+    void add(CBLReplicator *repl, int priority) {
+        {
+            LOCK(_mutex);
+            if (find(repl) != _members.end())
+                return;
+            _members.push_back({repl, priority});
+            // The change listeners are called with the replicator's mutex held, so the
+            // listener only records the new state and scheduling happens asynchronously:
+            _members.back().token = repl->addChangeListener(&statusChanged, _link);
+            _members.back().token->retainContext(_link);
+        }
+        scheduleAsync();
+    }
+
+
+    void remove(CBLReplicator *repl) {
+        Member removed;
+        {
+            LOCK(_mutex);
+            auto i = find(repl);
+            if (i == _members.end())
+                return;
+            removed = std::move(*i);
+            _members.erase(i);
+        }
+        removed.token->remove();
+        if (removed.state == kSuspended)
+            repl->setSuspended(false);
+        scheduleAsync();
+    }
+
+
+    void start(bool resetCheckpoint) {
+        {
+            LOCK(_mutex);
+            _running = true;
+            _resetCheckpoint = resetCheckpoint;
+            for (auto &m : _members) {
+                if (m.state == kDone)
+                    m.state = kWaiting;
+            }
+        }
+        schedule();
+    }
+
+
+    void stop() {
+        std::vector<Retained<CBLReplicator>> toStop;
+        {
+            LOCK(_mutex);
+            _running = false;
+            for (auto &m : _members) {
+                if (m.state == kWaiting)
+                    m.state = kDone;
+                else if (m.state != kDone)
+                    toStop.push_back(m.repl);
+            }
+        }
+        for (auto &repl : toStop)
+            repl->stop();
+    }
+
+
+    unsigned activeCount() const {
+        LOCK(_mutex);
+        return unsigned(std::count_if(_members.begin(), _members.end(),
+                                      [](const Member &m) {return m.state == kActive;}));
+    }
+
+private:
+    enum State : uint8_t {
+        kWaiting,       // Not started yet
+        kActive,        // Started and connecting or busy; uses a slot
+        kIdle,          // Started but idle or offline; doesn't use a slot
+        kSuspended,     // Suspended by the group to make room for a higher priority
+        kDone,          // Stopped
+    };
+
+    // How listeners and async tasks get to the group. They retain this, not the group, so that
+    // releasing the group frees it; its destructor then clears this, waiting for any call in
+    // progress. (No lock is held during the call, since the group calls into replicators.)
+    struct Link : public fleece::RefCounted {
+        explicit Link(CBLReplicatorGroup *g)    :_group(g) { }
+
+        template <class FN>
+        void use(FN fn) {
+            CBLReplicatorGroup *group;
+            {
+                LOCK(_mutex);
+                group = _group;
+                if (!group)
+                    return;
+                ++_users;
+            }
+            try {
+                fn(group);
+            } catch (...) {
+                done();
+                throw;
+            }
+            done();
+        }
+
+        void clear() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _group = nullptr;
+            _cond.wait(lock, [&] {return _users == 0;});
+        }
+
+    private:
+        void done() {
+            LOCK(_mutex);
+            if (--_users == 0)
+                _cond.notify_all();
+        }
+
+        std::mutex                                  _mutex;
+        std::condition_variable                     _cond;
+        CBLReplicatorGroup* _cbl_nullable           _group;
+        unsigned                                    _users {0};
+    };
+
+
+    struct Member {
+        Retained<CBLReplicator>     repl;
+        int                         priority {0};
+        Retained<CBLListenerToken>  token;
+        State                       state {kWaiting};
+        bool                        wasSuspended {false};   // setSuspended(true) was called
+    };
+
+
+    std::vector<Member>::iterator find(CBLReplicator *repl) {
+        return std::find_if(_members.begin(), _members.end(),
+                            [&](const Member &m) {return m.repl == repl;});
+    }
+
+
+    static void statusChanged(void *context, CBLReplicator *repl,
+                              const CBLReplicatorStatus *status)
+    {
+        ((Link*)context)->use([&](CBLReplicatorGroup *group) {
+            group->_statusChanged(repl, status->activity);
+        });
+    }
+
+
+    void _statusChanged(CBLReplicator *repl, CBLReplicatorActivityLevel activity) {
+        {
+            LOCK(_mutex);
+            auto i = find(repl);
+            if (i == _members.end())
+                return;
+            switch (activity) {
+                case kCBLReplicatorStopped:
+                    i->state = kDone;
+                    break;
+                case kCBLReplicatorConnecting:
+                case kCBLReplicatorBusy:
+                    if (i->state != kSuspended)
+                        i->state = kActive;
+                    break;
+                case kCBLReplicatorIdle:
+                case kCBLReplicatorOffline:
+                    if (i->state == kActive)
+                        i->state = kIdle;
+                    break;
+            }
+        }
+        scheduleAsync();
+    }
+
+
+    void scheduleAsync() {
+        {
+            LOCK(_mutex);
+            if (_scheduleQueued)
+                return;
+            _scheduleQueued = true;
+        }
+        retain(_link.get());
+        c4_runAsyncTask([](void *context) {
+            auto link = (Link*)context;
+            link->use([](CBLReplicatorGroup *group) {group->schedule();});
+            release(link);
+        }, _link.get());
+    }
+
+
+    // Decides which members should hold a slot, then starts, resumes or suspends replicators
+    // accordingly. Must not be called while holding any replicator's mutex.
+    void schedule() {
+        enum Action {kStart, kResume, kSuspend};
+        std::vector<std::pair<Retained<CBLReplicator>, Action>> actions;
+        bool reset;
+        {
+            LOCK(_mutex);
+            _scheduleQueued = false;
+            if (!_running)
+                return;
+            reset = _resetCheckpoint;
+
+            // Candidates for a slot, highest priority first; on a tie, the ones already active
+            // win, then the ones added first:
+            std::vector<Member*> pool;
+            for (auto &m : _members) {
+                if (m.state == kActive || m.state == kWaiting || m.state == kSuspended)
+                    pool.push_back(&m);
+            }
+            std::stable_sort(pool.begin(), pool.end(), [](Member *a, Member *b) {
+                if (a->priority != b->priority)
+                    return a->priority > b->priority;
+                return (a->state == kActive) > (b->state == kActive);
+            });
+
+            size_t nSlots = _maxActive ? std::min(size_t(_maxActive), pool.size()) : pool.size();
+            for (size_t i = 0; i < nSlots; ++i) {
+                Member *m = pool[i];
+                if (m->state == kWaiting) {
+                    actions.emplace_back(m->repl, m->wasSuspended ? kResume : kStart);
+                    if (m->wasSuspended)
+                        actions.emplace_back(m->repl, kStart);
+                } else if (m->state == kSuspended) {
+                    actions.emplace_back(m->repl, kResume);
+                }
+                m->state = kActive;
+                m->wasSuspended = false;
+            }
+            // Suspend active members that lost their slot to a higher priority. (Members that
+            // are over budget only because idle ones became busy on a tie are left alone, to
+            // avoid thrashing.)
+            int lowestPriority = nSlots ? pool[nSlots - 1]->priority : 0;
+            for (size_t i = nSlots; i < pool.size(); ++i) {
+                Member *m = pool[i];
+                if (m->state == kActive && m->priority < lowestPriority) {
+                    actions.emplace_back(m->repl, kSuspend);
+                    m->state = kSuspended;
+                    m->wasSuspended = true;
+                }
+            }
+        }
+
+        for (auto &[repl, action] : actions) {
+            switch (action) {
+                case kStart:    repl->start(reset); break;
+                case kResume:   repl->setSuspended(false); break;
+                case kSuspend:  repl->setSuspended(true); break;
+            }
+        }
+    }
+
+
+    const unsigned              _maxActive;         // 0 means unlimited
+    mutable std::mutex          _mutex;
+    std::vector<Member>         _members;
+    bool                        _running {false};
+    bool                        _resetCheckpoint {false};
+    bool                        _scheduleQueued {false};
+    Retained<Link> const        _link;
+};
+
+CBL_ASSUME_NONNULL_END
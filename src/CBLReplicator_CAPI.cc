@@ -18,6 +18,7 @@
 
 #include "CBLReplicator.h"
 #include "CBLReplicator_Internal.hh"
+#include "CBLReplicatorGroup_Internal.hh"
 
 
 const FLString kCBLAuthDefaultCookieName = FLSTR("SyncGatewaySession");
@@ -94,6 +95,29 @@ bool CBLReplicator_IsDocumentPending(CBLReplicator *repl, FLString docID, CBLErr
     } catchAndBridge(outError)
 }
 
+uint64_t CBLReplicator_PendingDocumentCount(CBLReplicator *repl, CBLError *outError) noexcept {
+    try {
+        if (outError) outError->code = 0;
+        return repl->pendingDocumentCount();
+    } catchAndBridge(outError)
+}
+
+FLArray CBLReplicator_PendingDocumentIDsPage(CBLReplicator *repl,
+                                             uint64_t offset,
+                                             unsigned limit,
+                                             CBLError *outError) noexcept
+{
+    try {
+        return FLArray_Retain(repl->pendingDocumentIDsPage(offset, limit));
+    } catchAndBridge(outError)
+}
+
+CBLReplicatorMetrics CBLReplicator_Metrics(CBLReplicator* repl) noexcept {
+    try {
+        return repl->metrics();
+    } catchAndWarn()
+}
+
 CBLListenerToken* CBLReplicator_AddChangeListener(CBLReplicator* repl,
                                                   CBLReplicatorChangeListener listener,
                                                   void *context) noexcept
@@ -107,3 +131,56 @@ CBLListenerToken* CBLReplicator_AddDocumentReplicationListener(CBLReplicator* re
 {
     return retain(repl->addDocumentListener(listener, context));
 }
+
+bool CBLDatabase_ResolveAllConflicts(CBLDatabase* db,
+                                     CBLConflictResolver resolver,
+                                     void *context,
+                                     CBLConflictSweepProgress progress,
+                                     CBLError *outError) noexcept
+{
+    try {
+        AllConflictsResolver sweep(db, resolver, context, progress);
+        if (sweep.runNow())
+            return true;
+        if (outError) *outError = sweep.firstError();
+        return false;
+    } catchAndBridge(outError)
+}
+
+
+#pragma mark - REPLICATOR GROUP:
+
+
+CBLReplicatorGroup* CBLReplicatorGroup_Create(unsigned maxActive) noexcept {
+    try {
+        return retain(new CBLReplicatorGroup(maxActive));
+    } catchAndWarn()
+}
+
+void CBLReplicatorGroup_Add(CBLReplicatorGroup* group, CBLReplicator* repl, int priority) noexcept {
+    try {
+        group->add(repl, priority);
+    } catchAndBridgeReturning(nullptr, )
+}
+
+void CBLReplicatorGroup_Remove(CBLReplicatorGroup* group, CBLReplicator* repl) noexcept {
+    try {
+        group->remove(repl);
+    } catchAndBridgeReturning(nullptr, )
+}
+
+void CBLReplicatorGroup_Start(CBLReplicatorGroup* group, bool reset) noexcept {
+    try {
+        group->start(reset);
+    } catchAndBridgeReturning(nullptr, )
+}
+
+void CBLReplicatorGroup_Stop(CBLReplicatorGroup* group) noexcept {
+    try {
+        group->stop();
+    } catchAndBridgeReturning(nullptr, )
+}
+
+unsigned CBLReplicatorGroup_ActiveCount(CBLReplicatorGroup* group) noexcept {
+    return group->activeCount();
+}
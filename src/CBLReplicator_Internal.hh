@@ -16,10 +16,15 @@
 // limitations under the License.
 //
 
+#pragma once
 #include "CBLReplicator.h"
 #include "CBLReplicatorConfig.hh"
 #include "CBLDocument_Internal.hh"
 #include "ConflictResolver.hh"
+#include "ReplicationFilter.hh"
+#include "PropertyCryptoBatch.hh"
+#include "CBLTrace_Internal.hh"
+#include "Timer.hh"
 #include "Internal.hh"
 #include "c4Replicator.hh"
 #include "c4Private.h"
@@ -27,8 +32,11 @@
 #include "fleece/Fleece.hh"
 #include "fleece/Mutable.hh"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 
 CBL_ASSUME_NONNULL_BEGIN
@@ -66,6 +74,8 @@ public:
     CBLReplicator(const CBLReplicatorConfiguration &conf)
     :_conf(conf)
     ,_db(conf.database)
+    ,_resolverExecutor(new ConflictResolverExecutor(_db, conf.maxConflictResolvers,
+                                                    conf.conflictResolverBatchSize))
     {
         // One-time initialization of network transport:
         static once_flag once;
@@ -91,7 +101,16 @@ public:
             ((CBLReplicator*)ctx)->_documentsEnded(pushing, numDocs, docs);
         };
 
-        if (_conf.pushFilter) {
+        if (_conf.documentEventsFlushInterval > 0)
+            _docEventsTimer = std::make_unique<litecore::actor::Timer>([this]{ flushDocumentEvents(); });
+
+        // Compile the filter expressions, if any:
+        if (_conf.pushFilterExpression.buf)
+            _pushPredicate = std::make_unique<FilterPredicate>(_conf.pushFilterExpression);
+        if (_conf.pullFilterExpression.buf)
+            _pullPredicate = std::make_unique<FilterPredicate>(_conf.pullFilterExpression);
+
+        if (_conf.pushFilter || _pushPredicate) {
             params.pushFilter = [](C4String collectionName,
                                    C4String docID,
                                    C4String revID,
@@ -102,7 +121,7 @@ public:
                 return ((CBLReplicator*)ctx)->_filter(docID, revID, flags, body, true);
             };
         }
-        if (_conf.pullFilter) {
+        if (_conf.pullFilter || _pullPredicate) {
             params.validationFunc = [](C4String collectionName,
                                        C4String docID,
                                        C4String revID,
@@ -116,7 +135,14 @@ public:
         
 #ifdef COUCHBASE_ENTERPRISE
         
-        if (_conf.propertyEncryptor) {
+        if (_conf.propertyBatchEncryptor)
+            _batchEncryptor = std::make_unique<PropertyCryptoBatch>(_conf.propertyBatchEncryptor,
+                                                                    _conf.context);
+        if (_conf.propertyBatchDecryptor)
+            _batchDecryptor = std::make_unique<PropertyCryptoBatch>(_conf.propertyBatchDecryptor,
+                                                                    _conf.context);
+
+        if (_conf.propertyEncryptor || _batchEncryptor) {
             params.propertyEncryptor = [](void* ctx,
                                           C4String documentID,
                                           FLDict properties,
@@ -131,7 +157,7 @@ public:
             };
         }
         
-        if (_conf.propertyDecryptor) {
+        if (_conf.propertyDecryptor || _batchDecryptor) {
             params.propertyDecryptor = [](void* ctx,
                                           C4String documentID,
                                           FLDict properties,
@@ -153,6 +179,7 @@ public:
         params.optionsDictFleece = options;
 
         // Create the LiteCore replicator:
+        cbl_internal::LockStats::CallerScope caller(kCBLLockCallerReplicator);
         _conf.database->useLocked([&](C4Database *c4db) {
 #ifdef COUCHBASE_ENTERPRISE
             if (_conf.endpoint->otherLocalDB()) {
@@ -182,9 +209,17 @@ public:
         _retainSelf = this;     // keep myself from being freed until the replicator stops
         _useInitialStatus = false;
         
-        if (_db->registerStoppable(this))
+        if (_db->registerStoppable(this)) {
+            if (!_running) {
+                _running = true;
+                _runningSince = std::chrono::steady_clock::now();
+            }
+            {
+                LOCK(_pendingMutex);
+                _pendingDocIDs = Doc();     // the checkpoint may be reset
+            }
             _c4repl->start(reset);
-        else
+        } else
             CBL_Log(kCBLLogDomainReplicator, kCBLLogWarning,
                     "Couldn't start the replicator as the database is closing or closed.");
     }
@@ -199,15 +234,30 @@ public:
 
 
     MutableDict pendingDocumentIDs() {
-        alloc_slice arrayData(_c4repl->pendingDocIDs());
-        if (!arrayData)
+        Doc doc = pendingDocIDsSnapshot();
+        if (!doc)
             return nullptr;
 
         MutableDict result = MutableDict::newDict();
-        if (arrayData) {
-            Doc doc(arrayData, kFLTrusted);
-            for (Array::iterator i(doc.asArray()); i; ++i)
-                result.set(i->asString(), true);
+        for (Array::iterator i(doc.asArray()); i; ++i)
+            result.set(i->asString(), true);
+        return result;
+    }
+
+
+    uint64_t pendingDocumentCount() {
+        Doc doc = pendingDocIDsSnapshot();
+        return doc ? doc.asArray().count() : 0;
+    }
+
+
+    MutableArray pendingDocumentIDsPage(uint64_t offset, unsigned limit) {
+        MutableArray result = MutableArray::newArray();
+        Doc doc = pendingDocIDsSnapshot();
+        if (doc) {
+            Array ids = doc.asArray();
+            for (uint64_t i = offset; i < ids.count() && i - offset < limit; ++i)
+                result.append(ids[uint32_t(i)]);
         }
         return result;
     }
@@ -218,6 +268,48 @@ public:
     }
 
 
+    CBLReplicatorMetrics metrics() {
+        CBLReplicatorMetrics m = {};
+        {
+            LOCK(_mutex);
+            if (!_metricsEnabled) {
+                // Per-document progress is needed to count documents in each direction:
+                _metricsEnabled = true;
+                if (_progressLevel != kC4ReplProgressPerDocument) {
+                    _c4repl->setProgressLevel(kC4ReplProgressPerDocument);
+                    _progressLevel = kC4ReplProgressPerDocument;
+                }
+            }
+            m.runningSeconds = _runningSeconds;
+            if (_running)
+                m.runningSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                                  - _runningSince).count();
+            m.bytesTransferred = _c4status.progress.unitsCompleted;
+        }
+        m.documentsPushed = _metrics.docsPushed;
+        m.documentsPulled = _metrics.docsPulled;
+        if (m.runningSeconds > 0) {
+            m.documentsPushedPerSecond = m.documentsPushed / m.runningSeconds;
+            m.documentsPulledPerSecond = m.documentsPulled / m.runningSeconds;
+            m.bytesPerSecond = m.bytesTransferred / m.runningSeconds;
+        }
+        for (int i = 0; i < kCBLReplicatorBatchSizeBuckets; ++i)
+            m.revsPerBatch[i] = _metrics.revsPerBatch[i];
+        m.filterCalls = _metrics.filter.calls;
+        m.filterSeconds = _metrics.filter.seconds();
+        m.encryptorCalls = _metrics.encryptor.calls;
+        m.encryptorSeconds = _metrics.encryptor.seconds();
+        m.decryptorCalls = _metrics.decryptor.calls;
+        m.decryptorSeconds = _metrics.decryptor.seconds();
+        m.conflictsResolved = _metrics.conflictResolver.calls;
+        m.conflictResolverSeconds = _metrics.conflictResolver.seconds();
+        m.reconnectCount = _metrics.reconnects;
+
+        m.pendingDocumentCount = pendingDocumentCount();
+        return m;
+    }
+
+
     Retained<CBLListenerToken> addChangeListener(CBLReplicatorChangeListener listener,
                                                  void *context)
     {
@@ -239,6 +331,71 @@ public:
 
 private:
 
+    static constexpr size_t kMaxPooledFilterDocs = 16;
+
+    // Atomic counters behind CBLReplicator_Metrics.
+    struct Metrics {
+        // Number of calls to, and total time spent in, some function.
+        struct Timing {
+            std::atomic<uint64_t> calls {0};
+            std::atomic<uint64_t> nanoseconds {0};
+
+            void add(double secs) {
+                ++calls;
+                nanoseconds += uint64_t(secs * 1e9);
+            }
+            double seconds() const          {return nanoseconds / 1e9;}
+        };
+
+        // Adds the time from its construction to its destruction to a Timing.
+        struct ScopedTiming {
+            explicit ScopedTiming(Timing &t) :_timing(t) { }
+            ~ScopedTiming() {
+                _timing.add(std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                          - _start).count());
+            }
+        private:
+            Timing &_timing;
+            std::chrono::steady_clock::time_point const _start = std::chrono::steady_clock::now();
+        };
+
+        std::atomic<uint64_t>   docsPushed {0}, docsPulled {0};
+        std::atomic<uint64_t>   revsPerBatch[kCBLReplicatorBatchSizeBuckets] {};
+        Timing                  filter, encryptor, decryptor, conflictResolver;
+        std::atomic<uint64_t>   reconnects {0};
+
+        void addBatch(size_t numRevs) {
+            int bucket = 0;
+            while (bucket < kCBLReplicatorBatchSizeBuckets - 1 && numRevs >= (size_t(4) << (2 * bucket)))
+                ++bucket;
+            ++revsPerBatch[bucket];
+        }
+    };
+
+    // Buffered document replication events in one direction. The IDs are copied into `ids`,
+    // and each event's ID.buf holds the offset of its ID until `resolveIDs` is called.
+    struct DocumentEvents {
+        std::vector<CBLReplicatedDocument>  docs;
+        std::string                         ids;
+
+        bool empty() const                  {return docs.empty();}
+
+        void add(slice docID, CBLDocumentFlags flags, CBLError error) {
+            docs.push_back({FLString{(const void*)ids.size(), docID.size}, flags, error});
+            ids.append((const char*)docID.buf, docID.size);
+        }
+
+        void resolveIDs() {
+            for (auto &doc : docs)
+                doc.ID.buf = ids.data() + size_t(doc.ID.buf);
+        }
+
+        void clear() {
+            docs.clear();
+            ids.clear();
+        }
+    };
+
     alloc_slice encodeOptions() {
         Encoder enc;
         enc.beginDict();
@@ -248,6 +405,28 @@ private:
     }
 
 
+    // Returns the pending docIDs, as an array. The last result is reused until the database
+    // changes or the push makes progress.
+    Doc pendingDocIDsSnapshot() {
+        uint64_t lastSequence = _db->lastSequence();
+        uint64_t unitsCompleted;
+        {
+            LOCK(_mutex);
+            unitsCompleted = _c4status.progress.unitsCompleted;
+        }
+
+        LOCK(_pendingMutex);
+        if (!_pendingDocIDs || lastSequence != _pendingSequence
+                            || unitsCompleted != _pendingUnitsCompleted) {
+            alloc_slice arrayData(_c4repl->pendingDocIDs());
+            _pendingDocIDs = arrayData ? Doc(arrayData, kFLTrusted) : Doc();
+            _pendingSequence = lastSequence;
+            _pendingUnitsCompleted = unitsCompleted;
+        }
+        return _pendingDocIDs;
+    }
+
+
     CBLReplicatorStatus effectiveStatus(C4ReplicatorStatus c4status) {
         LOCK(_mutex);
         auto eff = external(c4status);
@@ -270,7 +449,18 @@ private:
 
 
     void _statusChanged(C4ReplicatorStatus c4status) {
+        if (c4status.level == kC4Stopped) {
+            // Deliver any buffered document events before reporting that the replicator stopped:
+            if (_docEventsTimer)
+                _docEventsTimer->stop();
+            flushDocumentEvents();
+        }
+
         LOCK(_mutex);
+        if (c4status.level == kC4Connecting && _lastLevel != kC4Connecting
+                                            && _lastLevel != kC4Stopped)
+            ++_metrics.reconnects;
+        _lastLevel = c4status.level;
         _c4status = c4status;
         auto cblStatus = effectiveStatus(c4status);
         
@@ -290,6 +480,11 @@ private:
         }
 
         if (cblStatus.activity == kCBLReplicatorStopped) {
+            if (_running) {
+                _running = false;
+                _runningSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                                 - _runningSince).count();
+            }
             _db->unregisterStoppable(this);
             _retainSelf = nullptr;  // Undoes the retain in `start`; now I can be freed
         }
@@ -300,44 +495,69 @@ private:
                          size_t numDocs,
                          const C4DocumentEnded* _cbl_nonnull c4Docs[_cbl_nonnull])
     {
-        LOCK(_mutex);
-        std::unique_ptr<std::vector<CBLReplicatedDocument>> docs;
-        if (!_docListeners.empty()) {
-            docs = std::make_unique<std::vector<CBLReplicatedDocument>>();
-            docs->reserve(numDocs);
-        } else if (_progressLevel != kC4ReplProgressOverall) {
-            _c4repl->setProgressLevel(kC4ReplProgressOverall);
-            _progressLevel = kC4ReplProgressOverall;
-        }
-        
+        _metrics.addBatch(numDocs);
+        size_t succeeded = 0;
         for (size_t i = 0; i < numDocs; ++i) {
-            auto src = *c4Docs[i];
-            if (!pushing && src.flags & kRevIsConflict) {
-                // Conflict -- start an async resolver task:
-                auto r = new ConflictResolver(_db, _conf.conflictResolver, _conf.context, src);
-                bumpConflictResolverCount(1);
-                r->runAsync( bind(&CBLReplicator::_conflictResolverFinished, this, std::placeholders::_1) );
-            } else if (docs) {
-                // Otherwise add to list of changes to notify:
-                CBLReplicatedDocument doc = {};
-                doc.ID = src.docID;
-                doc.error = external(src.error);
-                doc.flags = 0;
-                if (src.flags & kRevDeleted)
-                    doc.flags |= kCBLDocumentFlagsDeleted;
-                if (src.flags & kRevPurged)
-                    doc.flags |= kCBLDocumentFlagsAccessRemoved;
-                docs->push_back(doc);
+            if (!c4Docs[i]->error.code && !(c4Docs[i]->flags & kRevIsConflict))
+                ++succeeded;
+        }
+        (pushing ? _metrics.docsPushed : _metrics.docsPulled) += succeeded;
+
+        bool notify;
+        {
+            LOCK(_mutex);
+            notify = !_docListeners.empty();
+            if (!notify && !_metricsEnabled && _progressLevel != kC4ReplProgressOverall) {
+                _c4repl->setProgressLevel(kC4ReplProgressOverall);
+                _progressLevel = kC4ReplProgressOverall;
+            }
+
+            if (!pushing) {
+                for (size_t i = 0; i < numDocs; ++i) {
+                    auto &src = *c4Docs[i];
+                    if (src.flags & kRevIsConflict) {
+                        // Conflict -- queue it on the resolver executor:
+                        auto r = new ConflictResolver(_db, _conf.conflictResolver, _conf.context, src);
+                        bumpConflictResolverCount(1);
+                        _resolverExecutor->submit(r, bind(&CBLReplicator::_conflictResolverFinished,
+                                                          this, std::placeholders::_1));
+                    }
+                }
             }
         }
-        if (docs)
-            _docListeners.call(this, pushing, unsigned(docs->size()), docs->data());
+
+        if (notify) {
+            // Add the other docs to the buffered events to notify:
+            {
+                LOCK(_docEventsMutex);
+                auto &events = _pendingDocEvents[pushing];
+                for (size_t i = 0; i < numDocs; ++i) {
+                    auto &src = *c4Docs[i];
+                    if (pushing || !(src.flags & kRevIsConflict)) {
+                        CBLDocumentFlags flags = 0;
+                        if (src.flags & kRevDeleted)
+                            flags |= kCBLDocumentFlagsDeleted;
+                        if (src.flags & kRevPurged)
+                            flags |= kCBLDocumentFlagsAccessRemoved;
+                        events.add(src.docID, flags, external(src.error));
+                    }
+                }
+            }
+            documentEventsAdded();
+        }
     }
     
 
     void _conflictResolverFinished(ConflictResolver *resolver) {
-        CBLReplicatedDocument doc = resolver->result();
-        _docListeners.call(this, false, 1, &doc);
+        _metrics.conflictResolver.add(resolver->elapsed());
+        if (!_docListeners.empty()) {
+            CBLReplicatedDocument doc = resolver->result();
+            {
+                LOCK(_docEventsMutex);
+                _pendingDocEvents[false].add(doc.ID, doc.flags, doc.error);
+            }
+            documentEventsAdded();
+        }
         delete resolver;
 
         LOCK(_mutex);
@@ -345,9 +565,65 @@ private:
     }
 
 
+    // Delivers buffered document events now, or schedules them to be delivered at the end of
+    // the configured flush interval.
+    void documentEventsAdded() {
+        if (!_docEventsTimer) {
+            flushDocumentEvents();
+        } else {
+            LOCK(_docEventsMutex);
+            if (!_docEventsTimer->scheduled())
+                _docEventsTimer->fireAfter(std::chrono::milliseconds(_conf.documentEventsFlushInterval));
+        }
+    }
+
+
+    // Calls the document listeners with the buffered events. The listeners aren't called while
+    // holding `_mutex`, so a slow listener doesn't hold up status changes.
+    void flushDocumentEvents() {
+        LOCK(_docEventsFlushMutex);     // Keeps deliveries in order
+        {
+            LOCK(_docEventsMutex);
+            for (int i = 0; i < 2; ++i)
+                std::swap(_pendingDocEvents[i], _flushingDocEvents[i]);
+        }
+        for (int pushing = 0; pushing < 2; ++pushing) {
+            auto &events = _flushingDocEvents[pushing];
+            if (events.empty())
+                continue;
+            events.resolveIDs();
+            cbl_internal::TraceSpan span(kCBLTraceNotification);
+            cbl_internal::LockStats::CallerScope caller(kCBLLockCallerListener);
+            _docListeners.call(this, bool(pushing), unsigned(events.docs.size()), events.docs.data());
+            events.clear();             // (keeps the capacity for reuse)
+        }
+    }
+
+
     bool _filter(slice docID, slice revID, C4RevisionFlags flags, Dict body, bool pushing) {
-        Retained<CBLDocument> doc = new CBLDocument(_conf.database, docID, revID, flags, body);
+        Metrics::ScopedTiming timing(_metrics.filter);
+
+        // The expression is evaluated against the body directly, without a CBLDocument:
+        auto &predicate = pushing ? _pushPredicate : _pullPredicate;
+        if (predicate && !(*predicate)(docID, flags, body))
+            return false;
+
         CBLReplicationFilter filter = pushing ? _conf.pushFilter : _conf.pullFilter;
+        if (!filter)
+            return true;
+
+        // The callback gets a pooled document that borrows the revision's data:
+        Retained<CBLDocument> doc;
+        {
+            LOCK(_filterDocsMutex);
+            if (!_filterDocs.empty()) {
+                doc = std::move(_filterDocs.back());
+                _filterDocs.pop_back();
+            }
+        }
+        if (!doc)
+            doc = new CBLDocument(_conf.database);
+        doc->borrowRevision(docID, revID, body);
         
         CBLDocumentFlags docFlags = 0;
         if (flags & kRevDeleted)
@@ -355,7 +631,14 @@ private:
         if (flags & kRevPurged)
             docFlags |= kCBLDocumentFlagsAccessRemoved;
         
-        return filter(_conf.context, doc, docFlags);
+        bool result = filter(_conf.context, doc, docFlags);
+
+        if (doc->endBorrow()) {
+            LOCK(_filterDocsMutex);
+            if (_filterDocs.size() < kMaxPooledFilterDocs)
+                _filterDocs.push_back(std::move(doc));
+        }
+        return result;
     }
 
 #ifdef COUCHBASE_ENTERPRISE
@@ -363,6 +646,10 @@ private:
     C4SliceResult _encrypt(C4String documentID, FLDict properties, C4String keyPath, C4Slice input,
                            C4StringResult* outAlgorithm, C4StringResult* outKeyID, C4Error* outError)
     {
+        Metrics::ScopedTiming timing(_metrics.encryptor);
+        if (_batchEncryptor)
+            return _batchEncryptor->encrypt(documentID, properties, keyPath, input,
+                                            outAlgorithm, outKeyID, outError);
         CBLError error = {};
         auto encryptor = _conf.propertyEncryptor;
         auto result = encryptor(_conf.context, documentID, properties, keyPath, input,
@@ -374,6 +661,10 @@ private:
     C4SliceResult _decrypt(C4String documentID, FLDict properties, C4String keyPath, C4Slice input,
                            C4String algorithm, C4String keyID, C4Error* outError)
     {
+        Metrics::ScopedTiming timing(_metrics.decryptor);
+        if (_batchDecryptor)
+            return _batchDecryptor->decrypt(documentID, properties, keyPath, input,
+                                            algorithm, keyID, outError);
         CBLError error = {};
         auto decryptor = _conf.propertyDecryptor;
         auto result = decryptor(_conf.context, documentID, properties, keyPath, input,
@@ -388,6 +679,14 @@ private:
     ReplicatorConfiguration const               _conf;
     Retained<CBLDatabase>                       _db;
     Retained<C4Replicator>                      _c4repl;
+    Retained<ConflictResolverExecutor>          _resolverExecutor;
+    std::unique_ptr<FilterPredicate>            _pushPredicate, _pullPredicate;
+    std::mutex                                  _filterDocsMutex;
+    std::vector<Retained<CBLDocument>>          _filterDocs;        // Pool of docs for _filter
+    std::mutex                                  _docEventsMutex;    // Guards _pendingDocEvents
+    std::mutex                                  _docEventsFlushMutex;
+    DocumentEvents                              _pendingDocEvents[2];   // Indexed by `pushing`
+    DocumentEvents                              _flushingDocEvents[2];
     bool                                        _useInitialStatus;  // For returning status before first start
     C4ReplicatorStatus                          _c4status {kC4Stopped};
     Retained<CBLReplicator>                     _retainSelf;
@@ -395,6 +694,20 @@ private:
     Listeners<CBLReplicatorChangeListener>      _changeListeners;
     Listeners<CBLDocumentReplicationListener>   _docListeners;
     C4ReplicatorProgressLevel                   _progressLevel {kC4ReplProgressOverall};
+    Metrics                                     _metrics;
+    bool                                        _metricsEnabled {false};
+    bool                                        _running {false};   // Started and not yet stopped
+    std::chrono::steady_clock::time_point       _runningSince;
+    double                                      _runningSeconds {0};
+    C4ReplicatorActivityLevel                   _lastLevel {kC4Stopped};
+    std::mutex                                  _pendingMutex;      // Guards the _pending* vars
+    Doc                                         _pendingDocIDs;     // Cached pendingDocIDs()
+    uint64_t                                    _pendingSequence {0};
+    uint64_t                                    _pendingUnitsCompleted {0};
+#ifdef COUCHBASE_ENTERPRISE
+    std::unique_ptr<PropertyCryptoBatch>        _batchEncryptor, _batchDecryptor;
+#endif
+    std::unique_ptr<litecore::actor::Timer>     _docEventsTimer;    // Only if batching; must be last
 };
 
 CBL_ASSUME_NONNULL_END
@@ -0,0 +1,71 @@
+//
+// CBLTrace_Internal.hh
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "CBLLog.h"
+#include "fleece/slice.hh"
+#include "PlatformCompat.hh"
+#include <atomic>
+
+CBL_ASSUME_NONNULL_BEGIN
+
+namespace cbl_internal {
+
+    /** A stack-based timing span around an operation, reported to the callback registered with
+        `CBL_SetTraceCallback` when it goes out of scope. If tracing is disabled, constructing one
+        costs a single relaxed atomic load. (Implemented in CBLLog.cc.) */
+    class TraceSpan {
+    public:
+        struct Config {
+            CBLTraceCallback        callback;
+            void* _cbl_nullable     context;
+            uint64_t                threshold;      // Sampled if a random uint32 is below this
+        };
+
+        explicit TraceSpan(CBLTraceOperation op, fleece::slice detail = fleece::nullslice) {
+            if (_usuallyFalse(sConfig.load(std::memory_order_relaxed) != nullptr))
+                begin(op, detail);
+        }
+
+        ~TraceSpan() {
+            if (_usuallyFalse(_pushed))
+                end();
+        }
+
+        TraceSpan(const TraceSpan&) =delete;
+        TraceSpan& operator=(const TraceSpan&) =delete;
+
+        static void setCallback(CBLTraceCallback _cbl_nullable, void* _cbl_nullable context,
+                                double sampleRate);
+
+    private:
+        void begin(CBLTraceOperation, fleece::slice detail);
+        void end();
+
+        static std::atomic<const Config*> sConfig;
+
+        const Config* _cbl_nullable     _config {nullptr};
+        TraceSpan* _cbl_nullable        _parent {nullptr};
+        CBLTraceSpan                    _span;
+        bool                            _pushed {false};    // I'm the thread's current span
+        bool                            _traced {false};    // Sampled; report when done
+    };
+
+}
+
+CBL_ASSUME_NONNULL_END
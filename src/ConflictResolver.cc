@@ -86,50 +86,31 @@ namespace cbl_internal {
     }
 
 
-    // Performs conflict resolution. Returns true on success, false on failure. Sets _error.
     bool ConflictResolver::runNow() {
+        bool ok = _runNow();
+        if (_completionHandler)
+            _completionHandler(this);       // the handler will most likely delete me
+        return ok;
+    }
+
+
+    // Performs conflict resolution. Returns true on success, false on failure. Sets _error.
+    bool ConflictResolver::_runNow() {
+        TraceSpan span(kCBLTraceConflictResolution, _docID);
+        LockStats::CallerScope caller(kCBLLockCallerReplicator);
+        Stopwatch st;
         bool ok, inConflict = false;
         int retryCount = 0;
         try {
             do {
-                // Create a CBLDocument that reflects the conflict revision:
-                auto conflict = _db->getMutableDocument(_docID);
-                if (!conflict) {
-                    SyncLog(Info, "Doc '%.*s' no longer exists, no conflict to resolve",
-                            FMTSLICE(_docID));
+                if (!prepare()) {
+                    _elapsed += st.elapsed();
                     return true;
                 }
 
-                if (_revID) {
-                    ok = conflict->selectRevision(_revID) &&
-                         (conflict->revisionFlags() & (kRevLeaf|kRevIsConflict)) ==
-                                                      (kRevLeaf|kRevIsConflict);
-                } else {
-                    ok = conflict->selectNextConflictingRevision();
-                    _revID = conflict->revisionID();
-                }
+                // Now save the resolution:
+                ok = apply();
                 if (!ok) {
-                    // Revision is gone or not a leaf: Conflict must be resolved, so stop
-                    SyncLog(Info, "Conflict in doc '%.*s' already resolved, nothing to do",
-                            FMTSLICE(_docID));
-                    if (_completionHandler) {
-                        _completionHandler(this);       // the handler will most likely delete me
-                    }
-
-                    return true;
-                }
-
-                // Now resolve the conflict:
-                if (_clientResolver)
-                    ok = customResolve(conflict);
-                else
-                    ok = defaultResolve(conflict);
-
-                if (ok) {
-                    _revID = conflict->revisionID();
-                    _flags = conflict->revisionFlags();
-                } else {
-                    _error = external(C4Error::make(LiteCoreDomain, kC4ErrorConflict));
                     // If a local revision is saved at the same time we'll fail with a conflict, so retry:
                     inConflict = (++retryCount < 10);
                     if (inConflict) {
@@ -143,7 +124,69 @@ namespace cbl_internal {
             C4Error::fromCurrentException(internal(&_error));
             ok = false;
         }
+        _elapsed += st.elapsed();
+        return finished(ok);
+    }
+
+
+    // Loads the conflicting revision and decides how to resolve it. Returns false if there
+    // turns out to be nothing to resolve.
+    bool ConflictResolver::prepare() {
+        _conflict = nullptr;
+        _localDoc = nullptr;
+        _resolvedDoc = nullptr;
 
+        // Create a CBLDocument that reflects the conflict revision:
+        auto conflict = _db->getMutableDocument(_docID);
+        if (!conflict) {
+            SyncLog(Info, "Doc '%.*s' no longer exists, no conflict to resolve",
+                    FMTSLICE(_docID));
+            return false;
+        }
+
+        bool ok;
+        if (_revID) {
+            ok = conflict->selectRevision(_revID) &&
+                 (conflict->revisionFlags() & (kRevLeaf|kRevIsConflict)) ==
+                                              (kRevLeaf|kRevIsConflict);
+        } else {
+            ok = conflict->selectNextConflictingRevision();
+            _revID = conflict->revisionID();
+        }
+        if (!ok) {
+            // Revision is gone or not a leaf: Conflict must be resolved, so stop
+            SyncLog(Info, "Conflict in doc '%.*s' already resolved, nothing to do",
+                    FMTSLICE(_docID));
+            return false;
+        }
+
+        _conflict = conflict;
+        if (_clientResolver && _clientResolver != CBLDefaultConflictResolver)
+            decideCustom();
+        else
+            decideDefault();
+        return true;
+    }
+
+
+    // Saves the resolution decided by `prepare`. Returns false if the save conflicted.
+    bool ConflictResolver::apply() {
+        bool ok = _conflict->resolveConflict(_resolution, _resolvedDoc);
+        if (ok) {
+            _revID = _conflict->revisionID();
+            _flags = _conflict->revisionFlags();
+        } else {
+            _error = external(C4Error::make(LiteCoreDomain, kC4ErrorConflict));
+        }
+        _conflict = nullptr;
+        _localDoc = nullptr;
+        _resolvedDoc = nullptr;
+        return ok;
+    }
+
+
+    // Logs the outcome of a resolution and records it in _error.
+    bool ConflictResolver::finished(bool ok) {
         if (ok) {
             SyncLog(Info, "Successfully resolved and saved doc '%.*s'", FMTSLICE(_docID));
             _error = {};
@@ -154,44 +197,28 @@ namespace cbl_internal {
                     internal(_error).description().c_str(),
                     internal(_error).backtrace().c_str());
         }
-        
-        if (_completionHandler)
-            _completionHandler(this);       // the handler will most likely delete me
         return ok;
     }
 
 
-    // Performs default conflict resolution.
+    // Decides the default conflict resolution from the revisions' metadata, without loading
+    // the local document or decoding either body.
     // 1. Deleted wins
     // 2. Higher generation wins
     // 3. Higher revisionID wins
-    bool ConflictResolver::defaultResolve(CBLDocument *conflict) {
-        CBLDocument *remoteDoc = conflict;
-        if (remoteDoc->revisionFlags() & kRevDeleted)
-            remoteDoc = nullptr;
-        
-        auto localDoc = _db->getDocument(_docID, true);
-        if (localDoc && localDoc->revisionFlags() & kRevDeleted)
-            localDoc = nullptr;
-        
-        auto resolved = defaultConflictResolver(_clientResolverContext, _docID, localDoc, remoteDoc);
-        
-        CBLDocument::Resolution resolution;
-        if (resolved == remoteDoc)
-            resolution = CBLDocument::Resolution::useRemote;
-        else
-            resolution = CBLDocument::Resolution::useLocal;
-        
-        return conflict->resolveConflict(resolution, resolved);
+    void ConflictResolver::decideDefault() {
+        _resolution = _conflict->defaultConflictResolution();
+        _resolvedDoc = nullptr;
     }
 
 
-    // Performs custom conflict resolution.
-    bool ConflictResolver::customResolve(CBLDocument *conflict) {
-        CBLDocument *remoteDoc = conflict;
+    // Decides the conflict resolution by calling the custom resolver.
+    void ConflictResolver::decideCustom() {
+        CBLDocument *remoteDoc = _conflict;
         if (remoteDoc->revisionFlags() & kRevDeleted)
             remoteDoc = nullptr;
-        auto localDoc = _db->getDocument(_docID, true);
+        _localDoc = _db->getDocument(_docID, true);
+        const CBLDocument *localDoc = _localDoc;
         if (localDoc && localDoc->revisionFlags() & kRevDeleted)
             localDoc = nullptr;
 
@@ -209,12 +236,18 @@ namespace cbl_internal {
         SyncLog(Info, "Custom conflict resolver for '%.*s' took %.0fms",
                 FMTSLICE(_docID), st.elapsedMS());
 
+        _resolvedDoc = resolved;
+        // The remoteDoc (conflict) and localDoc are retained by this resolver. The merged doc
+        // created and returned by the custom conflict resolver is adopted by _resolvedDoc, so
+        // its original reference is released here.
+        if (resolved != localDoc && resolved != remoteDoc)
+            CBLDocument_Release(resolved);
+
         // Determine the resolution type:
-        CBLDocument::Resolution resolution;
         if (resolved == localDoc)
-            resolution = CBLDocument::Resolution::useLocal;
-        else if (resolved == conflict)
-            resolution = CBLDocument::Resolution::useRemote;
+            _resolution = CBLDocument::Resolution::useLocal;
+        else if (resolved == _conflict)
+            _resolution = CBLDocument::Resolution::useRemote;
         else {
             if (resolved) {
                 // Sanity check the resolved document:
@@ -229,19 +262,8 @@ namespace cbl_internal {
                                      FMTSLICE(resolved->docID()), FMTSLICE(_docID));
                 }
             }
-            resolution = CBLDocument::Resolution::useMerge;
+            _resolution = CBLDocument::Resolution::useMerge;
         }
-
-        // Actually resolve the conflict & save the document:
-        bool result = conflict->resolveConflict(resolution, resolved);
-        
-        // The remoteDoc (conflict) and localDoc are backed by the RetainedConst and will be
-        // released by the RetainedConst destructor. For the merged doc created and returned by
-        // the custom conflict resolver, an explicit release is needed here.
-        if (resolved != localDoc && resolved != remoteDoc)
-            CBLDocument_Release(resolved);
-        
-        return result;
     }
 
     CBLReplicatedDocument ConflictResolver::result() const {
@@ -256,34 +278,210 @@ namespace cbl_internal {
     }
 
 
+#pragma mark - EXECUTOR:
+
+
+    ConflictResolverExecutor::ConflictResolverExecutor(CBLDatabase *db,
+                                                       unsigned maxWorkers,
+                                                       unsigned batchSize)
+    :_db(db)
+    ,_maxWorkers(maxWorkers ? maxWorkers : kDefaultMaxWorkers)
+    ,_batchSize(batchSize ? batchSize : kDefaultBatchSize)
+    { }
+
+
+    void ConflictResolverExecutor::submit(ConflictResolver *resolver,
+                                          ConflictResolver::CompletionHandler handler)
+    {
+        assert(handler);
+        resolver->_completionHandler = move(handler);
+        SyncLog(Info, "Scheduling async resolution of conflict in doc '%.*s'",
+                FMTSLICE(resolver->_docID));
+        LOCK(_mutex);
+        _queue.push_back(resolver);
+        if (_activeWorkers < _maxWorkers) {
+            ++_activeWorkers;
+            retain(this);       // released at the end of drain()
+            c4_runAsyncTask([](void *context) { ((ConflictResolverExecutor*)context)->drain(); },
+                            this);
+        }
+    }
+
+
+    void ConflictResolverExecutor::drain() noexcept {
+        vector<ConflictResolver*> batch;
+        while (true) {
+            {
+                LOCK(_mutex);
+                if (_queue.empty()) {
+                    --_activeWorkers;
+                    break;
+                }
+                size_t n = min(size_t(_batchSize), _queue.size());
+                batch.assign(_queue.begin(), _queue.begin() + n);
+                _queue.erase(_queue.begin(), _queue.begin() + n);
+            }
+            runBatch(batch);
+        }
+        release(this);
+    }
+
+
+    void ConflictResolverExecutor::runBatch(vector<ConflictResolver*> &batch) {
+        // The built-in policy doesn't call out to client code, so it's safe to hold the
+        // database lock while resolving; that lets the whole batch share one transaction.
+        auto isBuiltIn = [](ConflictResolver *r) {
+            return !r->_clientResolver || r->_clientResolver == CBLDefaultConflictResolver;
+        };
+        if (batch.size() > 1 && all_of(batch.begin(), batch.end(), isBuiltIn)) {
+            SyncLog(Info, "Resolving %zu conflicts in one transaction", batch.size());
+            LockStats::CallerScope caller(kCBLLockCallerReplicator);
+            try {
+                _db->useLocked([&](C4Database *c4db) {
+                    C4Database::Transaction t(c4db);
+                    for (auto r : batch)
+                        r->_runNow();
+                    t.commit();
+                });
+            } catch (...) {
+                C4Error error = C4Error::fromCurrentException();
+                SyncLog(Error, "Failed to commit batch of conflict resolutions: %s",
+                        error.description().c_str());
+                for (auto r : batch)
+                    r->_error = external(error);
+            }
+        } else {
+            for (auto r : batch)
+                r->_runNow();
+        }
+
+        // Notify only after the resolutions have been committed:
+        for (auto r : batch)
+            r->_completionHandler(r);       // the handler will most likely delete r
+        batch.clear();
+    }
+
+
 #pragma mark - ALL CONFLICTS RESOLVER:
 
 
     AllConflictsResolver::AllConflictsResolver(CBLDatabase *db,
-                                               CBLConflictResolver resolver, void *context)
+                                               CBLConflictResolver resolver, void *context,
+                                               CBLConflictSweepProgress progress,
+                                               size_t chunkSize)
     :_db(db)
     ,_clientResolver(resolver)
     ,_clientResolverContext(context)
+    ,_progress(progress)
+    ,_chunkSize(chunkSize ? chunkSize : kDefaultChunkSize)
     { }
 
 
-    void AllConflictsResolver::runNow() {
-        while (next()) {
-            alloc_slice docID = _enum->documentInfo().docID;
-            ConflictResolver resolver(_db, _clientResolver, _clientResolverContext, docID);
-            resolver.runNow();
+    bool AllConflictsResolver::runNow() {
+        vector<alloc_slice> docIDs;
+        while (nextChunk(docIDs)) {
+            resolveChunk(docIDs);
+            if (_progress)
+                _progress(_clientResolverContext, _processed, _failed);
         }
+        return _failed == 0;
     }
 
 
-    bool AllConflictsResolver::next() {
-        return _db->useLocked<bool>([&](C4Database *c4db) {
+    bool AllConflictsResolver::nextChunk(vector<alloc_slice> &docIDs) {
+        LockStats::CallerScope caller(kCBLLockCallerReplicator);
+        docIDs.clear();
+        _db->useLocked([&](C4Database *c4db) {
             if (!_enum) {
                 // Flags value of 0 means without kC4IncludeNonConflicted, i.e. only conflicted.
                 _enum = make_unique<C4DocEnumerator>(c4db, C4EnumeratorOptions{ 0 });
             }
-            return _enum->next();
+            while (docIDs.size() < _chunkSize && _enum->next())
+                docIDs.emplace_back(_enum->documentInfo().docID);
         });
+        return !docIDs.empty();
+    }
+
+
+    void AllConflictsResolver::resolveChunk(const vector<alloc_slice> &docIDs) {
+        LockStats::CallerScope caller(kCBLLockCallerReplicator);
+        enum State : uint8_t {kNothingToDo, kPrepared, kResolved, kRetry, kFailed};
+
+        vector<unique_ptr<ConflictResolver>> resolvers;
+        resolvers.reserve(docIDs.size());
+        for (auto &docID : docIDs)
+            resolvers.push_back(make_unique<ConflictResolver>(_db, _clientResolver,
+                                                              _clientResolverContext, docID));
+        vector<State> states(resolvers.size(), kNothingToDo);
+
+        auto decide = [&] {
+            for (size_t i = 0; i < resolvers.size(); ++i) {
+                try {
+                    states[i] = resolvers[i]->prepare() ? kPrepared : kNothingToDo;
+                } catch (...) {
+                    C4Error::fromCurrentException(internal(&resolvers[i]->_error));
+                    states[i] = kFailed;
+                }
+            }
+        };
+
+        auto save = [&] {
+            _db->useLocked([&](C4Database *c4db) {
+                C4Database::Transaction t(c4db);
+                for (size_t i = 0; i < resolvers.size(); ++i) {
+                    if (states[i] != kPrepared)
+                        continue;
+                    try {
+                        states[i] = resolvers[i]->apply() ? kResolved : kRetry;
+                    } catch (...) {
+                        C4Error::fromCurrentException(internal(&resolvers[i]->_error));
+                        states[i] = kFailed;
+                    }
+                }
+                t.commit();
+            });
+        };
+
+        try {
+            if (!_clientResolver || _clientResolver == CBLDefaultConflictResolver) {
+                // The built-in policy doesn't call out to client code, so hold the database
+                // lock while deciding too; nothing can sneak in between deciding and saving.
+                _db->useLocked([&](C4Database*) {
+                    decide();
+                    save();
+                });
+            } else {
+                // Don't hold the lock while the custom resolver runs:
+                decide();
+                save();
+            }
+        } catch (...) {
+            // The transaction didn't commit, so none of the chunk's resolutions were saved:
+            C4Error error = C4Error::fromCurrentException();
+            SyncLog(Error, "Failed to commit chunk of conflict resolutions: %s",
+                    error.description().c_str());
+            for (size_t i = 0; i < resolvers.size(); ++i) {
+                if (states[i] == kPrepared || states[i] == kResolved) {
+                    resolvers[i]->_error = external(error);
+                    states[i] = kFailed;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < resolvers.size(); ++i) {
+            bool ok;
+            if (states[i] == kRetry) {
+                // Lost a race with a newer local save; resolve this one on its own:
+                ok = resolvers[i]->_runNow();
+            } else if (states[i] == kNothingToDo) {
+                ok = true;
+            } else {
+                ok = resolvers[i]->finished(states[i] == kResolved);
+            }
+            ++_processed;
+            if (!ok && _failed++ == 0)
+                _firstError = resolvers[i]->_error;
+        }
     }
 
 }
@@ -6,7 +6,11 @@
 
 #pragma once
 #include "CBLReplicatorConfig.hh"
+#include "RefCounted.hh"
+#include <deque>
 #include <functional>
+#include <mutex>
+#include <vector>
 
 CBL_ASSUME_NONNULL_BEGIN
 
@@ -45,10 +49,20 @@ namespace cbl_internal {
         /// to the replicator's progress listener.
         CBLReplicatedDocument result() const;
 
+        /// The time spent resolving the conflict, in seconds.
+        double elapsed() const                  {return _elapsed;}
+
     private:
+        friend class ConflictResolverExecutor;
+
+        friend class AllConflictsResolver;
+
         bool _runNow();
-        bool defaultResolve(CBLDocument *conflict);
-        bool customResolve(CBLDocument *conflict);
+        bool prepare();
+        bool apply();
+        bool finished(bool ok);
+        void decideDefault();
+        void decideCustom();
 
         Retained<CBLDatabase>   _db;
         CBLConflictResolver _cbl_nullable _clientResolver;
@@ -58,25 +72,77 @@ namespace cbl_internal {
         C4RevisionFlags         _flags {};
         CompletionHandler       _completionHandler;
         CBLError                _error {};
+        double                  _elapsed {0};
+        Retained<CBLDocument>   _conflict;              // Set between prepare() and apply()
+        RetainedConst<CBLDocument> _localDoc;
+        RetainedConst<CBLDocument> _resolvedDoc;
+        CBLDocument::Resolution _resolution {};
+    };
+
+
+
+    /** Runs ConflictResolvers on a bounded number of async workers. Each worker takes a batch
+        of queued resolvers; if they use the built-in resolution policy, which never calls
+        out to client code, the whole batch is resolved and saved in a single transaction. */
+    class ConflictResolverExecutor : public fleece::RefCounted {
+    public:
+        static constexpr unsigned kDefaultMaxWorkers = 2;
+        static constexpr unsigned kDefaultBatchSize  = 64;
+
+        /// Constructor.
+        /// @param maxWorkers  Max number of resolver tasks to run at once; 0 for the default.
+        /// @param batchSize  Max number of resolvers a worker takes at once; 0 for the default.
+        ConflictResolverExecutor(CBLDatabase*, unsigned maxWorkers, unsigned batchSize);
+
+        /// Queues a resolver. The handler is called when it's finished, and takes ownership.
+        void submit(ConflictResolver*, ConflictResolver::CompletionHandler);
+
+    private:
+        void drain() noexcept;
+        void runBatch(std::vector<ConflictResolver*> &batch);
+
+        Retained<CBLDatabase>           _db;
+        unsigned const                  _maxWorkers;
+        unsigned const                  _batchSize;
+        std::mutex                      _mutex;
+        std::deque<ConflictResolver*>   _queue;
+        unsigned                        _activeWorkers {0};
     };
 
 
 
-    /** Scans the database for all unresolved conflicts and resolves them. */
+    /** Scans the database for all unresolved conflicts and resolves them. The conflicted docIDs
+        are collected in chunks; each chunk's resolutions are decided first, then saved in a
+        single transaction. */
     class AllConflictsResolver {
     public:
+        static constexpr size_t kDefaultChunkSize = 100;
+
         explicit AllConflictsResolver(CBLDatabase*,
-                                      CBLConflictResolver,
-                                      void* _cbl_nullable context);
-        void runNow();
+                                      CBLConflictResolver _cbl_nullable,
+                                      void* _cbl_nullable context,
+                                      CBLConflictSweepProgress _cbl_nullable progress = nullptr,
+                                      size_t chunkSize = kDefaultChunkSize);
+
+        /// Resolves all conflicts. Returns false if any of them failed to resolve.
+        bool runNow();
+
+        /// The error of the first document that failed to resolve.
+        const CBLError& firstError() const      {return _firstError;}
 
     private:
-        bool next();
+        bool nextChunk(std::vector<alloc_slice> &docIDs);
+        void resolveChunk(const std::vector<alloc_slice> &docIDs);
         
         Retained<CBLDatabase>               _db;
-        CBLConflictResolver                 _clientResolver;
+        CBLConflictResolver _cbl_nullable   _clientResolver;
         void* _cbl_nullable                 _clientResolverContext;
+        CBLConflictSweepProgress _cbl_nullable _progress;
+        size_t const                        _chunkSize;
         std::unique_ptr<C4DocEnumerator>    _enum;
+        uint64_t                            _processed {0};
+        uint64_t                            _failed {0};
+        CBLError                            _firstError {};
     };
 
 }
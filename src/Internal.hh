@@ -27,7 +27,19 @@
 
 CBL_ASSUME_NONNULL_BEGIN
 
+namespace cbl_internal {
+    // Allocate and free CBLRefCounted objects, with the allocator set by CBL_SetAllocator if any.
+    void* allocateObject(size_t size);
+    void deallocateObject(void *ptr, size_t size) noexcept;
+}
+
+
 struct CBLRefCounted : public fleece::RefCounted, fleece::InstanceCountedIn<CBLRefCounted> {
+    static void* operator new(size_t size)          {return cbl_internal::allocateObject(size);}
+    static void operator delete(void *ptr, size_t size) noexcept {
+        cbl_internal::deallocateObject(ptr, size);
+    }
+
 protected:
     using Value = fleece::Value;
     using Dict = fleece::Dict;
@@ -17,6 +17,8 @@
 //
 
 #include "Listener.hh"
+#include "CBLTrace_Internal.hh"
+#include "LockStats.hh"
 
 using namespace std;
 
@@ -33,55 +35,103 @@ void CBLListenerToken::remove() {
 
 NotificationQueue::NotificationQueue(CBLDatabase *database)
 :_database(database)
-,_state(State())
-{ }
+,_cells(new Cell[kCapacity])
+{
+    for (size_t i = 0; i < kCapacity; ++i)
+        _cells[i].sequence.store(i, memory_order_relaxed);
+}
+
 
 void NotificationQueue::setCallback(CBLNotificationsReadyCallback callback, void *context) {
-    auto pending = _state.useLocked<Notifications>([&](State &state) {
-        state.callback = callback;
-        state.context = context;
-        return callback ? nullptr : move(state.queue);
-    });
-    call(pending);
+    _context = context;
+    _callback = callback;
+    if (!callback)
+        notifyAll();    // Call any notifications that were queued
 }
 
 
 void NotificationQueue::add(Notification notification) {
-    bool notifyNow = false;
-    CBLNotificationsReadyCallback readyCallback = nullptr;
-    void* readyContext;
-
-    _state.useLocked([&](State &state) {
-        if (state.callback) {
-            bool first = !state.queue;
-            if (first)
-                state.queue.reset( new vector<Notification> );
-            state.queue->push_back(notification);
-            if (first) {
-                readyCallback = state.callback;
-                readyContext = state.context;
-            }
-        } else {
-            notifyNow = true;
-        }
-    });
-
-    if (notifyNow)
+    CBLNotificationsReadyCallback readyCallback = _callback;
+    if (!readyCallback) {
+        cbl_internal::TraceSpan span(kCBLTraceNotification);
+        cbl_internal::LockStats::CallerScope caller(kCBLLockCallerListener);
         notification();                         // immediate notification
-    else if (readyCallback)
-        readyCallback(readyContext, _database); // notify that notifications are queued
+        return;
+    }
+
+    // Once the ring has overflowed, everything goes to the overflow vector until it's drained,
+    // so that notifications stay in order:
+    if (_overflowing.load(memory_order_acquire) || !push(notification)) {
+        // The ring is full; this is rare enough that a mutex-protected vector will do:
+        lock_guard<mutex> lock(_overflowMutex);
+        _overflow.push_back(move(notification));
+        _overflowing.store(true, memory_order_release);
+    }
+    // Tell the client, unless it's already been told and hasn't called notifyAll yet:
+    if (!_signaled.exchange(true))
+        readyCallback(_context, _database);     // notify that notifications are queued
 }
 
 
 void NotificationQueue::notifyAll() {
-    auto queue = move(_state.useLocked()->queue);
-    call(queue);
+    // Take the queued notifications, then call them unlocked, since a listener may well call
+    // back into the queue (e.g. CBLDatabase_SendNotifications):
+    vector<Notification> notifications;
+    {
+        lock_guard<mutex> lock(_popMutex);
+        _signaled = false;
+        Notification n;
+        while (pop(n))
+            notifications.push_back(move(n));
+        // Everything in the overflow vector is newer than anything in the ring:
+        lock_guard<mutex> olock(_overflowMutex);
+        for (Notification &o : _overflow)
+            notifications.push_back(move(o));
+        _overflow.clear();
+        _overflowing.store(false, memory_order_release);
+    }
+
+    cbl_internal::TraceSpan span(kCBLTraceNotification);
+    cbl_internal::LockStats::CallerScope caller(kCBLLockCallerListener);
+    for (Notification &n : notifications)
+        n();
 }
 
 
-void NotificationQueue::call(const Notifications &queue) {
-    if (queue) {
-        for (Notification &n : *queue)
-            n();
+// Adds to the ring; returns false if it's full. (This is Dmitry Vyukov's bounded queue: each
+// cell's sequence number tells whether it's free for the producer claiming that position.)
+bool NotificationQueue::push(Notification &notification) {
+    size_t pos = _pushPos.load(memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+        cell = &_cells[pos & (kCapacity - 1)];
+        size_t seq = cell->sequence.load(memory_order_acquire);
+        auto diff = intptr_t(seq) - intptr_t(pos);
+        if (diff == 0) {
+            if (_pushPos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = _pushPos.load(memory_order_relaxed);
+        }
     }
+    cell->notification = move(notification);
+    cell->sequence.store(pos + 1, memory_order_release);
+    return true;
+}
+
+
+// Removes the oldest notification from the ring; returns false if there is none.
+// Must be called with `_popMutex` locked.
+bool NotificationQueue::pop(Notification &notification) {
+    Cell *cell = &_cells[_popPos & (kCapacity - 1)];
+    size_t seq = cell->sequence.load(memory_order_acquire);
+    if (intptr_t(seq) - intptr_t(_popPos + 1) < 0)
+        return false;
+    notification = move(cell->notification);
+    cell->notification = {};
+    cell->sequence.store(_popPos + kCapacity, memory_order_release);
+    ++_popPos;
+    return true;
 }
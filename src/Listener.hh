@@ -51,7 +51,11 @@ public:
     }
 
     /** Called by `CBLListener_Remove` */
-    void remove();
+    virtual void remove();
+
+    /** Keeps an object alive as long as this token, for a context that has to outlive any call
+        to the listener that's already in progress when the token is removed. */
+    void retainContext(fleece::RefCounted *owner)      {_contextOwner = owner;}
 
 protected:
     friend class cbl_internal::ListenersBase;
@@ -64,6 +68,7 @@ protected:
     std::atomic<const void*>                   _callback;          // Really a C fn pointer
     void* const  _cbl_nullable                 _context;
     cbl_internal::ListenersBase* _cbl_nullable _owner {nullptr};
+    fleece::Retained<fleece::RefCounted>       _contextOwner;
 };
 
 
@@ -89,24 +94,38 @@ namespace cbl_internal {
 
 
 
-    /** Manages a set of CBLListenerTokens. Thread-safe. */
+    /** Manages a set of CBLListenerTokens. Thread-safe.
+        The set is copy-on-write: adding or removing a token publishes a new immutable vector,
+        so reading the tokens (e.g. to call them) takes no lock and doesn't copy anything. */
     class ListenersBase {
     public:
+        using Tokens = std::vector<fleece::Retained<CBLListenerToken>>;
+        using Snapshot = std::shared_ptr<const Tokens>;
+
+        ListenersBase()
+        :_tokens(std::make_shared<const Tokens>())
+        { }
+
         ~ListenersBase() {
             clear();
         }
 
         void add(CBLListenerToken* t) {
             LOCK(_mutex);
-            _tokens.emplace_back(t);
+            auto tokens = std::make_shared<Tokens>(*_tokens);
+            tokens->emplace_back(t);
             t->addedTo(this);
+            std::atomic_store(&_tokens, Snapshot(std::move(tokens)));
         }
 
         void remove(CBLListenerToken* t) {
             LOCK(_mutex);
-            for (auto i = _tokens.begin(); i != _tokens.end(); ++i) {
+            auto &current = *_tokens;
+            for (auto i = current.begin(); i != current.end(); ++i) {
                 if (i->get() == t) {
-                    _tokens.erase(i);
+                    auto tokens = std::make_shared<Tokens>(current);
+                    tokens->erase(tokens->begin() + (i - current.begin()));
+                    std::atomic_store(&_tokens, Snapshot(std::move(tokens)));
                     return;
                 }
             }
@@ -115,14 +134,13 @@ namespace cbl_internal {
 
         void clear() {
             LOCK(_mutex);
-            for (auto &tok : _tokens)
+            for (auto &tok : *_tokens)
                 tok->removed();
-            _tokens.clear();
+            std::atomic_store(&_tokens, std::make_shared<const Tokens>());
         }
 
         bool contains(CBLListenerToken *token) const {
-            LOCK(_mutex);
-            for (auto &tok : _tokens) {
+            for (auto &tok : *tokens()) {
                 if (tok == token)
                     return true;
             }
@@ -130,20 +148,18 @@ namespace cbl_internal {
         }
 
         bool empty() const {
-            LOCK(_mutex);
-            return _tokens.empty();
+            return tokens()->empty();
         }
 
-        using Tokens = std::vector<fleece::Retained<CBLListenerToken>>;
-
-        Tokens tokens() const {
-            LOCK(_mutex);
-            return _tokens;
+        /** Returns the current set of tokens. It's immutable, so it can be used without locking
+            while other threads add or remove tokens. */
+        Snapshot tokens() const {
+            return std::atomic_load(&_tokens);
         }
 
     private:
-        mutable std::mutex _mutex;
-        Tokens _tokens;
+        mutable std::mutex _mutex;      // Serializes writers; readers don't lock it
+        Snapshot _tokens;               // Only accessed with atomic_load/atomic_store
     };
 
 
@@ -167,16 +183,42 @@ namespace cbl_internal {
 
             template <class... Args>
         void call(Args... args) const {
-            for (auto &lp : tokens())
+            auto snapshot = tokens();
+            for (auto &lp : *snapshot)
                 ((ListenerToken<LISTENER>*)lp.get())->call(args...);
         }
+
+            template <class FN>
+        void forEach(FN fn) const {
+            auto snapshot = tokens();
+            for (auto &lp : *snapshot)
+                fn((ListenerToken<LISTENER>*)lp.get());
+        }
     };
 
 
-    using Notification = std::function<void()>;
+    /** A pending call to a listener: a function to call with a retained object and/or an
+        unretained pointer. It's small and fixed-size, so queueing it doesn't allocate. */
+    struct Notification {
+        using Function = void (*)(CBLRefCounted* _cbl_nullable, void* _cbl_nullable);
 
+        Function _cbl_nullable                      function {nullptr};
+        fleece::Retained<CBLRefCounted>             target;
+        void* _cbl_nullable                         context {nullptr};
 
-    /** Manages a queue of pending calls to listeners. Owned by CBLDatabase. Thread-safe. */
+        void operator() () const                    {function(target, context);}
+
+        /** A notification that calls `token->call()`. */
+            template <class TOKEN>
+        static Notification calling(TOKEN* _cbl_nonnull token) {
+            return {[](CBLRefCounted *t, void*) { ((TOKEN*)t)->call(); }, token, nullptr};
+        }
+    };
+
+
+    /** Manages a queue of pending calls to listeners. Owned by CBLDatabase. Thread-safe.
+        Notifications are kept in a bounded lock-free multi-producer ring, so threads adding
+        them never wait for the thread calling `notifyAll`. */
     class NotificationQueue {
     public:
         NotificationQueue(CBLDatabase*);
@@ -194,18 +236,27 @@ namespace cbl_internal {
 
 
     private:
-        using Notifications = std::unique_ptr<std::vector<Notification>>;
+        static constexpr size_t kCapacity = 4096;   // Must be a power of 2
 
-        void call(const Notifications&);
-        
-        struct State {
-            CBLNotificationsReadyCallback _cbl_nullable callback {nullptr};
-            void* _cbl_nullable context;
-            Notifications queue;
+        struct Cell {
+            std::atomic<size_t> sequence;
+            Notification        notification;
         };
 
-        CBLDatabase* const _database;
-        litecore::access_lock<State> _state;
+        bool push(Notification&);
+        bool pop(Notification&);
+
+        CBLDatabase* const                                  _database;
+        std::atomic<CBLNotificationsReadyCallback _cbl_nullable> _callback {nullptr};
+        std::atomic<void* _cbl_nullable>                    _context {nullptr};
+        std::atomic<bool>                                   _signaled {false};
+        std::unique_ptr<Cell[]>                             _cells;
+        std::atomic<size_t>                                 _pushPos {0};
+        size_t                                              _popPos {0};    // Guarded by _popMutex
+        std::mutex                                          _popMutex;
+        std::mutex                                          _overflowMutex;
+        std::vector<Notification>                           _overflow;      // Used if ring is full
+        std::atomic<bool>                                   _overflowing {false}; // _overflow in use
     };
 
 }
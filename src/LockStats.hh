@@ -0,0 +1,181 @@
+//
+// LockStats.hh
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "CBLDatabase.h"
+#include "PlatformCompat.hh"
+#include <atomic>
+#include <chrono>
+#include <utility>
+
+CBL_ASSUME_NONNULL_BEGIN
+
+namespace cbl_internal {
+
+    /** Contention statistics of a database's lock: how often it's acquired, how long threads
+        wait for it (attributed to the API that's calling), and how long it's held.
+        The counters are relaxed atomics; while disabled, a use of the lock only costs a relaxed
+        load of the `enabled` flag. */
+    class LockStats {
+    public:
+        static constexpr int kNumCallers = kCBLLockCallerListener + 1;
+        static constexpr int kNumBuckets = sizeof(CBLLockStats::holdTimeHistogram)
+                                            / sizeof(CBLLockStats::holdTimeHistogram[0]);
+
+        bool enabled() const        {return _enabled.load(std::memory_order_relaxed);}
+
+        /// Enables or disables the instrumentation; either way, the counters are reset.
+        void setEnabled(bool enabled) {
+            _enabled = false;
+            reset();
+            _enabled = enabled;
+        }
+
+        CBLLockStats get() const {
+            CBLLockStats s = {};
+            s.acquisitions = _acquisitions;
+            s.totalWaitTime = _totalWait;
+            s.maxWaitTime = _maxWait;
+            for (int i = 0; i < kNumCallers; ++i) {
+                s.acquisitionsByCaller[i] = _callerAcquisitions[i];
+                s.waitTimeByCaller[i] = _callerWait[i];
+            }
+            for (int i = 0; i < kNumBuckets; ++i)
+                s.holdTimeHistogram[i] = _holdHistogram[i];
+            return s;
+        }
+
+
+        /** Sets the calling API that the current thread's lock waits are attributed to, for the
+            lifetime of this object. The outermost scope wins, so an API that calls another one
+            is charged for its waits. */
+        class CallerScope {
+        public:
+            explicit CallerScope(CBLLockCaller caller)
+            :_outer(sCaller == kCBLLockCallerOther)
+            {
+                if (_outer)
+                    sCaller = caller;
+            }
+            ~CallerScope() {
+                if (_outer)
+                    sCaller = kCBLLockCallerOther;
+            }
+            CallerScope(const CallerScope&) =delete;
+            CallerScope& operator=(const CallerScope&) =delete;
+        private:
+            bool const _outer;
+        };
+
+
+        /** Times one use of the lock. Construct it just before locking, call `acquired` once
+            the lock is held, and destruct it after unlocking. */
+        class Timer {
+        public:
+            explicit Timer(LockStats &stats)
+            :_stats(stats.enabled() ? &stats : nullptr)
+            {
+                if (_usuallyFalse(_stats != nullptr))
+                    _start = _acquired = now();
+            }
+
+            void acquired() {
+                if (_usuallyFalse(_stats != nullptr))
+                    _acquired = now();
+            }
+
+            ~Timer() {
+                if (_usuallyFalse(_stats != nullptr))
+                    _stats->record(_acquired - _start, now() - _acquired);
+            }
+
+            Timer(const Timer&) =delete;
+            Timer& operator=(const Timer&) =delete;
+        private:
+            LockStats* _cbl_nullable _stats;
+            int64_t _start {0}, _acquired {0};
+        };
+
+
+        /** Holds a lock's access object, recording the time it's waited for and held. Members are
+            destructed in reverse order, so `_access` releases the lock before `_timer` ends. */
+        template <class LOCK>
+        class Locked {
+        public:
+            Locked(LockStats &stats, LOCK &lock)
+            :_timer(stats)
+            ,_access(lock.useLocked())
+            {
+                _timer.acquired();
+            }
+
+            decltype(auto) get()            {return _access.get();}
+            decltype(auto) operator* ()     {return _access.get();}
+            decltype(auto) operator-> ()    {return _access.operator->();}
+
+        private:
+            Timer                                       _timer;
+            decltype(std::declval<LOCK&>().useLocked()) _access;
+        };
+
+    private:
+        static int64_t now() {
+            using namespace std::chrono;
+            return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+
+        void reset() {
+            _acquisitions = 0;
+            _totalWait = 0;
+            _maxWait = 0;
+            for (auto &n : _callerAcquisitions)  n = 0;
+            for (auto &n : _callerWait)          n = 0;
+            for (auto &n : _holdHistogram)       n = 0;
+        }
+
+        void record(int64_t wait, int64_t hold) {
+            constexpr auto relaxed = std::memory_order_relaxed;
+            auto caller = sCaller;
+            _acquisitions.fetch_add(1, relaxed);
+            _totalWait.fetch_add(wait, relaxed);
+            _callerAcquisitions[caller].fetch_add(1, relaxed);
+            _callerWait[caller].fetch_add(wait, relaxed);
+            uint64_t max = _maxWait.load(relaxed);
+            while (uint64_t(wait) > max && !_maxWait.compare_exchange_weak(max, wait, relaxed))
+                ;
+            // Buckets are powers of ten, from "under 1µs" to "1s or more":
+            int bucket = 0;
+            for (int64_t limit = 1000; bucket < kNumBuckets - 1 && hold >= limit; limit *= 10)
+                ++bucket;
+            _holdHistogram[bucket].fetch_add(1, relaxed);
+        }
+
+        static inline thread_local CBLLockCaller sCaller = kCBLLockCallerOther;
+
+        std::atomic<bool>       _enabled {false};
+        std::atomic<uint64_t>   _acquisitions {0};
+        std::atomic<uint64_t>   _totalWait {0};
+        std::atomic<uint64_t>   _maxWait {0};
+        std::atomic<uint64_t>   _callerAcquisitions[kNumCallers] {};
+        std::atomic<uint64_t>   _callerWait[kNumCallers] {};
+        std::atomic<uint64_t>   _holdHistogram[kNumBuckets] {};
+    };
+
+}
+
+CBL_ASSUME_NONNULL_END
@@ -0,0 +1,188 @@
+//
+// PropertyCryptoBatch.cc
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "PropertyCryptoBatch.hh"
+
+#ifdef COUCHBASE_ENTERPRISE
+
+#include "CBLEncryptable_Internal.hh"
+#include "Base64.hh"
+
+using namespace std;
+using namespace fleece;
+
+
+namespace cbl_internal {
+
+    // Key prefix and properties of an encrypted value, as stored by LiteCore:
+    static constexpr slice kEncryptedPropKeyPrefix = "encrypted$";
+    static constexpr slice kAlgorithmProperty = "alg", kKeyIDProperty = "kid",
+                           kCiphertextProperty = "ciphertext";
+
+
+    static C4SliceResult copyResult(slice s) {
+        return s ? FLSliceResult_CreateWith(s.buf, s.size) : C4SliceResult{};
+    }
+
+
+    PropertyCryptoBatch::PropertyCryptoBatch(CBLPropertyBatchEncryptor encryptor, void *context)
+    :_encryptor(encryptor)
+    ,_context(context)
+    { }
+
+
+    PropertyCryptoBatch::PropertyCryptoBatch(CBLPropertyBatchDecryptor decryptor, void *context)
+    :_decryptor(decryptor)
+    ,_context(context)
+    { }
+
+
+    void PropertyCryptoBatch::collect(Dict dict, const string &path, vector<Property> &props) const {
+        for (Dict::iterator i(dict); i; ++i) {
+            Dict value = i.value().asDict();
+            if (!value)
+                continue;
+            slice key = i.keyString();
+            if (_encryptor) {
+                if (CBLEncryptable::isEncryptableValue(value)) {
+                    Property prop;
+                    prop.keyPath = path + string(key);
+                    prop.input = value[kCBLEncryptableValueProperty].toJSON(false, true);
+                    props.push_back(move(prop));
+                    continue;
+                }
+            } else if (key.hasPrefix(kEncryptedPropKeyPrefix)) {
+                if (slice ciphertext = value[kCiphertextProperty].asString(); ciphertext) {
+                    Property prop;
+                    prop.keyPath = path + string(key.from(kEncryptedPropKeyPrefix.size));
+                    prop.input = base64::decode(ciphertext);
+                    prop.algorithm = value[kAlgorithmProperty].asString();
+                    prop.kid = value[kKeyIDProperty].asString();
+                    props.push_back(move(prop));
+                    continue;
+                }
+            }
+            collect(value, path + string(key) + ".", props);
+        }
+    }
+
+
+    void PropertyCryptoBatch::run(slice docID, FLDict properties, Batch &batch) const {
+        vector<CBLCryptoProperty> cprops;
+        cprops.reserve(batch.props.size());
+        for (auto &prop : batch.props)
+            cprops.push_back({slice(prop.keyPath), prop.input, prop.algorithm, prop.kid, {}});
+
+        bool ok;
+        batch.error = {};
+        if (_encryptor) {
+            FLStringResult algorithm = {}, kid = {};
+            ok = _encryptor(_context, docID, properties, unsigned(cprops.size()), cprops.data(),
+                            &algorithm, &kid, &batch.error);
+            batch.algorithm = alloc_slice(move(algorithm));
+            batch.kid = alloc_slice(move(kid));
+        } else {
+            ok = _decryptor(_context, docID, properties, unsigned(cprops.size()), cprops.data(),
+                            &batch.error);
+        }
+        for (size_t i = 0; i < cprops.size(); ++i)
+            batch.props[i].output = alloc_slice(move(cprops[i].output));
+
+        if (!ok && !batch.error.code)
+            batch.error = {kCBLDomain, kCBLErrorCrypto};
+        batch.ok = ok && !batch.error.code;
+    }
+
+
+    PropertyCryptoBatch::Property* PropertyCryptoBatch::find(slice docID, FLDict properties,
+                                                              slice input)
+    {
+        if (docID != _docID || properties != _properties) {
+            // First callback for this document; collect and process all its properties:
+            _docID = docID;
+            _properties = properties;
+            _batch = Batch();
+            collect(Dict(properties), string(), _batch.props);
+            if (!_batch.props.empty())
+                run(docID, properties, _batch);
+        }
+
+        Property *found = nullptr;
+        bool allTaken = true;
+        for (auto &prop : _batch.props) {
+            if (!found && !prop.taken && prop.input == input) {
+                prop.taken = true;
+                found = &prop;
+            }
+            allTaken = allTaken && prop.taken;
+        }
+        if (allTaken)
+            _docID = nullslice;     // A later revision of the same doc starts a new batch
+        return found;
+    }
+
+
+    C4SliceResult PropertyCryptoBatch::encrypt(slice docID, FLDict properties, slice keyPath,
+                                               slice input,
+                                               C4StringResult* outAlgorithm,
+                                               C4StringResult* outKeyID,
+                                               C4Error* outError)
+    {
+        LOCK(_mutex);
+        Batch single, *batch = &_batch;
+        Property *prop = find(docID, properties, input);
+        if (!prop) {
+            single.props.push_back({string(keyPath), alloc_slice(input)});
+            run(docID, properties, single);
+            batch = &single;
+            prop = &single.props[0];
+        }
+        if (!batch->ok) {
+            *outError = internal(batch->error);
+            return {};
+        }
+        *outAlgorithm = copyResult(batch->algorithm);
+        *outKeyID = copyResult(batch->kid);
+        return copyResult(prop->output);
+    }
+
+
+    C4SliceResult PropertyCryptoBatch::decrypt(slice docID, FLDict properties, slice keyPath,
+                                               slice input, slice algorithm, slice keyID,
+                                               C4Error* outError)
+    {
+        LOCK(_mutex);
+        Batch single, *batch = &_batch;
+        Property *prop = find(docID, properties, input);
+        if (!prop) {
+            single.props.push_back({string(keyPath), alloc_slice(input),
+                                    alloc_slice(algorithm), alloc_slice(keyID)});
+            run(docID, properties, single);
+            batch = &single;
+            prop = &single.props[0];
+        }
+        if (!batch->ok) {
+            *outError = internal(batch->error);
+            return {};
+        }
+        return copyResult(prop->output);
+    }
+
+}
+
+#endif
@@ -0,0 +1,85 @@
+//
+// PropertyCryptoBatch.hh
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "CBLReplicator.h"
+#include "Internal.hh"
+#include "c4Base.h"
+#include "fleece/Fleece.hh"
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef COUCHBASE_ENTERPRISE
+
+CBL_ASSUME_NONNULL_BEGIN
+
+namespace cbl_internal {
+
+    /** Adapts a batch property encryptor or decryptor to LiteCore's per-property callbacks.
+        On the first callback for a document, all of the document's encryptable (or encrypted)
+        properties are collected and passed to the batch callback at once. Its results are then
+        handed out to the per-property callbacks, matched by their input data; a callback whose
+        input isn't in the batch is passed to the batch callback on its own. */
+    class PropertyCryptoBatch {
+    public:
+        PropertyCryptoBatch(CBLPropertyBatchEncryptor, void* _cbl_nullable context);
+        PropertyCryptoBatch(CBLPropertyBatchDecryptor, void* _cbl_nullable context);
+
+        C4SliceResult encrypt(fleece::slice docID, FLDict properties, fleece::slice keyPath,
+                              fleece::slice input,
+                              C4StringResult* outAlgorithm, C4StringResult* outKeyID,
+                              C4Error* outError);
+
+        C4SliceResult decrypt(fleece::slice docID, FLDict properties, fleece::slice keyPath,
+                              fleece::slice input, fleece::slice algorithm, fleece::slice keyID,
+                              C4Error* outError);
+
+    private:
+        struct Property {
+            std::string                 keyPath;
+            fleece::alloc_slice         input, algorithm, kid;
+            fleece::alloc_slice         output;
+            bool                        taken {false};
+        };
+
+        struct Batch {
+            std::vector<Property>       props;
+            fleece::alloc_slice         algorithm, kid;     // Encryption only
+            CBLError                    error {};
+            bool                        ok {false};
+        };
+
+        void collect(fleece::Dict, const std::string &path, std::vector<Property>&) const;
+        void run(fleece::slice docID, FLDict properties, Batch&) const;
+        Property* _cbl_nullable find(fleece::slice docID, FLDict properties, fleece::slice input);
+
+        CBLPropertyBatchEncryptor _cbl_nullable _encryptor {nullptr};
+        CBLPropertyBatchDecryptor _cbl_nullable _decryptor {nullptr};
+        void* _cbl_nullable     _context;
+        std::mutex              _mutex;             // Guards the vars below
+        fleece::alloc_slice     _docID;             // Document the current batch belongs to
+        FLDict _cbl_nullable    _properties {nullptr};
+        Batch                   _batch;
+    };
+
+}
+
+CBL_ASSUME_NONNULL_END
+
+#endif
@@ -0,0 +1,280 @@
+//
+// ReplicationFilter.cc
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "ReplicationFilter.hh"
+#include <climits>
+#include <string>
+
+using namespace std;
+using namespace fleece;
+
+
+namespace cbl_internal {
+
+    enum class Op : uint8_t {
+        kLiteral, kProperty, kDocID, kDeleted, kMissing, kArray,
+        kEqual, kNotEqual, kLess, kLessOrEqual, kGreater, kGreaterOrEqual,
+        kAnd, kOr, kNot, kIs, kIsNot, kIn, kNotIn
+    };
+
+
+    struct FilterPredicate::Node {
+        Op                          op;
+        Value                       literal;                // kLiteral
+        FLKeyPath _cbl_nullable     path {nullptr};         // kProperty
+        vector<unique_ptr<Node>>    operands;
+
+        explicit Node(Op o)     :op(o) { }
+        ~Node()                 {FLKeyPath_Free(path);}
+    };
+
+
+    // The value of an evaluated node.
+    struct FilterPredicate::Result {
+        enum Type : uint8_t {kMissing, kNull, kBool, kNumber, kString, kOther};
+
+        Type    type {kMissing};
+        bool    boolean {false};
+        double  number {0};
+        slice   string;
+        Value   value;
+
+        static Result of(Value v) {
+            Result r;
+            r.value = v;
+            switch (v.type()) {
+                case kFLUndefined:  r.type = kMissing; break;
+                case kFLNull:       r.type = kNull; break;
+                case kFLBoolean:    r.type = kBool; r.boolean = v.asBool(); break;
+                case kFLNumber:     r.type = kNumber; r.number = v.asDouble(); break;
+                case kFLString:     r.type = kString; r.string = v.asString(); break;
+                default:            r.type = kOther; break;
+            }
+            return r;
+        }
+
+        static Result ofBool(bool b)        {Result r; r.type = kBool; r.boolean = b; return r;}
+        static Result ofString(slice s)     {Result r; r.type = kString; r.string = s; return r;}
+
+        bool truthy() const {
+            switch (type) {
+                case kBool:     return boolean;
+                case kNumber:   return number != 0;
+                case kString:   return string.size > 0;
+                case kOther:    return true;
+                default:        return false;
+            }
+        }
+
+        // Returns <0, 0 or >0, or INT_MIN if the values aren't comparable.
+        int compare(const Result &other) const {
+            if (type != other.type || type == kMissing || type == kNull)
+                return INT_MIN;
+            switch (type) {
+                case kBool:     return int(boolean) - int(other.boolean);
+                case kNumber:   return (number < other.number) ? -1 : (number > other.number);
+                case kString:   return string.compare(other.string);
+                default:        return FLValue_IsEqual(value, other.value) ? 0 : INT_MIN;
+            }
+        }
+    };
+
+
+    struct FilterPredicate::Context {
+        slice               docID;
+        C4RevisionFlags     flags;
+        Dict                body;
+    };
+
+
+    static const struct {slice name; Op op; int minArgs, maxArgs;} kOperators[] = {
+        {"=",       Op::kEqual,             2, 2},
+        {"==",      Op::kEqual,             2, 2},
+        {"!=",      Op::kNotEqual,          2, 2},
+        {"<>",      Op::kNotEqual,          2, 2},
+        {"<",       Op::kLess,              2, 2},
+        {"<=",      Op::kLessOrEqual,       2, 2},
+        {">",       Op::kGreater,           2, 2},
+        {">=",      Op::kGreaterOrEqual,    2, 2},
+        {"AND",     Op::kAnd,               2, 9999},
+        {"OR",      Op::kOr,                2, 9999},
+        {"NOT",     Op::kNot,               1, 1},
+        {"IS",      Op::kIs,                2, 2},
+        {"IS NOT",  Op::kIsNot,             2, 2},
+        {"IN",      Op::kIn,                2, 2},
+        {"NOT IN",  Op::kNotIn,             2, 2},
+        {"[]",      Op::kArray,             0, 9999},
+        {"MISSING", Op::kMissing,           0, 0},
+    };
+
+
+    [[noreturn]] static void failCompile(const string &message) {
+        C4Error::raise(LiteCoreDomain, kC4ErrorInvalidQuery,
+                       "Invalid replication filter expression: %s", message.c_str());
+    }
+
+
+    FilterPredicate::FilterPredicate(slice jsonExpression) {
+        _doc = Doc::fromJSON(jsonExpression);
+        if (!_doc)
+            failCompile("not valid JSON");
+        _root = compile(_doc.root());
+    }
+
+
+    FilterPredicate::~FilterPredicate() = default;
+
+
+    unique_ptr<FilterPredicate::Node> FilterPredicate::compile(Value v) {
+        Array array = v.asArray();
+        if (!array) {
+            if (v.type() == kFLDict)
+                failCompile("dictionaries are not supported");
+            auto node = make_unique<Node>(Op::kLiteral);
+            node->literal = v;
+            return node;
+        }
+
+        slice opName = array[0].asString();
+        if (!opName)
+            failCompile("an operation must start with a string");
+        if (opName.size == 0)
+            failCompile("empty operation name");
+
+        if (opName[0] == '.') {
+            // Property path, either [".a.b"] or [".", "a", "b"]:
+            string spec(opName.size > 1 ? string(opName.from(1)) : string());
+            for (uint32_t i = 1; i < array.count(); ++i) {
+                slice component = array[i].asString();
+                if (!component)
+                    failCompile("property path components must be strings");
+                if (!spec.empty())
+                    spec += '.';
+                spec += string(component);
+            }
+            if (spec == "_id")
+                return make_unique<Node>(Op::kDocID);
+            if (spec == "_deleted")
+                return make_unique<Node>(Op::kDeleted);
+            auto node = make_unique<Node>(Op::kProperty);
+            FLError flErr;
+            node->path = FLKeyPath_New(slice(spec), &flErr);
+            if (!node->path)
+                failCompile("invalid property path '" + spec + "'");
+            return node;
+        }
+
+        for (auto &def : kOperators) {
+            if (def.name.caseEquivalent(opName)) {
+                int nArgs = int(array.count()) - 1;
+                if (nArgs < def.minArgs || nArgs > def.maxArgs)
+                    failCompile("wrong number of arguments to '" + string(opName) + "'");
+                auto node = make_unique<Node>(def.op);
+                for (uint32_t i = 1; i < array.count(); ++i)
+                    node->operands.push_back(compile(array[i]));
+                if ((def.op == Op::kIn || def.op == Op::kNotIn)
+                        && node->operands[1]->op != Op::kArray)
+                    failCompile("'" + string(opName) + "' requires a literal [] array");
+                return node;
+            }
+        }
+        failCompile("unsupported operation '" + string(opName) + "'");
+    }
+
+
+    FilterPredicate::Result FilterPredicate::eval(const Node &node, const Context &ctx) const {
+        auto operand = [&](size_t i) {return eval(*node.operands[i], ctx);};
+        switch (node.op) {
+            case Op::kLiteral:
+                return Result::of(node.literal);
+            case Op::kProperty:
+                return Result::of(FLKeyPath_Eval(node.path, Value(ctx.body)));
+            case Op::kDocID:
+                return Result::ofString(ctx.docID);
+            case Op::kDeleted:
+                return Result::ofBool((ctx.flags & kRevDeleted) != 0);
+            case Op::kMissing:
+            case Op::kArray:        // only meaningful as the right side of IN
+                return Result();
+            case Op::kEqual:
+                return Result::ofBool(operand(0).compare(operand(1)) == 0);
+            case Op::kNotEqual: {
+                int cmp = operand(0).compare(operand(1));
+                return Result::ofBool(cmp != 0 && cmp != INT_MIN);
+            }
+            case Op::kLess:
+            case Op::kLessOrEqual:
+            case Op::kGreater:
+            case Op::kGreaterOrEqual: {
+                Result lhs = operand(0), rhs = operand(1);
+                if (lhs.type != rhs.type || (lhs.type != Result::kNumber
+                                             && lhs.type != Result::kString))
+                    return Result::ofBool(false);
+                int cmp = lhs.compare(rhs);
+                switch (node.op) {
+                    case Op::kLess:         return Result::ofBool(cmp < 0);
+                    case Op::kLessOrEqual:  return Result::ofBool(cmp <= 0);
+                    case Op::kGreater:      return Result::ofBool(cmp > 0);
+                    default:                return Result::ofBool(cmp >= 0);
+                }
+            }
+            case Op::kAnd:
+                for (auto &sub : node.operands)
+                    if (!eval(*sub, ctx).truthy())
+                        return Result::ofBool(false);
+                return Result::ofBool(true);
+            case Op::kOr:
+                for (auto &sub : node.operands)
+                    if (eval(*sub, ctx).truthy())
+                        return Result::ofBool(true);
+                return Result::ofBool(false);
+            case Op::kNot:
+                return Result::ofBool(!operand(0).truthy());
+            case Op::kIs:
+            case Op::kIsNot: {
+                // Unlike `=`, IS treats null and missing as values:
+                Result lhs = operand(0), rhs = operand(1);
+                bool same;
+                if (lhs.type == Result::kMissing || lhs.type == Result::kNull)
+                    same = (lhs.type == rhs.type);
+                else
+                    same = (lhs.compare(rhs) == 0);
+                return Result::ofBool(same == (node.op == Op::kIs));
+            }
+            case Op::kIn:
+            case Op::kNotIn: {
+                Result lhs = operand(0);
+                bool found = false;
+                for (auto &item : node.operands[1]->operands) {
+                    if (lhs.compare(eval(*item, ctx)) == 0) {
+                        found = true;
+                        break;
+                    }
+                }
+                return Result::ofBool(found == (node.op == Op::kIn));
+            }
+        }
+        return Result();
+    }
+
+
+    bool FilterPredicate::operator() (slice docID, C4RevisionFlags flags, Dict body) const {
+        return eval(*_root, Context{docID, flags, body}).truthy();
+    }
+
+}
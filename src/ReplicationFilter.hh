@@ -0,0 +1,58 @@
+//
+// ReplicationFilter.hh
+//
+// Copyright © 2022 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Internal.hh"
+#include "c4DocumentTypes.h"
+#include "fleece/Fleece.hh"
+#include <memory>
+#include <vector>
+
+CBL_ASSUME_NONNULL_BEGIN
+
+namespace cbl_internal {
+
+    /** A replication filter given as an expression in the JSON query language, compiled once
+        and evaluated directly against each revision's body. Supported are property paths
+        (including the `._id` and `._deleted` meta-properties), literals, `[]` arrays, the
+        comparison operators `= == != <> < <= > >=`, `AND`, `OR`, `NOT`, `IS`, `IS NOT`,
+        `IN`, `NOT IN`, and `MISSING`. */
+    class FilterPredicate {
+    public:
+        /// Compiles the expression; throws a kC4ErrorInvalidQuery error if it's invalid.
+        explicit FilterPredicate(fleece::slice jsonExpression);
+        ~FilterPredicate();
+
+        /// Returns true if the revision matches the expression.
+        bool operator() (fleece::slice docID, C4RevisionFlags, fleece::Dict body) const;
+
+    private:
+        struct Node;
+        struct Result;
+        struct Context;
+
+        std::unique_ptr<Node> compile(fleece::Value);
+        Result eval(const Node&, const Context&) const;
+
+        fleece::Doc             _doc;       // Owns the literals the nodes point to
+        std::unique_ptr<Node>   _root;
+    };
+
+}
+
+CBL_ASSUME_NONNULL_END
@@ -5,6 +5,7 @@ CBL_C {
 		CBL_Release;
 		CBL_InstanceCount;
 		CBL_DumpInstances;
+		CBL_SetAllocator;
 		CBL_Now;
 		CBLError_Message;
 		CBLError_GetCaptureBacktraces;
@@ -24,42 +25,79 @@ CBL_C {
 		CBLBlob_Equals;
 		CBLBlob_Properties;
 		CBLBlob_Content;
+		CBLBlob_ReadRange;
 		CBLBlob_OpenContentStream;
 		CBLBlob_CreateJSON;
 		CBLBlob_CreateWithData;
 		CBLBlob_CreateWithStream;
 		CBLBlobReader_Read;
+		CBLBlobReader_Seek;
+		CBLBlobReader_Length;
 		CBLBlobReader_Close;
+		CBLBlob_MapContent;
+		CBLBlobContentMap_Content;
+		CBLBlobContentMap_IsMapped;
+		CBLBlobContentMap_FileDescriptor;
+		CBLBlobContentMap_Close;
 		CBLBlobWriter_Create;
 		CBLBlobWriter_Close;
 		CBLBlobWriter_Write;
 		CBLDatabase_GetBlob;
 		CBLDatabase_SaveBlob;
+		CBLDatabase_SaveBlobs;
+		CBLDatabase_BlobCacheStats;
+		CBLDatabase_GetBlobStoreStats;
+		CBLDatabase_NewBlobGC;
+		CBLBlobGC_Step;
+		CBLBlobGC_Progress;
 		CBLDatabaseConfiguration_Default;
 		CBL_DatabaseExists;
 		CBL_CopyDatabase;
+		CBL_CopyDatabaseWithProgress;
 		CBL_DeleteDatabase;
 		CBLDatabase_Delete;
 		CBLDatabase_Open;
+		CBLDatabase_OpenShared;
+		CBL_SetDatabaseCacheLimits;
 		CBLDatabase_Close;
 		CBLDatabase_Name;
 		CBLDatabase_Path;
 		CBLDatabase_Config;
 		CBLDatabase_Count;
+		CBLDatabase_SetLockStatsEnabled;
+		CBLDatabase_GetLockStats;
+		CBLDatabase_SetPageCacheSize;
+		CBLDatabase_ReleaseMemory;
+		CBLDatabase_GetMemoryStats;
+		CBL_HandleMemoryPressure;
+		CBLDatabase_GetOpenStats;
 		CBLDatabase_LastSequence;
 		CBLDatabase_Delete;
 		CBLDatabase_BeginTransaction;
 		CBLDatabase_EndTransaction;
 		CBLDatabase_PerformMaintenance;
+		CBLDatabase_ScheduleMaintenance;
+		CBLDatabase_ImportJSONLines;
+		CBLDatabase_ImportJSONLinesFromReader;
+		CBLDatabase_ExportJSONLines;
+		CBLDatabase_EnumerateChanges;
 		CBLDatabase_AddChangeListener;
+		CBLDatabase_AddCoalescedChangeListener;
 		CBLDatabase_AddChangeDetailListener;
 		CBLDatabase_AddDocumentChangeListener;
 		CBLDatabase_BufferNotifications;
 		CBLDatabase_SendNotifications;
 		CBLDatabase_CreateValueIndex;
 		CBLDatabase_CreateFullTextIndex;
+		CBLDatabase_CreateIndexes;
 		CBLDatabase_DeleteIndex;
 		CBLDatabase_GetIndexNames;
+		CBLDatabase_SetIndexStatsEnabled;
+		CBLDatabase_GetIndexStats;
+		CBLDatabase_CreateValueIndexAsync;
+		CBLDatabase_CreateFullTextIndexAsync;
+		CBLIndexBuild_State;
+		CBLIndexBuild_Cancel;
 		CBLDocument_ID;
 		CBLDocument_RevisionID;
 		CBLDocument_CanonicalRevisionID;
@@ -74,44 +112,82 @@ CBL_C {
 		CBLDocument_CreateJSON;
 		CBLDocument_SetJSON;
 		CBLDatabase_GetDocument;
+		CBLDatabase_GetDocuments;
+		CBLDatabase_GetDocumentsProperties;
+		CBLDatabase_GetDocumentAsync;
 		CBLDatabase_GetMutableDocument;
 		CBLDatabase_SaveDocument;
 		CBLDatabase_SaveDocumentWithConcurrencyControl;
 		CBLDatabase_SaveDocumentWithConflictHandler;
+		CBLDatabase_SaveDocuments;
+		CBLDatabase_SaveDocumentAsync;
 		CBLDatabase_DeleteDocument;
 		CBLDatabase_DeleteDocumentWithConcurrencyControl;
 		CBLDatabase_DeleteDocumentByID;
 		CBLDatabase_PurgeDocument;
 		CBLDatabase_PurgeDocumentByID;
+		CBLDatabase_PurgeDocuments;
+		CBLDatabase_PurgeDocumentsWhere;
+		CBLDatabase_EnumerateDocuments;
+		CBLDocEnumerator_Next;
 		CBLDatabase_GetDocumentExpiration;
 		CBLDatabase_SetDocumentExpiration;
+		CBLDatabase_SetDocumentsExpiration;
+		CBLDatabase_NextDocumentExpiration;
+		CBLDatabase_PurgeExpiredDocuments;
 		CBL_Log;
 		CBL_LogMessage;
+		CBL_SetTraceCallback;
 		CBLLog_Callback;
 		CBLLog_SetCallback;
 		CBLLog_CallbackLevel;
 		CBLLog_SetCallbackLevel;
+		CBLLog_DomainLevel;
+		CBLLog_SetDomainLevel;
+		CBLLog_SetCallbackAsync;
+		CBLLog_FlushCallback;
+		CBLLog_DroppedMessageCount;
 		CBLLog_ConsoleLevel;
 		CBLLog_SetConsoleLevel;
 		CBLLog_FileConfig;
 		CBLLog_SetFileConfig;
+		CBLLog_DecodeFile;
 		CBLLog_BeginExpectingExceptions;
 		CBLLog_EndExpectingExceptions;
 		CBLDatabase_CreateQuery;
+		CBLDatabase_CreateFullTextPageQuery;
+		CBLDatabase_QueryCacheStats;
+		CBLDatabase_QueryCount;
+		CBLDatabase_QueryExists;
+		CBLDatabase_PrecompileQueries;
 		CBLQuery_Parameters;
 		CBLQuery_SetParameters;
 		CBLQuery_Execute;
+		CBLQuery_ExecuteWithParameters;
+		CBLQuery_ExecutePageAfter;
+		CBLQuery_ExecuteAsync;
 		CBLQuery_Explain;
 		CBLQuery_ColumnCount;
 		CBLQuery_ColumnName;
 		CBLQuery_AddChangeListener;
+		CBLQuery_AddChangeListenerWithOptions;
+		CBLQuery_AddDeltaListener;
+		CBLQuery_SetListenerPaused;
 		CBLQuery_CopyCurrentResults;
 		CBLResultSet_Next;
 		CBLResultSet_ValueAtIndex;
 		CBLResultSet_ValueForKey;
 		CBLResultSet_ResultArray;
 		CBLResultSet_ResultDict;
+		CBLResultSet_NextBatch;
+		CBLResultSet_NextPage;
+		CBLResultSet_NextColumns;
 		CBLResultSet_GetQuery;
+		CBL_FanOutQuery;
+		CBLFanOutResults_Next;
+		CBLFanOutResults_ValueAtIndex;
+		CBLFanOutResults_ResultArray;
+		CBLFanOutResults_Database;
 		kCBLAuthDefaultCookieName;
 		CBLEndpoint_CreateWithURL;
 		CBLEndpoint_Free;
@@ -127,9 +203,19 @@ CBL_C {
 		CBLReplicator_Status;
 		CBLReplicator_PendingDocumentIDs;
 		CBLReplicator_IsDocumentPending;
+		CBLReplicator_PendingDocumentCount;
+		CBLReplicator_PendingDocumentIDsPage;
+		CBLReplicator_Metrics;
+		CBLReplicatorGroup_Create;
+		CBLReplicatorGroup_Add;
+		CBLReplicatorGroup_Remove;
+		CBLReplicatorGroup_Start;
+		CBLReplicatorGroup_Stop;
+		CBLReplicatorGroup_ActiveCount;
 		CBLReplicator_AddChangeListener;
 		CBLReplicator_AddDocumentReplicationListener;
 		CBLDefaultConflictResolver;
+		CBLDatabase_ResolveAllConflicts;
 		kFLNullValue;
 		kFLUndefinedValue;
 		kFLEmptyArray;
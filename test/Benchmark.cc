@@ -0,0 +1,459 @@
+//
+// Benchmark.cc
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// `cblite_bench`: repeatable micro- and macro-benchmarks of the hot paths of the C API,
+// run against synthetic data, with results written as JSON so they can be tracked over time.
+//
+// Usage: cblite_bench [--docs N] [--iterations N] [--dir PATH] [--output FILE] [--filter STR]
+
+#include "cbl/CouchbaseLite.h"
+#include "fleece/Fleece.hh"
+#include "fleece/Mutable.hh"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace fleece;
+
+
+static constexpr const char* kDBName = "CBLBench";
+static constexpr const char* kOtherDBName = "CBLBench_Other";
+
+
+struct Options {
+    unsigned    docCount    = 10000;
+    unsigned    iterations  = 5;
+    string      directory;
+    string      outputPath;
+    string      filter;
+};
+
+
+struct Result {
+    string          name;
+    uint64_t        ops;            // Number of operations per iteration
+    vector<double>  seconds;        // Elapsed time of each iteration
+};
+
+
+[[noreturn]] static void fail(const char *what, const CBLError &error) {
+    FLSliceResult msg = CBLError_Message(&error);
+    fprintf(stderr, "FATAL: %s: %.*s (%d/%d)\n", what, (int)msg.size, (const char*)msg.buf,
+            error.domain, error.code);
+    FLSliceResult_Release(msg);
+    exit(1);
+}
+
+
+#define CHECK_OK(EXPR, WHAT)  if (!(EXPR)) fail(WHAT, error)
+
+
+static string docIDFor(unsigned i) {
+    char buf[20];
+    snprintf(buf, sizeof(buf), "doc-%07u", i);
+    return buf;
+}
+
+
+/** Generates deterministic synthetic documents. */
+class DataGenerator {
+public:
+    explicit DataGenerator(uint32_t seed =12345) :_rand(seed) { }
+
+    void fill(CBLDocument *doc, unsigned i) {
+        static const char* kCities[] = {"Berlin", "Lima", "Oslo", "Paris", "Quito", "Seoul",
+                                        "Tokyo", "Vienna"};
+        FLMutableDict props = CBLDocument_MutableProperties(doc);
+        MutableDict dict(props);
+        dict["index"] = int64_t(i);
+        dict["number"] = int64_t(_rand() % 100000);
+        dict["city"] = kCities[_rand() % 8];
+        dict["score"] = double(_rand() % 10000) / 100.0;
+        dict["active"] = bool(_rand() % 2);
+        char name[32];
+        snprintf(name, sizeof(name), "user %08x", unsigned(_rand()));
+        dict["name"] = name;
+        auto tags = MutableArray::newArray();
+        for (unsigned t = _rand() % 4; t > 0; --t)
+            tags.append(kCities[_rand() % 8]);
+        dict["tags"] = tags;
+    }
+
+    unsigned nextIndex(unsigned count)      {return unsigned(_rand() % count);}
+
+    void fillBytes(vector<uint8_t> &bytes) {
+        for (auto &b : bytes)
+            b = uint8_t(_rand());
+    }
+
+private:
+    mt19937 _rand;
+};
+
+
+class Benchmark {
+public:
+    explicit Benchmark(const Options &options)
+    :_options(options)
+    {
+        _config = CBLDatabaseConfiguration_Default();
+        if (!_options.directory.empty())
+            _config.directory = slice(_options.directory);
+    }
+
+    ~Benchmark() {
+        closeDBs();
+    }
+
+    void runAll() {
+        auto populate = [&]{ saveDocsInTransaction(); };
+        auto populateIndexed = [&]{ saveDocsInTransaction(); createIndex(); };
+
+        run("save_single",          _options.docCount,  nullptr,  [&]{ saveDocs(1); });
+        run("save_batch_100",       _options.docCount,  nullptr,  [&]{ saveDocs(100); });
+        run("save_transaction",     _options.docCount,  nullptr,  [&]{ saveDocsInTransaction(); });
+        run("get_document",         _options.docCount,  populate, [&]{ getDocs(); });
+        run("query_unindexed",      100,                populate, [&]{ query(100); });
+        run("query_indexed",        100,        populateIndexed,  [&]{ query(100); });
+        run("result_set_iterate",   _options.docCount,  populate, [&]{ iterateAll(); });
+        run("blob_write_1mb",       16,                 nullptr,  [&]{ writeBlobs(16); });
+        run("blob_read_1mb",        16, [&]{ writeBlobs(16); },   [&]{ readBlobs(); });
+#ifdef COUCHBASE_ENTERPRISE
+        run("replicate_local_push", _options.docCount,  populate, [&]{ replicateLocal(); });
+#endif
+    }
+
+    void writeJSON(ostream &out) const {
+        JSONEncoder enc;
+        enc.beginDict();
+        enc.writeKey("version");
+        enc.writeString(CBLITE_VERSION);
+        enc.writeKey("docCount");
+        enc.writeUInt(_options.docCount);
+        enc.writeKey("iterations");
+        enc.writeUInt(_options.iterations);
+        enc.writeKey("benchmarks");
+        enc.beginArray();
+        for (const Result &r : _results) {
+            vector<double> sorted = r.seconds;
+            sort(sorted.begin(), sorted.end());
+            double total = 0;
+            for (double s : sorted)
+                total += s;
+            double median = sorted[sorted.size() / 2];
+            enc.beginDict();
+            enc.writeKey("name");
+            enc.writeString(r.name);
+            enc.writeKey("ops");
+            enc.writeUInt(r.ops);
+            enc.writeKey("min_sec");
+            enc.writeDouble(sorted.front());
+            enc.writeKey("median_sec");
+            enc.writeDouble(median);
+            enc.writeKey("max_sec");
+            enc.writeDouble(sorted.back());
+            enc.writeKey("mean_sec");
+            enc.writeDouble(total / sorted.size());
+            enc.writeKey("ops_per_sec");
+            enc.writeDouble(median > 0 ? r.ops / median : 0.0);
+            enc.endDict();
+        }
+        enc.endArray();
+        enc.endDict();
+        out << string(enc.finish()) << "\n";
+    }
+
+private:
+    using Body = function<void()>;
+
+    // Runs a benchmark `iterations` times, each on a fresh database prepared by `setup`;
+    // only `body` is timed.
+    void run(const char *name, uint64_t ops, Body setup, Body body) {
+        if (!_options.filter.empty() && !strstr(name, _options.filter.c_str()))
+            return;
+        cerr << "Running " << name << "..." << flush;
+        Result result {name, ops, {}};
+        for (unsigned i = 0; i < _options.iterations; ++i) {
+            openFreshDBs();
+            if (setup)
+                setup();
+            auto start = chrono::steady_clock::now();
+            body();
+            auto end = chrono::steady_clock::now();
+            result.seconds.push_back(chrono::duration<double>(end - start).count());
+        }
+        closeDBs();
+        cerr << " " << result.seconds.front() << " sec\n";
+        _results.push_back(std::move(result));
+    }
+
+    void openFreshDBs() {
+        closeDBs();
+        CBLError error;
+        for (const char *name : {kDBName, kOtherDBName}) {
+            if (!CBL_DeleteDatabase(slice(name), _config.directory, &error) && error.code != 0)
+                fail("deleting database", error);
+        }
+        _db = CBLDatabase_Open(slice(kDBName), &_config, &error);
+        CHECK_OK(_db, "opening database");
+        _blobDocIDs.clear();
+    }
+
+    void closeDBs() {
+        CBLError error;
+        for (CBLDatabase **db : {&_db, &_otherDB}) {
+            if (*db) {
+                CHECK_OK(CBLDatabase_Close(*db, &error), "closing database");
+                CBLDatabase_Release(*db);
+                *db = nullptr;
+            }
+        }
+    }
+
+    void createIndex() {
+        CBLError error;
+        CBLValueIndexConfiguration config = {};
+        config.expressionLanguage = kCBLN1QLLanguage;
+        config.expressions = "number"_sl;
+        CHECK_OK(CBLDatabase_CreateValueIndex(_db, "numbers"_sl, config, &error), "indexing");
+    }
+
+    // Saves the synthetic docs, `batchSize` at a time.
+    void saveDocs(unsigned batchSize) {
+        CBLError error;
+        DataGenerator gen;
+        vector<CBLDocument*> docs;
+        for (unsigned i = 0; i < _options.docCount; ) {
+            unsigned n = min(batchSize, _options.docCount - i);
+            for (unsigned j = 0; j < n; ++j, ++i) {
+                CBLDocument *doc = CBLDocument_CreateWithID(slice(docIDFor(i)));
+                gen.fill(doc, i);
+                docs.push_back(doc);
+            }
+            if (batchSize == 1) {
+                CHECK_OK(CBLDatabase_SaveDocument(_db, docs[0], &error), "saving");
+            } else {
+                CHECK_OK(CBLDatabase_SaveDocuments(_db, docs.data(), docs.size(),
+                                                   kCBLConcurrencyControlLastWriteWins,
+                                                   nullptr, &error), "saving batch");
+            }
+            for (CBLDocument *doc : docs)
+                CBLDocument_Release(doc);
+            docs.clear();
+        }
+    }
+
+    // Saves the synthetic docs one at a time inside a single transaction.
+    void saveDocsInTransaction() {
+        CBLError error;
+        DataGenerator gen;
+        CHECK_OK(CBLDatabase_BeginTransaction(_db, &error), "beginning transaction");
+        for (unsigned i = 0; i < _options.docCount; ++i) {
+            CBLDocument *doc = CBLDocument_CreateWithID(slice(docIDFor(i)));
+            gen.fill(doc, i);
+            CHECK_OK(CBLDatabase_SaveDocument(_db, doc, &error), "saving");
+            CBLDocument_Release(doc);
+        }
+        CHECK_OK(CBLDatabase_EndTransaction(_db, true, &error), "committing");
+    }
+
+    // Reads docs in a random order.
+    void getDocs() {
+        CBLError error;
+        DataGenerator gen(54321);
+        for (unsigned i = 0; i < _options.docCount; ++i) {
+            auto docID = docIDFor(gen.nextIndex(_options.docCount));
+            const CBLDocument *doc = CBLDatabase_GetDocument(_db, slice(docID), &error);
+            CHECK_OK(doc, "getting document");
+            CBLDocument_Release(doc);
+        }
+    }
+
+    // Runs a parameterized range query `times` times.
+    void query(unsigned times) {
+        CBLError error;
+        CBLQuery *query = CBLDatabase_CreateQuery(_db, kCBLN1QLLanguage,
+                            "SELECT meta().id, number FROM _ WHERE number BETWEEN $lo AND $hi"_sl,
+                            nullptr, &error);
+        CHECK_OK(query, "compiling query");
+        DataGenerator gen(999);
+        for (unsigned i = 0; i < times; ++i) {
+            int64_t lo = gen.nextIndex(99000);
+            auto params = MutableDict::newDict();
+            params["lo"] = lo;
+            params["hi"] = lo + 1000;
+            CBLQuery_SetParameters(query, params);
+            CBLResultSet *rs = CBLQuery_Execute(query, &error);
+            CHECK_OK(rs, "running query");
+            while (CBLResultSet_Next(rs))
+                ;
+            CBLResultSet_Release(rs);
+        }
+        CBLQuery_Release(query);
+    }
+
+    // Iterates over every doc with a query, reading each column.
+    void iterateAll() {
+        CBLError error;
+        CBLQuery *query = CBLDatabase_CreateQuery(_db, kCBLN1QLLanguage,
+                                                  "SELECT name, number, score FROM _"_sl,
+                                                  nullptr, &error);
+        CHECK_OK(query, "compiling query");
+        CBLResultSet *rs = CBLQuery_Execute(query, &error);
+        CHECK_OK(rs, "running query");
+        uint64_t rows = 0;
+        double sum = 0;
+        while (CBLResultSet_Next(rs)) {
+            (void)FLValue_AsString(CBLResultSet_ValueAtIndex(rs, 0));
+            sum += FLValue_AsInt(CBLResultSet_ValueAtIndex(rs, 1));
+            sum += FLValue_AsDouble(CBLResultSet_ValueAtIndex(rs, 2));
+            ++rows;
+        }
+        CBLResultSet_Release(rs);
+        CBLQuery_Release(query);
+        if (rows != _options.docCount)
+            cerr << "Warning: query returned " << rows << " rows\n";
+    }
+
+    // Writes `count` 1MB blobs with a write stream, each in its own document.
+    void writeBlobs(unsigned count) {
+        CBLError error;
+        DataGenerator gen;
+        vector<uint8_t> chunk(64 * 1024);
+        for (unsigned i = 0; i < count; ++i) {
+            CBLBlobWriteStream *writer = CBLBlobWriter_Create(_db, &error);
+            CHECK_OK(writer, "creating blob writer");
+            for (unsigned c = 0; c < 16; ++c) {
+                gen.fillBytes(chunk);
+                CHECK_OK(CBLBlobWriter_Write(writer, chunk.data(), chunk.size(), &error),
+                         "writing blob");
+            }
+            CBLBlob *blob = CBLBlob_CreateWithStream("application/octet-stream"_sl, writer);
+            string docID = "blob-" + to_string(i);
+            CBLDocument *doc = CBLDocument_CreateWithID(slice(docID));
+            FLSlot_SetBlob(FLMutableDict_Set(CBLDocument_MutableProperties(doc), "blob"_sl), blob);
+            CHECK_OK(CBLDatabase_SaveDocument(_db, doc, &error), "saving blob doc");
+            CBLDocument_Release(doc);
+            CBLBlob_Release(blob);
+            _blobDocIDs.push_back(docID);
+        }
+    }
+
+    // Reads back the blobs written by `writeBlobs` with a read stream.
+    void readBlobs() {
+        CBLError error;
+        vector<uint8_t> buffer(64 * 1024);
+        for (const string &docID : _blobDocIDs) {
+            const CBLDocument *doc = CBLDatabase_GetDocument(_db, slice(docID), &error);
+            CHECK_OK(doc, "getting blob doc");
+            const CBLBlob *blob = FLDict_GetBlob(FLValue_AsDict(
+                                        FLDict_Get(CBLDocument_Properties(doc), "blob"_sl)));
+            CHECK_OK(blob, "getting blob");
+            CBLBlobReadStream *reader = CBLBlob_OpenContentStream(blob, &error);
+            CHECK_OK(reader, "opening blob stream");
+            int n;
+            while ((n = CBLBlobReader_Read(reader, buffer.data(), buffer.size(), &error)) > 0)
+                ;
+            CHECK_OK(n == 0, "reading blob");
+            CBLBlobReader_Close(reader);
+            CBLDocument_Release(doc);
+        }
+    }
+
+#ifdef COUCHBASE_ENTERPRISE
+    // Pushes all the docs to a second local database.
+    void replicateLocal() {
+        CBLError error;
+        _otherDB = CBLDatabase_Open(slice(kOtherDBName), &_config, &error);
+        CHECK_OK(_otherDB, "opening other database");
+        CBLReplicatorConfiguration config = {};
+        config.database = _db;
+        config.endpoint = CBLEndpoint_CreateWithLocalDB(_otherDB);
+        config.replicatorType = kCBLReplicatorTypePush;
+        CBLReplicator *repl = CBLReplicator_Create(&config, &error);
+        CBLEndpoint_Free(config.endpoint);
+        CHECK_OK(repl, "creating replicator");
+        CBLReplicator_Start(repl, false);
+        CBLReplicatorStatus status;
+        while ((status = CBLReplicator_Status(repl)).activity != kCBLReplicatorStopped)
+            this_thread::sleep_for(chrono::milliseconds(2));
+        error = status.error;
+        CHECK_OK(error.code == 0, "replicating");
+        CBLReplicator_Release(repl);
+    }
+#endif
+
+    Options const               _options;
+    CBLDatabaseConfiguration    _config;
+    CBLDatabase*                _db = nullptr;
+    CBLDatabase*                _otherDB = nullptr;
+    vector<string>              _blobDocIDs;
+    vector<Result>              _results;
+};
+
+
+static void usage() {
+    cerr << "Usage: cblite_bench [--docs N] [--iterations N] [--dir PATH] [--output FILE]"
+            " [--filter STR]\n";
+    exit(2);
+}
+
+
+int main(int argc, const char *argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc)
+            usage();
+        const char *value = argv[++i];
+        if (arg == "--docs")
+            options.docCount = unsigned(max(1, atoi(value)));
+        else if (arg == "--iterations")
+            options.iterations = unsigned(max(1, atoi(value)));
+        else if (arg == "--dir")
+            options.directory = value;
+        else if (arg == "--output")
+            options.outputPath = value;
+        else if (arg == "--filter")
+            options.filter = value;
+        else
+            usage();
+    }
+
+    CBLLog_SetConsoleLevel(kCBLLogWarning);
+
+    Benchmark bench(options);
+    bench.runAll();
+    if (options.outputPath.empty()) {
+        bench.writeJSON(cout);
+    } else {
+        ofstream out(options.outputPath);
+        bench.writeJSON(out);
+    }
+    return 0;
+}
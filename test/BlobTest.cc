@@ -18,7 +18,12 @@
 
 #include "CBLTest.hh"
 #include "CBLPrivate.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace fleece;
 using namespace std;
@@ -113,3 +118,211 @@ TEST_CASE_METHOD(BlobTest, "Create JSON from Blob", "[Blob]") {
     CHECK(alloc_slice(CBLBlob_CreateJSON(gotBlob)) == "{\"content_type\":\"text/plain\",\"digest\":\"sha1-dXNgUcxC3n7lxfrYkbLUG4gOKRw=\",\"length\":34,\"@type\":\"blob\"}"_sl);
     CBLDocument_Release(doc);
 }
+
+
+TEST_CASE_METHOD(BlobTest, "Map blob content", "[Blob]") {
+    alloc_slice content("This is the content of the blob to be mapped.");
+    CBLBlob* blob = CBLBlob_CreateWithData("text/plain"_sl, content);
+
+    CBLError error;
+    auto doc = CBLDocument_CreateWithID("doc1"_sl);
+    auto props = CBLDocument_MutableProperties(doc);
+    FLMutableDict_SetBlob(props, "blob"_sl, blob);
+    REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLBlob_Release(blob);
+    CBLDocument_Release(doc);
+
+    const CBLDocument* savedDoc = CBLDatabase_GetDocument(db, "doc1"_sl, &error);
+    REQUIRE(savedDoc);
+    const CBLBlob* gotBlob = FLValue_GetBlob(FLDict_Get(CBLDocument_Properties(savedDoc), "blob"_sl));
+    REQUIRE(gotBlob);
+
+    CBLBlobContentMap* map = CBLBlob_MapContent(gotBlob, &error);
+    REQUIRE(map);
+    CHECK(slice(CBLBlobContentMap_Content(map)) == content);
+#ifndef _WIN32
+    // The test database isn't encrypted, so the blob's file can be mapped:
+    CHECK(CBLBlobContentMap_IsMapped(map));
+    CHECK(CBLBlobContentMap_FileDescriptor(map) >= 0);
+#endif
+    CBLBlobContentMap_Close(map);
+    CBLDocument_Release(savedDoc);
+}
+
+
+TEST_CASE_METHOD(BlobTest, "Read blob range and seek", "[Blob]") {
+    alloc_slice content("0123456789abcdefghijklmnopqrstuvwxyz");
+    CBLBlob* blob = CBLBlob_CreateWithData("text/plain"_sl, content);
+
+    // An unsaved blob's range comes from memory:
+    CBLError error;
+    CHECK(alloc_slice(CBLBlob_ReadRange(blob, 10, 6, &error)) == "abcdef"_sl);
+
+    auto doc = CBLDocument_CreateWithID("doc1"_sl);
+    auto props = CBLDocument_MutableProperties(doc);
+    FLMutableDict_SetBlob(props, "blob"_sl, blob);
+    REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLBlob_Release(blob);
+    CBLDocument_Release(doc);
+
+    const CBLDocument* savedDoc = CBLDatabase_GetDocument(db, "doc1"_sl, &error);
+    REQUIRE(savedDoc);
+    const CBLBlob* gotBlob = FLValue_GetBlob(FLDict_Get(CBLDocument_Properties(savedDoc), "blob"_sl));
+    REQUIRE(gotBlob);
+
+    CHECK(alloc_slice(CBLBlob_ReadRange(gotBlob, 10, 6, &error)) == "abcdef"_sl);
+    CHECK(alloc_slice(CBLBlob_ReadRange(gotBlob, 30, 100, &error)) == "uvwxyz"_sl);
+    alloc_slice empty = CBLBlob_ReadRange(gotBlob, content.size, 10, &error);
+    CHECK(empty.size == 0);
+    {
+        ExpectingExceptions x;
+        CHECK(!alloc_slice(CBLBlob_ReadRange(gotBlob, content.size + 1, 10, &error)));
+        CHECK(error.code == kCBLErrorInvalidParameter);
+    }
+
+    CBLBlobReadStream* stream = CBLBlob_OpenContentStream(gotBlob, &error);
+    REQUIRE(stream);
+    CHECK(CBLBlobReader_Length(stream, &error) == int64_t(content.size));
+    REQUIRE(CBLBlobReader_Seek(stream, 20, &error));
+    char buf[4];
+    CHECK(CBLBlobReader_Read(stream, buf, sizeof(buf), &error) == 4);
+    CHECK(slice(buf, 4) == "klmn"_sl);
+    REQUIRE(CBLBlobReader_Seek(stream, 0, &error));
+    CHECK(CBLBlobReader_Read(stream, buf, sizeof(buf), &error) == 4);
+    CHECK(slice(buf, 4) == "0123"_sl);
+    {
+        ExpectingExceptions x;
+        CHECK(!CBLBlobReader_Seek(stream, content.size + 1, &error));
+        CHECK(error.code == kCBLErrorInvalidParameter);
+    }
+    CBLBlobReader_Close(stream);
+    CBLDocument_Release(savedDoc);
+}
+
+
+TEST_CASE_METHOD(BlobTest, "Save many blobs", "[Blob]") {
+    constexpr size_t kNumBlobs = 20;
+    vector<string> contents;
+    vector<CBLBlob*> blobs;
+    for (size_t i = 0; i < kNumBlobs; ++i) {
+        contents.push_back("This is the content of blob #" + to_string(i));
+        blobs.push_back(CBLBlob_CreateWithData("text/plain"_sl, slice(contents.back())));
+    }
+
+    CBLError error;
+    SECTION("Batch") {
+        REQUIRE(CBLDatabase_SaveBlobs(db, blobs.data(), blobs.size(), &error));
+    }
+    SECTION("In a document") {
+        auto doc = CBLDocument_CreateWithID("doc1"_sl);
+        auto props = CBLDocument_MutableProperties(doc);
+        FLMutableArray array = FLMutableArray_New();
+        for (auto blob : blobs)
+            FLMutableArray_AppendBlob(array, blob);
+        FLSlot_SetArray(FLMutableDict_Set(props, "images"_sl), array);
+        FLMutableArray_Release(array);
+        REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+        CBLDocument_Release(doc);
+    }
+
+    for (size_t i = 0; i < kNumBlobs; ++i) {
+        FLSliceResult gotContent = CBLBlob_Content(blobs[i], &error);
+        CHECK(slice(gotContent) == slice(contents[i]));
+        FLSliceResult_Release(gotContent);
+        CBLBlob_Release(blobs[i]);
+    }
+}
+
+
+TEST_CASE_METHOD(BlobTest, "Blob store stats and GC", "[Blob]") {
+    // Two docs share one blob; another blob is saved without being used:
+    CBLError error;
+    CBLBlob* shared = CBLBlob_CreateWithData("text/plain"_sl, "This blob is used twice."_sl);
+    for (slice docID : {"doc1"_sl, "doc2"_sl}) {
+        auto doc = CBLDocument_CreateWithID(docID);
+        FLMutableDict_SetBlob(CBLDocument_MutableProperties(doc), "blob"_sl, shared);
+        REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+        CBLDocument_Release(doc);
+    }
+    CBLBlob* unused = CBLBlob_CreateWithData("text/plain"_sl, "This blob isn't used at all."_sl);
+    REQUIRE(CBLDatabase_SaveBlob(db, unused, &error));
+    uint64_t sharedSize = CBLBlob_Length(shared), unusedSize = CBLBlob_Length(unused);
+
+    CBLBlobStoreStats stats;
+    CBLBlobSize largest[4];
+    REQUIRE(CBLDatabase_GetBlobStoreStats(db, &stats, largest, 4, &error));
+    CHECK(stats.blobCount == 2);
+    CHECK(stats.totalBytes == sharedSize + unusedSize);
+    CHECK(stats.reachableCount == 1);
+    CHECK(stats.reachableBytes == sharedSize);
+    CHECK(stats.referenceCount == 2);
+    CHECK(stats.referencedBytes == 2 * sharedSize);
+    REQUIRE(stats.largestCount == 2);
+    CHECK(slice(largest[0].digest) == slice(CBLBlob_Digest(unused)));
+    CHECK(largest[0].size == unusedSize);
+    CHECK(largest[1].size == sharedSize);
+
+    // Collect a doc at a time; only the unused blob goes:
+    CBLBlobGC* gc = CBLDatabase_NewBlobGC(db, &error);
+    REQUIRE(gc);
+    unsigned steps = 0;
+    while (CBLBlobGC_Step(gc, 1, &error))
+        ++steps;
+    CHECK(error.code == 0);
+    CHECK(steps >= 3);
+    CBLBlobGCProgress progress = CBLBlobGC_Progress(gc);
+    CHECK(progress.done);
+    CHECK(progress.blobsFound == 2);
+    CHECK(progress.docsScanned >= 2);
+    CHECK(progress.blobsDeleted == 1);
+    CHECK(progress.bytesFreed == unusedSize);
+    CBLBlobGC_Release(gc);
+
+    REQUIRE(CBLDatabase_GetBlobStoreStats(db, &stats, nullptr, 0, &error));
+    CHECK(stats.blobCount == 1);
+    CHECK(stats.reachableCount == 1);
+    alloc_slice content = CBLBlob_Content(shared, &error);
+    CHECK(content == "This blob is used twice."_sl);
+    CBLBlob_Release(shared);
+    CBLBlob_Release(unused);
+}
+
+
+TEST_CASE_METHOD(BlobTest, "Save blob in a transaction during compaction", "[Blob]") {
+    // A compaction holds the blob GC lock while it waits for the open transaction; a save in
+    // that transaction mustn't wait for the lock, but install its blob in the transaction:
+    struct Progress {
+        mutex m;
+        condition_variable cond;
+        bool finished = false;
+    } progress;
+    auto callback = [](void *context, unsigned done, unsigned count, bool finished,
+                       const CBLError *err) {
+        auto p = (Progress*)context;
+        lock_guard<mutex> lock(p->m);
+        p->finished = finished;
+        p->cond.notify_all();
+        return true;
+    };
+
+    CBLError error;
+    REQUIRE(CBLDatabase_BeginTransaction(db, &error));
+    CBLMaintenanceType compact = kCBLMaintenanceTypeCompact;
+    REQUIRE(CBLDatabase_ScheduleMaintenance(db, &compact, 1, 0.0, callback, &progress, &error));
+    this_thread::sleep_for(chrono::milliseconds(100));
+
+    CBLBlob* blob = CBLBlob_CreateWithData("text/plain"_sl, "Saved during compaction."_sl);
+    auto doc = CBLDocument_CreateWithID("doc"_sl);
+    FLMutableDict_SetBlob(CBLDocument_MutableProperties(doc), "blob"_sl, blob);
+    REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLDocument_Release(doc);
+    REQUIRE(CBLDatabase_EndTransaction(db, true, &error));
+
+    {
+        unique_lock<mutex> lock(progress.m);
+        REQUIRE(progress.cond.wait_for(lock, chrono::seconds(20), [&]{return progress.finished;}));
+    }
+    alloc_slice content = CBLBlob_Content(blob, &error);
+    CHECK(content == "Saved during compaction."_sl);
+    CBLBlob_Release(blob);
+}
@@ -110,6 +110,15 @@ TEST_CASE_METHOD(CBLTest_Cpp, "C++ Blob", "[Blob]") {
             CHECK(string(buf, n) == "This is th");
         }
 
+        {
+            unique_ptr<BlobReadStream> in(blob.openContentStream());
+            CHECK(in->length() == kBlobContents.size);
+            in->seek(20);
+            size_t n = in->read(buf, 10);
+            CHECK(string(buf, n) == "of the blo");
+            CHECK(blob.loadRange(8, 3) == "the"_sl);
+        }
+
         Blob blob2(doc["picture"].asDict());
         CHECK(blob2 == blob);
     }
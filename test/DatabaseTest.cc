@@ -20,8 +20,14 @@
 #include "CBLPrivate.h"
 #include "fleece/Fleece.hh"
 #include "fleece/Mutable.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 using namespace std;
 using namespace fleece;
@@ -90,6 +96,40 @@ TEST_CASE_METHOD(DatabaseTest, "Database w/o config") {
 }
 
 
+// A counting allocator, installed while the test binary starts up, before any object exists:
+static atomic<uint64_t> sCustomAllocs {0}, sCustomFrees {0};
+static const bool sCustomAllocatorSet = [] {
+    static const CBLAllocator allocator = {
+        [](void*, size_t size) -> void* {++sCustomAllocs; return malloc(size);},
+        [](void*, void *ptr, size_t) {++sCustomFrees; free(ptr);},
+        nullptr
+    };
+    return CBL_SetAllocator(&allocator);
+}();
+
+
+TEST_CASE_METHOD(DatabaseTest, "Custom Allocator") {
+    REQUIRE(sCustomAllocatorSet);
+    uint64_t allocs = sCustomAllocs, frees = sCustomFrees;
+    CBLDocument *doc = CBLDocument_CreateWithID("doc"_sl);
+    CHECK(sCustomAllocs > allocs);
+    CBLDocument_Release(doc);
+    CHECK(sCustomFrees > frees);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Set Allocator Too Late") {
+    // The database already exists, so its allocator can't change:
+    CBLAllocator allocator = {
+        [](void*, size_t size) -> void* {return malloc(size);},
+        [](void*, void *ptr, size_t) {free(ptr);},
+        nullptr
+    };
+    CHECK(!CBL_SetAllocator(&allocator));
+    CHECK(!CBL_SetAllocator(nullptr));
+}
+
+
 #ifdef COUCHBASE_ENTERPRISE
 
 TEST_CASE_METHOD(DatabaseTest, "Database Encryption") {
@@ -138,11 +178,86 @@ TEST_CASE_METHOD(DatabaseTest, "Database Encryption") {
         CHECK(error.code == kCBLErrorNotADatabaseFile);
     }
 
+    // The same derived key can be reused, then cleared:
+    CBLDatabase_Release(defaultdb);
+    defaultdb = CBLDatabase_Open("encdb"_sl, &config, &error);
+    REQUIRE(defaultdb);
+    CBLEncryptionKey_Clear(&config.encryptionKey);
+    CHECK(config.encryptionKey.algorithm == kCBLEncryptionNone);
+    uint8_t zeroes[32] = {};
+    CHECK(memcmp(config.encryptionKey.bytes, zeroes, sizeof(zeroes)) == 0);
+
     CHECK(CBLDatabase_Delete(defaultdb, &error));
     CBLDatabase_Release(defaultdb);
     CHECK(!CBL_DatabaseExists("encdb"_sl, nullslice));
 }
 
+
+TEST_CASE_METHOD(DatabaseTest, "Change Encryption Key Async") {
+    CBLError error;
+    CBLDatabaseConfiguration config = kDatabaseConfiguration;
+    config.readerCount = 2;
+    REQUIRE(CBLEncryptionKey_FromPassword(&config.encryptionKey, "sekrit"_sl));
+    otherDB = CBLDatabase_Open(kOtherDBName, &config, &error);
+    REQUIRE(otherDB);
+    createDocument(otherDB, "doc1", "foo", "bar");
+
+    CBLQuery* query = CBLDatabase_CreateQuery(otherDB, kCBLN1QLLanguage,
+                                              "SELECT foo FROM _"_sl, nullptr, &error);
+    REQUIRE(query);
+    auto checkQuery = [&] {
+        CBLResultSet* results = CBLQuery_Execute(query, &error);
+        REQUIRE(results);
+        CHECK(CBLResultSet_Next(results));
+        CHECK(Value(CBLResultSet_ValueAtIndex(results, 0)).asString() == "bar"_sl);
+        CBLResultSet_Release(results);
+    };
+    checkQuery();
+
+    struct Result {
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool done = false;
+        CBLError error = {};
+    } result;
+    CBLEncryptionKey newKey;
+    REQUIRE(CBLEncryptionKey_FromPassword(&newKey, "new-sekrit"_sl));
+    CBLDatabase_ChangeEncryptionKeyAsync(otherDB, &newKey,
+                                         [](void *context, CBLDatabase*, const CBLError *error) {
+        auto r = (Result*)context;
+        std::lock_guard<std::mutex> lock(r->mutex);
+        if (error)
+            r->error = *error;
+        r->done = true;
+        r->cond.notify_all();
+    }, &result);
+    {
+        std::unique_lock<std::mutex> lock(result.mutex);
+        REQUIRE(result.cond.wait_for(lock, std::chrono::seconds(30), [&]{return result.done;}));
+    }
+    CHECK(result.error.code == 0);
+
+    // The readers reopen with the new key, and the query is compiled again on them:
+    for (int i = 0; i < 3; ++i)
+        checkQuery();
+    CBLQuery_Release(query);
+    CHECK(memcmp(CBLDatabase_Config(otherDB).encryptionKey.bytes, newKey.bytes, 32) == 0);
+
+    CBLDatabase_Release(otherDB);
+    otherDB = nullptr;
+    {
+        ExpectingExceptions x;
+        CHECK(!CBLDatabase_Open(kOtherDBName, &config, &error));
+        CHECK(error.code == kCBLErrorNotADatabaseFile);
+    }
+    config.encryptionKey = newKey;
+    otherDB = CBLDatabase_Open(kOtherDBName, &config, &error);
+    REQUIRE(otherDB);
+    CHECK(CBLDatabase_Count(otherDB) == 1);
+    CBLEncryptionKey_Clear(&newKey);
+    CBLEncryptionKey_Clear(&config.encryptionKey);
+}
+
 #endif
 
 
@@ -371,6 +486,93 @@ TEST_CASE_METHOD(DatabaseTest, "Access nested collections from a copy of modifie
     CBLDocument_Release(doc);
 }
 
+TEST_CASE_METHOD(DatabaseTest, "Copy of modified mutable doc shares unmodified collections") {
+    CBLError error;
+    CBLDocument* doc = CBLDocument_CreateWithID("foo"_sl);
+    REQUIRE(CBLDocument_SetJSON(doc, "{\"name\":{\"first\": \"Jane\"}, \"phones\": [\"650-123-4567\"]}"_sl, &error));
+    REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLDocument_Release(doc);
+
+    // Only the modified Dict is promoted to mutable:
+    doc = CBLDatabase_GetMutableDocument(db, "foo"_sl, &error);
+    REQUIRE(doc);
+    FLMutableDict mProps = CBLDocument_MutableProperties(doc);
+    FLMutableDict mDict = FLMutableDict_GetMutableDict(mProps, "name"_sl);
+    REQUIRE(mDict);
+    FLMutableDict_SetString(mDict, "first"_sl, "Julie"_sl);
+    CHECK(!FLArray_AsMutable(FLValue_AsArray(FLDict_Get(mProps, "phones"_sl))));
+
+    // The copy gets its own copy of the modified Dict, but shares the unmodified Array:
+    CBLDocument* mDoc = CBLDocument_MutableCopy(doc);
+    FLMutableDict mProps2 = CBLDocument_MutableProperties(mDoc);
+    FLMutableDict mDict2 = FLDict_AsMutable(FLValue_AsDict(FLDict_Get(mProps2, "name"_sl)));
+    REQUIRE(mDict2);
+    CHECK(mDict2 != mDict);
+    CHECK(!FLArray_AsMutable(FLValue_AsArray(FLDict_Get(mProps2, "phones"_sl))));
+
+    FLMutableDict_SetString(mDict2, "first"_sl, "Jill"_sl);
+    FLMutableArray mArray2 = FLMutableDict_GetMutableArray(mProps2, "phones"_sl);
+    REQUIRE(mArray2);
+    FLMutableArray_SetString(mArray2, 0, "415-123-4567"_sl);
+    CHECK(FLValue_AsString(FLDict_Get(mDict, "first"_sl)) == "Julie"_sl);
+    CHECK(alloc_slice(CBLDocument_CreateJSON(doc)) ==
+          "{\"name\":{\"first\":\"Julie\"},\"phones\":[\"650-123-4567\"]}"_sl);
+
+    CBLDocument_Release(mDoc);
+    CBLDocument_Release(doc);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Mutable copy of a doc with JSON properties") {
+    CBLError error;
+    CBLDocument* doc = CBLDocument_CreateWithID("foo"_sl);
+    REQUIRE(CBLDocument_SetJSON(doc, "{\"greeting\":\"Howdy!\"}"_sl, &error));
+    CBLDocument* mDoc = CBLDocument_MutableCopy(doc);
+    CHECK(alloc_slice(CBLDocument_CreateJSON(mDoc)) == "{\"greeting\":\"Howdy!\"}"_sl);
+    CBLDocument_Release(mDoc);
+    CBLDocument_Release(doc);
+}
+
+TEST_CASE_METHOD(DatabaseTest, "Save unmodified and partially modified doc") {
+    CBLError error;
+    CBLDocument* doc = CBLDocument_CreateWithID("foo"_sl);
+    REQUIRE(CBLDocument_SetJSON(doc, "{\"a\":{\"x\":1},\"b\":[{\"y\":2}]}"_sl, &error));
+    REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLDocument_Release(doc);
+
+    // Saving without accessing or modifying the properties reuses the revision's body:
+    doc = CBLDatabase_GetMutableDocument(db, "foo"_sl, &error);
+    REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLDocument_Release(doc);
+    doc = CBLDatabase_GetMutableDocument(db, "foo"_sl, &error);
+    CHECK(CBLDocument_Sequence(doc) == 2);
+    CHECK(Dict(CBLDocument_Properties(doc)).toJSONString() == "{\"a\":{\"x\":1},\"b\":[{\"y\":2}]}");
+    REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLDocument_Release(doc);
+
+    // Modifying one branch:
+    doc = CBLDatabase_GetMutableDocument(db, "foo"_sl, &error);
+    FLMutableDict a = FLMutableDict_GetMutableDict(CBLDocument_MutableProperties(doc), "a"_sl);
+    FLMutableDict_SetInt(a, "x"_sl, 10);
+    REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLDocument_Release(doc);
+    doc = CBLDatabase_GetMutableDocument(db, "foo"_sl, &error);
+    CHECK(CBLDocument_Sequence(doc) == 4);
+    CHECK(Dict(CBLDocument_Properties(doc)).toJSONString() == "{\"a\":{\"x\":10},\"b\":[{\"y\":2}]}");
+
+    // Replacing the properties with a new dict isn't mistaken for no change:
+    FLMutableDict props = FLMutableDict_New();
+    FLMutableDict_SetString(props, "c"_sl, "new"_sl);
+    CBLDocument_SetProperties(doc, props);
+    FLMutableDict_Release(props);
+    REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLDocument_Release(doc);
+    const CBLDocument* rdoc = CBLDatabase_GetDocument(db, "foo"_sl, &error);
+    CHECK(Dict(CBLDocument_Properties(rdoc)).toJSONString() == "{\"c\":\"new\"}");
+    CBLDocument_Release(rdoc);
+}
+
+
 TEST_CASE_METHOD(DatabaseTest, "Set MutableProperties") {
     CBLDocument* doc1 = CBLDocument_Create();
     FLMutableDict prop1 = CBLDocument_MutableProperties(doc1);
@@ -402,6 +604,41 @@ TEST_CASE_METHOD(DatabaseTest, "Get Document with Empty ID") {
     CHECK(error.code == 0);
 }
 
+TEST_CASE_METHOD(DatabaseTest, "Get Multiple Documents") {
+    createDocument(db, "doc1", "foo", "bar1");
+    createDocument(db, "doc2", "foo", "bar2");
+    CBLError error;
+    REQUIRE(CBLDatabase_DeleteDocumentByID(db, "doc2"_sl, &error));
+    createDocument(db, "doc3", "foo", "bar3");
+
+    FLString docIDs[4] = {"doc1"_sl, "doc2"_sl, "doc3"_sl, "nope"_sl};
+    const CBLDocument* docs[4];
+    REQUIRE(CBLDatabase_GetDocuments(db, docIDs, 4, docs, &error));
+    REQUIRE(docs[0]);
+    CHECK(CBLDocument_ID(docs[0]) == "doc1"_sl);
+    CHECK(Dict(CBLDocument_Properties(docs[0])).toJSONString() == "{\"foo\":\"bar1\"}");
+    CHECK(!docs[1]);
+    REQUIRE(docs[2]);
+    CHECK(CBLDocument_ID(docs[2]) == "doc3"_sl);
+    CHECK(!docs[3]);
+    for (auto doc : docs)
+        CBLDocument_Release(doc);
+
+    FLDict props = CBLDatabase_GetDocumentsProperties(db, docIDs, 4, &error);
+    REQUIRE(props);
+    CHECK(Dict(props).toJSONString() == "{\"doc1\":{\"foo\":\"bar1\"},\"doc3\":{\"foo\":\"bar3\"}}");
+    FLDict_Release(props);
+
+    // Duplicate IDs are only written once:
+    FLString dupIDs[4] = {"doc3"_sl, "doc1"_sl, "doc3"_sl, "doc1"_sl};
+    props = CBLDatabase_GetDocumentsProperties(db, dupIDs, 4, &error);
+    REQUIRE(props);
+    CHECK(Dict(props).count() == 2);
+    CHECK(Dict(props).toJSONString() == "{\"doc1\":{\"foo\":\"bar1\"},\"doc3\":{\"foo\":\"bar3\"}}");
+    FLDict_Release(props);
+}
+
+
 
 #pragma mark - Save Document:
 
@@ -758,6 +995,52 @@ TEST_CASE_METHOD(DatabaseTest, "Save Document with Conflict Handler : On another
 }
 
 
+TEST_CASE_METHOD(DatabaseTest, "Save Documents in Batch") {
+    createDocument(db, "doc2", "foo", "bar");
+    CBLError error;
+    CBLDocument* stale = CBLDatabase_GetMutableDocument(db, "doc2"_sl, &error);
+    REQUIRE(stale);
+    createDocument(db, "doc3", "foo", "bar");
+    CBLDocument* existing = CBLDatabase_GetMutableDocument(db, "doc3"_sl, &error);
+    REQUIRE(existing);
+
+    // Make `stale` out of date:
+    CBLDocument* doc2 = CBLDatabase_GetMutableDocument(db, "doc2"_sl, &error);
+    FLMutableDict_SetInt(CBLDocument_MutableProperties(doc2), "n"_sl, 1);
+    REQUIRE(CBLDatabase_SaveDocument(db, doc2, &error));
+    CBLDocument_Release(doc2);
+
+    CBLDocument* docs[3] = {CBLDocument_CreateWithID("doc1"_sl), stale, existing};
+    for (auto doc : docs)
+        FLMutableDict_SetInt(CBLDocument_MutableProperties(doc), "n"_sl, 2);
+
+    CBLError results[3];
+    CHECK(!CBLDatabase_SaveDocuments(db, docs, 3, kCBLConcurrencyControlFailOnConflict,
+                                     results, &error));
+    CHECK(error.domain == kCBLDomain);
+    CHECK(error.code == kCBLErrorConflict);
+    CHECK(results[0].code == 0);
+    CHECK(results[1].domain == kCBLDomain);
+    CHECK(results[1].code == kCBLErrorConflict);
+    CHECK(results[2].code == 0);
+    CHECK(CBLDocument_Sequence(docs[0]) == 4);
+    CHECK(CBLDocument_Sequence(docs[2]) == 5);
+    CHECK(CBLDatabase_Count(db) == 3);
+
+    // With last-write-wins, the stale doc is saved too:
+    REQUIRE(CBLDatabase_SaveDocuments(db, docs, 3, kCBLConcurrencyControlLastWriteWins,
+                                      results, &error));
+    for (int i = 0; i < 3; ++i) {
+        CHECK(results[i].code == 0);
+        const CBLDocument* saved = CBLDatabase_GetDocument(db, CBLDocument_ID(docs[i]), &error);
+        REQUIRE(saved);
+        CHECK(Dict(CBLDocument_Properties(saved)).toJSONString() == "{\"n\":2}");
+        CBLDocument_Release(saved);
+        CBLDocument_Release(docs[i]);
+    }
+}
+
+
 TEST_CASE_METHOD(DatabaseTest, "Save Document into Different DB") {
     CBLDocument* doc = CBLDocument_CreateWithID("foo"_sl);
     FLMutableDict props = CBLDocument_MutableProperties(doc);
@@ -1112,6 +1395,44 @@ TEST_CASE_METHOD(DatabaseTest, "Copy Database") {
 }
 
 
+TEST_CASE_METHOD(DatabaseTest, "Copy Database With Progress") {
+    for (int i = 1; i <= 100; ++i)
+        createDocument(db, slice("doc" + to_string(i)), "foo", "bar");
+
+    // The callback is only called if the filesystem can't clone the files:
+    struct Progress { uint64_t calls = 0, copied = 0, total = 0; } progress;
+    auto callback = [](void *context, uint64_t copied, uint64_t total) {
+        auto p = (Progress*)context;
+        CHECK(copied >= p->copied);
+        CHECK(copied <= total);
+        p->calls++;
+        p->copied = copied;
+        p->total = total;
+    };
+
+    CBLError error;
+    alloc_slice path = CBLDatabase_Path(db);
+    REQUIRE(CBL_CopyDatabaseWithProgress(path, kOtherDBName, &kDatabaseConfiguration,
+                                         callback, &progress, &error));
+    if (progress.calls > 0)
+        CHECK(progress.copied == progress.total);
+    CHECK(!CBL_DatabaseExists(slice(string(kOtherDBName) + "~copy"), kDatabaseConfiguration.directory));
+
+    otherDB = CBLDatabase_Open(kOtherDBName, &kDatabaseConfiguration, &error);
+    REQUIRE(otherDB);
+    CHECK(CBLDatabase_Count(otherDB) == 100);
+
+    // Copying over an existing database fails:
+    {
+        ExpectingExceptions x;
+        CHECK(!CBL_CopyDatabaseWithProgress(path, kOtherDBName, &kDatabaseConfiguration,
+                                            callback, &progress, &error));
+        CHECK(error.domain == kCBLDomain);
+        CHECK(error.code == kCBLErrorConflict);
+    }
+}
+
+
 #pragma mark - Document Expiry:
 
 
@@ -1135,6 +1456,58 @@ TEST_CASE_METHOD(DatabaseTest, "Expiration") {
 }
 
 
+TEST_CASE_METHOD(DatabaseTest, "Purge Expired Documents") {
+    CBLError error;
+    CHECK(CBLDatabase_NextDocumentExpiration(db, &error) == 0);
+    CHECK(CBLDatabase_PurgeExpiredDocuments(db, 0, 0.0, &error) == 0);
+
+    for (int i = 1; i <= 4; ++i)
+        createDocument(db, slice("doc" + to_string(i)), "foo", "bar");
+    CBLTimestamp soon = CBL_Now() + 500, later = soon + 100000;
+    for (const char *docID : {"doc1", "doc2", "doc3"})
+        CHECK(CBLDatabase_SetDocumentExpiration(db, slice(docID), soon, &error));
+    CHECK(CBLDatabase_SetDocumentExpiration(db, "doc4"_sl, later, &error));
+    CHECK(CBLDatabase_NextDocumentExpiration(db, &error) == soon);
+
+    // Nothing has expired yet:
+    CHECK(CBLDatabase_PurgeExpiredDocuments(db, 2, 0.0, &error) == 0);
+    CHECK(CBLDatabase_Count(db) == 4);
+
+    // (The background housekeeping may purge some of them first.)
+    this_thread::sleep_for(700ms);
+    int64_t purged = CBLDatabase_PurgeExpiredDocuments(db, 2, 0.0, &error);
+    CHECK(purged >= 0);
+    CHECK(purged <= 3);
+    CHECK(CBLDatabase_Count(db) == 1);
+    CHECK(CBLDatabase_NextDocumentExpiration(db, &error) == later);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Bulk Expiration and Purge") {
+    CBLError error;
+    for (int i = 1; i <= 5; ++i)
+        createDocument(db, slice("doc" + to_string(i)), "foo", (i <= 3) ? "bar" : "baz");
+
+    FLString docIDs[3] = {FLStr("doc1"), FLStr("doc2"), FLStr("docX")};
+    CBLTimestamp later = CBL_Now() + 100000;
+    CHECK(CBLDatabase_SetDocumentsExpiration(db, docIDs, 3, later, &error) == 2);
+    CHECK(CBLDatabase_GetDocumentExpiration(db, "doc2"_sl, &error) == later);
+    CHECK(CBLDatabase_SetDocumentsExpiration(db, docIDs, 3, 0, &error) == 2);
+    CHECK(CBLDatabase_GetDocumentExpiration(db, "doc2"_sl, &error) == 0);
+
+    CHECK(CBLDatabase_PurgeDocuments(db, docIDs, 3, &error) == 2);
+    CHECK(CBLDatabase_Count(db) == 3);
+
+    CHECK(CBLDatabase_PurgeDocumentsWhere(db, "foo = 'baz'"_sl, &error) == 2);
+    CHECK(CBLDatabase_Count(db) == 1);
+    CHECK(CBLDatabase_PurgeDocumentsWhere(db, "foo = 'baz'"_sl, &error) == 0);
+
+    ExpectingExceptions x;
+    CHECK(CBLDatabase_PurgeDocumentsWhere(db, "foo = = 'baz'"_sl, &error) == -1);
+    CHECK(error.code == kCBLErrorInvalidQuery);
+}
+
+
 TEST_CASE_METHOD(DatabaseTest, "Expiration After Reopen") {
     createDocument(db, "doc1", "foo", "bar");
     createDocument(db, "doc2", "foo", "bar");
@@ -1157,6 +1530,111 @@ TEST_CASE_METHOD(DatabaseTest, "Expiration After Reopen") {
 }
 
 
+#pragma mark - Document Enumeration:
+
+
+TEST_CASE_METHOD(DatabaseTest, "Enumerate Documents") {
+    CBLError error;
+    for (int i = 1; i <= 9; ++i)
+        createDocument(db, slice("doc" + to_string(i)), "n", slice(to_string(i)));
+    REQUIRE(CBLDatabase_DeleteDocumentByID(db, "doc5"_sl, &error));
+
+    auto enumerate = [&](const CBLDocEnumeratorOptions *options) {
+        vector<string> result;
+        CBLDocEnumerator *e = CBLDatabase_EnumerateDocuments(db, options, &error);
+        REQUIRE(e);
+        while (const CBLDocument *doc = CBLDocEnumerator_Next(e, &error)) {
+            string entry(slice(CBLDocument_ID(doc)));
+            FLValue n = FLDict_Get(CBLDocument_Properties(doc), "n"_sl);
+            if (n)
+                entry += "=" + string(slice(FLValue_AsString(n)));
+            result.push_back(entry);
+        }
+        CHECK(error.code == 0);
+        CBLDocEnumerator_Release(e);
+        return result;
+    };
+
+    CHECK(enumerate(nullptr) == (vector<string>{"doc1=1", "doc2=2", "doc3=3", "doc4=4", "doc6=6",
+                                                "doc7=7", "doc8=8", "doc9=9"}));
+
+    CBLDocEnumeratorOptions options = {};
+    options.batchSize = 2;
+    options.startDocID = "doc3"_sl;
+    options.endDocID = "doc6"_sl;
+    options.flags = kCBLEnumerateIncludeDeleted | kCBLEnumerateMetadataOnly;
+    CHECK(enumerate(&options) == (vector<string>{"doc3", "doc4", "doc5", "doc6"}));
+
+    options.flags = kCBLEnumerateDescending;
+    options.startDocID = "doc8"_sl;
+    options.endDocID = "doc4"_sl;
+    CHECK(enumerate(&options) == (vector<string>{"doc8=8", "doc7=7", "doc6=6", "doc4=4"}));
+
+    // Releasing an enumerator before the end:
+    CBLDocEnumerator *e = CBLDatabase_EnumerateDocuments(db, nullptr, &error);
+    REQUIRE(CBLDocEnumerator_Next(e, &error));
+    CBLDocEnumerator_Release(e);
+}
+
+
+#pragma mark - Changes Feed:
+
+
+TEST_CASE_METHOD(DatabaseTest, "Enumerate Changes") {
+    CBLError error;
+    for (int i = 1; i <= 5; ++i)
+        createDocument(db, slice("doc" + to_string(i)), "n", slice(to_string(i)));
+    REQUIRE(CBLDatabase_DeleteDocumentByID(db, "doc2"_sl, &error));
+
+    struct Feed {
+        vector<string> docIDs;
+        vector<CBLChangeFlags> flags;
+        vector<string> values;
+        unsigned batches = 0;
+        bool stopEarly = false;
+    };
+    auto callback = [](void *context, const CBLChangedDocument changes[], unsigned count) {
+        auto feed = (Feed*)context;
+        ++feed->batches;
+        for (unsigned i = 0; i < count; ++i) {
+            feed->docIDs.emplace_back(slice(changes[i].docID));
+            feed->flags.push_back(changes[i].flags);
+            if (changes[i].properties)
+                feed->values.emplace_back(slice(FLValue_AsString(FLDict_Get(changes[i].properties,
+                                                                            "n"_sl))));
+        }
+        return !feed->stopEarly;
+    };
+
+    // All changes, in sequence order, with the deleted doc last:
+    Feed all;
+    int64_t last = CBLDatabase_EnumerateChanges(db, 0, 2, true, callback, &all, &error);
+    CHECK(last == int64_t(CBLDatabase_LastSequence(db)));
+    CHECK(all.batches == 3);
+    CHECK(all.docIDs == (vector<string>{"doc1", "doc3", "doc4", "doc5", "doc2"}));
+    CHECK(all.flags[3] == 0);
+    CHECK(all.flags[4] == kCBLChangeDeleted);
+    CHECK(all.values == (vector<string>{"1", "3", "4", "5"}));
+
+    // Resuming from the cursor only reports later changes:
+    CHECK(CBLDatabase_EnumerateChanges(db, last, 0, false, callback, &all, &error) == last);
+    CHECK(all.batches == 3);
+    createDocument(db, "doc6", "n", "6");
+    Feed more;
+    int64_t next = CBLDatabase_EnumerateChanges(db, last, 0, false, callback, &more, &error);
+    CHECK(next > last);
+    CHECK(more.docIDs == (vector<string>{"doc6"}));
+    CHECK(more.values.empty());
+
+    // Returning false stops after that batch:
+    Feed stopped;
+    stopped.stopEarly = true;
+    CHECK(CBLDatabase_EnumerateChanges(db, 0, 2, false, callback, &stopped, &error) > 0);
+    CHECK(stopped.batches == 1);
+    CHECK(stopped.docIDs.size() == 2);
+}
+
+
 #pragma mark - Maintenance:
 
 
@@ -1200,6 +1678,52 @@ TEST_CASE_METHOD(DatabaseTest, "Maintenance : Compact and Integrity Check") {
 }
 
 
+TEST_CASE_METHOD(DatabaseTest, "Maintenance : Scheduled") {
+    createDocument(db, "doc1", "foo", "bar1");
+
+    struct Progress {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<unsigned> steps;
+        bool finished = false, failed = false;
+        unsigned cancelAfter = 99;
+    } progress;
+    auto callback = [](void *context, unsigned done, unsigned count, bool finished,
+                       const CBLError *err) {
+        auto p = (Progress*)context;
+        CHECK(count == 3);
+        std::lock_guard<std::mutex> lock(p->mutex);
+        p->steps.push_back(done);
+        p->finished = finished;
+        p->failed = (err != nullptr);
+        p->cond.notify_all();
+        return done < p->cancelAfter;
+    };
+    auto waitFinished = [&] {
+        std::unique_lock<std::mutex> lock(progress.mutex);
+        REQUIRE(progress.cond.wait_for(lock, 20s, [&]{return progress.finished;}));
+    };
+
+    CBLMaintenanceType steps[3] = {kCBLMaintenanceTypeOptimize,
+                                   kCBLMaintenanceTypeIntegrityCheck,
+                                   kCBLMaintenanceTypeCompact};
+    CBLError error;
+    SECTION("All steps") {
+        REQUIRE(CBLDatabase_ScheduleMaintenance(db, steps, 3, 0.0, callback, &progress, &error));
+        waitFinished();
+        CHECK(progress.steps == (std::vector<unsigned>{1, 2, 3}));
+    }
+    SECTION("Cancelled") {
+        progress.cancelAfter = 1;
+        REQUIRE(CBLDatabase_ScheduleMaintenance(db, steps, 3, 0.0, callback, &progress, &error));
+        waitFinished();
+        CHECK(progress.steps == (std::vector<unsigned>{1, 1}));
+    }
+    CHECK(!progress.failed);
+    CHECK(CBLDatabase_Count(db) == 1);
+}
+
+
 TEST_CASE_METHOD(DatabaseTest, "Maintenance : Reindex") {
     CBLError error;
     CBLValueIndexConfiguration config = {};
@@ -1329,6 +1853,605 @@ TEST_CASE_METHOD(DatabaseTest, "Transaction Abort") {
 }
 
 
+TEST_CASE_METHOD(DatabaseTest, "Reader Connections") {
+    CBLError error;
+    CBLDatabaseConfiguration config = kDatabaseConfiguration;
+    config.readerCount = 2;
+    otherDB = CBLDatabase_Open(kOtherDBName, &config, &error);
+    REQUIRE(otherDB);
+    CHECK(CBLDatabase_Config(otherDB).readerCount == 2);
+
+    createDocument(otherDB, "doc1", "foo", "bar1");
+    createDocument(otherDB, "doc2", "foo", "bar2");
+    CHECK(CBLDatabase_Count(otherDB) == 2);
+    CHECK(CBLDatabase_LastSequence(otherDB) == 2);
+
+    // An immutable doc read from a reader can still be deleted:
+    const CBLDocument* doc1 = CBLDatabase_GetDocument(otherDB, "doc1"_sl, &error);
+    REQUIRE(doc1);
+    CHECK(CBLDatabase_DeleteDocumentWithConcurrencyControl(otherDB, doc1,
+                                                           kCBLConcurrencyControlFailOnConflict,
+                                                           &error));
+    CBLDocument_Release(doc1);
+    CHECK(!CBLDatabase_GetDocument(otherDB, "doc1"_sl, &error));
+
+    // Queries run on the readers too:
+    CBLQuery* query = CBLDatabase_CreateQuery(otherDB, kCBLN1QLLanguage,
+                                              "SELECT foo FROM _ WHERE foo = $foo"_sl,
+                                              nullptr, &error);
+    REQUIRE(query);
+    MutableDict params = MutableDict::newDict();
+    params["foo"] = "bar2";
+    CBLQuery_SetParameters(query, params);
+    for (int i = 0; i < 3; ++i) {
+        CBLResultSet* results = CBLQuery_Execute(query, &error);
+        REQUIRE(results);
+        CHECK(CBLResultSet_Next(results));
+        CHECK(Value(CBLResultSet_ValueAtIndex(results, 0)).asString() == "bar2"_sl);
+        CHECK(!CBLResultSet_Next(results));
+        CBLResultSet_Release(results);
+    }
+    CBLQuery_Release(query);
+
+    // Reads inside a transaction see its uncommitted changes:
+    REQUIRE(CBLDatabase_BeginTransaction(otherDB, &error));
+    createDocument(otherDB, "doc3", "foo", "bar3");
+    CHECK(CBLDatabase_Count(otherDB) == 2);
+    const CBLDocument* doc3 = CBLDatabase_GetDocument(otherDB, "doc3"_sl, &error);
+    CHECK(doc3);
+    CBLDocument_Release(doc3);
+    REQUIRE(CBLDatabase_EndTransaction(otherDB, false, &error));
+    CHECK(CBLDatabase_Count(otherDB) == 1);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Shared Database Handles") {
+    CBLError error;
+    CBL_SetDatabaseCacheLimits(4, 0.2);
+
+    CBLDatabase *db1 = CBLDatabase_OpenShared(kOtherDBName, &kDatabaseConfiguration, &error);
+    REQUIRE(db1);
+    CBLDatabase *db2 = CBLDatabase_OpenShared(kOtherDBName, &kDatabaseConfiguration, &error);
+    CHECK(db2 == db1);
+    createDocument(db1, "doc1", "foo", "bar");
+    CHECK(CBLDatabase_Count(db2) == 1);
+
+    // A different configuration doesn't get the cached handle:
+    {
+        ExpectingExceptions x;
+        CBLDatabaseConfiguration config = kDatabaseConfiguration;
+        config.readerCount += 1;
+        CHECK(!CBLDatabase_OpenShared(kOtherDBName, &config, &error));
+        CHECK(error.domain == kCBLDomain);
+        CHECK(error.code == kCBLErrorInvalidParameter);
+    }
+    CBLDatabase_Release(db1);
+    CBLDatabase_Release(db2);
+
+    // The cache still has it open, so it can't be deleted:
+    {
+        ExpectingExceptions x;
+        CHECK(!CBL_DeleteDatabase(kOtherDBName, kDatabaseConfiguration.directory, &error));
+        CHECK(error.code == kCBLErrorBusy);
+    }
+
+    // Once it's been idle for the timeout, it's closed:
+    this_thread::sleep_for(600ms);
+    CHECK(CBL_DeleteDatabase(kOtherDBName, kDatabaseConfiguration.directory, &error));
+
+    // A disabled cache doesn't share handles:
+    CBL_SetDatabaseCacheLimits(0, 0.0);
+    db1 = CBLDatabase_OpenShared(kOtherDBName, &kDatabaseConfiguration, &error);
+    REQUIRE(db1);
+    otherDB = CBLDatabase_OpenShared(kOtherDBName, &kDatabaseConfiguration, &error);
+    CHECK(otherDB != db1);
+    CHECK(CBLDatabase_Close(db1, &error));
+    CBLDatabase_Release(db1);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Lazy Reader Connections") {
+    CBLError error;
+    CBLDatabaseConfiguration config = kDatabaseConfiguration;
+    config.readerCount = 2;
+    config.lazyReaders = true;
+    otherDB = CBLDatabase_Open(kOtherDBName, &config, &error);
+    REQUIRE(otherDB);
+    CHECK(CBLDatabase_Config(otherDB).readerCount == 2);
+    CHECK(CBLDatabase_Config(otherDB).lazyReaders);
+
+    CBLDatabaseOpenStats stats = CBLDatabase_GetOpenStats(otherDB);
+    CHECK(stats.openTime > 0);
+    CHECK(stats.totalTime >= stats.setupTime + stats.openTime + stats.readersTime);
+
+    createDocument(otherDB, "doc1", "foo", "bar1");
+    CHECK(CBLDatabase_Count(otherDB) == 1);
+    const CBLDocument* doc1 = CBLDatabase_GetDocument(otherDB, "doc1"_sl, &error);
+    REQUIRE(doc1);
+    CBLDocument_Release(doc1);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Storage Tuning") {
+    CBLError error;
+    CBLDatabaseConfiguration config = kDatabaseConfiguration;
+    config.readerCount = 1;
+    config.storage.pageCacheSize = 512;
+    config.storage.mmapSize = 1 << 20;
+    config.storage.walAutoCheckpoint = 200;
+    config.storage.syncMode = kCBLSyncFull;
+    otherDB = CBLDatabase_Open(kOtherDBName, &config, &error);
+    REQUIRE(otherDB);
+    CBLStorageTuning storage = CBLDatabase_Config(otherDB).storage;
+    CHECK(storage.pageCacheSize == 512);
+    CHECK(storage.mmapSize == 1 << 20);
+    CHECK(storage.walAutoCheckpoint == 200);
+    CHECK(storage.syncMode == kCBLSyncFull);
+
+    createDocument(otherDB, "doc1", "foo", "bar1");
+    CHECK(CBLDatabase_Count(otherDB) == 1);
+
+    CHECK(CBLDatabase_SetPageCacheSize(otherDB, 128, &error));
+    CHECK(CBLDatabase_Config(otherDB).storage.pageCacheSize == 128);
+    {
+        ExpectingExceptions x;
+        CHECK(!CBLDatabase_SetPageCacheSize(otherDB, 0, &error));
+        CHECK(error.code == kCBLErrorInvalidParameter);
+    }
+
+    REQUIRE(CBLDatabase_Close(otherDB, &error));
+    CBLDatabase_Release(otherDB);
+    otherDB = nullptr;
+    config.storage.syncMode = CBLSyncMode(99);
+    {
+        ExpectingExceptions x;
+        CHECK(!CBLDatabase_Open(kOtherDBName, &config, &error));
+        CHECK(error.code == kCBLErrorInvalidParameter);
+    }
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Query Cache") {
+    CBLError error;
+    CBLDatabaseConfiguration config = kDatabaseConfiguration;
+    config.queryCacheCapacity = 2;
+    otherDB = CBLDatabase_Open(kOtherDBName, &config, &error);
+    REQUIRE(otherDB);
+    CHECK(CBLDatabase_Config(otherDB).queryCacheCapacity == 2);
+    createDocument(otherDB, "doc1", "foo", "bar1");
+    createDocument(otherDB, "doc2", "foo", "bar2");
+
+    auto runQuery = [&](CBLQuery *query, const char *foo) {
+        MutableDict params = MutableDict::newDict();
+        params["foo"] = foo;
+        CBLQuery_SetParameters(query, params);
+        CBLResultSet* results = CBLQuery_Execute(query, &error);
+        REQUIRE(results);
+        REQUIRE(CBLResultSet_Next(results));
+        string result(Value(CBLResultSet_ValueAtIndex(results, 0)).asString());
+        CHECK(!CBLResultSet_Next(results));
+        CBLResultSet_Release(results);
+        return result;
+    };
+
+    // Two queries with the same source share the compiled query, but not the parameters:
+    slice source = "SELECT meta().id FROM _ WHERE foo = $foo"_sl;
+    CBLQuery* q1 = CBLDatabase_CreateQuery(otherDB, kCBLN1QLLanguage, source, nullptr, &error);
+    REQUIRE(q1);
+    CBLQuery* q2 = CBLDatabase_CreateQuery(otherDB, kCBLN1QLLanguage, source, nullptr, &error);
+    REQUIRE(q2);
+    CBLQueryCacheStats stats = CBLDatabase_QueryCacheStats(otherDB);
+    CHECK(stats.hits == 1);
+    CHECK(stats.misses == 1);
+    CHECK(stats.count == 1);
+    CHECK(stats.capacity == 2);
+
+    CHECK(runQuery(q1, "bar1") == "doc1");
+    CHECK(runQuery(q2, "bar2") == "doc2");
+    CBLResultSet* results = CBLQuery_Execute(q1, &error);
+    REQUIRE(results);
+    REQUIRE(CBLResultSet_Next(results));
+    CHECK(Value(CBLResultSet_ValueAtIndex(results, 0)).asString() == "doc1"_sl);
+    CBLResultSet_Release(results);
+    CBLQuery_Release(q1);
+    CBLQuery_Release(q2);
+
+    // The least recently used query is evicted:
+    for (const char *str : {"SELECT foo FROM _", "SELECT meta().id, foo FROM _"}) {
+        CBLQuery* q = CBLDatabase_CreateQuery(otherDB, kCBLN1QLLanguage, slice(str),
+                                              nullptr, &error);
+        REQUIRE(q);
+        CBLQuery_Release(q);
+    }
+    stats = CBLDatabase_QueryCacheStats(otherDB);
+    CHECK(stats.misses == 3);
+    CHECK(stats.count == 2);
+    q1 = CBLDatabase_CreateQuery(otherDB, kCBLN1QLLanguage, source, nullptr, &error);
+    REQUIRE(q1);
+    CBLQuery_Release(q1);
+    CHECK(CBLDatabase_QueryCacheStats(otherDB).misses == 4);
+
+    // Invalid queries aren't cached:
+    int errPos;
+    CHECK(!CBLDatabase_CreateQuery(otherDB, kCBLN1QLLanguage, "SELECT FROM WHERE"_sl,
+                                   &errPos, &error));
+    CHECK(CBLDatabase_QueryCacheStats(otherDB).count == 2);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Precompile Queries") {
+    CBLError error;
+    FLString queries[3] = {FLStr("SELECT foo FROM _"),
+                           FLStr("SELECT meta().id FROM _ WHERE foo = $foo"),
+                           FLStr("SELECT FROM WHERE")};
+
+    // Without a query cache, there's nowhere to put them:
+    {
+        ExpectingExceptions x;
+        CHECK(!CBLDatabase_PrecompileQueries(db, kCBLN1QLLanguage, queries, 3,
+                                             nullptr, nullptr, &error));
+        CHECK(error.code == kCBLErrorUnsupported);
+    }
+
+    CBLDatabaseConfiguration config = kDatabaseConfiguration;
+    config.queryCacheCapacity = 4;
+    otherDB = CBLDatabase_Open(kOtherDBName, &config, &error);
+    REQUIRE(otherDB);
+
+    struct Result {
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool done = false;
+        unsigned compiled = 0, failed = 0;
+    } result;
+    auto callback = [](void *context, unsigned compiled, unsigned failed) {
+        auto r = (Result*)context;
+        std::lock_guard<std::mutex> lock(r->mutex);
+        r->compiled = compiled;
+        r->failed = failed;
+        r->done = true;
+        r->cond.notify_all();
+    };
+    {
+        ExpectingExceptions x;
+        REQUIRE(CBLDatabase_PrecompileQueries(otherDB, kCBLN1QLLanguage, queries, 3,
+                                              callback, &result, &error));
+        std::unique_lock<std::mutex> lock(result.mutex);
+        REQUIRE(result.cond.wait_for(lock, std::chrono::seconds(10), [&]{return result.done;}));
+    }
+    CHECK(result.compiled == 2);
+    CHECK(result.failed == 1);
+    CHECK(CBLDatabase_QueryCacheStats(otherDB).count == 2);
+
+    // Creating a precompiled query is a cache hit:
+    CBLQuery* q = CBLDatabase_CreateQuery(otherDB, kCBLN1QLLanguage, queries[1], nullptr, &error);
+    REQUIRE(q);
+    CBLQuery_Release(q);
+    CBLQueryCacheStats stats = CBLDatabase_QueryCacheStats(otherDB);
+    CHECK(stats.hits == 1);
+    CHECK(stats.misses == 2);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Async Save, Get and Query") {
+    struct Result {
+        std::mutex mutex;
+        std::condition_variable cond;
+        unsigned calls = 0, saved = 0;
+        std::vector<std::string> order;
+        std::string prop;
+        bool missing = false;
+        uint64_t rows = 0;
+
+        void wait(unsigned n) {
+            std::unique_lock<std::mutex> lock(mutex);
+            REQUIRE(cond.wait_for(lock, std::chrono::seconds(10), [&]{return calls >= n;}));
+        }
+        void done() {
+            ++calls;
+            cond.notify_all();
+        }
+    } result;
+
+    // Saves finish in the order they were requested:
+    for (int i = 0; i < 10; ++i) {
+        char docID[20];
+        snprintf(docID, sizeof(docID), "doc-%02d", i);
+        CBLDocument* doc = CBLDocument_CreateWithID(slice(docID));
+        FLMutableDict_SetInt(CBLDocument_MutableProperties(doc), "n"_sl, i);
+        CBLDatabase_SaveDocumentAsync(db, doc, kCBLConcurrencyControlFailOnConflict,
+                                      [](void *context, CBLDocument *doc, bool saved,
+                                         const CBLError *error) {
+            auto r = (Result*)context;
+            std::lock_guard<std::mutex> lock(r->mutex);
+            r->order.emplace_back(slice(CBLDocument_ID(doc)));
+            if (saved && !error)
+                ++r->saved;
+            r->done();
+        }, &result);
+        CBLDocument_Release(doc);
+    }
+    result.wait(10);
+    CHECK(result.saved == 10);
+    CHECK(std::is_sorted(result.order.begin(), result.order.end()));
+    CHECK(CBLDatabase_Count(db) == 10);
+
+    auto getCallback = [](void *context, const CBLDocument *doc, const CBLError *error) {
+        auto r = (Result*)context;
+        std::lock_guard<std::mutex> lock(r->mutex);
+        if (doc)
+            r->prop = std::to_string(FLValue_AsInt(FLDict_Get(CBLDocument_Properties(doc), "n"_sl)));
+        else
+            r->missing = !error;
+        r->done();
+    };
+    CBLDatabase_GetDocumentAsync(db, "doc-07"_sl, getCallback, &result);
+    CBLDatabase_GetDocumentAsync(db, "nope"_sl, getCallback, &result);
+    result.wait(12);
+    CHECK(result.prop == "7");
+    CHECK(result.missing);
+
+    // With buffered notifications, the completion waits for CBLDatabase_SendNotifications:
+    CBLDatabase_BufferNotifications(db, [](void*, CBLDatabase*) { }, nullptr);
+    CBLError error;
+    CBLQuery* query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage,
+                                              "SELECT n FROM _ WHERE n >= 5"_sl, nullptr, &error);
+    REQUIRE(query);
+    CBLQuery_ExecuteAsync(query, [](void *context, CBLQuery*, CBLResultSet *rs,
+                                    const CBLError *error) {
+        auto r = (Result*)context;
+        std::lock_guard<std::mutex> lock(r->mutex);
+        if (rs) {
+            while (CBLResultSet_Next(rs))
+                ++r->rows;
+        }
+        r->done();
+    }, &result);
+    CBLQuery_Release(query);
+    std::this_thread::sleep_for(200ms);
+    {
+        std::lock_guard<std::mutex> lock(result.mutex);
+        CHECK(result.calls == 12);
+    }
+    CBLDatabase_SendNotifications(db);
+    result.wait(13);
+    CHECK(result.rows == 5);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Blob Cache") {
+    CBLError error;
+    CBLDatabaseConfiguration config = kDatabaseConfiguration;
+    config.blobCacheCapacity = 100;
+    otherDB = CBLDatabase_Open(kOtherDBName, &config, &error);
+    REQUIRE(otherDB);
+    CHECK(CBLDatabase_Config(otherDB).blobCacheCapacity == 100);
+
+    // Save six 20-byte blobs and one that's too big to cache:
+    vector<CBLBlob*> blobs;
+    for (int i = 0; i < 7; ++i) {
+        string content = (i < 6) ? "Blob content #00000" + to_string(i) : string(30, 'x');
+        CBLBlob *blob = CBLBlob_CreateWithData("text/plain"_sl, slice(content));
+        REQUIRE(CBLDatabase_SaveBlob(otherDB, blob, &error));
+        blobs.push_back(blob);
+    }
+    auto read = [&](int i) {
+        FLSliceResult content = CBLBlob_Content(blobs[i], &error);
+        REQUIRE(content.buf);
+        FLSliceResult_Release(content);
+    };
+
+    read(0);
+    read(0);
+    CBLBlobCacheStats stats = CBLDatabase_BlobCacheStats(otherDB);
+    CHECK(stats.hits == 1);
+    CHECK(stats.misses == 1);
+    CHECK(stats.count == 1);
+    CHECK(stats.size == 20);
+    CHECK(stats.capacity == 100);
+
+    read(6);
+    CHECK(CBLDatabase_BlobCacheStats(otherDB).count == 1);
+
+    // Filling the cache evicts the least recently read blob:
+    for (int i = 1; i < 6; ++i)
+        read(i);
+    stats = CBLDatabase_BlobCacheStats(otherDB);
+    CHECK(stats.misses == 7);
+    CHECK(stats.count == 5);
+    CHECK(stats.size == 100);
+    read(5);
+    CHECK(CBLDatabase_BlobCacheStats(otherDB).hits == 2);
+    read(0);
+    CHECK(CBLDatabase_BlobCacheStats(otherDB).misses == 8);
+
+    for (auto blob : blobs)
+        CBLBlob_Release(blob);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Release Memory") {
+    CBLError error;
+    CBLDatabaseConfiguration config = kDatabaseConfiguration;
+    config.blobCacheCapacity = 1000;
+    config.queryCacheCapacity = 4;
+    config.readerCount = 1;
+    config.storage.pageCacheSize = 256;
+    otherDB = CBLDatabase_Open(kOtherDBName, &config, &error);
+    REQUIRE(otherDB);
+
+    CBLBlob *blob = CBLBlob_CreateWithData("text/plain"_sl, "Some blob content"_sl);
+    REQUIRE(CBLDatabase_SaveBlob(otherDB, blob, &error));
+    FLSliceResult content = CBLBlob_Content(blob, &error);
+    REQUIRE(content.buf);
+    FLSliceResult_Release(content);
+    CBLQuery *query = CBLDatabase_CreateQuery(otherDB, kCBLN1QLLanguage, "SELECT foo FROM _"_sl,
+                                              nullptr, &error);
+    REQUIRE(query);
+    CBLQuery_Release(query);
+
+    CBLMemoryStats stats = CBLDatabase_GetMemoryStats(otherDB);
+    CHECK(stats.blobCacheBytes == 17);
+    CHECK(stats.cachedQueries == 1);
+    CHECK(stats.openConnections == 2);
+    CHECK(stats.pageCacheLimit == 2 * 256 * 1024);
+
+    // Moderate pressure keeps the compiled queries:
+    CBLDatabase_ReleaseMemory(otherDB, kCBLMemoryPressureModerate);
+    stats = CBLDatabase_GetMemoryStats(otherDB);
+    CHECK(stats.blobCacheBytes == 0);
+    CHECK(stats.cachedQueries == 1);
+
+    CBL_HandleMemoryPressure(kCBLMemoryPressureCritical);
+    CHECK(CBLDatabase_GetMemoryStats(otherDB).cachedQueries == 0);
+
+    // The blob can still be read, and refills the cache:
+    content = CBLBlob_Content(blob, &error);
+    REQUIRE(content.buf);
+    FLSliceResult_Release(content);
+    CHECK(CBLDatabase_GetMemoryStats(otherDB).blobCacheBytes == 17);
+    CBLBlob_Release(blob);
+}
+
+
+#pragma mark - IMPORT & EXPORT:
+
+
+TEST_CASE_METHOD(DatabaseTest, "Import JSON Lines") {
+    CBLImportOptions options = {};
+    options.batchSize = 16;
+    options.workerCount = 3;
+    struct Progress {uint64_t calls = 0, docs = 0;} progress;
+    options.progress = [](void *context, uint64_t docs, uint64_t bytes) {
+        auto p = (Progress*)context;
+        CHECK(docs > p->docs);
+        CHECK(bytes > 0);
+        ++p->calls;
+        p->docs = docs;
+        return true;
+    };
+    options.context = &progress;
+
+    uint64_t docCount = 0;
+    CBLError error;
+    REQUIRE(CBLDatabase_ImportJSONLines(db, slice(GetTestFilePath("names_100.json")), &options,
+                                        &docCount, &error));
+    CHECK(docCount == 100);
+    CHECK(CBLDatabase_Count(db) == 100);
+    CHECK(progress.calls == 7);
+    CHECK(progress.docs == 100);
+
+    ExpectingExceptions x;
+    CHECK(!CBLDatabase_ImportJSONLines(db, "/no/such/file.json"_sl, nullptr, nullptr, &error));
+    CHECK(error.domain == kCBLPOSIXDomain);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Import JSON Lines From Reader") {
+    struct Input {slice data; size_t pos = 0;} input;
+    input.data = "{\"id\":\"a\",\"n\":1}\r\n\n{\"id\":\"b\",\"n\":2}\n{\"n\":3}\n{\"id\":\"a\",\"n\":4}"_sl;
+    auto reader = [](void *context, void *buffer, size_t size) -> int64_t {
+        auto in = (Input*)context;
+        size_t n = std::min(size, std::min(in->data.size - in->pos, size_t(5)));
+        memcpy(buffer, (const char*)in->data.buf + in->pos, n);
+        in->pos += n;
+        return n;
+    };
+
+    CBLImportOptions options = {};
+    options.idProperty = "id"_sl;
+    options.batchSize = 2;
+    uint64_t docCount = 0;
+    CBLError error;
+    REQUIRE(CBLDatabase_ImportJSONLinesFromReader(db, reader, &input, &options, &docCount, &error));
+    CHECK(docCount == 4);
+    CHECK(CBLDatabase_Count(db) == 3);
+
+    const CBLDocument* doc = CBLDatabase_GetDocument(db, "a"_sl, &error);
+    REQUIRE(doc);
+    CHECK(Dict(CBLDocument_Properties(doc)).toJSONString() == "{\"id\":\"a\",\"n\":4}");
+    CBLDocument_Release(doc);
+
+    // Invalid JSON:
+    input = {"{\"id\":\"c\"}\n{\"n\":\n"_sl};
+    ExpectingExceptions x;
+    CHECK(!CBLDatabase_ImportJSONLinesFromReader(db, reader, &input, nullptr, nullptr, &error));
+    CHECK(error.domain == kCBLFleeceDomain);
+}
+
+
+static bool appendToString(void *context, const void *data, size_t size) {
+    ((string*)context)->append((const char*)data, size);
+    return true;
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Export JSON Lines") {
+    createDocument(db, "doc1", "foo", "bar1");
+    createDocument(db, "doc\"2", "foo", "bar2");
+    createDocument(db, "doc3", "foo", "bar3");
+    CBLError error;
+    REQUIRE(CBLDatabase_DeleteDocumentByID(db, "doc3"_sl, &error));
+
+    string output;
+    uint64_t count = 0;
+    REQUIRE(CBLDatabase_ExportJSONLines(db, nullptr, "_id"_sl, appendToString, &output,
+                                        &count, &error));
+    CHECK(count == 2);
+    CHECK(output == "{\"_id\":\"doc\\\"2\",\"foo\":\"bar2\"}\n"
+                    "{\"_id\":\"doc1\",\"foo\":\"bar1\"}\n");
+
+    // Round trip:
+    otherDB = CBLDatabase_Open(kOtherDBName, &kDatabaseConfiguration, &error);
+    REQUIRE(otherDB);
+    struct Input {slice data; size_t pos = 0;} input {slice(output)};
+    CBLImportOptions options = {};
+    options.idProperty = "_id"_sl;
+    REQUIRE(CBLDatabase_ImportJSONLinesFromReader(otherDB, [](void *context, void *buffer, size_t size) -> int64_t {
+        auto in = (Input*)context;
+        size_t n = std::min(size, in->data.size - in->pos);
+        memcpy(buffer, (const char*)in->data.buf + in->pos, n);
+        in->pos += n;
+        return n;
+    }, &input, &options, &count, &error));
+    CHECK(count == 2);
+    const CBLDocument* doc = CBLDatabase_GetDocument(otherDB, "doc\"2"_sl, &error);
+    REQUIRE(doc);
+    CBLDocument_Release(doc);
+
+    // A body with a property named like the ID property gets the ID instead, not the key twice:
+    createDocument(db, "doc4", "id", "other");
+    output.clear();
+    REQUIRE(CBLDatabase_ExportJSONLines(db, nullptr, "id"_sl, appendToString, &output,
+                                        &count, &error));
+    CHECK(count == 3);
+    CHECK(output == "{\"id\":\"doc\\\"2\",\"foo\":\"bar2\"}\n"
+                    "{\"id\":\"doc1\",\"foo\":\"bar1\"}\n"
+                    "{\"id\":\"doc4\"}\n");
+    REQUIRE(CBLDatabase_DeleteDocumentByID(db, "doc4"_sl, &error));
+
+    // Query results:
+    CBLQuery* query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage,
+                                              "SELECT foo, missing FROM _ ORDER BY foo"_sl,
+                                              nullptr, &error);
+    REQUIRE(query);
+    output.clear();
+    REQUIRE(CBLDatabase_ExportJSONLines(db, query, nullslice, appendToString, &output,
+                                        &count, &error));
+    CHECK(count == 2);
+    CHECK(output == "{\"foo\":\"bar1\"}\n{\"foo\":\"bar2\"}\n");
+    CBLQuery_Release(query);
+
+    // Writer failure:
+    ExpectingExceptions x;
+    CHECK(!CBLDatabase_ExportJSONLines(db, nullptr, nullslice,
+                                       [](void*, const void*, size_t) {return false;},
+                                       nullptr, nullptr, &error));
+    CHECK(error.domain == kCBLDomain);
+    CHECK(error.code == kCBLErrorIOError);
+}
+
+
 #pragma mark - LISTENERS:
 
 
@@ -1439,6 +2562,252 @@ TEST_CASE_METHOD(DatabaseTest, "Scheduled database notifications") {
 }
 
 
+TEST_CASE_METHOD(DatabaseTest, "Many scheduled database notifications") {
+    // Repeated changes to a doc, while notifications are buffered, are delivered together:
+    fooListenerCalls = notificationsReadyCalls = 0;
+    auto fooToken = CBLDatabase_AddDocumentChangeListener(db, "foo"_sl, fooListener, this);
+    CBLDatabase_BufferNotifications(db, notificationsReady, this);
+
+    const int kNumSaves = 5000;
+    for (int i = 0; i < kNumSaves; ++i)
+        createDocument(db, "foo", "n", to_string(i));
+    CHECK(notificationsReadyCalls == 1);
+    CHECK(fooListenerCalls == 0);
+
+    CBLDatabase_SendNotifications(db);
+    CHECK(fooListenerCalls == 1);
+
+    // After sending, the next notification calls the ready callback again:
+    createDocument(db, "foo", "n", "last");
+    CHECK(notificationsReadyCalls == 2);
+    CBLDatabase_SendNotifications(db);
+    CHECK(fooListenerCalls == 2);
+
+    CBLListener_Remove(fooToken);
+}
+
+
+static void countingDocListener(void *context, const CBLDatabase *db, FLString docID) {
+    auto counts = (vector<int>*)context;
+    int n = 0;
+    REQUIRE(sscanf(string(slice(docID)).c_str(), "doc-%d", &n) == 1);
+    ++(*counts)[n];
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Many document listeners") {
+    const int kNumDocs = 5000;
+    vector<int> counts(kNumDocs);
+    vector<CBLListenerToken*> tokens;
+    for (int i = 0; i < kNumDocs; i += 2) {
+        string docID = "doc-" + to_string(i);
+        tokens.push_back(CBLDatabase_AddDocumentChangeListener(db, slice(docID),
+                                                               countingDocListener, &counts));
+    }
+    // Two listeners on the same doc:
+    tokens.push_back(CBLDatabase_AddDocumentChangeListener(db, "doc-10"_sl,
+                                                           countingDocListener, &counts));
+
+    CBLError error;
+    REQUIRE(CBLDatabase_BeginTransaction(db, &error));
+    for (int i = 0; i < 100; ++i)
+        createDocument(db, "doc-" + to_string(i), "n", "1");
+    REQUIRE(CBLDatabase_EndTransaction(db, true, &error));
+
+    for (int i = 0; i < 100; ++i)
+        CHECK(counts[i] == ((i % 2) ? 0 : ((i == 10) ? 2 : 1)));
+
+    // Removed listeners aren't called:
+    for (auto token : tokens)
+        CBLListener_Remove(token);
+    createDocument(db, "doc-0", "n", "2");
+    CHECK(counts[0] == 1);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Remove document listener after database is released") {
+    CBLError error;
+    otherDB = CBLDatabase_Open(kOtherDBName, &kDatabaseConfiguration, &error);
+    REQUIRE(otherDB);
+    vector<int> counts(1);
+    auto token = CBLDatabase_AddDocumentChangeListener(otherDB, "doc-0"_sl,
+                                                       countingDocListener, &counts);
+    createDocument(otherDB, "doc-0", "n", "1");
+    CHECK(counts[0] == 1);
+
+    CHECK(CBLDatabase_Close(otherDB, &error));
+    CBLDatabase_Release(otherDB);
+    otherDB = nullptr;
+    // The token outlives the database; removing it mustn't touch the database:
+    CBLListener_Remove(token);
+}
+
+
+struct CoalescedListenerState {
+    mutex lock;
+    vector<vector<string>> calls;
+};
+
+static void coalescedListener(void *context, const CBLDatabase *db, unsigned nDocs, FLString *docIDs) {
+    auto state = (CoalescedListenerState*)context;
+    vector<string> ids;
+    for (unsigned i = 0; i < nDocs; ++i)
+        ids.emplace_back(slice(docIDs[i]));
+    lock_guard<mutex> lock(state->lock);
+    state->calls.push_back(ids);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Coalesced database notifications") {
+    CoalescedListenerState state;
+    auto callCount = [&] {
+        lock_guard<mutex> lock(state.lock);
+        return state.calls.size();
+    };
+
+    SECTION("Interval") {
+        CBLChangeCoalescingOptions options = {300, 0};
+        auto token = CBLDatabase_AddCoalescedChangeListener(db, &options, coalescedListener, &state);
+        for (int i = 0; i < 5; ++i) {
+            createDocument(db, "foo", "n", to_string(i));
+            createDocument(db, "bar", "n", to_string(i));
+        }
+        // Nothing is delivered until the interval is up:
+        CHECK(callCount() == 0);
+        for (int i = 0; i < 200 && callCount() == 0; ++i)
+            this_thread::sleep_for(chrono::milliseconds(10));
+        this_thread::sleep_for(chrono::milliseconds(400));
+        {
+            lock_guard<mutex> lock(state.lock);
+            REQUIRE(state.calls.size() == 1);
+            CHECK(state.calls[0] == (vector<string>{"foo", "bar"}));
+        }
+        CBLListener_Remove(token);
+    }
+
+    SECTION("Max batch size") {
+        CBLChangeCoalescingOptions options = {60000, 2};
+        auto token = CBLDatabase_AddCoalescedChangeListener(db, &options, coalescedListener, &state);
+        CBLError error;
+        REQUIRE(CBLDatabase_BeginTransaction(db, &error));
+        for (const char *docID : {"a", "b", "a", "c", "d"})
+            createDocument(db, docID, "greeting", "hi");
+        REQUIRE(CBLDatabase_EndTransaction(db, true, &error));
+        // A full batch is delivered right away:
+        {
+            lock_guard<mutex> lock(state.lock);
+            REQUIRE(state.calls.size() == 2);
+            CHECK(state.calls[0] == (vector<string>{"a", "b"}));
+            CHECK(state.calls[1] == (vector<string>{"c", "d"}));
+        }
+        CBLListener_Remove(token);
+    }
+
+    SECTION("Removed during the interval") {
+        CBLChangeCoalescingOptions options = {100, 0};
+        auto token = CBLDatabase_AddCoalescedChangeListener(db, &options, coalescedListener, &state);
+        createDocument(db, "foo", "n", "1");
+        CBLListener_Remove(token);
+        this_thread::sleep_for(chrono::milliseconds(300));
+        CHECK(callCount() == 0);
+    }
+
+    SECTION("Database released during the interval") {
+        CBLError error;
+        otherDB = CBLDatabase_Open(kOtherDBName, &kDatabaseConfiguration, &error);
+        REQUIRE(otherDB);
+        CBLChangeCoalescingOptions options = {100, 0};
+        auto token = CBLDatabase_AddCoalescedChangeListener(otherDB, &options,
+                                                            coalescedListener, &state);
+        createDocument(otherDB, "foo", "n", "1");
+        CHECK(CBLDatabase_Close(otherDB, &error));
+        CBLDatabase_Release(otherDB);
+        otherDB = nullptr;
+        // The timer mustn't fire into the freed database:
+        this_thread::sleep_for(chrono::milliseconds(300));
+        CHECK(callCount() == 0);
+        CBLListener_Remove(token);
+    }
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Lock stats") {
+    createDocument(db, "foo", "greeting", "hi");
+    CBLLockStats stats = CBLDatabase_GetLockStats(db);
+    CHECK(stats.acquisitions == 0);     // disabled by default
+
+    CBLDatabase_SetLockStatsEnabled(db, true);
+    createDocument(db, "bar", "greeting", "hi");
+    CBLDocument *doc = CBLDatabase_GetMutableDocument(db, "foo"_sl, nullptr);
+    CBLDocument_Release(doc);
+    stats = CBLDatabase_GetLockStats(db);
+    CBLDatabase_SetLockStatsEnabled(db, false);
+
+    CHECK(stats.acquisitions > 0);
+    CHECK(stats.acquisitionsByCaller[kCBLLockCallerSave] > 0);
+    CHECK(stats.acquisitionsByCaller[kCBLLockCallerGet] > 0);
+    uint64_t byCaller = 0, held = 0;
+    for (auto n : stats.acquisitionsByCaller)
+        byCaller += n;
+    for (auto n : stats.holdTimeHistogram)
+        held += n;
+    CHECK(byCaller == stats.acquisitions);
+    CHECK(held == stats.acquisitions);
+    CHECK(stats.maxWaitTime <= stats.totalWaitTime);
+
+    // Disabling resets the stats:
+    CHECK(CBLDatabase_GetLockStats(db).acquisitions == 0);
+}
+
+
+TEST_CASE_METHOD(DatabaseTest, "Trace spans") {
+    struct Span {CBLTraceOperation op; uint64_t id, parent; int64_t duration; string detail;};
+    vector<Span> spans;
+    auto onSpan = [](void *context, const CBLTraceSpan *span) {
+        ((vector<Span>*)context)->push_back({span->operation, span->spanID, span->parentID,
+                                             span->duration, string(slice(span->detail))});
+    };
+
+    CBL_SetTraceCallback(onSpan, &spans, 1.0);
+    createDocument(db, "foo", "greeting", "hi");
+    const CBLDocument *doc = CBLDatabase_GetDocument(db, "foo"_sl, nullptr);
+    CBLDocument_Release(doc);
+    CBLError error;
+    CBLQuery *query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage, "SELECT greeting FROM _"_sl,
+                                              nullptr, &error);
+    CBLResultSet *rs = query ? CBLQuery_Execute(query, &error) : nullptr;
+    int rows = 0;
+    while (rs && CBLResultSet_Next(rs))
+        ++rows;
+    CBLResultSet_Release(rs);
+    CBLQuery_Release(query);
+    CBL_SetTraceCallback(nullptr, nullptr, 0.0);
+
+    CHECK(rows == 1);
+    auto count = [&](CBLTraceOperation op) {
+        return count_if(spans.begin(), spans.end(), [&](const Span &s) {return s.op == op;});
+    };
+    CHECK(count(kCBLTraceDocumentSave) == 1);
+    CHECK(count(kCBLTraceDocumentGet) == 1);
+    CHECK(count(kCBLTraceQueryExecute) == 1);
+    CHECK(count(kCBLTraceResultSetNext) == 2);
+    for (auto &s : spans) {
+        CHECK(s.id != 0);
+        CHECK(s.duration >= 0);
+        if (s.op == kCBLTraceDocumentSave || s.op == kCBLTraceDocumentGet)
+            CHECK(s.detail == "foo");
+    }
+
+    // Nothing is traced after disabling, nor with a zero sample rate:
+    spans.clear();
+    createDocument(db, "bar", "greeting", "hi");
+    CBL_SetTraceCallback(onSpan, &spans, 0.0);
+    createDocument(db, "baz", "greeting", "hi");
+    CBL_SetTraceCallback(nullptr, nullptr, 0.0);
+    CHECK(spans.empty());
+}
+
+
 TEST_CASE_METHOD(DatabaseTest, "Set blob in document", "[Blob]") {
     // Create and Save blob:
     CBLError error;
@@ -1465,6 +2834,36 @@ TEST_CASE_METHOD(DatabaseTest, "Set blob in document", "[Blob]") {
 }
 
 
+TEST_CASE_METHOD(DatabaseTest, "Set blob in document created from JSON", "[Blob]") {
+    CBLError error;
+    CBLDocument* doc = CBLDocument_CreateWithID("doc1"_sl);
+    REQUIRE(CBLDocument_SetJSON(doc, "{\"greeting\":\"hi\"}"_sl, &error));
+
+    // Modifying the JSON properties afterwards still installs new blobs:
+    FLSlice blobContent = FLStr("I'm Blob.");
+    CBLBlob* blob = CBLBlob_CreateWithData("text/plain"_sl, blobContent);
+    FLMutableDict_SetBlob(CBLDocument_MutableProperties(doc), FLSTR("blob"), blob);
+    CHECK(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLDocument_Release(doc);
+    CBLBlob_Release(blob);
+
+    doc = CBLDatabase_GetMutableDocument(db, "doc1"_sl, &error);
+    const CBLBlob* blob2 = FLValue_GetBlob(FLDict_Get(CBLDocument_Properties(doc), "blob"_sl));
+    REQUIRE(blob2);
+    FLSliceResult content = CBLBlob_Content(blob2, &error);
+    CHECK((slice)content == blobContent);
+    FLSliceResult_Release(content);
+
+    // Plain JSON, saved without walking it:
+    REQUIRE(CBLDocument_SetJSON(doc, "{\"greeting\":\"bye\",\"n\":[1,{\"x\":2}]}"_sl, &error));
+    CHECK(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLDocument_Release(doc);
+    const CBLDocument* rdoc = CBLDatabase_GetDocument(db, "doc1"_sl, &error);
+    CHECK(Dict(CBLDocument_Properties(rdoc)).toJSONString() == "{\"greeting\":\"bye\",\"n\":[1,{\"x\":2}]}");
+    CBLDocument_Release(rdoc);
+}
+
+
 TEST_CASE_METHOD(DatabaseTest, "Set blob in document using indirect properties", "[Blob]") {
     // Create and Save blob:
     CBLError error;
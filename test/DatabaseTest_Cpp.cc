@@ -331,6 +331,84 @@ TEST_CASE_METHOD(CBLTest_Cpp, "C++ Save Conflict") {
 }
 
 
+TEST_CASE_METHOD(CBLTest_Cpp, "C++ Save Documents") {
+    vector<MutableDocument> docs;
+    for (int i = 0; i < 10; ++i) {
+        MutableDocument doc("doc-" + to_string(i));
+        doc["n"] = i;
+        docs.push_back(doc);
+    }
+    REQUIRE(db.saveDocuments(docs, kCBLConcurrencyControlFailOnConflict));
+    CHECK(db.count() == 10);
+    for (auto &doc : docs) {
+        CHECK(doc.sequence() > 0);
+        CHECK(db.getDocument(doc.id())["n"].asInt() == doc["n"].asInt());
+    }
+
+    MutableDocument shadowDoc = db.getMutableDocument("doc-3");
+    shadowDoc["n"] = 33;
+    db.saveDocument(shadowDoc);
+    docs[3]["n"] = 300;
+    CHECK(!db.saveDocuments(docs, kCBLConcurrencyControlFailOnConflict));
+    REQUIRE(db.saveDocuments(docs, kCBLConcurrencyControlLastWriteWins));
+    CHECK(db.getDocument("doc-3")["n"].asInt() == 300);
+}
+
+
+TEST_CASE_METHOD(CBLTest_Cpp, "C++ Async Operations") {
+    MutableDocument doc("foo");
+    doc["n"] = 10;
+    async::Future<bool> saved = db.saveDocumentAsync(doc, kCBLConcurrencyControlFailOnConflict);
+    CHECK(saved.get());
+    CHECK(saved.ready());
+
+    Document readDoc = db.getDocumentAsync("foo").get();
+    REQUIRE(readDoc);
+    CHECK(readDoc["n"].asInt() == 10);
+    CHECK(!db.getDocumentAsync("bar").get());
+
+    MutableDocument shadowDoc = db.getMutableDocument("foo");
+    shadowDoc["n"] = 7;
+    db.saveDocument(shadowDoc);
+    doc["n"] = 11;
+    CHECK(!db.saveDocumentAsync(doc, kCBLConcurrencyControlFailOnConflict).get());
+
+    Query query(db, kCBLN1QLLanguage, "SELECT n FROM _");
+    ResultSet results = query.executeAsync().get();
+    int rows = 0;
+    for (auto &result : results) {
+        CHECK(result.valueAtIndex(0).asInt() == 7);
+        ++rows;
+    }
+    CHECK(rows == 1);
+}
+
+
+TEST_CASE_METHOD(CBLTest_Cpp, "C++ Slice Accessors") {
+    CHECK(db.nameSlice() == slice(db.name()));
+    CHECK(db.pathSlice() == slice(db.path()));
+
+    MutableDocument doc("foo");
+    doc["n"] = 1;
+    db.saveDocument(doc);
+    CHECK(doc.idSlice() == "foo"_sl);
+    CHECK(doc.revisionIDSlice() == slice(doc.revisionID()));
+
+    Query query(db, kCBLN1QLLanguage, "SELECT META().id AS id, n FROM _");
+    REQUIRE(query.columnCount() == 2);
+    CHECK(query.columnName(0) == "id"_sl);
+    CHECK(query.columnName(1) == "n"_sl);
+
+    // Iterating a temporary result set keeps it alive until the loop ends:
+    int rows = 0;
+    for (auto &result : query.execute()) {
+        CHECK(result.valueForKey("id").asString() == "foo"_sl);
+        ++rows;
+    }
+    CHECK(rows == 1);
+}
+
+
 TEST_CASE_METHOD(CBLTest_Cpp, "Retaining immutable Fleece") {
     MutableDocument mdoc("ubiq");
     {
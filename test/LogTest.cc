@@ -20,6 +20,9 @@
 #include "cbl/CouchbaseLite.h"
 #include "fleece/Fleece.hh"
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <dirent.h>
 #include <sys/stat.h>
 
@@ -73,10 +76,12 @@ public:
         if (oldConfig != nullptr) {
             CBLLogFileConfiguration config = *oldConfig;
             config.level = kCBLLogNone;
+            config.deferFormatting = false;
             REQUIRE(CBLLog_SetFileConfig(config, nullptr));
         }
         
         // Reset log callback:
+        CBLLog_SetCallbackAsync(0);
         CBLLog_SetCallback(nullptr);
         CBLLog_SetCallbackLevel(kCBLLogNone);
     }
@@ -271,6 +276,50 @@ TEST_CASE_METHOD(LogTest, "File Logging : Set Log Level", "[Log][FileLog]") {
 }
 
 
+TEST_CASE_METHOD(LogTest, "File Logging : Binary with Deferred Formatting", "[Log][FileLog]") {
+    prepareLogDir();
+    
+    CBLLogFileConfiguration config = {};
+    config.directory = slice(logDir);
+    config.level = kCBLLogInfo;
+    config.deferFormatting = true;
+    CBLError error;
+    REQUIRE(CBLLog_SetFileConfig(config, &error));
+    CHECK(CBLLog_FileConfig()->deferFormatting);
+    
+    CBL_Log(kCBLLogDomainDatabase, kCBLLogInfo, "deferred %d %s %.2f", 42, "bar", 1.5);
+    
+    // Close the log files:
+    config.level = kCBLLogNone;
+    REQUIRE(CBLLog_SetFileConfig(config, &error));
+    
+    string binaryPath;
+    for (string path : getAllLogFilePaths()) {
+        if (splitPath(path).second.find(kLogFileNamePrefixes[kCBLLogInfo]) == 0)
+            binaryPath = path;
+    }
+    REQUIRE(!binaryPath.empty());
+    
+    string textPath = logDir + kSeparatorChar + "decoded.txt";
+    REQUIRE(CBLLog_DecodeFile(slice(binaryPath), slice(textPath), &error));
+    bool found = false;
+    ReadFileByLines(textPath, [&](FLSlice line) {
+        if (string(line).find("deferred 42 bar 1.50") != string::npos)
+            found = true;
+        return true;
+    });
+    CHECK(found);
+    
+    {
+        ExpectingExceptions x;
+        CHECK(!CBLLog_DecodeFile(slice(logDir + kSeparatorChar + "nosuchfile.cbllog"),
+                                 slice(textPath), &error));
+    }
+    CHECK(error.domain == kCBLDomain);
+    CHECK(error.code == kCBLErrorNotFound);
+}
+
+
 TEST_CASE_METHOD(LogTest, "Custom Logging", "[Log][CustomLog]") {
     // Set log callback:
     static vector<CBLLogLevel>recs;
@@ -312,6 +361,36 @@ TEST_CASE_METHOD(LogTest, "Custom Logging", "[Log][CustomLog]") {
 }
 
 
+TEST_CASE_METHOD(LogTest, "Custom Logging : Domain Levels", "[Log][CustomLog]") {
+    static vector<pair<CBLLogDomain,string>> recs;
+    recs.clear();
+    CBLLog_SetCallback([](CBLLogDomain domain, CBLLogLevel level, FLString msg) {
+        recs.emplace_back(domain, string(msg));
+    });
+    CBLLog_SetCallbackLevel(kCBLLogWarning);
+    CBLLog_SetDomainLevel(kCBLLogSinkCallback, kCBLLogDomainReplicator, kCBLLogVerbose);
+    CHECK(CBLLog_DomainLevel(kCBLLogSinkCallback, kCBLLogDomainReplicator) == kCBLLogVerbose);
+    CHECK(CBLLog_DomainLevel(kCBLLogSinkCallback, kCBLLogDomainDatabase) == kCBLLogWarning);
+    CHECK(CBLLog_CallbackLevel() == kCBLLogWarning);
+    
+    CBL_Log(kCBLLogDomainDatabase, kCBLLogVerbose, "db verbose");
+    CBL_LogMessage(kCBLLogDomainQuery, kCBLLogInfo, "query info"_sl);
+    CBL_Log(kCBLLogDomainReplicator, kCBLLogVerbose, "repl verbose");
+    CBL_Log(kCBLLogDomainDatabase, kCBLLogWarning, "db warning");
+    
+    REQUIRE(recs.size() == 2);
+    CHECK(recs[0] == make_pair(kCBLLogDomainReplicator, string("repl verbose")));
+    CHECK(recs[1] == make_pair(kCBLLogDomainDatabase, string("db warning")));
+    
+    // Setting the callback level resets each domain's level:
+    CBLLog_SetCallbackLevel(kCBLLogError);
+    CHECK(CBLLog_DomainLevel(kCBLLogSinkCallback, kCBLLogDomainReplicator) == kCBLLogError);
+    recs.clear();
+    CBL_Log(kCBLLogDomainReplicator, kCBLLogVerbose, "repl verbose");
+    CHECK(recs.empty());
+}
+
+
 TEST_CASE_METHOD(LogTest, "Log Message", "[Log]") {
     static vector<string>recs;
     CBLLog_SetCallback([](CBLLogDomain domain, CBLLogLevel level, FLString msg) {
@@ -329,3 +408,55 @@ TEST_CASE_METHOD(LogTest, "Log Message", "[Log]") {
     CHECK(recs[0] == "foo bar");
     CHECK(recs[1] == "hello world");
 }
+
+
+TEST_CASE_METHOD(LogTest, "Async Custom Logging", "[Log][CustomLog]") {
+    static vector<string> recs;
+    static thread::id callbackThread;
+    static atomic<bool> blocked;
+    recs.clear();
+    blocked = false;
+    CBLLog_SetCallback([](CBLLogDomain domain, CBLLogLevel level, FLString msg) {
+        while (blocked)
+            this_thread::sleep_for(1ms);
+        callbackThread = this_thread::get_id();
+        recs.push_back(string(msg));
+    });
+    CBLLog_SetCallbackLevel(kCBLLogInfo);
+    
+    SECTION("Delivered in order") {
+        CBLLog_SetCallbackAsync(1000);
+        uint64_t dropped = CBLLog_DroppedMessageCount();
+        for (int i = 0; i < 100; i++)
+            CBL_Log(kCBLLogDomainDatabase, kCBLLogInfo, "message %d", i);
+        CBLLog_FlushCallback();
+        
+        REQUIRE(recs.size() == 100);
+        for (int i = 0; i < 100; i++)
+            CHECK(recs[i] == "message " + to_string(i));
+        CHECK(callbackThread != this_thread::get_id());
+        CHECK(CBLLog_DroppedMessageCount() == dropped);
+    }
+    
+    SECTION("Dropped when full") {
+        CBLLog_SetCallbackAsync(4);
+        uint64_t dropped = CBLLog_DroppedMessageCount();
+        blocked = true;
+        for (int i = 0; i < 20; i++)
+            CBL_Log(kCBLLogDomainDatabase, kCBLLogInfo, "message %d", i);
+        blocked = false;
+        CBLLog_FlushCallback();
+        
+        CHECK(recs.size() < 20);
+        CHECK(recs.size() + (CBLLog_DroppedMessageCount() - dropped) == 20);
+        CHECK(recs[0] == "message 0");
+    }
+    
+    // Back to synchronous delivery:
+    CBLLog_SetCallbackAsync(0);
+    recs.clear();
+    CBL_LogMessage(kCBLLogDomainDatabase, kCBLLogInfo, "sync"_sl);
+    REQUIRE(recs.size() == 1);
+    CHECK(recs[0] == "sync");
+    CHECK(callbackThread == this_thread::get_id());
+}
@@ -20,10 +20,15 @@
 #include "cbl/CouchbaseLite.h"
 #include "fleece/Fleece.hh"
 #include "fleece/Mutable.hh"
+#include <algorithm>
 #include <iostream>
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <set>
+#include <vector>
 
 using namespace std;
 using namespace fleece;
@@ -207,6 +212,152 @@ TEST_CASE_METHOD(QueryTest, "Query Parameters", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Query Execute With Parameters Concurrently", "[Query]") {
+    CBLError error;
+    query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage,
+                                    "SELECT count(*) AS n FROM _ WHERE contact.address.zip BETWEEN $zip0 AND $zip1"_sl,
+                                    nullptr, &error);
+    REQUIRE(query);
+
+    auto countZips = [&](const char *zip0, const char *zip1) -> int64_t {
+        auto params = MutableDict::newDict();
+        params["zip0"] = zip0;
+        params["zip1"] = zip1;
+        CBLError err;
+        CBLResultSet *rs = CBLQuery_ExecuteWithParameters(query, params, &err);
+        if (!rs || !CBLResultSet_Next(rs))
+            return -1;
+        int64_t n = FLValue_AsInt(CBLResultSet_ValueAtIndex(rs, 0));
+        CBLResultSet_Release(rs);
+        return n;
+    };
+
+    int64_t expected30000 = countZips("30000", "39999");
+    CHECK(expected30000 == 7);
+    int64_t expectedAll = countZips("00000", "99999");
+    CHECK(expectedAll == 100);
+    // The query's own parameters are unaffected:
+    CHECK(CBLQuery_Parameters(query) == nullptr);
+
+    atomic<int> failures {0};
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 20; ++i) {
+                bool narrow = (i + t) % 2;
+                int64_t n = narrow ? countZips("30000", "39999") : countZips("00000", "99999");
+                if (n != (narrow ? expected30000 : expectedAll))
+                    ++failures;
+            }
+        });
+    }
+    for (auto &th : threads)
+        th.join();
+    CHECK(failures == 0);
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Query Execute With NULL Parameters", "[Query]") {
+    CBLError error;
+    query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage, "SELECT count(*) AS n FROM _"_sl,
+                                    nullptr, &error);
+    REQUIRE(query);
+    CBLResultSet *rs = CBLQuery_ExecuteWithParameters(query, nullptr, &error);
+    REQUIRE(rs);
+    REQUIRE(CBLResultSet_Next(rs));
+    CHECK(FLValue_AsInt(CBLResultSet_ValueAtIndex(rs, 0)) == 100);
+    CBLResultSet_Release(rs);
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Query Count and Exists", "[Query]") {
+    CBLError error;
+    auto params = MutableDict::newDict();
+    params["zip0"] = "30000";
+    params["zip1"] = "39999";
+
+    CHECK(CBLDatabase_QueryCount(db, kCBLN1QLLanguage,
+                                 "contact.address.zip BETWEEN $zip0 AND $zip1"_sl,
+                                 params, &error) == 7);
+    CHECK(CBLDatabase_QueryCount(db, kCBLJSONLanguage,
+                                 "['BETWEEN', ['.contact.address.zip'], ['$zip0'], ['$zip1']]"_sl,
+                                 params, &error) == 7);
+    CHECK(CBLDatabase_QueryCount(db, kCBLN1QLLanguage, "gender = 'female'"_sl,
+                                 nullptr, &error) == 55);
+
+    CHECK(CBLDatabase_QueryExists(db, kCBLN1QLLanguage,
+                                  "birthday LIKE '1959-%'"_sl, nullptr, &error));
+    CHECK(!CBLDatabase_QueryExists(db, kCBLN1QLLanguage,
+                                   "birthday LIKE '1859-%'"_sl, nullptr, &error));
+    CHECK(error.code == 0);
+    CHECK(!CBLDatabase_QueryExists(db, kCBLJSONLanguage,
+                                   "['=', ['.name.first'], 'Nobody']"_sl, nullptr, &error));
+    CHECK(error.code == 0);
+
+    {
+        ExpectingExceptions x;
+        CHECK(CBLDatabase_QueryCount(db, kCBLN1QLLanguage, "zip =="_sl,
+                                     nullptr, &error) == -1);
+        CHECK(error.domain == kCBLDomain);
+        CHECK(error.code == kCBLErrorInvalidQuery);
+    }
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Fan-Out Query", "[Query]") {
+    CBLError error;
+    const CBLDatabase* dbs[3] = {db, db, db};
+    slice queryStr = "SELECT name.first FROM _ WHERE gender = $gender ORDER BY name.first"_sl;
+    auto params = MutableDict::newDict();
+    params["gender"] = "female";
+
+    SECTION("Unordered") {
+        CBLFanOutResults *rs = CBL_FanOutQuery(dbs, 3, kCBLN1QLLanguage, queryStr, params,
+                                               nullptr, &error);
+        REQUIRE(rs);
+        unsigned n = 0;
+        while (CBLFanOutResults_Next(rs, &error)) {
+            CHECK(CBLFanOutResults_Database(rs) == db);
+            CHECK(FLValue_GetType(CBLFanOutResults_ValueAtIndex(rs, 0)) == kFLString);
+            ++n;
+        }
+        CHECK(error.code == 0);
+        CHECK(n == 3 * 55);
+        CBLFanOutResults_Release(rs);
+    }
+
+    SECTION("Ordered, with limit") {
+        CBLFanOutOptions options = {};
+        options.ordered = true;
+        options.limit = 10;
+        options.maxThreads = 2;
+        CBLFanOutResults *rs = CBL_FanOutQuery(dbs, 3, kCBLN1QLLanguage, queryStr, params,
+                                               &options, &error);
+        REQUIRE(rs);
+        vector<string> names;
+        while (CBLFanOutResults_Next(rs, &error))
+            names.emplace_back(Array(CBLFanOutResults_ResultArray(rs))[0].asString());
+        CHECK(error.code == 0);
+        REQUIRE(names.size() == 10);
+        CHECK(std::is_sorted(names.begin(), names.end()));
+        CHECK(names[0] == names[1]);
+        CHECK(names[1] == names[2]);
+        CBLFanOutResults_Release(rs);
+    }
+
+    SECTION("Invalid query") {
+        ExpectingExceptions x;
+        CBLFanOutResults *rs = CBL_FanOutQuery(dbs, 3, kCBLN1QLLanguage, "SELECT foo bar"_sl,
+                                               nullptr, nullptr, &error);
+        REQUIRE(rs);
+        CHECK(!CBLFanOutResults_Next(rs, &error));
+        CHECK(error.domain == kCBLDomain);
+        CHECK(error.code == kCBLErrorInvalidQuery);
+        CBLFanOutResults_Release(rs);
+    }
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Create and Delete Value Index", "[Query]") {
     CBLError error;
     int errPos;
@@ -298,6 +449,244 @@ TEST_CASE_METHOD(QueryTest, "Create and Delete Full-Text Index", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Full-Text Page Query", "[Query]") {
+    CBLError error;
+    static constexpr int kNumDocs = 25;
+    for (int i = 0; i < kNumDocs; ++i) {
+        char docID[20];
+        snprintf(docID, sizeof(docID), "fts-%02d", i);
+        string text = "the orchard";
+        for (int n = 0; n <= i % 5; ++n)
+            text += " apple";
+        CBLDocument *doc = CBLDocument_CreateWithID(slice(docID));
+        FLMutableDict_SetString(CBLDocument_MutableProperties(doc), "text"_sl, slice(text));
+        REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+        CBLDocument_Release(doc);
+    }
+
+    CBLFullTextIndexConfiguration index = {};
+    index.expressionLanguage = kCBLN1QLLanguage;
+    index.expressions = "text"_sl;
+    index.language = "en"_sl;
+    index.disableStemming = true;
+    index.stopWords = "the"_sl;
+    REQUIRE(CBLDatabase_CreateFullTextIndex(db, "textIndex"_sl, index, &error));
+
+    CBLFullTextPageConfiguration config = {};
+    config.indexName = "textIndex"_sl;
+    config.columns = "text"_sl;
+    config.pageSize = 10;
+    query = CBLDatabase_CreateFullTextPageQuery(db, config, &error);
+    REQUIRE(query);
+    CHECK(CBLQuery_ColumnCount(query) == 3);
+    CHECK(CBLQuery_ColumnName(query, 1) == "_rank"_sl);
+    CHECK(CBLQuery_ColumnName(query, 2) == "_id"_sl);
+    {
+        auto params = MutableDict::newDict();
+        params["match"] = "apple";
+        CBLQuery_SetParameters(query, params);
+    }
+
+    // Read all the pages, checking that no row repeats and the ranks never go up:
+    set<string> seen;
+    int pages = 0;
+    double lastRank = 0;
+    alloc_slice lastID;
+    while (true) {
+        results = CBLQuery_ExecutePageAfter(query, lastRank, lastID, &error);
+        REQUIRE(results);
+        int rows = 0;
+        while (CBLResultSet_Next(results)) {
+            double rank = FLValue_AsDouble(CBLResultSet_ValueForKey(results, "_rank"_sl));
+            slice docID = FLValue_AsString(CBLResultSet_ValueForKey(results, "_id"_sl));
+            if (lastID)
+                CHECK(rank <= lastRank);
+            CHECK(seen.insert(string(docID)).second);
+            lastRank = rank;
+            lastID = docID;
+            ++rows;
+        }
+        CBLResultSet_Release(results);
+        results = nullptr;
+        if (rows == 0)
+            break;
+        CHECK(rows <= 10);
+        ++pages;
+    }
+    CHECK(pages == 3);
+    CHECK(seen.size() == kNumDocs);
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Index Stats", "[Query]") {
+    CBLError error;
+    CBLValueIndexConfiguration index1 = {kCBLN1QLLanguage, "name.first"_sl};
+    REQUIRE(CBLDatabase_CreateValueIndex(db, "index1"_sl, index1, &error));
+    CBLValueIndexConfiguration index2 = {kCBLN1QLLanguage, "birthday"_sl};
+    REQUIRE(CBLDatabase_CreateValueIndex(db, "index2"_sl, index2, &error));
+    CBLDatabase_SetIndexStatsEnabled(db, true);
+
+    int errPos;
+    for (int i = 0; i < 2; ++i) {
+        CBLQuery *q = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage,
+                                              "SELECT name.first FROM _ ORDER BY name.first"_sl,
+                                              &errPos, &error);
+        REQUIRE(q);
+        CBLQuery_Release(q);
+    }
+
+    FLDict stats = CBLDatabase_GetIndexStats(db);
+    REQUIRE(stats);
+    Dict dict(stats);
+    CHECK(dict.count() == 2);
+    CHECK(dict["index1"]["queryCount"].asInt() == 2);
+    CHECK(dict["index2"]["queryCount"].asInt() == 0);
+    FLDict_Release(stats);
+
+    CBLDatabase_SetIndexStatsEnabled(db, false);
+    stats = CBLDatabase_GetIndexStats(db);
+    CHECK(Dict(stats)["index1"].asDict().count() > 0);
+    CHECK(!Dict(stats)["index1"]["queryCount"]);
+    FLDict_Release(stats);
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Create Partial Value Index", "[Query]") {
+    CBLError error;
+    CBLValueIndexConfiguration config = {};
+    config.expressionLanguage = kCBLJSONLanguage;
+    config.expressions = R"([[".name.first"]])"_sl;
+    config.where = R"(["=", [".gender"], "female"])"_sl;
+    REQUIRE(CBLDatabase_CreateValueIndex(db, "females"_sl, config, &error));
+
+    FLArray indexNames = CBLDatabase_GetIndexNames(db);
+    CHECK(Array(indexNames).toJSONString() == R"(["females"])");
+    FLArray_Release(indexNames);
+
+    int errPos;
+    query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage,
+                                    "SELECT name.first FROM _ WHERE gender = 'female' AND name.first > 'M'"_sl,
+                                    &errPos, &error);
+    REQUIRE(query);
+    alloc_slice explanation(CBLQuery_Explain(query));
+    CHECK(explanation.find("INDEX females"_sl));
+
+    SECTION("N1QL expressions") {
+        config.expressionLanguage = kCBLN1QLLanguage;
+        config.expressions = "name.first"_sl;
+        ExpectingExceptions x;
+        CHECK(!CBLDatabase_CreateValueIndex(db, "females"_sl, config, &error));
+        CHECK(error.code == kCBLErrorInvalidParameter);
+    }
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Create Indexes", "[Query]") {
+    CBLError error;
+    CBLIndexSpec specs[2] = {};
+    specs[0].name = "index1"_sl;
+    specs[0].type = kCBLValueIndex;
+    specs[0].valueConfig = {kCBLN1QLLanguage, "name.first"_sl};
+    specs[1].name = "index2"_sl;
+    specs[1].type = kCBLFullTextIndex;
+    specs[1].fullTextConfig.expressionLanguage = kCBLN1QLLanguage;
+    specs[1].fullTextConfig.expressions = "product.description"_sl;
+
+    SECTION("Valid") {
+        CHECK(CBLDatabase_CreateIndexes(db, specs, 2, &error));
+        FLArray indexNames = CBLDatabase_GetIndexNames(db);
+        CHECK(Array(indexNames).toJSONString() == R"(["index1","index2"])");
+        FLArray_Release(indexNames);
+    }
+
+    SECTION("Invalid") {
+        specs[1].fullTextConfig.expressions = "product.description["_sl;
+        ExpectingExceptions x;
+        CHECK(!CBLDatabase_CreateIndexes(db, specs, 2, &error));
+        FLArray indexNames = CBLDatabase_GetIndexNames(db);
+        CHECK(FLArray_Count(indexNames) == 0);
+        FLArray_Release(indexNames);
+    }
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Create Value Index Asynchronously", "[Query]") {
+    struct Progress {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<CBLIndexBuildState> states;
+        bool cancelWhenRunning = false;
+    } progress;
+    auto listener = [](void *context, CBLIndexBuild *build, CBLIndexBuildState state, const CBLError *err) {
+        auto p = (Progress*)context;
+        CHECK((err != nullptr) == (state == kCBLIndexBuildFailed));
+        if (state == kCBLIndexBuildRunning && p->cancelWhenRunning)
+            CBLIndexBuild_Cancel(build);
+        std::lock_guard<std::mutex> lock(p->mutex);
+        p->states.push_back(state);
+        p->cond.notify_all();
+    };
+    auto waitDone = [&] {
+        std::unique_lock<std::mutex> lock(progress.mutex);
+        CHECK(progress.cond.wait_for(lock, std::chrono::seconds(10), [&] {
+            return !progress.states.empty() && progress.states.back() > kCBLIndexBuildRunning;
+        }));
+        return progress.states;
+    };
+
+    CBLError error;
+    CBLValueIndexConfiguration config = {};
+    config.expressionLanguage = kCBLN1QLLanguage;
+    config.expressions = "name.first"_sl;
+
+    SECTION("Finish") {
+        CBLIndexBuild *build = CBLDatabase_CreateValueIndexAsync(db, "index1"_sl, config,
+                                                                 listener, &progress, &error);
+        REQUIRE(build);
+        CHECK(waitDone() == std::vector<CBLIndexBuildState>{kCBLIndexBuildRunning,
+                                                             kCBLIndexBuildFinished});
+        CHECK(CBLIndexBuild_State(build) == kCBLIndexBuildFinished);
+        CBLIndexBuild_Release(build);
+
+        FLArray indexNames = CBLDatabase_GetIndexNames(db);
+        CHECK(Array(indexNames).toJSONString() == R"(["index1"])");
+        FLArray_Release(indexNames);
+
+        int errPos;
+        query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage,
+                                        "SELECT name.first FROM _ ORDER BY name.first"_sl,
+                                        &errPos, &error);
+        REQUIRE(query);
+        alloc_slice explanation(CBLQuery_Explain(query));
+        CHECK(explanation.find("USING INDEX index1"_sl));
+    }
+
+    SECTION("Cancel") {
+        progress.cancelWhenRunning = true;
+        CBLIndexBuild *build = CBLDatabase_CreateValueIndexAsync(db, "index1"_sl, config,
+                                                                 listener, &progress, &error);
+        REQUIRE(build);
+        CHECK(waitDone() == std::vector<CBLIndexBuildState>{kCBLIndexBuildRunning,
+                                                             kCBLIndexBuildCancelled});
+        CHECK(CBLIndexBuild_State(build) == kCBLIndexBuildCancelled);
+        CBLIndexBuild_Release(build);
+
+        FLArray indexNames = CBLDatabase_GetIndexNames(db);
+        CHECK(FLArray_Count(indexNames) == 0);
+        FLArray_Release(indexNames);
+    }
+
+    SECTION("Invalid") {
+        config.expressions = "name.first["_sl;
+        CBLIndexBuild *build = CBLDatabase_CreateValueIndexAsync(db, "index1"_sl, config,
+                                                                 listener, &progress, &error);
+        REQUIRE(build);
+        CHECK(waitDone().back() == kCBLIndexBuildFailed);
+        CBLIndexBuild_Release(build);
+    }
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query Result As Dict", "[Query]") {
     CBLError error;
     int errPos;
@@ -376,6 +765,97 @@ TEST_CASE_METHOD(QueryTest, "Query Result As Array", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Query Result Batches", "[Query]") {
+    CBLError error;
+    query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage,
+                                    "SELECT name.first, foo FROM _ ORDER BY name.first"_sl,
+                                    nullptr, &error);
+    REQUIRE(query);
+
+    // Read all the rows with CBLResultSet_Next, for comparison:
+    vector<string> expected;
+    results = CBLQuery_Execute(query, &error);
+    REQUIRE(results);
+    while (CBLResultSet_Next(results))
+        expected.push_back(string(Value(CBLResultSet_ValueAtIndex(results, 0)).asString()));
+    REQUIRE(expected.size() == 100);
+    CBLResultSet_Release(results);
+
+    SECTION("Columns") {
+        results = CBLQuery_Execute(query, &error);
+        REQUIRE(results);
+        FLValue firstNames[30], foos[30];
+        FLValue* columns[2] = {firstNames, foos};
+        size_t total = 0;
+        unsigned n;
+        while ((n = CBLResultSet_NextBatch(results, 30, columns)) > 0) {
+            CHECK(n == min(size_t(30), 100 - total));
+            for (unsigned i = 0; i < n; ++i) {
+                CHECK(Value(firstNames[i]).asString() == slice(expected[total + i]));
+                CHECK(foos[i] == nullptr);
+            }
+            total += n;
+        }
+        CHECK(total == 100);
+    }
+
+    SECTION("Pages") {
+        results = CBLQuery_Execute(query, &error);
+        REQUIRE(results);
+        size_t total = 0;
+        while (FLArray page = CBLResultSet_NextPage(results, 40)) {
+            uint32_t n = FLArray_Count(page);
+            CHECK(n == min(size_t(40), 100 - total));
+            for (uint32_t i = 0; i < n; ++i) {
+                Array row = Array(page)[i].asArray();
+                REQUIRE(row.count() == 2);
+                CHECK(row[0].asString() == slice(expected[total + i]));
+                CHECK(row[1].type() == kFLUndefined);
+            }
+            total += n;
+            FLArray_Release(page);
+        }
+        CHECK(total == 100);
+    }
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Query Typed Columns", "[Query]") {
+    CBLError error;
+    query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage,
+                                    "SELECT name.first, length(name.first), foo FROM _ ORDER BY name.first"_sl,
+                                    nullptr, &error);
+    REQUIRE(query);
+    results = CBLQuery_Execute(query, &error);
+    REQUIRE(results);
+
+    FLSlice names[64];
+    int64_t lengths[64];
+    double lengthsD[64];
+    int64_t foos[64];
+    bool haveFoos[64];
+    CBLColumnBuffer buffers[4] = {
+        {0, kCBLColumnSlice,  names,    nullptr},
+        {1, kCBLColumnInt64,  lengths,  nullptr},
+        {1, kCBLColumnDouble, lengthsD, nullptr},
+        {2, kCBLColumnInt64,  foos,     haveFoos},
+    };
+    size_t total = 0;
+    unsigned n;
+    while ((n = CBLResultSet_NextColumns(results, 64, buffers, 4)) > 0) {
+        CHECK(n == min(size_t(64), 100 - total));
+        for (unsigned i = 0; i < n; ++i) {
+            CHECK(lengths[i] == int64_t(names[i].size));
+            CHECK(lengthsD[i] == double(names[i].size));
+            CHECK(foos[i] == 0);
+            CHECK(!haveFoos[i]);
+        }
+        total += n;
+    }
+    CHECK(total == 100);
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query Listener", "[Query][LiveQuery]") {
     CBLError error;
     query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage,
@@ -559,6 +1039,66 @@ TEST_CASE_METHOD(QueryTest, "Multiple Query Listeners", "[Query][LiveQuery]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Identical Live Queries", "[Query][LiveQuery]") {
+    // Listeners on separate queries with the same source and parameters share one observer;
+    // a different parameter value gets its own.
+    CBLError error;
+    auto queryStr = "SELECT name FROM _ WHERE birthday like $dob ORDER BY birthday"_sl;
+    auto params = MutableDict::newDict();
+    params["dob"] = "1959-%";
+    query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage, queryStr, nullptr, &error);
+    REQUIRE(query);
+    CBLQuery_SetParameters(query, params);
+    CBLQuery *query2 = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage, queryStr, nullptr, &error);
+    REQUIRE(query2);
+    CBLQuery_SetParameters(query2, params);
+    CBLQuery *query3 = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage, queryStr, nullptr, &error);
+    REQUIRE(query3);
+    params["dob"] = "1977-%";
+    CBLQuery_SetParameters(query3, params);
+
+    auto callback = [](void *context, CBLQuery* query, CBLListenerToken* token) {
+        ((ListenerState*)context)->receivedCallback(context, query, token);
+    };
+    ListenerState state1, state2, state3;
+    auto token1 = CBLQuery_AddChangeListener(query, callback, &state1);
+    auto token2 = CBLQuery_AddChangeListener(query2, callback, &state2);
+    auto token3 = CBLQuery_AddChangeListener(query3, callback, &state3);
+
+    cerr << "Waiting for listeners...\n";
+    REQUIRE(state1.waitForCount(1));
+    REQUIRE(state2.waitForCount(1));
+    REQUIRE(state3.waitForCount(1));
+    CHECK(state1.resultCount() == 3);
+    CHECK(state2.resultCount() == 3);
+    CHECK(state3.resultCount() == 2);
+
+    cerr << "Deleting a doc...\n";
+    state1.reset();
+    state2.reset();
+    REQUIRE(CBLDatabase_DeleteDocumentByID(db, "0000012"_sl, &error));
+    REQUIRE(state1.waitForCount(1));
+    REQUIRE(state2.waitForCount(1));
+    CHECK(state1.resultCount() == 2);
+    CHECK(state2.resultCount() == 2);
+
+    cerr << "Changing one query's parameters...\n";
+    state2.reset();
+    CBLQuery_SetParameters(query2, params);
+    REQUIRE(state2.waitForCount(1));
+    CHECK(state2.resultCount() == 2);
+    CHECK(state1.count() == 1);
+
+    CBLListener_Remove(token1);
+    CBLListener_Remove(token2);
+    CBLListener_Remove(token3);
+    CBLQuery_Release(query2);
+    CBLQuery_Release(query3);
+    cerr << "Sleeping to ensure async cleanup ..." << endl;
+    this_thread::sleep_for(500ms);
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query Listener and Coalescing notification", "[Query][LiveQuery]") {
     CBLError error;
     query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage,
@@ -596,6 +1136,81 @@ TEST_CASE_METHOD(QueryTest, "Query Listener and Coalescing notification", "[Quer
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Query Delta Listener", "[Query][LiveQuery]") {
+    CBLError error;
+    query = CBLDatabase_CreateQuery(db, kCBLN1QLLanguage,
+                                    "SELECT META().id, name FROM _ WHERE birthday like '1959-%' ORDER BY birthday"_sl,
+                                    nullptr, &error);
+    REQUIRE(query);
+
+    struct DeltaState {
+        std::mutex mutex;
+        int calls = 0;
+        int rows = 0;
+        vector<unsigned> inserted, removed, changed;
+    } state;
+
+    cerr << "Adding delta listener\n";
+    auto listenerToken = CBLQuery_AddDeltaListener(query, 0, [](void *context, CBLQuery* query,
+                                                                CBLListenerToken* token,
+                                                                const CBLQueryDelta *delta) {
+        auto state = (DeltaState*)context;
+        lock_guard<mutex> lock(state->mutex);
+        ++state->calls;
+        state->rows = countResults(delta->results);
+        state->inserted.assign(delta->inserted, delta->inserted + delta->insertedCount);
+        state->removed.assign(delta->removed, delta->removed + delta->removedCount);
+        state->changed.assign(delta->changed, delta->changed + delta->changedCount);
+    }, &state);
+    REQUIRE(listenerToken);
+
+    auto waitForCalls = [&](int target) {
+        for (int i = 0; i < 50; ++i) {
+            {
+                lock_guard<mutex> lock(state.mutex);
+                if (state.calls == target)
+                    return true;
+            }
+            this_thread::sleep_for(100ms);
+        }
+        return false;
+    };
+
+    cerr << "Waiting for listener...\n";
+    REQUIRE(waitForCalls(1));
+    CHECK(state.rows == 3);
+    CHECK(state.inserted == vector<unsigned>{0, 1, 2});
+    CHECK(state.removed.empty());
+    CHECK(state.changed.empty());
+
+    cerr << "Deleting a doc...\n";
+    REQUIRE(CBLDatabase_DeleteDocumentByID(db, "0000012"_sl, &error));
+    REQUIRE(waitForCalls(2));
+    CHECK(state.rows == 2);
+    CHECK(state.inserted.empty());
+    CHECK(state.removed.size() == 1);
+    CHECK(state.changed.empty());
+
+    cerr << "Updating a doc...\n";
+    CBLDocument *doc = CBLDatabase_GetMutableDocument(db, "0000046"_sl, &error);
+    REQUIRE(doc);
+    FLMutableDict props = CBLDocument_MutableProperties(doc);
+    FLMutableDict_SetString(props, "name"_sl, "Zaphod"_sl);
+    REQUIRE(CBLDatabase_SaveDocument(db, doc, &error));
+    CBLDocument_Release(doc);
+    REQUIRE(waitForCalls(3));
+    CHECK(state.rows == 2);
+    CHECK(state.inserted.empty());
+    CHECK(state.removed.empty());
+    CHECK(state.changed.size() == 1);
+
+    CBLListener_Remove(listenerToken);
+    listenerToken = nullptr;
+    cerr << "Sleeping to ensure async cleanup ..." << endl;
+    this_thread::sleep_for(500ms);
+}
+
+
 #ifdef COUCHBASE_ENTERPRISE
 
 TEST_CASE_METHOD(QueryTest, "Query Encryptable", "[Query]") {
@@ -750,3 +1365,47 @@ TEST_CASE_METHOD(QueryTest_Cpp, "Query Listener C++ API", "[Query]") {
     cerr << "Sleeping to ensure async cleanup ..." << endl;
     this_thread::sleep_for(500ms);
 }
+
+
+TEST_CASE_METHOD(QueryTest_Cpp, "Throttled Query Listener C++ API", "[Query][LiveQuery]") {
+    Query query(db, kCBLN1QLLanguage, "SELECT name FROM _ WHERE birthday like '1959-%' ORDER BY birthday");
+    {
+        cerr << "Adding throttled listener\n";
+        std::atomic_int calls{0};
+        std::atomic_int resultCount{-1};
+        CBLQueryListenerOptions options = {};
+        options.minIntervalMs = 300;
+        options.debounceMs = 200;
+        Query::ChangeListener listenerToken = query.addChangeListener(options, [&](Query::Change change) {
+            ResultSet rs = change.results();
+            resultCount = countResults(rs);
+            ++calls;
+        });
+
+        cerr << "Waiting for listener...\n";
+        while (calls < 1)
+            this_thread::sleep_for(100ms);
+        CHECK(resultCount == 3);
+
+        cerr << "Deleting docs while paused...\n";
+        listenerToken.setPaused(true);
+        REQUIRE(db.deleteDocument(db.getDocument("0000012"), kCBLConcurrencyControlLastWriteWins));
+        this_thread::sleep_for(1000ms);
+        CHECK(calls == 1);
+
+        cerr << "Resuming...\n";
+        listenerToken.setPaused(false);
+        while (calls < 2)
+            this_thread::sleep_for(100ms);
+        CHECK(resultCount == 2);
+
+        cerr << "Deleting another doc...\n";
+        REQUIRE(db.deleteDocument(db.getDocument("0000046"), kCBLConcurrencyControlLastWriteWins));
+        while (calls < 3)
+            this_thread::sleep_for(100ms);
+        CHECK(resultCount == 1);
+    }
+
+    cerr << "Sleeping to ensure async cleanup ..." << endl;
+    this_thread::sleep_for(500ms);
+}
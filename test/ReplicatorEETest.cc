@@ -18,6 +18,9 @@
 
 #include "ReplicatorTest.hh"
 #include "CBLPrivate.h"
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 
 
@@ -160,6 +163,137 @@ TEST_CASE_METHOD(ReplicatorLocalTest, "Pending Documents", "[Replicator]") {
 }
 
 
+TEST_CASE_METHOD(ReplicatorLocalTest, "Pending Document Count", "[Replicator]") {
+    config.replicatorType = kCBLReplicatorTypePush;
+    
+    replicate();
+    CBLError error;
+    CHECK(CBLReplicator_PendingDocumentCount(repl, &error) == 0);
+    CHECK(error.code == 0);
+    
+    for (int i = 0; i < 25; i++) {
+        MutableDocument doc("doc-" + to_string(i));
+        doc["n"] = i;
+        db.saveDocument(doc);
+    }
+    CHECK(CBLReplicator_PendingDocumentCount(repl, &error) == 25);
+    CHECK(CBLReplicator_PendingDocumentCount(repl, &error) == 25);
+    
+    // Page through the IDs:
+    set<string> pending;
+    uint64_t offset = 0;
+    while (true) {
+        FLArray page = CBLReplicator_PendingDocumentIDsPage(repl, offset, 10, &error);
+        REQUIRE(page);
+        uint32_t n = FLArray_Count(page);
+        CHECK(n <= 10);
+        for (uint32_t i = 0; i < n; i++)
+            pending.insert(string(slice(FLValue_AsString(FLArray_Get(page, i)))));
+        FLArray_Release(page);
+        if (n == 0)
+            break;
+        offset += n;
+    }
+    CHECK(offset == 25);
+    CHECK(pending.size() == 25);
+    CHECK(pending.count("doc-7") == 1);
+    
+    replicate();
+    CHECK(CBLReplicator_PendingDocumentCount(repl, &error) == 0);
+    CHECK(error.code == 0);
+}
+
+TEST_CASE_METHOD(ReplicatorLocalTest, "Compression Option", "[Replicator]") {
+    for (int i = 0; i < 100; i++) {
+        MutableDocument doc("doc-" + to_string(i));
+        doc["n"] = i;
+        db.saveDocument(doc);
+    }
+
+    config.replicatorType = kCBLReplicatorTypePush;
+    config.compressionLevel = 9;
+    replicate();
+    CHECK(otherDB.count() == 100);
+}
+
+TEST_CASE_METHOD(ReplicatorLocalTest, "Invalid Compression Level", "[Replicator]") {
+    config.compressionLevel = 10;
+    CBLError error;
+    {
+        ExpectingExceptions x;
+        CHECK(!CBLReplicator_Create(&config, &error));
+    }
+    CHECK(error.domain == kCBLDomain);
+    CHECK(error.code == kCBLErrorInvalidParameter);
+}
+
+TEST_CASE_METHOD(ReplicatorLocalTest, "Replicator Group", "[Replicator]") {
+    config.replicatorType = kCBLReplicatorTypePush;
+    for (int i = 0; i < 10; i++) {
+        MutableDocument doc("doc-" + to_string(i));
+        doc["n"] = i;
+        db.saveDocument(doc);
+    }
+
+    struct Observer {
+        mutex               m;
+        vector<int>         stopped;
+        unsigned            maxBusy {0};
+        set<CBLReplicator*> busy;
+        CBLReplicator*      repls[3];
+    } observer;
+
+    CBLReplicatorGroup* group = CBLReplicatorGroup_Create(1);
+    REQUIRE(group);
+    const int priorities[3] = {0, 10, 5};
+    CBLReplicator** repls = observer.repls;
+    CBLListenerToken* tokens[3];
+    for (int i = 0; i < 3; i++) {
+        CBLError error;
+        repls[i] = CBLReplicator_Create(&config, &error);
+        REQUIRE(repls[i]);
+        tokens[i] = CBLReplicator_AddChangeListener(repls[i], [](void *context, CBLReplicator *r,
+                                                                 const CBLReplicatorStatus *status) {
+            auto obs = (Observer*)context;
+            lock_guard<mutex> lock(obs->m);
+            if (status->activity == kCBLReplicatorBusy || status->activity == kCBLReplicatorConnecting)
+                obs->busy.insert(r);
+            else
+                obs->busy.erase(r);
+            obs->maxBusy = max(obs->maxBusy, unsigned(obs->busy.size()));
+            if (status->activity == kCBLReplicatorStopped)
+                obs->stopped.push_back(int(find(&obs->repls[0], &obs->repls[3], r) - &obs->repls[0]));
+        }, &observer);
+        CBLReplicatorGroup_Add(group, repls[i], priorities[i]);
+    }
+    CHECK(CBLReplicatorGroup_ActiveCount(group) == 0);
+
+    CBLReplicatorGroup_Start(group, false);
+    for (int n = 0; n < 100; n++) {
+        {
+            lock_guard<mutex> lock(observer.m);
+            if (observer.stopped.size() == 3)
+                break;
+        }
+        this_thread::sleep_for(100ms);
+    }
+
+    {
+        lock_guard<mutex> lock(observer.m);
+        CHECK(observer.stopped == (vector<int>{1, 2, 0}));
+        CHECK(observer.maxBusy == 1);
+    }
+    CHECK(CBLReplicatorGroup_ActiveCount(group) == 0);
+    CHECK(otherDB.count() == 10);
+
+    for (int i = 0; i < 3; i++) {
+        CBLReplicatorGroup_Remove(group, repls[i]);
+        CBLListener_Remove(tokens[i]);
+        CBLReplicator_Release(repls[i]);
+    }
+    CBLReplicatorGroup_Release(group);
+}
+
 TEST_CASE_METHOD(ReplicatorLocalTest, "Default Resolver : Deleted Wins", "[Replicator][Conflict]") {
     SECTION("No conflict resolved specified") {
         config.conflictResolver = nullptr;
@@ -311,6 +445,151 @@ TEST_CASE_METHOD(ReplicatorLocalTest, "Default Resolver : Higher RevID Wins", "[
     CHECK(remoteDoc.revisionID() == doc2.revisionID());
 }
 
+TEST_CASE_METHOD(ReplicatorLocalTest, "Default Resolver : Local Higher Gen Wins", "[Replicator][Conflict]") {
+    SECTION("No conflict resolved specified") {
+        config.conflictResolver = nullptr;
+    }
+    
+    SECTION("Specify default conflict resolver") {
+        config.conflictResolver = CBLDefaultConflictResolver;
+    }
+    
+    config.replicatorType = kCBLReplicatorTypePull;
+
+    // Create and Update, with a blob:
+    MutableDocument doc("foo");
+    doc["greeting"] = "Howdy!";
+    db.saveDocument(doc);
+    auto blob = Blob("text/plain"_sl, "Blob!"_sl);
+    doc["signature"] = blob.properties();
+    db.saveDocument(doc);
+
+    // Create:
+    MutableDocument doc2("foo");
+    doc2["greeting"] = "Salaam Alaykum";
+    otherDB.saveDocument(doc2);
+    
+    REQUIRE(CBLDocument_Generation(doc.ref()) > CBLDocument_Generation(doc2.ref()));
+
+    // Pull
+    resetReplicator();
+    replicate();
+
+    // The local revision's content should win, on top of the remote revision:
+    CHECK(asVector(replicatedDocIDs) == vector<string>{"foo"});
+    Document localDoc = db.getDocument("foo");
+    REQUIRE(localDoc);
+    CHECK(localDoc["greeting"].asString() == "Howdy!"_sl);
+    Blob localBlob(localDoc["signature"].asDict());
+    CHECK(localBlob.loadContent() == "Blob!"_sl);
+    CHECK(CBLDocument_Generation(localDoc.ref()) == CBLDocument_Generation(doc2.ref()) + 1);
+}
+
+
+TEST_CASE_METHOD(ReplicatorLocalTest, "Default Resolver : Batched", "[Replicator][Conflict]") {
+    SECTION("One resolver, small batches") {
+        config.maxConflictResolvers = 1;
+        config.conflictResolverBatchSize = 7;
+    }
+
+    SECTION("Default executor settings") {
+        config.maxConflictResolvers = 0;
+        config.conflictResolverBatchSize = 0;
+    }
+
+    config.replicatorType = kCBLReplicatorTypePull;
+
+    // Create 50 conflicts; the remote side has the higher generation so it should win:
+    vector<string> docIDs;
+    for (int i = 0; i < 50; i++) {
+        string docID = "doc-" + to_string(i);
+        docIDs.push_back(docID);
+
+        MutableDocument doc(docID);
+        doc["greeting"] = "Howdy!";
+        db.saveDocument(doc);
+
+        MutableDocument doc2(docID);
+        doc2["greeting"] = "Salaam Alaykum";
+        otherDB.saveDocument(doc2);
+        doc2["greeting"] = "Konichiwa";
+        otherDB.saveDocument(doc2);
+    }
+    sort(docIDs.begin(), docIDs.end());
+
+    resetReplicator();
+    replicate();
+
+    CHECK(asVector(replicatedDocIDs) == docIDs);
+    for (auto &docID : docIDs) {
+        Document localDoc = db.getDocument(docID);
+        REQUIRE(localDoc);
+        CHECK(localDoc["greeting"].asString() == "Konichiwa"_sl);
+        CHECK(otherDB.getDocument(docID).revisionID() == localDoc.revisionID());
+    }
+}
+
+
+TEST_CASE_METHOD(ReplicatorLocalTest, "Resolve All Conflicts", "[Replicator][Conflict]") {
+    config.replicatorType = kCBLReplicatorTypePull;
+
+    // A resolver that fails, so the pulled conflicts are left in the database:
+    config.conflictResolver = [](void *context,
+                                 FLString documentID,
+                                 const CBLDocument *localDocument,
+                                 const CBLDocument *remoteDocument) -> const CBLDocument* {
+        throw std::runtime_error("not resolving");
+    };
+
+    for (int i = 0; i < 25; i++) {
+        string docID = "doc-" + to_string(i);
+        MutableDocument doc(docID);
+        doc["greeting"] = "Howdy!";
+        db.saveDocument(doc);
+
+        MutableDocument doc2(docID);
+        doc2["greeting"] = "Salaam Alaykum";
+        otherDB.saveDocument(doc2);
+        doc2["greeting"] = "Konichiwa";
+        otherDB.saveDocument(doc2);
+    }
+
+    {
+        ExpectingExceptions x;
+        resetReplicator();
+        replicate();
+    }
+    CHECK(db.getDocument("doc-0")["greeting"].asString() == "Howdy!"_sl);
+
+    struct Progress {
+        unsigned calls = 0;
+        uint64_t processed = 0, failed = 0;
+    } progress;
+    auto progressCallback = [](void *context, uint64_t processed, uint64_t failed) {
+        auto p = (Progress*)context;
+        ++p->calls;
+        p->processed = processed;
+        p->failed = failed;
+    };
+
+    CBLError error;
+    CHECK(CBLDatabase_ResolveAllConflicts(db.ref(), nullptr, &progress, progressCallback, &error));
+    CHECK(progress.calls >= 1);
+    CHECK(progress.processed == 25);
+    CHECK(progress.failed == 0);
+    for (int i = 0; i < 25; i++) {
+        Document localDoc = db.getDocument("doc-" + to_string(i));
+        REQUIRE(localDoc);
+        CHECK(localDoc["greeting"].asString() == "Konichiwa"_sl);
+    }
+
+    // Nothing left to resolve:
+    progress = {};
+    CHECK(CBLDatabase_ResolveAllConflicts(db.ref(), nullptr, &progress, progressCallback, &error));
+    CHECK(progress.calls == 0);
+}
+
+
 class ReplicatorConflictTest : public ReplicatorLocalTest {
 public:
     enum class ResolverMode { kLocalWins, kRemoteWins, kMerge, kMergeAutoID };
@@ -602,6 +881,68 @@ TEST_CASE_METHOD(ReplicatorLocalTest, "Document Replication Listener", "[Replica
 }
 
 
+TEST_CASE_METHOD(ReplicatorLocalTest, "Batched Document Replication Listener", "[Replicator]") {
+    config.replicatorType = kCBLReplicatorTypePush;
+    config.documentEventsFlushInterval = 250;
+
+    vector<string> docIDs;
+    for (int i = 0; i < 20; i++) {
+        MutableDocument doc("doc-" + to_string(i));
+        doc["n"] = i;
+        db.saveDocument(doc);
+        docIDs.push_back(doc.id());
+    }
+    sort(docIDs.begin(), docIDs.end());
+
+    // Buffered events must all be delivered by the time the replicator stops:
+    replicate();
+    CHECK(asVector(replicatedDocIDs) == docIDs);
+    CHECK(replicatedDocs.size() == 20);
+    for (auto &doc : replicatedDocs)
+        CHECK(doc.error.code == 0);
+}
+
+TEST_CASE_METHOD(ReplicatorLocalTest, "Replicator Metrics", "[Replicator]") {
+    config.replicatorType = kCBLReplicatorTypePush;
+    config.pushFilter = [](void *context, CBLDocument* doc, CBLDocumentFlags flags) -> bool {
+        return true;
+    };
+    enableDocReplicationListener = false;
+
+    for (int i = 0; i < 10; i++) {
+        MutableDocument doc("doc-" + to_string(i));
+        doc["n"] = i;
+        db.saveDocument(doc);
+    }
+
+    repl = CBLReplicator_Create(&config, nullptr);
+    REQUIRE(repl);
+    CBLReplicatorMetrics metrics = CBLReplicator_Metrics(repl);
+    CHECK(metrics.runningSeconds == 0);
+    CHECK(metrics.documentsPushed == 0);
+    CHECK(metrics.pendingDocumentCount == 10);
+
+    replicate();
+
+    metrics = CBLReplicator_Metrics(repl);
+    CHECK(metrics.runningSeconds > 0);
+    CHECK(metrics.documentsPushed == 10);
+    CHECK(metrics.documentsPulled == 0);
+    CHECK(metrics.documentsPushedPerSecond > 0);
+    uint64_t batched = 0;
+    for (int i = 0; i < kCBLReplicatorBatchSizeBuckets; i++)
+        batched += metrics.revsPerBatch[i];
+    CHECK(batched > 0);
+    CHECK(metrics.filterCalls == 10);
+    CHECK(metrics.conflictsResolved == 0);
+    CHECK(metrics.pendingDocumentCount == 0);
+    CHECK(metrics.reconnectCount == 0);
+
+    // Stopped replicators don't accumulate running time:
+    this_thread::sleep_for(100ms);
+    CHECK(CBLReplicator_Metrics(repl).runningSeconds == metrics.runningSeconds);
+}
+
 class ReplicatorFilterTest : public ReplicatorLocalTest {
 public:
     int count = 0;
@@ -688,4 +1029,91 @@ TEST_CASE_METHOD(ReplicatorFilterTest, "Pull Filter", "[Replicator][Filter]") {
 }
 
 
+
+TEST_CASE_METHOD(ReplicatorLocalTest, "Filter Retains Document", "[Replicator][Filter]") {
+    // Filter documents are reused between calls, unless the callback retains them:
+    config.replicatorType = kCBLReplicatorTypePush;
+    vector<const CBLDocument*> retained;
+    config.context = &retained;
+    config.pushFilter = [](void *context, CBLDocument* doc, CBLDocumentFlags flags) -> bool {
+        auto docs = (vector<const CBLDocument*>*)context;
+        if (FLSlice_Equal(CBLDocument_ID(doc), "keep"_sl))
+            docs->push_back(CBLDocument_Retain(doc));
+        return true;
+    };
+
+    MutableDocument doc1("keep");
+    doc1["n"] = 1;
+    db.saveDocument(doc1);
+    for (int i = 0; i < 10; i++) {
+        MutableDocument doc("doc-" + to_string(i));
+        doc["n"] = i;
+        db.saveDocument(doc);
+    }
+
+    replicate();
+    REQUIRE(retained.size() == 1);
+    CHECK(slice(CBLDocument_ID(retained[0])) == "keep"_sl);
+    CHECK(slice(CBLDocument_RevisionID(retained[0])) == doc1.revisionID());
+    for (auto doc : retained)
+        CBLDocument_Release(doc);
+}
+
+TEST_CASE_METHOD(ReplicatorLocalTest, "Filter Expressions", "[Replicator][Filter]") {
+    Database theDB;
+    SECTION("Push") {
+        theDB = db;
+        config.replicatorType = kCBLReplicatorTypePush;
+        config.pushFilterExpression = R"(["AND", ["=", [".type"], "user"], ["!=", ["._id"], "u3"]])"_sl;
+    }
+    SECTION("Pull") {
+        theDB = otherDB;
+        config.replicatorType = kCBLReplicatorTypePull;
+        config.pullFilterExpression = R"(["AND", ["=", [".type"], "user"], ["!=", ["._id"], "u3"]])"_sl;
+    }
+
+    for (int i = 1; i <= 3; i++) {
+        MutableDocument user("u" + to_string(i));
+        user["type"] = "user";
+        theDB.saveDocument(user);
+
+        MutableDocument telemetry("t" + to_string(i));
+        telemetry["type"] = "telemetry";
+        theDB.saveDocument(telemetry);
+    }
+
+    replicate();
+    CHECK(CBLReplicator_Status(repl).progress.documentCount == 2);
+
+    Database target = (theDB == db) ? otherDB : db;
+    CHECK(target.getDocument("u1"));
+    CHECK(target.getDocument("u2"));
+    CHECK(!target.getDocument("u3"));
+    CHECK(!target.getDocument("t1"));
+}
+
+
+TEST_CASE_METHOD(ReplicatorLocalTest, "Invalid Filter Expression", "[Replicator][Filter]") {
+    config.replicatorType = kCBLReplicatorTypePush;
+    SECTION("Not JSON") {
+        config.pushFilterExpression = "[\"=\", [\".type\"], "_sl;
+    }
+    SECTION("Unknown operator") {
+        config.pushFilterExpression = R"(["LIKE", [".type"], "u%"])"_sl;
+    }
+    SECTION("Wrong argument count") {
+        config.pushFilterExpression = R"(["NOT", true, false])"_sl;
+    }
+    SECTION("Empty operator") {
+        config.pushFilterExpression = R"([""])"_sl;
+    }
+
+    ExpectingExceptions x;
+    CBLError error;
+    repl = CBLReplicator_Create(&config, &error);
+    CHECK(!repl);
+    CHECK(error.domain == kCBLDomain);
+    CHECK(error.code == kCBLErrorInvalidQuery);
+}
+
 #endif // COUCHBASE_ENTERPRISE
@@ -494,6 +494,106 @@ TEST_CASE_METHOD(ReplicatorPropertyEncryptionTest, "Encrypt and decrypt multiple
     }
 }
 
+static void xorProperties(unsigned count, CBLCryptoProperty* props) {
+    for (unsigned i = 0; i < count; ++i) {
+        alloc_slice output(props[i].input);
+        for (size_t j = 0; j < output.size; ++j)
+            (uint8_t&)output[j] = output[j] ^ 'K';
+        props[i].output = FLSliceResult(output);
+    }
+}
+
+TEST_CASE_METHOD(ReplicatorPropertyEncryptionTest, "Batch encrypt and decrypt multiple properties", "[Replicator][Encryptable]") {
+    struct Counts {
+        int calls = 0;
+        int properties = 0;
+    };
+    static Counts encrypted, decrypted;
+    encrypted = decrypted = {};
+
+    config.propertyBatchEncryptor = [](void* context, FLString docID, FLDict props,
+                                       unsigned count, CBLCryptoProperty* cprops,
+                                       FLStringResult* alg, FLStringResult* kid,
+                                       CBLError* error) -> bool
+    {
+        encrypted.calls++;
+        encrypted.properties += count;
+        xorProperties(count, cprops);
+        return true;
+    };
+    config.propertyBatchDecryptor = [](void* context, FLString docID, FLDict props,
+                                       unsigned count, CBLCryptoProperty* cprops,
+                                       CBLError* error) -> bool
+    {
+        decrypted.calls++;
+        decrypted.properties += count;
+        for (unsigned i = 0; i < count; ++i)
+            CHECK(cprops[i].algorithm == "CB_MOBILE_CUSTOM"_sl);
+        xorProperties(count, cprops);
+        return true;
+    };
+
+    {
+        auto doc = CBLDocument_CreateWithID("doc1"_sl);
+        auto props = CBLDocument_MutableProperties(doc);
+        
+        auto secret1 = CBLEncryptable_CreateWithString("Secret 1"_sl);
+        FLMutableDict_SetEncryptableValue(props, "secret1"_sl, secret1);
+        
+        auto secret2 = CBLEncryptable_CreateWithInt(10);
+        FLMutableDict_SetEncryptableValue(props, "secret2"_sl, secret2);
+        
+        auto nestedDict = FLMutableDict_New();
+        auto secret3 = CBLEncryptable_CreateWithBool(true);
+        FLMutableDict_SetEncryptableValue(nestedDict, "secret3"_sl, secret3);
+        
+        FLSlot_SetDict(FLMutableDict_Set(props, "nested"_sl), nestedDict);
+        
+        CBLError error;
+        CHECK(CBLDatabase_SaveDocument(db.ref(), doc, &error));
+        
+        CBLDocument_Release(doc);
+        FLMutableDict_Release(nestedDict);
+        CBLEncryptable_Release(secret1);
+        CBLEncryptable_Release(secret2);
+        CBLEncryptable_Release(secret3);
+        
+        config.replicatorType = kCBLReplicatorTypePushAndPull;
+        replicate();
+        
+        doc = CBLDatabase_GetMutableDocument(otherDB.ref(), "doc1"_sl, &error);
+        props = CBLDocument_MutableProperties(doc);
+
+        CHECK(Dict(FLValue_AsDict(FLDict_Get(props, "encrypted$secret1"_sl))).toJSON(false, true) ==
+              "{\"alg\":\"CB_MOBILE_CUSTOM\",\"ciphertext\":\"aRguKDkuP2t6aQ==\"}");
+        auto nested = FLValue_AsDict(FLDict_Get(props, "nested"_sl));
+        CHECK(Dict(FLValue_AsDict(FLDict_Get(nested, "encrypted$secret3"_sl))).toJSON(false, true) ==
+              "{\"alg\":\"CB_MOBILE_CUSTOM\",\"ciphertext\":\"Pzk+Lg==\"}");
+        
+        CHECK(encrypted.calls == 1);
+        CHECK(encrypted.properties == 3);
+        CBLDocument_Release(doc);
+    }
+    
+    {
+        resetDBAndReplicator();
+        replicate();
+
+        CBLError error;
+        auto doc = CBLDatabase_GetMutableDocument(db.ref(), "doc1"_sl, &error);
+        auto props = CBLDocument_Properties(doc);
+
+        CHECK(Dict(FLValue_AsDict(FLDict_Get(props, "secret1"_sl))).toJSON(false, true) ==
+              "{\"@type\":\"encryptable\",\"value\":\"Secret 1\"}");
+        CHECK(Dict(FLValue_AsDict(FLDict_Get(props, "secret2"_sl))).toJSON(false, true) ==
+              "{\"@type\":\"encryptable\",\"value\":10}");
+        
+        CHECK(decrypted.calls == 1);
+        CHECK(decrypted.properties == 3);
+        CBLDocument_Release(doc);
+    }
+}
+
 TEST_CASE_METHOD(ReplicatorPropertyEncryptionTest, "No encryptor : crypto error", "[Replicator][Encryptable]") {
     auto doc = CBLDocument_CreateWithID("doc1"_sl);
     auto props = CBLDocument_MutableProperties(doc);